@@ -39,6 +39,9 @@
 #import "SPSessionTeardownTests.h"
 #import "SPPlaylistTests.h"
 #import "SPConcurrencyTests.h"
+#import "SPCircularBufferTests.h"
+#import "SPObjectCacheTests.h"
+#import "SPAudioOutputTests.h"
 #import "TestConstants.h"
 
 static NSString * const kTestStatusServerUserDefaultsKey = @"StatusColorServer";
@@ -52,6 +55,9 @@ static NSString * const kTestStatusServerUserDefaultsKey = @"StatusColorServer";
 @property (nonatomic, strong) SPTests *teardownTests;
 @property (nonatomic, strong) SPTests *playlistTests;
 @property (nonatomic, strong) SPTests *concurrencyTests;
+@property (nonatomic, strong) SPTests *circularBufferTests;
+@property (nonatomic, strong) SPTests *objectCacheTests;
+@property (nonatomic, strong) SPTests *audioOutputTests;
 @end
 
 @implementation TestRunner
@@ -64,6 +70,9 @@ static NSString * const kTestStatusServerUserDefaultsKey = @"StatusColorServer";
 @synthesize teardownTests;
 @synthesize playlistTests;
 @synthesize concurrencyTests;
+@synthesize circularBufferTests;
+@synthesize objectCacheTests;
+@synthesize audioOutputTests;
 
 -(void)completeTestsWithPassCount:(NSUInteger)passCount failCount:(NSUInteger)failCount {
 	if ([[NSUserDefaults standardUserDefaults] boolForKey:kLogForTeamCityUserDefaultsKey])
@@ -154,8 +163,11 @@ static NSString * const kTestStatusServerUserDefaultsKey = @"StatusColorServer";
 	self.inboxTests = [SPPostTracksToInboxTests new];
 	self.metadataTests = [SPMetadataTests new];
 	self.teardownTests = [SPSessionTeardownTests new];
+	self.circularBufferTests = [SPCircularBufferTests new];
+	self.objectCacheTests = [SPObjectCacheTests new];
+	self.audioOutputTests = [SPAudioOutputTests new];
 
-	NSArray *tests = @[self.sessionTests, self.concurrencyTests, self.playlistTests, self.audioTests, self.searchTests,
+	NSArray *tests = @[self.sessionTests, self.concurrencyTests, self.circularBufferTests, self.objectCacheTests, self.audioOutputTests, self.playlistTests, self.audioTests, self.searchTests,
 	self.inboxTests, self.metadataTests, self.teardownTests];
 
 	__block NSUInteger totalPassCount = 0;
@@ -53,11 +53,17 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #import "SPAlbumBrowse.h"
 #import "SPToplist.h"
 #import "SPUnknownPlaylist.h"
+#import "SPObjectCache.h"
 
 #import "SPSignupViewController.h"
 #import "SPLoginViewController.h"
 
 #import "SPCircularBuffer.h"
+#import "SPAudioDeliveryBatcher.h"
+#import "SPAudioKernels.h"
+#import "SPAudioOutputSink.h"
+#import "SPAUGraphOutputSink.h"
+#import "SPNullAudioOutputSink.h"
 #import "SPCoreAudioController.h"
 #import "SPPlaybackManager.h"
 
@@ -83,7 +89,13 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #import <CocoaLibSpotify/SPAlbumBrowse.h>
 #import <CocoaLibSpotify/SPToplist.h>
 #import <CocoaLibSpotify/SPUnknownPlaylist.h>
+#import <CocoaLibSpotify/SPObjectCache.h>
 #import <CocoaLibSpotify/SPCircularBuffer.h>
+#import <CocoaLibSpotify/SPAudioDeliveryBatcher.h>
+#import <CocoaLibSpotify/SPAudioKernels.h>
+#import <CocoaLibSpotify/SPAudioOutputSink.h>
+#import <CocoaLibSpotify/SPAUGraphOutputSink.h>
+#import <CocoaLibSpotify/SPNullAudioOutputSink.h>
 #import <CocoaLibSpotify/SPCoreAudioController.h>
 #import <CocoaLibSpotify/SPPlaybackManager.h>
 #import <CocoaLibSpotify/SPAsyncLoading.h>
@@ -0,0 +1,95 @@
+//
+//  SPAUGraphOutputSink.h
+//  CocoaLibSpotify
+//
+/*
+ Copyright (c) 2011, Spotify AB
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of Spotify AB nor the names of its contributors may 
+ be used to endorse or promote products derived from this software 
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL SPOTIFY AB BE LIABLE FOR ANY DIRECT, INDIRECT,
+ INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// This class outputs audio through a Core Audio graph. Where it can, it converts the audio
+// itself with the kernels in SPAudioKernels.h. Otherwise the graph is made of an audio format
+// converter, a mixer and the system's standard output.
+
+#import <Foundation/Foundation.h>
+#import <AudioToolbox/AudioToolbox.h>
+#import "SPAudioOutputSink.h"
+
+/** Returns the sink format equivalent to the given linear PCM stream description. */
+extern SPAudioOutputFormat SPAudioOutputFormatFromStreamDescription(AudioStreamBasicDescription description);
+
+/** Returns the linear PCM stream description equivalent to the given sink format. */
+extern AudioStreamBasicDescription SPStreamDescriptionFromAudioOutputFormat(SPAudioOutputFormat format);
+
+/** Allows the nodes of an SPAUGraphOutputSink's audio graph to be customised. */
+
+@protocol SPAUGraphOutputSinkDelegate <NSObject>
+
+/**
+ Connects the given `AUNode` instances together to complete the audio graph.
+ 
+ @param sourceOutputBusNumber The bus on which the source node will be providing audio data.
+ @param sourceNode The `AUNode` which will provide audio data for the graph.
+ @param destinationInputBusNumber The bus on which the destination node expects to receive audio data.
+ @param destinationNode The `AUNode` which will carry the audio data to the system's audio output.
+ @param graph The `AUGraph` containing the given nodes.
+ @param error A pointer to an NSError instance to be filled with an `NSError` should a problem occur.
+ @return `YES` if the connection was made successfully, otherwise `NO`.
+ */
+-(BOOL)connectOutputBus:(UInt32)sourceOutputBusNumber ofNode:(AUNode)sourceNode toInputBus:(UInt32)destinationInputBusNumber ofNode:(AUNode)destinationNode inGraph:(AUGraph)graph error:(NSError **)error;
+
+/** 
+ Called when custom nodes in the graph should be disposed.
+ 
+ @param graph The `AUGraph` that is being disposed. 
+ */
+-(void)disposeOfCustomNodesInGraph:(AUGraph)graph;
+
+@end
+
+/** Outputs audio to the system's audio output using an `AUGraph`. This is the default sink of SPCoreAudioController. */
+
+@interface SPAUGraphOutputSink : NSObject <SPAudioOutputSink>
+
+/** 
+ Returns the receiver's delegate. 
+ 
+ If a delegate is set, it's responsible for connecting the converter node to the next node
+ (the mixer, or the output if audio is processed in software) when the graph is built. 
+ Otherwise, the receiver connects them directly.
+ */
+@property (readwrite, nonatomic, assign) __unsafe_unretained id <SPAUGraphOutputSinkDelegate> delegate;
+
+/**
+ Whether the receiver converts audio itself in the render callback. Defaults to `YES`.
+ 
+ When enabled and the input is interleaved 16-bit integer audio, as delivered by libspotify, the graph
+ has no mixer node, and a converter node is only added if a delegate needs one to connect custom nodes to.
+ Other formats always go through the converter and mixer nodes. Changes take effect the next time the
+ receiver is prepared.
+ */
+@property (readwrite, nonatomic) BOOL processesAudioInSoftware;
+
+@end
@@ -0,0 +1,559 @@
+//
+//  SPAUGraphOutputSink.m
+//  CocoaLibSpotify
+//
+/*
+ Copyright (c) 2011, Spotify AB
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of Spotify AB nor the names of its contributors may 
+ be used to endorse or promote products derived from this software 
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL SPOTIFY AB BE LIABLE FOR ANY DIRECT, INDIRECT,
+ INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "SPAUGraphOutputSink.h"
+#import "SPAudioKernels.h"
+#import <AudioUnit/AudioUnit.h>
+#include <mach/mach_time.h>
+
+#if TARGET_OS_IPHONE
+#import <AVFoundation/AVFoundation.h>
+#endif
+
+static OSStatus AUGraphOutputSinkRenderCallback(void *inRefCon,
+												AudioUnitRenderActionFlags *ioActionFlags,
+												const AudioTimeStamp *inTimeStamp,
+												UInt32 inBusNumber,
+												UInt32 inNumberFrames,
+												AudioBufferList *ioData);
+
+static void fillWithError(NSError **mayBeAnError, NSString *localizedDescription, int code);
+static BOOL SPAUGraphOutputSinkCanProcessFormatInSoftware(AudioStreamBasicDescription format);
+
+static UInt32 const kMaximumFramesPerSlice = 4096;
+static UInt32 const kMaximumSoftwareChannelCount = 8;
+
+static mach_timebase_info_data_t hostTimebase;
+
+static inline UInt64 SPAUGraphOutputSinkHostTimeForTimeStamp(const AudioTimeStamp *timeStamp) {
+	if (timeStamp == NULL || !(timeStamp->mFlags & kAudioTimeStampHostTimeValid) || hostTimebase.denom == 0)
+		return 0;
+	return (timeStamp->mHostTime * hostTimebase.numer) / hostTimebase.denom;
+}
+
+@interface SPAUGraphOutputSink ()
+
+-(BOOL)buildGraphWithInputFormat:(SPAudioOutputFormat)inputFormat error:(NSError **)err;
+
+@end
+
+@implementation SPAUGraphOutputSink {
+	
+	AUGraph audioProcessingGraph;
+	AudioUnit outputUnit;
+	AudioUnit mixerUnit;
+	AudioUnit inputConverterUnit;
+	
+	AUNode outputNode;
+	AUNode inputConverterNode;
+	AUNode mixerNode;
+	
+	SPAudioOutputRenderCallback renderCallback;
+	void *renderContext;
+	
+	// Software processing. The scratch buffers are sized for the largest slice and
+	// channel count we accept, so they never need reallocating while the graph is running.
+	BOOL processingInSoftware;
+	UInt32 softwareChannelCount;
+	SInt16 *softwareInputScratch;
+	float *softwareFloatScratch;
+}
+
+-(id)init {
+	self = [super init];
+	
+	if (self) {
+		self.processesAudioInSoftware = YES;
+	}
+	return self;
+}
+
+-(void)dealloc {
+	[self teardown];
+}
+
+@synthesize delegate;
+@synthesize processesAudioInSoftware;
+
+-(BOOL)isPrepared {
+	return audioProcessingGraph != NULL;
+}
+
+#pragma mark -
+#pragma mark Audio Unit Properties
+
+-(BOOL)applyInputFormat:(SPAudioOutputFormat)newInputFormat error:(NSError **)err {
+	
+	if (audioProcessingGraph == NULL)
+		return NO;
+	
+	AudioStreamBasicDescription newInputDescription = SPStreamDescriptionFromAudioOutputFormat(newInputFormat);
+	
+	if (self.processesAudioInSoftware && 
+		SPAUGraphOutputSinkCanProcessFormatInSoftware(newInputDescription) != processingInSoftware) {
+		// The graph we have can't take this format, so build one that can.
+		return [self prepareWithInputFormat:newInputFormat renderCallback:renderCallback context:renderContext error:err];
+	}
+	
+	AudioUnit entryUnit = inputConverterUnit != NULL ? inputConverterUnit : outputUnit;
+	AudioStreamBasicDescription entryDescription = newInputDescription;
+	
+	if (processingInSoftware) {
+		// We hand the graph the canonical format ourselves, so the converter (if any) has nothing to do.
+		memset(&entryDescription, 0, sizeof(entryDescription));
+		entryDescription.mSampleRate = newInputDescription.mSampleRate;
+		entryDescription.mFormatID = kAudioFormatLinearPCM;
+		entryDescription.mFormatFlags = kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
+		entryDescription.mBytesPerPacket = sizeof(float);
+		entryDescription.mFramesPerPacket = 1;
+		entryDescription.mBytesPerFrame = sizeof(float);
+		entryDescription.mChannelsPerFrame = newInputDescription.mChannelsPerFrame;
+		entryDescription.mBitsPerChannel = 8 * sizeof(float);
+		softwareChannelCount = newInputDescription.mChannelsPerFrame;
+	}
+	
+	OSStatus status = AudioUnitSetProperty(entryUnit,
+								  kAudioUnitProperty_StreamFormat,
+								  kAudioUnitScope_Input,
+								  0,
+								  &entryDescription,
+								  sizeof(entryDescription));
+	if (status != noErr) {
+        fillWithError(err, @"Couldn't set input format", status);
+		return NO;
+    }
+	
+	return YES;
+}
+
+#pragma mark -
+#pragma mark Queue Control
+
+-(void)startOutput {
+    if (audioProcessingGraph == NULL)
+        return;
+	
+	Boolean isRunning = NO;
+	AUGraphIsRunning(audioProcessingGraph, &isRunning);
+	if (isRunning)
+		return;
+	
+    AUGraphStart(audioProcessingGraph);
+	if (outputUnit != NULL)
+		AudioOutputUnitStart(outputUnit);
+}
+
+-(void)stopOutput {
+    if (audioProcessingGraph == NULL)
+        return;
+    
+	Boolean isRunning = NO;
+	AUGraphIsRunning(audioProcessingGraph, &isRunning);
+	
+	if (!isRunning)
+		return;
+
+	AUGraphStop(audioProcessingGraph);
+}
+
+#pragma mark -
+#pragma mark Setup and Teardown
+
+-(void)teardown {
+	
+    if (audioProcessingGraph != NULL) {
+		[self stopOutput];
+		[self.delegate disposeOfCustomNodesInGraph:audioProcessingGraph];
+		
+		AUGraphUninitialize(audioProcessingGraph);
+		DisposeAUGraph(audioProcessingGraph);
+		
+#if TARGET_OS_IPHONE
+		[[AVAudioSession sharedInstance] setActive:NO error:nil];
+#endif
+		
+		audioProcessingGraph = NULL;
+		outputUnit = NULL;
+		mixerUnit = NULL;
+		inputConverterUnit = NULL;
+	}
+	
+	// A failed prepare may have allocated these without getting as far as creating a graph.
+	free(softwareInputScratch);
+	softwareInputScratch = NULL;
+	free(softwareFloatScratch);
+	softwareFloatScratch = NULL;
+	processingInSoftware = NO;
+}
+
+-(BOOL)prepareWithInputFormat:(SPAudioOutputFormat)inputFormat
+			   renderCallback:(SPAudioOutputRenderCallback)callback
+					  context:(void *)context
+						error:(NSError **)err {
+    
+    if (audioProcessingGraph != NULL)
+        [self teardown];
+	
+	renderCallback = callback;
+	if (hostTimebase.denom == 0)
+		mach_timebase_info(&hostTimebase);
+	renderContext = context;
+	
+	if ([self buildGraphWithInputFormat:inputFormat error:err])
+		return YES;
+	
+	// Don't leave a half-built graph or its scratch buffers behind.
+	[self teardown];
+	return NO;
+}
+
+-(BOOL)buildGraphWithInputFormat:(SPAudioOutputFormat)inputFormat error:(NSError **)err {
+	
+	AudioStreamBasicDescription inputDescription = SPStreamDescriptionFromAudioOutputFormat(inputFormat);
+	
+	// When we can convert ourselves, the mixer isn't needed, and the converter
+	// is only kept as a place for the delegate to attach custom nodes.
+	processingInSoftware = self.processesAudioInSoftware && SPAUGraphOutputSinkCanProcessFormatInSoftware(inputDescription);
+	BOOL needsConverter = !processingInSoftware || self.delegate != nil;
+	
+	if (processingInSoftware) {
+		softwareInputScratch = calloc(kMaximumFramesPerSlice * kMaximumSoftwareChannelCount, sizeof(SInt16));
+		softwareFloatScratch = calloc(kMaximumFramesPerSlice * kMaximumSoftwareChannelCount, sizeof(float));
+		softwareChannelCount = inputDescription.mChannelsPerFrame;
+	}
+	
+#if TARGET_OS_IPHONE
+	NSError *error = nil;
+	BOOL success = YES;
+	success &= [[AVAudioSession sharedInstance] setCategory:AVAudioSessionCategoryPlayback error:&error];
+	success &= [[AVAudioSession sharedInstance] setActive:YES error:&error];
+	
+	if (!success && err != NULL) {
+		*err = error;
+		return NO;
+	}
+#endif
+	
+    // A description of the output device we're looking for.
+    AudioComponentDescription outputDescription;
+	outputDescription.componentType = kAudioUnitType_Output;
+#if TARGET_OS_IPHONE
+	outputDescription.componentSubType = kAudioUnitSubType_RemoteIO;
+#else
+    outputDescription.componentSubType = kAudioUnitSubType_DefaultOutput;
+#endif
+    outputDescription.componentManufacturer = kAudioUnitManufacturer_Apple;
+    outputDescription.componentFlags = 0;
+    outputDescription.componentFlagsMask = 0;
+	
+	// A description of the mixer unit
+	AudioComponentDescription mixerDescription;
+	mixerDescription.componentType = kAudioUnitType_Mixer;
+	mixerDescription.componentSubType = kAudioUnitSubType_MultiChannelMixer;
+	mixerDescription.componentManufacturer = kAudioUnitManufacturer_Apple;
+	mixerDescription.componentFlags = 0;
+	mixerDescription.componentFlagsMask = 0;
+	
+	// A description for the libspotify -> standard PCM device
+	AudioComponentDescription converterDescription;
+	converterDescription.componentType = kAudioUnitType_FormatConverter;
+	converterDescription.componentSubType = kAudioUnitSubType_AUConverter;
+	converterDescription.componentManufacturer = kAudioUnitManufacturer_Apple;
+	converterDescription.componentFlags = 0;
+	converterDescription.componentFlagsMask = 0;
+    
+	// Create an AUGraph
+	OSErr status = NewAUGraph(&audioProcessingGraph);
+	if (status != noErr) {
+        fillWithError(err, @"Couldn't init graph", status);
+        return NO;
+    }
+	
+	// Open the graph. AudioUnits are open but not initialized (no resource allocation occurs here)
+	AUGraphOpen(audioProcessingGraph);
+	if (status != noErr) {
+        fillWithError(err, @"Couldn't open graph", status);
+        return NO;
+    }
+	
+	// Add audio output...
+	status = AUGraphAddNode(audioProcessingGraph, &outputDescription, &outputNode);
+	if (status != noErr) {
+        fillWithError(err, @"Couldn't add output node", status);
+        return NO;
+    }
+	
+	// Get output unit
+	status = AUGraphNodeInfo(audioProcessingGraph, outputNode, NULL, &outputUnit);
+	if (status != noErr) {
+        fillWithError(err, @"Couldn't get output unit", status);
+        return NO;
+    }
+	
+	if (!processingInSoftware) {
+		// Add mixer
+		status = AUGraphAddNode(audioProcessingGraph, &mixerDescription, &mixerNode);
+		if (status != noErr) {
+			fillWithError(err, @"Couldn't add mixer node", status);
+			return NO;
+		}
+	
+		// Get mixer unit so we can configure it
+		status = AUGraphNodeInfo(audioProcessingGraph, mixerNode, NULL, &mixerUnit);
+		if (status != noErr) {
+			fillWithError(err, @"Couldn't get mixer unit", status);
+			return NO;
+		}
+	
+		// Set mixer bus count
+		UInt32 busCount = 1;
+		status = AudioUnitSetProperty(mixerUnit, kAudioUnitProperty_ElementCount, kAudioUnitScope_Input, 0, &busCount, sizeof(busCount));
+		if (status != noErr) {
+			fillWithError(err, @"Couldn't set mixer bus count", status);
+			return NO;
+		}
+	
+		// Set mixer input volume
+		status = AudioUnitSetParameter(mixerUnit, kMultiChannelMixerParam_Volume, kAudioUnitScope_Input, 0, 1.0, 0);
+		if (status != noErr) {
+			fillWithError(err, @"Couldn't set mixer volume", status);
+			return NO;
+		}
+	}
+	
+	if (needsConverter) {
+		// Create PCM converter
+		status = AUGraphAddNode(audioProcessingGraph, &converterDescription, &inputConverterNode);
+		if (status != noErr) {
+			fillWithError(err, @"Couldn't add converter node", status);
+			return NO;
+		}
+	
+		status = AUGraphNodeInfo(audioProcessingGraph, inputConverterNode, NULL, &inputConverterUnit);
+		if (status != noErr) {
+			fillWithError(err, @"Couldn't get input unit", status);
+			return NO;
+		}
+	}
+	
+	AUNode entryNode = outputNode;
+	
+	if (needsConverter) {
+		
+		AUNode converterDestinationNode = outputNode;
+		
+		if (mixerUnit != NULL) {
+			// Connect mixer to output
+			status = AUGraphConnectNodeInput(audioProcessingGraph, mixerNode, 0, outputNode, 0);
+			if (status != noErr) {
+				fillWithError(err, @"Couldn't connect mixer to output", status);
+				return NO;
+			}
+			converterDestinationNode = mixerNode;
+		}
+		
+		if (self.delegate != nil) {
+			if (![self.delegate connectOutputBus:0 ofNode:inputConverterNode toInputBus:0 ofNode:converterDestinationNode inGraph:audioProcessingGraph error:err])
+				return NO;
+		} else {
+			// Connect converter to mixer
+			status = AUGraphConnectNodeInput(audioProcessingGraph, inputConverterNode, 0, converterDestinationNode, 0);
+			if (status != noErr) {
+				fillWithError(err, @"Couldn't connect converter to mixer", status);
+				return NO;
+			}
+		}
+		
+		entryNode = inputConverterNode;
+	}
+	
+	// Set render callback
+	AURenderCallbackStruct rcbs;
+	rcbs.inputProc = AUGraphOutputSinkRenderCallback;
+	rcbs.inputProcRefCon = (__bridge void *)(self);
+	
+	status = AUGraphSetNodeInputCallback(audioProcessingGraph, entryNode, 0, &rcbs);
+	if (status != noErr) {
+        fillWithError(err, @"Couldn't add render callback", status);
+        return NO;
+    }
+	
+	// Finally, set the kAudioUnitProperty_MaximumFramesPerSlice of each unit 
+	// to 4096, to allow playback on iOS when the screen is locked.
+	// Code based on http://developer.apple.com/library/ios/#qa/qa1606/_index.html
+	
+	UInt32 maxFramesPerSlice = kMaximumFramesPerSlice;
+	if (inputConverterUnit != NULL) {
+		status = AudioUnitSetProperty(inputConverterUnit, kAudioUnitProperty_MaximumFramesPerSlice, kAudioUnitScope_Global, 0, &maxFramesPerSlice, sizeof(maxFramesPerSlice));
+		if (status != noErr) {
+			fillWithError(err, @"Couldn't set max frames per slice on input converter", status);
+			return NO;
+		}
+	}
+	
+	if (mixerUnit != NULL) {
+		status = AudioUnitSetProperty(mixerUnit, kAudioUnitProperty_MaximumFramesPerSlice, kAudioUnitScope_Global, 0, &maxFramesPerSlice, sizeof(maxFramesPerSlice));
+		if (status != noErr) {
+			fillWithError(err, @"Couldn't set max frames per slice on mixer", status);
+			return NO;
+		}
+	}
+	
+	status = AudioUnitSetProperty(outputUnit, kAudioUnitProperty_MaximumFramesPerSlice, kAudioUnitScope_Global, 0, &maxFramesPerSlice, sizeof(maxFramesPerSlice));
+	if (status != noErr) {
+		fillWithError(err, @"Couldn't set max frames per slice on output", status);
+        return NO;
+	}
+	
+	// Init Queue
+	status = AUGraphInitialize(audioProcessingGraph);
+	if (status != noErr) {
+		fillWithError(err, @"Couldn't initialize graph", status);
+        return NO;
+	}
+	
+	AUGraphUpdate(audioProcessingGraph, NULL);
+	
+	// Apply properties and let's get going!
+    [self startOutput];
+	return [self applyInputFormat:inputFormat error:err];
+}
+
+static void fillWithError(NSError **mayBeAnError, NSString *localizedDescription, int code) {
+    if (mayBeAnError == NULL)
+        return;
+    
+    *mayBeAnError = [NSError errorWithDomain:@"com.CocoaLibSpotify.SPCoreAudioController"
+                                        code:code
+                                    userInfo:localizedDescription ? [NSDictionary dictionaryWithObject:localizedDescription
+                                                                                                forKey:NSLocalizedDescriptionKey]
+                                            : nil];
+    
+}
+
+static OSStatus AUGraphOutputSinkRenderCallback(void *inRefCon,
+												AudioUnitRenderActionFlags *ioActionFlags,
+												const AudioTimeStamp *inTimeStamp,
+												UInt32 inBusNumber,
+												UInt32 inNumberFrames,
+												AudioBufferList *ioData) {
+	
+    __unsafe_unretained SPAUGraphOutputSink *self = (__bridge SPAUGraphOutputSink *)inRefCon;
+	
+	if (self->processingInSoftware) {
+		
+		UInt32 channelCount = self->softwareChannelCount;
+		void *input = self->softwareInputScratch;
+		
+		if (self->renderCallback == NULL || inNumberFrames > kMaximumFramesPerSlice || ioData->mNumberBuffers < channelCount ||
+			!self->renderCallback(self->renderContext, inNumberFrames, SPAUGraphOutputSinkHostTimeForTimeStamp(inTimeStamp), &input)) {
+			for (UInt32 bufferIndex = 0; bufferIndex < ioData->mNumberBuffers; bufferIndex++)
+				memset(ioData->mBuffers[bufferIndex].mData, 0, ioData->mBuffers[bufferIndex].mDataByteSize);
+			*ioActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+			return noErr;
+		}
+		
+		float *channels[kMaximumSoftwareChannelCount];
+		for (UInt32 channel = 0; channel < channelCount; channel++)
+			channels[channel] = ioData->mBuffers[channel].mData;
+		
+		SPAudioConvertInt16ToFloat32(input, self->softwareFloatScratch, inNumberFrames * channelCount);
+		SPAudioDeinterleaveFloat32(self->softwareFloatScratch, channels, channelCount, inNumberFrames);
+		return noErr;
+	}
+	
+	AudioBuffer *buffer = &(ioData->mBuffers[0]);
+	
+	if (self->renderCallback == NULL || !self->renderCallback(self->renderContext, inNumberFrames, SPAUGraphOutputSinkHostTimeForTimeStamp(inTimeStamp), &buffer->mData)) {
+		buffer->mDataByteSize = 0;
+		*ioActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+	}
+	
+    return noErr;
+}
+
+SPAudioOutputFormat SPAudioOutputFormatFromStreamDescription(AudioStreamBasicDescription description) {
+	
+	SPAudioOutputFormat format;
+	format.sampleRate = description.mSampleRate;
+	format.channelsPerFrame = description.mChannelsPerFrame;
+	format.bitsPerChannel = description.mBitsPerChannel;
+	format.bytesPerFrame = description.mBytesPerFrame;
+	format.flags = 0;
+	
+	if (description.mFormatFlags & kAudioFormatFlagIsFloat)
+		format.flags |= SPAudioOutputFormatFlagIsFloat;
+	if (description.mFormatFlags & kAudioFormatFlagIsSignedInteger)
+		format.flags |= SPAudioOutputFormatFlagIsSignedInteger;
+	if (description.mFormatFlags & kAudioFormatFlagIsBigEndian)
+		format.flags |= SPAudioOutputFormatFlagIsBigEndian;
+	if (description.mFormatFlags & kAudioFormatFlagIsNonInterleaved)
+		format.flags |= SPAudioOutputFormatFlagIsNonInterleaved;
+	
+	return format;
+}
+
+AudioStreamBasicDescription SPStreamDescriptionFromAudioOutputFormat(SPAudioOutputFormat format) {
+	
+	AudioStreamBasicDescription description;
+	memset(&description, 0, sizeof(description));
+	description.mSampleRate = format.sampleRate;
+	description.mFormatID = kAudioFormatLinearPCM;
+	description.mFormatFlags = kAudioFormatFlagIsPacked;
+	description.mFramesPerPacket = 1;
+	description.mBytesPerFrame = format.bytesPerFrame;
+	description.mBytesPerPacket = format.bytesPerFrame;
+	description.mChannelsPerFrame = format.channelsPerFrame;
+	description.mBitsPerChannel = format.bitsPerChannel;
+	
+	if (format.flags & SPAudioOutputFormatFlagIsFloat)
+		description.mFormatFlags |= kAudioFormatFlagIsFloat;
+	if (format.flags & SPAudioOutputFormatFlagIsSignedInteger)
+		description.mFormatFlags |= kAudioFormatFlagIsSignedInteger;
+	if (format.flags & SPAudioOutputFormatFlagIsBigEndian)
+		description.mFormatFlags |= kAudioFormatFlagIsBigEndian;
+	if (format.flags & SPAudioOutputFormatFlagIsNonInterleaved)
+		description.mFormatFlags |= kAudioFormatFlagIsNonInterleaved;
+	
+	return description;
+}
+
+static BOOL SPAUGraphOutputSinkCanProcessFormatInSoftware(AudioStreamBasicDescription format) {
+	return format.mFormatID == kAudioFormatLinearPCM &&
+		(format.mFormatFlags & kAudioFormatFlagIsSignedInteger) &&
+		!(format.mFormatFlags & kAudioFormatFlagIsNonInterleaved) &&
+		(format.mFormatFlags & kAudioFormatFlagIsBigEndian) == (kAudioFormatFlagsNativeEndian & kAudioFormatFlagIsBigEndian) &&
+		format.mBitsPerChannel == 16 &&
+		format.mChannelsPerFrame > 0 && format.mChannelsPerFrame <= kMaximumSoftwareChannelCount &&
+		format.mBytesPerFrame == format.mChannelsPerFrame * sizeof(SInt16);
+}
+
+@end
@@ -110,7 +110,7 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 @property (nonatomic, readonly, getter=isLoaded) BOOL loaded;
 
 /** Returns the session the album's metadata is loaded in. */
-@property (nonatomic, readonly, strong) SPSession *session;
+@property (nonatomic, readonly, assign) __unsafe_unretained SPSession *session;
 
 ///----------------------------
 /// @name Metadata
@@ -31,6 +31,7 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #import "SPAlbum.h"
+#import "SPObjectCache.h"
 #import "SPSession.h"
 #import "SPImage.h"
 #import "SPArtist.h"
@@ -40,7 +41,7 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 @interface SPAlbum ()
 
 @property (nonatomic, readwrite) sp_album *album;
-@property (nonatomic, readwrite, strong) SPSession *session;
+@property (nonatomic, readwrite, assign) __unsafe_unretained SPSession *session;
 @property (nonatomic, readwrite, strong) SPImage *cover; 
 @property (nonatomic, readwrite, strong) SPImage *smallCover; 
 @property (nonatomic, readwrite, strong) SPImage *largeCover; 
@@ -59,18 +60,11 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 @implementation SPAlbum
 
-static NSMutableDictionary *albumCache;
-
 +(SPAlbum *)albumWithAlbumStruct:(sp_album *)anAlbum inSession:(SPSession *)aSession {
     
 	SPAssertOnLibSpotifyThread();
 	
-    if (albumCache == nil) {
-        albumCache = [[NSMutableDictionary alloc] init];
-    }
-    
-    NSValue *ptrValue = [NSValue valueWithPointer:anAlbum];
-    SPAlbum *cachedAlbum = [albumCache objectForKey:ptrValue];
+    SPAlbum *cachedAlbum = [aSession.albumCache objectForKeyBytes:&anAlbum];
     
     if (cachedAlbum != nil) {
         return cachedAlbum;
@@ -78,7 +72,7 @@ static NSMutableDictionary *albumCache;
     
     cachedAlbum = [[SPAlbum alloc] initWithAlbumStruct:anAlbum inSession:aSession];
     
-    [albumCache setObject:cachedAlbum forKey:ptrValue];
+    [aSession.albumCache setObject:cachedAlbum forKeyBytes:&anAlbum cost:0];
     return cachedAlbum;
 }
 
@@ -99,7 +93,7 @@ static NSMutableDictionary *albumCache;
 			sp_link_release(link);
 			sp_album_release(album);
 		}
-		if (block) dispatch_async(dispatch_get_main_queue(), ^() { block(newAlbum); });
+		if (block) SPDispatchToCallbackQueue(aSession, ^() { block(newAlbum); });
 	});
 }
 
@@ -179,24 +173,22 @@ static NSMutableDictionary *albumCache;
 		newName = nil;
 	}
 	
-	dispatch_async(dispatch_get_main_queue(), ^{
-		self.cover = newCover;
-		self.smallCover = newSmallCover;
-		self.largeCover = newLargeCover;
-		self.artist = newArtist;
-		self.name = newName;
-		self.year = newYear;
-		self.type = newAlbumType;
-		self.available = newAvailable;
-		self.loaded = newLoaded;
-	});
+	SPEnqueuePropertyUpdate(self.session, self, @"cover", newCover);
+	SPEnqueuePropertyUpdate(self.session, self, @"smallCover", newSmallCover);
+	SPEnqueuePropertyUpdate(self.session, self, @"largeCover", newLargeCover);
+	SPEnqueuePropertyUpdate(self.session, self, @"artist", newArtist);
+	SPEnqueuePropertyUpdate(self.session, self, @"name", newName);
+	SPEnqueuePropertyUpdate(self.session, self, @"year", [NSNumber numberWithUnsignedInteger:newYear]);
+	SPEnqueuePropertyUpdate(self.session, self, @"type", [NSNumber numberWithInt:newAlbumType]);
+	SPEnqueuePropertyUpdate(self.session, self, @"available", [NSNumber numberWithBool:newAvailable]);
+	SPEnqueuePropertyUpdate(self.session, self, @"loaded", [NSNumber numberWithBool:newLoaded]);
 }
 
 -(void)albumBrowseDidLoad {
 	SPDispatchAsync(^{
 		if (self.album) {
 			int aYear = sp_album_year(self.album);
-			dispatch_async(dispatch_get_main_queue(), ^{
+			SPDispatchToCallbackQueue(self.session, ^{
 				self.year = aYear;
 			});
 		}
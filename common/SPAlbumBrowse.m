@@ -32,6 +32,7 @@
 
 #import "SPAlbumBrowse.h"
 #import "SPSession.h"
+#import "SPSessionInternal.h"
 #import "SPAlbum.h"
 #import "SPArtist.h"
 #import "SPErrorExtensions.h"
@@ -111,7 +112,7 @@ void albumbrowse_complete (sp_albumbrowse *result, void *userdata) {
 			newCopyrights = [NSArray arrayWithArray:copyrights];
 		}
 		
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(albumBrowse.session, ^{
 			albumBrowse.loadError = error;
 			albumBrowse.review = newReview;
 			albumBrowse.artist = newArtist;
@@ -31,6 +31,7 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #import "SPArtist.h"
+#import "SPObjectCache.h"
 #import "SPURLExtensions.h"
 #import "SPSession.h"
 #import "SPSessionInternal.h"
@@ -43,23 +44,17 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 @property (nonatomic, copy, readwrite) NSURL *spotifyURL;
 @property (nonatomic, readwrite) sp_artist *artist;
 @property (nonatomic, readwrite, getter=isLoaded) BOOL loaded;
+@property (nonatomic, readwrite, assign) __unsafe_unretained SPSession *session;
 
 @end
 
 @implementation SPArtist
 
-static NSMutableDictionary *artistCache;
-
 +(SPArtist *)artistWithArtistStruct:(sp_artist *)anArtist inSession:(SPSession *)aSession {
     
 	SPAssertOnLibSpotifyThread();
 	
-    if (artistCache == nil) {
-        artistCache = [[NSMutableDictionary alloc] init];
-    }
-    
-    NSValue *ptrValue = [NSValue valueWithPointer:anArtist];
-    SPArtist *cachedArtist = [artistCache objectForKey:ptrValue];
+    SPArtist *cachedArtist = [aSession.artistCache objectForKeyBytes:&anArtist];
     
     if (cachedArtist != nil) {
         return cachedArtist;
@@ -67,7 +62,7 @@ static NSMutableDictionary *artistCache;
     
     cachedArtist = [[SPArtist alloc] initWithArtistStruct:anArtist inSession:aSession];
     
-    [artistCache setObject:cachedArtist forKey:ptrValue];
+    [aSession.artistCache setObject:cachedArtist forKeyBytes:&anArtist cost:0];
     return cachedArtist;
 }
 
@@ -88,7 +83,7 @@ static NSMutableDictionary *artistCache;
 			sp_artist_release(artist);
 			sp_link_release(link);
 		}
-		if (block) dispatch_async(dispatch_get_main_queue(), ^() { block(newArtist); });
+		if (block) SPDispatchToCallbackQueue(aSession, ^() { block(newArtist); });
 	});
 }
 
@@ -99,6 +94,7 @@ static NSMutableDictionary *artistCache;
 	SPAssertOnLibSpotifyThread();
 	
     if ((self = [super init])) {
+		self.session = aSession;
         self.artist = anArtist;
         sp_artist_add_ref(self.artist);
         sp_link *link = sp_link_create_from_artist(anArtist);
@@ -145,10 +141,8 @@ static NSMutableDictionary *artistCache;
 	
 	BOOL isLoaded = sp_artist_is_loaded(self.artist);
 	
-	dispatch_async(dispatch_get_main_queue(), ^() {
-		self.name = newName;
-		self.loaded = isLoaded;
-	});
+	SPEnqueuePropertyUpdate(self.session, self, @"name", newName);
+	SPEnqueuePropertyUpdate(self.session, self, @"loaded", [NSNumber numberWithBool:isLoaded]);
 }
 
 -(NSString *)description {
@@ -166,6 +160,7 @@ static NSMutableDictionary *artistCache;
 @synthesize spotifyURL;
 @synthesize name;
 @synthesize loaded;
+@synthesize session;
 
 -(void)dealloc {
 	sp_artist *outgoing_artist = _artist;
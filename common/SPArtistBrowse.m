@@ -40,6 +40,7 @@
 #import "SPArtist.h"
 #import "SPImage.h"
 #import "SPSession.h"
+#import "SPSessionInternal.h"
 
 @interface SPArtistBrowse ()
 
@@ -142,7 +143,7 @@ void artistbrowse_complete(sp_artistbrowse *result, void *userdata) {
 			newPortraits = [NSArray arrayWithArray:portraits];
 		}
 		
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(artistBrowse.session, ^{
 			artistBrowse.loadError = error;
 			artistBrowse.biography = newBio;
 			artistBrowse.tracks = newTracks;
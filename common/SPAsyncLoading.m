@@ -31,10 +31,27 @@
  */
 
 #import "SPAsyncLoading.h"
+#import "SPSession.h"
+#import "SPSessionInternal.h"
 
 static void * const kSPAsyncLoadingObserverKVOContext = @"SPAsyncLoadingObserverKVO";
 static NSMutableArray *observerCache;
 
+// Callbacks go to the callback queue of the session the items belong to, or the main queue if they don't say.
+static SPSession *SPAsyncLoadingSessionForItems(NSArray *items) {
+	
+	for (id item in items) {
+		if ([item isKindOfClass:[SPSession class]])
+			return item;
+		if ([item respondsToSelector:@selector(session)]) {
+			id session = [item performSelector:@selector(session)];
+			if ([session isKindOfClass:[SPSession class]])
+				return session;
+		}
+	}
+	return nil;
+}
+
 @interface SPAsyncLoading ()
 
 -(id)initWithItems:(NSArray *)items loadedBlock:(void (^)(NSArray *))block;
@@ -72,7 +89,7 @@ static NSMutableArray *observerCache;
 		allLoaded &= item.isLoaded;
 	
 	if (allLoaded) {
-		if (block) dispatch_async(dispatch_get_main_queue(), ^() { block(items); });
+		if (block) SPDispatchToCallbackQueue(SPAsyncLoadingSessionForItems(items), ^() { block(items); });
 		return nil;
 	}
 	
@@ -149,7 +166,7 @@ static NSMutableArray *observerCache;
 		}
 	}
 	
-	if (self.loadedWithTimeoutHandler) dispatch_async(dispatch_get_main_queue(), ^() {
+	if (self.loadedWithTimeoutHandler) SPDispatchToCallbackQueue(SPAsyncLoadingSessionForItems(self.observedItems), ^() {
 		self.loadedWithTimeoutHandler([NSArray arrayWithArray:loadedItems], [NSArray arrayWithArray:notLoadedItems]);
 		self.loadedHandler = nil;
 		self.loadedWithTimeoutHandler = nil;
@@ -173,7 +190,7 @@ static NSMutableArray *observerCache;
 													 selector:@selector(triggerTimeout)
 													   object:nil];
 			
-			if (self.loadedHandler || self.loadedWithTimeoutHandler) dispatch_async(dispatch_get_main_queue(), ^() {
+			if (self.loadedHandler || self.loadedWithTimeoutHandler) SPDispatchToCallbackQueue(SPAsyncLoadingSessionForItems(self.observedItems), ^() {
 				if (self.loadedHandler)
 					self.loadedHandler(self.observedItems);
 				else if (self.loadedWithTimeoutHandler)
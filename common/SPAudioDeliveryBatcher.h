@@ -0,0 +1,111 @@
+//
+//  SPAudioDeliveryBatcher.h
+//  CocoaLibSpotify
+//
+/*
+ Copyright (c) 2011, Spotify AB
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of Spotify AB nor the names of its contributors may 
+ be used to endorse or promote products derived from this software 
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL SPOTIFY AB BE LIABLE FOR ANY DIRECT, INDIRECT,
+ INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// This class passes the audio libspotify delivers on to an audio delivery delegate, keeping the
+// stream's format for each session. It can collect the small, frequent chunks libspotify delivers 
+// into larger batches first, so the delegate does its work less often.
+
+#import <Foundation/Foundation.h>
+#import "CocoaLibSpotifyPlatformImports.h"
+#import "SPSession.h"
+
+/**
+ Collects audio delivered by libspotify into batches for an SPSessionAudioDeliveryDelegate.
+ 
+ Audio is copied into a staging buffer and only passed to the delegate once at least `batchDuration`
+ worth has built up. Staged audio is passed on early when the audio format changes and at the end of
+ a track, and audio that has waited longer than `batchDuration` is passed on by a timer, so nothing
+ is held back indefinitely if delivery slows down. At a discontinuity, staged audio is thrown away.
+ 
+ Each SPSession delivers audio to its `audioDeliveryDelegate` through its own instance of this class, which
+ keeps the description of the session's audio stream, so any number of sessions can deliver audio at once.
+ The delegate is called from whichever thread delivers audio or from the receiver's own queue, but never
+ from two at once. No locks are held while it's called, so it may call back into the session.
+ */
+
+@interface SPAudioDeliveryBatcher : NSObject
+
+/**
+ Initializes a batcher for audio from the given session.
+ 
+ @param aSession The session to pass to the delegate. It's not retained.
+ @return Returns the initialized batcher.
+ */
+-(id)initWithSession:(id <SPSessionPlaybackProvider>)aSession;
+
+/** Returns the session passed to the delegate. */
+@property (readonly, nonatomic, assign) __unsafe_unretained id <SPSessionPlaybackProvider> session;
+
+/** Returns the delegate batches of audio are passed to. Any staged audio is discarded while this is `nil`. */
+@property (readwrite, assign) __unsafe_unretained id <SPSessionAudioDeliveryDelegate> delegate;
+
+/** 
+ Returns the least amount of audio, in seconds, collected before it's passed to the delegate. Defaults to `0.0`.
+ 
+ At `0.0`, audio is passed straight on without being copied.
+ */
+@property (readwrite) NSTimeInterval batchDuration;
+
+@end
+
+///----------------------------
+/// @name Delivering Audio
+///----------------------------
+
+/** Returns `YES` if the batcher has a delegate to deliver audio to.
+ 
+ @param batcher The batcher to query.
+ */
+extern BOOL SPAudioDeliveryBatcherIsActive(__unsafe_unretained SPAudioDeliveryBatcher *batcher);
+
+/** Stages audio delivered by libspotify, passing it to the delegate if a batch has built up.
+ 
+ This has the same semantics as libspotify's `music_delivery` callback. It only sends Objective-C
+ messages when it passes audio on, and doesn't need an autorelease pool around it. It never waits
+ for the delegate: if the delegate is being called from another thread, no frames are accepted and
+ libspotify delivers them again later.
+ 
+ @param batcher The batcher to deliver to.
+ @param format The format of the audio.
+ @param frames The audio data.
+ @param frameCount The number of frames of audio, or `0` at a discontinuity.
+ @return Returns the number of frames accepted. libspotify will deliver the rest again later.
+ */
+extern NSInteger SPAudioDeliveryBatcherDeliverFrames(__unsafe_unretained SPAudioDeliveryBatcher *batcher, const sp_audioformat *format, const void *frames, NSInteger frameCount);
+
+/** Tells the batcher the current track has finished delivering.
+ 
+ The delegate's `-sessionDidEndAudioDelivery:` is called once all the audio staged before this
+ has been passed on, which may be later if the delegate's buffers are full.
+ 
+ @param batcher The batcher to notify.
+ */
+extern void SPAudioDeliveryBatcherEndTrack(__unsafe_unretained SPAudioDeliveryBatcher *batcher);
@@ -0,0 +1,438 @@
+//
+//  SPAudioDeliveryBatcher.m
+//  CocoaLibSpotify
+//
+/*
+ Copyright (c) 2011, Spotify AB
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of Spotify AB nor the names of its contributors may 
+ be used to endorse or promote products derived from this software 
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL SPOTIFY AB BE LIABLE FOR ANY DIRECT, INDIRECT,
+ INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "SPAudioDeliveryBatcher.h"
+#import "SPCircularBuffer.h"
+#include <pthread.h>
+
+// Room for libspotify's chunks on top of two batches, so a batch being passed on never stops the next one building up.
+static NSTimeInterval const kStagingHeadroomDuration = 0.25;
+// How soon to try again when the delegate's buffers are full.
+static NSTimeInterval const kFlushRetryInterval = 0.02;
+
+@interface SPAudioDeliveryBatcher ()
+
+@property (readwrite, nonatomic, assign) __unsafe_unretained id <SPSessionPlaybackProvider> session;
+
+@end
+
+@implementation SPAudioDeliveryBatcher {
+	
+	// The lock guards the delegate and the fields below, but is never held while the delegate is
+	// called. Instead, one thread at a time owns delivery, and only that thread calls the delegate.
+	pthread_mutex_t lock;
+	pthread_cond_t deliveryFinished;
+	BOOL delivering;
+	pthread_t deliveringThread;
+	BOOL endOfTrackPending;
+	BOOL discontinuityPending;
+	BOOL flushScheduled;
+	
+	// Only touched by the thread that owns delivery.
+	SPCircularBuffer *stagingBuffer;
+	NSUInteger stagingCapacity;
+	sp_audioformat stagingFormat;
+	AudioStreamBasicDescription stagingDescription;
+	CFAbsoluteTime stagedSince;
+	
+	dispatch_queue_t flushQueue;
+}
+
+-(id)initWithSession:(id <SPSessionPlaybackProvider>)aSession {
+	self = [super init];
+	
+	if (self) {
+		pthread_mutex_init(&lock, NULL);
+		pthread_cond_init(&deliveryFinished, NULL);
+		flushQueue = dispatch_queue_create("com.spotify.CocoaLibSpotify.audiodeliverybatcher", DISPATCH_QUEUE_SERIAL);
+		self.session = aSession;
+		
+		// The rest of the description is filled in when we get audio.
+		memset(&stagingDescription, 0, sizeof(stagingDescription));
+		stagingDescription.mFormatID = kAudioFormatLinearPCM;
+		stagingDescription.mFormatFlags = kLinearPCMFormatFlagIsSignedInteger | kLinearPCMFormatFlagIsPacked | kAudioFormatFlagsNativeEndian;
+		stagingDescription.mFramesPerPacket = 1;
+		stagingDescription.mBitsPerChannel = 16;
+	}
+	return self;
+}
+
+-(void)dealloc {
+	dispatch_release(flushQueue);
+	pthread_cond_destroy(&deliveryFinished);
+	pthread_mutex_destroy(&lock);
+}
+
+@synthesize session;
+@synthesize batchDuration;
+@synthesize delegate;
+
+-(id <SPSessionAudioDeliveryDelegate>)delegate {
+	pthread_mutex_lock(&lock);
+	id <SPSessionAudioDeliveryDelegate> currentDelegate = delegate;
+	pthread_mutex_unlock(&lock);
+	return currentDelegate;
+}
+
+-(void)setDelegate:(id <SPSessionAudioDeliveryDelegate>)aDelegate {
+	
+	pthread_mutex_lock(&lock);
+	delegate = aDelegate;
+	
+	// Wait for any call to the old delegate to return, so it's never called once this returns.
+	// The delegate itself may change the delegate, in which case there's nothing to wait for.
+	while (delivering && !pthread_equal(deliveringThread, pthread_self()))
+		pthread_cond_wait(&deliveryFinished, &lock);
+	
+	pthread_mutex_unlock(&lock);
+}
+
+#pragma mark -
+
+static void SPAudioDeliveryBatcherScheduleFlush(__unsafe_unretained SPAudioDeliveryBatcher *self, NSTimeInterval delay);
+
+// Takes ownership of delivery. Must be called with the lock held. If another thread owns delivery,
+// either waits for it to finish or returns NO straight away. Always returns NO if the calling thread
+// already owns delivery, which means the delegate has called back into the session.
+static BOOL SPAudioDeliveryBatcherBeginDelivery(__unsafe_unretained SPAudioDeliveryBatcher *self, BOOL waitUntilAvailable) {
+	
+	if (self->delivering && pthread_equal(self->deliveringThread, pthread_self()))
+		return NO;
+	
+	while (self->delivering) {
+		if (!waitUntilAvailable)
+			return NO;
+		pthread_cond_wait(&self->deliveryFinished, &self->lock);
+	}
+	
+	self->delivering = YES;
+	self->deliveringThread = pthread_self();
+	return YES;
+}
+
+static NSUInteger SPAudioDeliveryBatcherStagedLength(__unsafe_unretained SPAudioDeliveryBatcher *self) {
+	return SPCircularBufferGetLength(self->stagingBuffer);
+}
+
+static void SPAudioDeliveryBatcherDiscardStagedAudio(__unsafe_unretained SPAudioDeliveryBatcher *self) {
+	SPCircularBufferRegion regions[2];
+	SPCircularBufferCommitRead(self->stagingBuffer, SPCircularBufferAcquireReadableRegions(self->stagingBuffer, regions));
+}
+
+// Passes audio to the delegate with the lock released, returning the number of frames it accepted,
+// or -1 if there's no delegate. Must be called with the lock held by the thread that owns delivery.
+static NSInteger SPAudioDeliveryBatcherPassFramesToDelegate(__unsafe_unretained SPAudioDeliveryBatcher *self, const void *frames, NSInteger frameCount) {
+	
+	__unsafe_unretained id <SPSessionAudioDeliveryDelegate> currentDelegate = self->delegate;
+	if (currentDelegate == nil)
+		return -1;
+	
+	AudioStreamBasicDescription description = self->stagingDescription;
+	NSInteger framesAccepted = 0;
+	
+	pthread_mutex_unlock(&self->lock);
+	@autoreleasepool {
+		framesAccepted = [currentDelegate session:self->session shouldDeliverAudioFrames:frames ofCount:frameCount streamDescription:description];
+	}
+	pthread_mutex_lock(&self->lock);
+	
+	return framesAccepted;
+}
+
+// Tells the delegate the track has ended, with the lock released. Must be called with the lock held by the thread that owns delivery.
+static void SPAudioDeliveryBatcherPassEndOfTrackToDelegate(__unsafe_unretained SPAudioDeliveryBatcher *self) {
+	
+	__unsafe_unretained id <SPSessionAudioDeliveryDelegate> currentDelegate = self->delegate;
+	if (![currentDelegate respondsToSelector:@selector(sessionDidEndAudioDelivery:)])
+		return;
+	
+	pthread_mutex_unlock(&self->lock);
+	@autoreleasepool {
+		[currentDelegate sessionDidEndAudioDelivery:self->session];
+	}
+	pthread_mutex_lock(&self->lock);
+}
+
+// Throws away staged audio and tells the delegate to do the same, if libspotify has reported a
+// discontinuity. Must be called with the lock held by the thread that owns delivery.
+static void SPAudioDeliveryBatcherApplyPendingDiscontinuity(__unsafe_unretained SPAudioDeliveryBatcher *self) {
+	
+	while (self->discontinuityPending) {
+		self->discontinuityPending = NO;
+		self->endOfTrackPending = NO;
+		SPAudioDeliveryBatcherDiscardStagedAudio(self);
+		SPAudioDeliveryBatcherPassFramesToDelegate(self, NULL, 0);
+	}
+}
+
+// Gives up ownership of delivery. Must be called with the lock held.
+static void SPAudioDeliveryBatcherEndDelivery(__unsafe_unretained SPAudioDeliveryBatcher *self) {
+	
+	// A discontinuity reported while we were calling the delegate must reach it before anything else does.
+	SPAudioDeliveryBatcherApplyPendingDiscontinuity(self);
+	
+	self->delivering = NO;
+	pthread_cond_broadcast(&self->deliveryFinished);
+}
+
+// Passes as much staged audio to the delegate as it'll take, followed by any pending end of track.
+// Returns YES if nothing is left to pass on. Must be called with the lock held by the thread that owns delivery.
+static BOOL SPAudioDeliveryBatcherFlush(__unsafe_unretained SPAudioDeliveryBatcher *self) {
+	
+	UInt32 bytesPerFrame = self->stagingDescription.mBytesPerFrame;
+	
+	if (self->delegate == nil) {
+		SPAudioDeliveryBatcherDiscardStagedAudio(self);
+		self->endOfTrackPending = NO;
+		return YES;
+	}
+	
+	SPCircularBufferRegion regions[2];
+	while (!self->discontinuityPending && SPCircularBufferAcquireReadableRegions(self->stagingBuffer, regions) > 0) {
+		
+		// Audio is only ever staged in whole frames, so regions always split between frames.
+		NSInteger frameCount = regions[0].length / bytesPerFrame;
+		NSInteger framesAccepted = SPAudioDeliveryBatcherPassFramesToDelegate(self, regions[0].data, frameCount);
+		
+		if (framesAccepted < 0) {
+			// The delegate was removed while we were calling it.
+			SPAudioDeliveryBatcherDiscardStagedAudio(self);
+			self->endOfTrackPending = NO;
+			return YES;
+		}
+		
+		if (framesAccepted == 0)
+			return NO;
+		
+		SPCircularBufferCommitRead(self->stagingBuffer, MIN(framesAccepted, frameCount) * bytesPerFrame);
+	}
+	
+	if (self->discontinuityPending)
+		return YES;
+	
+	if (self->endOfTrackPending) {
+		self->endOfTrackPending = NO;
+		SPAudioDeliveryBatcherPassEndOfTrackToDelegate(self);
+	}
+	
+	return YES;
+}
+
+static BOOL SPAudioDeliveryBatcherPrepareStagingBuffer(__unsafe_unretained SPAudioDeliveryBatcher *self, NSUInteger batchLength) {
+	
+	UInt32 bytesPerFrame = self->stagingDescription.mBytesPerFrame;
+	NSUInteger headroomLength = (NSUInteger)(kStagingHeadroomDuration * self->stagingDescription.mSampleRate) * bytesPerFrame;
+	NSUInteger capacity = (batchLength * 2) + headroomLength;
+	
+	// The buffer is only replaced when it's empty. Until then, a buffer that's too small just makes for smaller batches.
+	if (self->stagingBuffer != nil && (self->stagingCapacity >= capacity || SPAudioDeliveryBatcherStagedLength(self) > 0))
+		return YES;
+	
+	SPCircularBuffer *newBuffer = [[SPCircularBuffer alloc] initWithMaximumLength:capacity
+																			 mode:SPCircularBufferModeSingleProducerSingleConsumer
+																		 mirrored:YES];
+	if (newBuffer == nil)
+		return self->stagingBuffer != nil;
+	
+	self->stagingBuffer = newBuffer;
+	self->stagingCapacity = newBuffer.maximumLength;
+	return YES;
+}
+
+// Must be called with the lock held by the thread that owns delivery.
+static NSInteger SPAudioDeliveryBatcherStageFrames(__unsafe_unretained SPAudioDeliveryBatcher *self, const sp_audioformat *format, const void *frames, NSInteger frameCount) {
+	
+	if (format->sample_rate != self->stagingFormat.sample_rate || format->channels != self->stagingFormat.channels) {
+		
+		// Audio that's already staged has to go out in its own format first.
+		if (!SPAudioDeliveryBatcherFlush(self))
+			return 0;
+		
+		// Start afresh, so a buffer that isn't mirrored wraps around between frames of the new format.
+		self->stagingBuffer = nil;
+		self->stagingFormat = *format;
+		self->stagingDescription.mSampleRate = (Float64)format->sample_rate;
+		self->stagingDescription.mBytesPerPacket = format->channels * sizeof(SInt16);
+		self->stagingDescription.mBytesPerFrame = self->stagingDescription.mBytesPerPacket;
+		self->stagingDescription.mChannelsPerFrame = format->channels;
+	}
+	
+	// Staged audio waiting for the end of its track has to be passed on before any from the next track.
+	if (self->endOfTrackPending && !SPAudioDeliveryBatcherFlush(self))
+		return 0;
+	
+	UInt32 bytesPerFrame = self->stagingDescription.mBytesPerFrame;
+	NSUInteger batchLength = (NSUInteger)(self->batchDuration * self->stagingDescription.mSampleRate) * bytesPerFrame;
+	NSUInteger stagedLength = SPAudioDeliveryBatcherStagedLength(self);
+	
+	if (batchLength == 0 && stagedLength == 0) {
+		// Not batching, so there's no need to copy anything.
+		return MAX(SPAudioDeliveryBatcherPassFramesToDelegate(self, frames, frameCount), 0);
+	}
+	
+	if (!SPAudioDeliveryBatcherPrepareStagingBuffer(self, batchLength))
+		return 0;
+	
+	NSUInteger freeLength = self->stagingCapacity - MIN(stagedLength, self->stagingCapacity);
+	NSUInteger copyLength = MIN((NSUInteger)frameCount * bytesPerFrame, freeLength - (freeLength % bytesPerFrame));
+	
+	if (copyLength > 0) {
+		
+		SPCircularBufferRegion regions[2];
+		SPCircularBufferAcquireWritableRegions(self->stagingBuffer, regions);
+		NSUInteger directCopyLength = MIN(copyLength, regions[0].length);
+		memcpy(regions[0].data, frames, directCopyLength);
+		memcpy(regions[1].data, (const uint8_t *)frames + directCopyLength, copyLength - directCopyLength);
+		SPCircularBufferCommitWrite(self->stagingBuffer, copyLength);
+		
+		if (stagedLength == 0)
+			self->stagedSince = CFAbsoluteTimeGetCurrent();
+		stagedLength += copyLength;
+	}
+	
+	if (stagedLength >= batchLength && stagedLength > 0)
+		SPAudioDeliveryBatcherFlush(self);
+	
+	// Make sure whatever's left doesn't wait for libspotify, which may not deliver again for a while.
+	if (SPAudioDeliveryBatcherStagedLength(self) > 0)
+		SPAudioDeliveryBatcherScheduleFlush(self, self->batchDuration);
+	
+	return copyLength / bytesPerFrame;
+}
+
+// Must be called with the lock held.
+static void SPAudioDeliveryBatcherScheduleFlush(__unsafe_unretained SPAudioDeliveryBatcher *self, NSTimeInterval delay) {
+	
+	if (self->flushScheduled)
+		return;
+	
+	self->flushScheduled = YES;
+	
+	// Holding on to the batcher keeps it alive until the flush has run.
+	SPAudioDeliveryBatcher *batcher = self;
+	dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(MAX(delay, kFlushRetryInterval) * NSEC_PER_SEC)), self->flushQueue, ^{
+		
+		pthread_mutex_lock(&batcher->lock);
+		batcher->flushScheduled = NO;
+		
+		// This isn't the audio thread, so it's fine to wait for whoever is delivering to finish.
+		if (SPAudioDeliveryBatcherBeginDelivery(batcher, YES)) {
+			
+			if (SPAudioDeliveryBatcherStagedLength(batcher) > 0 || batcher->endOfTrackPending) {
+				
+				NSTimeInterval waited = CFAbsoluteTimeGetCurrent() - batcher->stagedSince;
+				NSTimeInterval nextDelay = batcher->batchDuration - waited;
+				
+				if (batcher->endOfTrackPending || nextDelay <= 0.0) {
+					SPAudioDeliveryBatcherFlush(batcher);
+					nextDelay = kFlushRetryInterval;
+				}
+				
+				if (SPAudioDeliveryBatcherStagedLength(batcher) > 0 || batcher->endOfTrackPending)
+					SPAudioDeliveryBatcherScheduleFlush(batcher, nextDelay);
+			}
+			
+			SPAudioDeliveryBatcherEndDelivery(batcher);
+		}
+		
+		pthread_mutex_unlock(&batcher->lock);
+	});
+}
+
+#pragma mark -
+
+BOOL SPAudioDeliveryBatcherIsActive(__unsafe_unretained SPAudioDeliveryBatcher *batcher) {
+	
+	if (batcher == nil)
+		return NO;
+	
+	pthread_mutex_lock(&batcher->lock);
+	BOOL active = batcher->delegate != nil;
+	pthread_mutex_unlock(&batcher->lock);
+	return active;
+}
+
+NSInteger SPAudioDeliveryBatcherDeliverFrames(__unsafe_unretained SPAudioDeliveryBatcher *batcher, const sp_audioformat *format, const void *frames, NSInteger frameCount) {
+	
+	if (batcher == nil)
+		return frameCount;
+	
+	pthread_mutex_lock(&batcher->lock);
+	
+	NSInteger framesAccepted = frameCount;
+	
+	if (batcher->delegate != nil) {
+		
+		if (frameCount == 0) {
+			// A discontinuity. Everything staged is from before it, and the delegate is about to throw its
+			// own audio away too. If the delegate is busy, this happens as soon as it returns.
+			batcher->discontinuityPending = YES;
+			framesAccepted = 0;
+			if (SPAudioDeliveryBatcherBeginDelivery(batcher, NO))
+				SPAudioDeliveryBatcherEndDelivery(batcher);
+			
+		} else if (SPAudioDeliveryBatcherBeginDelivery(batcher, NO)) {
+			SPAudioDeliveryBatcherApplyPendingDiscontinuity(batcher);
+			framesAccepted = SPAudioDeliveryBatcherStageFrames(batcher, format, frames, frameCount);
+			SPAudioDeliveryBatcherEndDelivery(batcher);
+			
+		} else {
+			// Rather than wait for the delegate, have libspotify deliver this audio again later.
+			framesAccepted = 0;
+		}
+	}
+	
+	pthread_mutex_unlock(&batcher->lock);
+	return framesAccepted;
+}
+
+void SPAudioDeliveryBatcherEndTrack(__unsafe_unretained SPAudioDeliveryBatcher *batcher) {
+	
+	if (batcher == nil)
+		return;
+	
+	pthread_mutex_lock(&batcher->lock);
+	
+	batcher->endOfTrackPending = YES;
+	
+	if (SPAudioDeliveryBatcherBeginDelivery(batcher, NO)) {
+		if (!SPAudioDeliveryBatcherFlush(batcher))
+			SPAudioDeliveryBatcherScheduleFlush(batcher, kFlushRetryInterval);
+		SPAudioDeliveryBatcherEndDelivery(batcher);
+	} else {
+		// Whoever is delivering will usually pass it on, but make sure.
+		SPAudioDeliveryBatcherScheduleFlush(batcher, kFlushRetryInterval);
+	}
+	
+	pthread_mutex_unlock(&batcher->lock);
+}
+
+@end
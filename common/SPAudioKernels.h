@@ -0,0 +1,102 @@
+//
+//  SPAudioKernels.h
+//  CocoaLibSpotify
+//
+/*
+ Copyright (c) 2011, Spotify AB
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of Spotify AB nor the names of its contributors may 
+ be used to endorse or promote products derived from this software 
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL SPOTIFY AB BE LIABLE FOR ANY DIRECT, INDIRECT,
+ INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// These functions are the sample-level processing used in the audio render path. They're
+// vectorized with AVX2, SSE2 or NEON depending on what the target architecture is compiled for,
+// and fall back to plain C otherwise. All of them are safe to call from a real-time thread.
+
+#import <Foundation/Foundation.h>
+
+/** Returns the name of the instruction set the kernels were compiled for: `"AVX2"`, `"SSE2"`, `"NEON"` or `"scalar"`. */
+extern const char *SPAudioKernelsInstructionSetName(void);
+
+/** Returns the linear gain for the given volume, between `0.0` and `1.0`, using a cubic taper.
+ 
+ A cubic taper makes volume changes sound roughly even across the whole range,
+ matching the curve previously applied by the mixer unit.
+ */
+extern float SPAudioGainForVolume(double volume);
+
+/** Converts signed 16-bit samples to 32-bit floating point samples in the range [-1.0, 1.0).
+ 
+ @param input The samples to convert.
+ @param output The buffer to write converted samples to. Must not overlap `input`.
+ @param sampleCount The number of samples to convert.
+ */
+extern void SPAudioConvertInt16ToFloat32(const SInt16 *input, float *output, NSUInteger sampleCount);
+
+/** Converts 32-bit floating point samples to signed 16-bit samples, clipping anything outside [-1.0, 1.0).
+ 
+ Samples are rounded to the nearest value, with ties going to the even one. Every instruction set gives the same results.
+ 
+ @param input The samples to convert.
+ @param output The buffer to write converted samples to. Must not overlap `input`.
+ @param sampleCount The number of samples to convert.
+ */
+extern void SPAudioConvertFloat32ToInt16(const float *input, SInt16 *output, NSUInteger sampleCount);
+
+/** Multiplies samples by a gain that moves linearly from `startGain` to `endGain` across the buffer.
+ 
+ Ramping the gain across a whole buffer, rather than jumping to the new value, avoids the
+ "zipper" noise otherwise heard while the volume is being changed.
+ 
+ @param samples The samples to process, in place.
+ @param sampleCount The number of samples to process.
+ @param startGain The gain to apply to the first sample.
+ @param endGain The gain the ramp is heading towards, which will be applied to the sample following the last one.
+ */
+extern void SPAudioApplyGainRamp(float *samples, NSUInteger sampleCount, float startGain, float endGain);
+
+/** Adds one buffer of samples to another.
+ 
+ @param input The samples to add.
+ @param output The samples to add to, in place.
+ @param sampleCount The number of samples to process.
+ */
+extern void SPAudioMixFloat32(const float *input, float *output, NSUInteger sampleCount);
+
+/** Splits interleaved samples into one buffer per channel.
+ 
+ @param input The interleaved samples.
+ @param outputs An array of `channelCount` buffers, each at least `frameCount` samples long.
+ @param channelCount The number of channels in `input`.
+ @param frameCount The number of frames to process.
+ */
+extern void SPAudioDeinterleaveFloat32(const float *input, float * const *outputs, UInt32 channelCount, NSUInteger frameCount);
+
+/** Merges one buffer per channel into interleaved samples.
+ 
+ @param inputs An array of `channelCount` buffers, each at least `frameCount` samples long.
+ @param output The buffer to write interleaved samples to.
+ @param channelCount The number of channels.
+ @param frameCount The number of frames to process.
+ */
+extern void SPAudioInterleaveFloat32(const float * const *inputs, float *output, UInt32 channelCount, NSUInteger frameCount);
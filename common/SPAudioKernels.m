@@ -0,0 +1,307 @@
+//
+//  SPAudioKernels.m
+//  CocoaLibSpotify
+//
+/*
+ Copyright (c) 2011, Spotify AB
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of Spotify AB nor the names of its contributors may 
+ be used to endorse or promote products derived from this software 
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL SPOTIFY AB BE LIABLE FOR ANY DIRECT, INDIRECT,
+ INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "SPAudioKernels.h"
+#include <math.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SP_AUDIO_KERNELS_AVX2 1
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define SP_AUDIO_KERNELS_SSE2 1
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SP_AUDIO_KERNELS_NEON 1
+#endif
+
+static float const kInt16ToFloat32Scale = 1.0f / 32768.0f;
+static float const kFloat32ToInt16Scale = 32768.0f;
+static float const kFloat32ToInt16Minimum = -32768.0f;
+static float const kFloat32ToInt16Maximum = 32767.0f;
+
+const char *SPAudioKernelsInstructionSetName(void) {
+#if SP_AUDIO_KERNELS_AVX2
+	return "AVX2";
+#elif SP_AUDIO_KERNELS_SSE2
+	return "SSE2";
+#elif SP_AUDIO_KERNELS_NEON
+	return "NEON";
+#else
+	return "scalar";
+#endif
+}
+
+float SPAudioGainForVolume(double volume) {
+	if (volume <= 0.0) return 0.0f;
+	if (volume >= 1.0) return 1.0f;
+	return (float)(volume * volume * volume);
+}
+
+#pragma mark -
+#pragma mark Conversion
+
+void SPAudioConvertInt16ToFloat32(const SInt16 *input, float *output, NSUInteger sampleCount) {
+	
+	NSUInteger i = 0;
+	
+#if SP_AUDIO_KERNELS_AVX2
+	__m256 scale256 = _mm256_set1_ps(kInt16ToFloat32Scale);
+	for (; i + 8 <= sampleCount; i += 8) {
+		__m256i widened = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(input + i)));
+		_mm256_storeu_ps(output + i, _mm256_mul_ps(_mm256_cvtepi32_ps(widened), scale256));
+	}
+#elif SP_AUDIO_KERNELS_SSE2
+	__m128 scale = _mm_set1_ps(kInt16ToFloat32Scale);
+	for (; i + 8 <= sampleCount; i += 8) {
+		__m128i samples = _mm_loadu_si128((const __m128i *)(input + i));
+		// Unpacking a register with itself puts each sample in the top half of a 32-bit lane,
+		// so an arithmetic shift back down sign-extends it.
+		__m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16);
+		__m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+		_mm_storeu_ps(output + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+		_mm_storeu_ps(output + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+	}
+#elif SP_AUDIO_KERNELS_NEON
+	for (; i + 8 <= sampleCount; i += 8) {
+		int16x8_t samples = vld1q_s16(input + i);
+		vst1q_f32(output + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples))), kInt16ToFloat32Scale));
+		vst1q_f32(output + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples))), kInt16ToFloat32Scale));
+	}
+#endif
+	
+	for (; i < sampleCount; i++)
+		output[i] = input[i] * kInt16ToFloat32Scale;
+}
+
+void SPAudioConvertFloat32ToInt16(const float *input, SInt16 *output, NSUInteger sampleCount) {
+	
+	NSUInteger i = 0;
+	
+	// The vector paths clamp before converting, as x86 turns anything out of the 32-bit range into
+	// INT32_MIN, and round to nearest like lrintf() below. Narrowing then can't saturate.
+#if SP_AUDIO_KERNELS_AVX2
+	__m256 scale256 = _mm256_set1_ps(kFloat32ToInt16Scale);
+	__m256 minimum256 = _mm256_set1_ps(kFloat32ToInt16Minimum);
+	__m256 maximum256 = _mm256_set1_ps(kFloat32ToInt16Maximum);
+	for (; i + 16 <= sampleCount; i += 16) {
+		__m256 firstScaled = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(input + i), scale256), minimum256), maximum256);
+		__m256 secondScaled = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(input + i + 8), scale256), minimum256), maximum256);
+		__m256i first = _mm256_cvtps_epi32(firstScaled);
+		__m256i second = _mm256_cvtps_epi32(secondScaled);
+		// Packing works within each 128-bit lane, so put the halves back in order afterwards.
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(first, second), _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_si256((__m256i *)(output + i), packed);
+	}
+#elif SP_AUDIO_KERNELS_SSE2
+	__m128 scale = _mm_set1_ps(kFloat32ToInt16Scale);
+	__m128 minimum = _mm_set1_ps(kFloat32ToInt16Minimum);
+	__m128 maximum = _mm_set1_ps(kFloat32ToInt16Maximum);
+	for (; i + 8 <= sampleCount; i += 8) {
+		__m128i low = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(input + i), scale), minimum), maximum));
+		__m128i high = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(input + i + 4), scale), minimum), maximum));
+		_mm_storeu_si128((__m128i *)(output + i), _mm_packs_epi32(low, high));
+	}
+#elif SP_AUDIO_KERNELS_NEON
+	float32x4_t minimum = vdupq_n_f32(kFloat32ToInt16Minimum);
+	float32x4_t maximum = vdupq_n_f32(kFloat32ToInt16Maximum);
+#if !defined(__aarch64__)
+	// ARMv7 can only convert by truncating. Adding and subtracting 1.5 * 2^23 first rounds to nearest
+	// in the float unit, leaving a whole number to convert, which is exact for anything we've clamped.
+	float32x4_t rounding = vdupq_n_f32(12582912.0f);
+#endif
+	for (; i + 8 <= sampleCount; i += 8) {
+		float32x4_t lowScaled = vminq_f32(vmaxq_f32(vmulq_n_f32(vld1q_f32(input + i), kFloat32ToInt16Scale), minimum), maximum);
+		float32x4_t highScaled = vminq_f32(vmaxq_f32(vmulq_n_f32(vld1q_f32(input + i + 4), kFloat32ToInt16Scale), minimum), maximum);
+#if defined(__aarch64__)
+		int32x4_t low = vcvtnq_s32_f32(lowScaled);
+		int32x4_t high = vcvtnq_s32_f32(highScaled);
+#else
+		int32x4_t low = vcvtq_s32_f32(vsubq_f32(vaddq_f32(lowScaled, rounding), rounding));
+		int32x4_t high = vcvtq_s32_f32(vsubq_f32(vaddq_f32(highScaled, rounding), rounding));
+#endif
+		vst1q_s16(output + i, vcombine_s16(vqmovn_s32(low), vqmovn_s32(high)));
+	}
+#endif
+	
+	for (; i < sampleCount; i++) {
+		float sample = input[i] * kFloat32ToInt16Scale;
+		if (sample >= 32767.0f)
+			output[i] = INT16_MAX;
+		else if (sample <= -32768.0f)
+			output[i] = INT16_MIN;
+		else
+			output[i] = (SInt16)lrintf(sample);
+	}
+}
+
+#pragma mark -
+#pragma mark Gain
+
+void SPAudioApplyGainRamp(float *samples, NSUInteger sampleCount, float startGain, float endGain) {
+	
+	if (sampleCount == 0 || (startGain == 1.0f && endGain == 1.0f))
+		return;
+	
+	float step = (endGain - startGain) / sampleCount;
+	NSUInteger i = 0;
+	
+	// Each lane's gain is computed from the sample index rather than accumulated,
+	// so rounding errors don't build up over long buffers.
+#if SP_AUDIO_KERNELS_AVX2
+	__m256 lanes256 = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+	__m256 start256 = _mm256_set1_ps(startGain);
+	__m256 step256 = _mm256_set1_ps(step);
+	for (; i + 8 <= sampleCount; i += 8) {
+		__m256 index = _mm256_add_ps(_mm256_set1_ps((float)i), lanes256);
+		__m256 gain = _mm256_add_ps(start256, _mm256_mul_ps(index, step256));
+		_mm256_storeu_ps(samples + i, _mm256_mul_ps(_mm256_loadu_ps(samples + i), gain));
+	}
+#elif SP_AUDIO_KERNELS_SSE2
+	__m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+	__m128 start = _mm_set1_ps(startGain);
+	__m128 stepVector = _mm_set1_ps(step);
+	for (; i + 4 <= sampleCount; i += 4) {
+		__m128 index = _mm_add_ps(_mm_set1_ps((float)i), lanes);
+		__m128 gain = _mm_add_ps(start, _mm_mul_ps(index, stepVector));
+		_mm_storeu_ps(samples + i, _mm_mul_ps(_mm_loadu_ps(samples + i), gain));
+	}
+#elif SP_AUDIO_KERNELS_NEON
+	static const float laneOffsets[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+	float32x4_t lanes = vld1q_f32(laneOffsets);
+	float32x4_t start = vdupq_n_f32(startGain);
+	for (; i + 4 <= sampleCount; i += 4) {
+		float32x4_t index = vaddq_f32(vdupq_n_f32((float)i), lanes);
+		float32x4_t gain = vmlaq_n_f32(start, index, step);
+		vst1q_f32(samples + i, vmulq_f32(vld1q_f32(samples + i), gain));
+	}
+#endif
+	
+	for (; i < sampleCount; i++)
+		samples[i] *= startGain + (i * step);
+}
+
+#pragma mark -
+#pragma mark Mixing
+
+void SPAudioMixFloat32(const float *input, float *output, NSUInteger sampleCount) {
+	
+	NSUInteger i = 0;
+	
+#if SP_AUDIO_KERNELS_AVX2
+	for (; i + 8 <= sampleCount; i += 8)
+		_mm256_storeu_ps(output + i, _mm256_add_ps(_mm256_loadu_ps(output + i), _mm256_loadu_ps(input + i)));
+#elif SP_AUDIO_KERNELS_SSE2
+	for (; i + 4 <= sampleCount; i += 4)
+		_mm_storeu_ps(output + i, _mm_add_ps(_mm_loadu_ps(output + i), _mm_loadu_ps(input + i)));
+#elif SP_AUDIO_KERNELS_NEON
+	for (; i + 4 <= sampleCount; i += 4)
+		vst1q_f32(output + i, vaddq_f32(vld1q_f32(output + i), vld1q_f32(input + i)));
+#endif
+	
+	for (; i < sampleCount; i++)
+		output[i] += input[i];
+}
+
+#pragma mark -
+#pragma mark Interleaving
+
+void SPAudioDeinterleaveFloat32(const float *input, float * const *outputs, UInt32 channelCount, NSUInteger frameCount) {
+	
+	NSUInteger frame = 0;
+	
+	if (channelCount == 2) {
+		// Stereo is by far the most common case, so it gets a vectorized path.
+		float *left = outputs[0];
+		float *right = outputs[1];
+#if SP_AUDIO_KERNELS_SSE2
+		for (; frame + 4 <= frameCount; frame += 4) {
+			__m128 first = _mm_loadu_ps(input + (frame * 2));
+			__m128 second = _mm_loadu_ps(input + (frame * 2) + 4);
+			_mm_storeu_ps(left + frame, _mm_shuffle_ps(first, second, _MM_SHUFFLE(2, 0, 2, 0)));
+			_mm_storeu_ps(right + frame, _mm_shuffle_ps(first, second, _MM_SHUFFLE(3, 1, 3, 1)));
+		}
+#elif SP_AUDIO_KERNELS_NEON
+		for (; frame + 4 <= frameCount; frame += 4) {
+			float32x4x2_t channels = vld2q_f32(input + (frame * 2));
+			vst1q_f32(left + frame, channels.val[0]);
+			vst1q_f32(right + frame, channels.val[1]);
+		}
+#endif
+		for (; frame < frameCount; frame++) {
+			left[frame] = input[frame * 2];
+			right[frame] = input[(frame * 2) + 1];
+		}
+		return;
+	}
+	
+	for (; frame < frameCount; frame++) {
+		for (UInt32 channel = 0; channel < channelCount; channel++)
+			outputs[channel][frame] = input[(frame * channelCount) + channel];
+	}
+}
+
+void SPAudioInterleaveFloat32(const float * const *inputs, float *output, UInt32 channelCount, NSUInteger frameCount) {
+	
+	NSUInteger frame = 0;
+	
+	if (channelCount == 2) {
+		const float *left = inputs[0];
+		const float *right = inputs[1];
+#if SP_AUDIO_KERNELS_SSE2
+		for (; frame + 4 <= frameCount; frame += 4) {
+			__m128 leftSamples = _mm_loadu_ps(left + frame);
+			__m128 rightSamples = _mm_loadu_ps(right + frame);
+			_mm_storeu_ps(output + (frame * 2), _mm_unpacklo_ps(leftSamples, rightSamples));
+			_mm_storeu_ps(output + (frame * 2) + 4, _mm_unpackhi_ps(leftSamples, rightSamples));
+		}
+#elif SP_AUDIO_KERNELS_NEON
+		for (; frame + 4 <= frameCount; frame += 4) {
+			float32x4x2_t channels;
+			channels.val[0] = vld1q_f32(left + frame);
+			channels.val[1] = vld1q_f32(right + frame);
+			vst2q_f32(output + (frame * 2), channels);
+		}
+#endif
+		for (; frame < frameCount; frame++) {
+			output[frame * 2] = left[frame];
+			output[(frame * 2) + 1] = right[frame];
+		}
+		return;
+	}
+	
+	for (; frame < frameCount; frame++) {
+		for (UInt32 channel = 0; channel < channelCount; channel++)
+			output[(frame * channelCount) + channel] = inputs[channel][frame];
+	}
+}
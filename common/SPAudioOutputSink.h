@@ -0,0 +1,121 @@
+//
+//  SPAudioOutputSink.h
+//  CocoaLibSpotify
+//
+/*
+ Copyright (c) 2011, Spotify AB
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of Spotify AB nor the names of its contributors may 
+ be used to endorse or promote products derived from this software 
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL SPOTIFY AB BE LIABLE FOR ANY DIRECT, INDIRECT,
+ INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// An output sink is the part of the audio pipeline that actually consumes PCM audio.
+// SPCoreAudioController owns buffering, volume, position accounting and format changes,
+// and the sink pulls audio from it whenever its output needs more. The audio it's handed
+// already has the volume applied. Nothing in this protocol depends on Core Audio, but
+// SPCoreAudioController itself still uses Core Audio types and OSAtomic, so it only builds
+// on Apple platforms.
+
+#import <Foundation/Foundation.h>
+#include <stdint.h>
+
+/** Flags describing the sample layout of an SPAudioOutputFormat. */
+enum {
+	SPAudioOutputFormatFlagIsFloat = 1 << 0, /* Samples are floating point. Otherwise they're integers. */
+	SPAudioOutputFormatFlagIsSignedInteger = 1 << 1, /* Integer samples are signed. */
+	SPAudioOutputFormatFlagIsBigEndian = 1 << 2, /* Samples are big endian. Otherwise they're little endian. */
+	SPAudioOutputFormatFlagIsNonInterleaved = 1 << 3 /* Each channel is in its own buffer. Otherwise channels are interleaved. */
+};
+typedef uint32_t SPAudioOutputFormatFlags;
+
+/** Describes the linear PCM audio handed to an output sink. */
+typedef struct SPAudioOutputFormat {
+	double sampleRate; /* The number of frames per second. */
+	uint32_t channelsPerFrame; /* The number of channels in each frame. */
+	uint32_t bitsPerChannel; /* The number of bits in each sample. */
+	uint32_t bytesPerFrame; /* The number of bytes in each frame. */
+	SPAudioOutputFormatFlags flags; /* The sample layout. */
+} SPAudioOutputFormat;
+
+/**
+ Fills an output buffer with audio from an SPCoreAudioController.
+ 
+ This is safe to call from a real-time thread. It neither takes locks nor allocates memory.
+ 
+ If the requested audio is contiguous in the controller's buffer, the callback may repoint `*ioData`
+ at the buffered audio instead of copying it. That memory stays valid until the next call. If `*ioData`
+ is `NULL` on entry, the callback will only succeed if it can repoint it.
+ 
+ @param context The context given to the sink in `-prepareWithInputFormat:renderCallback:context:error:`.
+ @param frameCount The number of frames of audio required.
+ @param hostTime The time, in nanoseconds on the system's monotonic clock, at which the first frame
+ will be heard, or `0` if the sink doesn't know.
+ @param ioData A pointer to the buffer to fill.
+ @return `YES` if `frameCount` frames of audio were provided, or `NO` if not enough audio is buffered,
+ in which case the sink should output silence.
+ */
+typedef BOOL (*SPAudioOutputRenderCallback)(void *context, uint32_t frameCount, uint64_t hostTime, void **ioData);
+
+/** Describes a destination for audio played through SPCoreAudioController. */
+
+@protocol SPAudioOutputSink <NSObject>
+
+/**
+ Prepares the sink to output audio. 
+ 
+ This is called before the first audio is output, and again if the sink needs to be rebuilt. The
+ sink should pull audio by calling `callback` with `context` until `-teardown` is called.
+ 
+ @param inputFormat The format of the audio the sink will be given.
+ @param callback The function to call when the sink needs audio.
+ @param context The context to pass to `callback`.
+ @param error A pointer to an NSError instance to be filled with an `NSError` should a problem occur.
+ @return `YES` if the sink is ready to output audio, otherwise `NO`.
+ */
+-(BOOL)prepareWithInputFormat:(SPAudioOutputFormat)inputFormat
+			   renderCallback:(SPAudioOutputRenderCallback)callback
+					  context:(void *)context
+						error:(NSError **)error;
+
+/**
+ Tells the sink that the audio it's given will be in a new format from now on.
+ 
+ @param inputFormat The new format.
+ @param error A pointer to an NSError instance to be filled with an `NSError` should a problem occur.
+ @return `YES` if the sink accepted the format, otherwise `NO`.
+ */
+-(BOOL)applyInputFormat:(SPAudioOutputFormat)inputFormat error:(NSError **)error;
+
+/** Stops output and releases any resources acquired in `-prepareWithInputFormat:renderCallback:context:error:`. */
+-(void)teardown;
+
+/** Starts pulling audio. */
+-(void)startOutput;
+
+/** Stops pulling audio. The render callback will not be called after this method returns. */
+-(void)stopOutput;
+
+/** Returns `YES` if the sink has been prepared and not yet torn down. */
+@property (readonly, getter = isPrepared) BOOL prepared;
+
+@end
@@ -39,25 +39,79 @@
 
 #import <Foundation/Foundation.h>
 
+typedef enum SPCircularBufferMode {
+	SPCircularBufferModeLocking = 0, /* All access is serialized with a lock. Any number of threads may read and write. */
+	SPCircularBufferModeSingleProducerSingleConsumer /* Lock-free. Exactly one thread may write and exactly one thread may read. */
+} SPCircularBufferMode;
+
+/** Describes a contiguous span of memory inside an SPCircularBuffer. */
+typedef struct SPCircularBufferRegion {
+	void *data; /* A pointer to the start of the span. */
+	NSUInteger length; /* The length of the span, in bytes. */
+} SPCircularBufferRegion;
+
 @interface SPCircularBuffer : NSObject {
 @private
     void *buffer;
 	NSUInteger maximumLength;
-	NSUInteger dataStartOffset;
-	NSUInteger dataEndOffset;
-	BOOL empty;
+	SPCircularBufferMode mode;
+	BOOL mirrored;
+	volatile NSUInteger readCursor;
+	volatile NSUInteger writeCursor;
+	volatile NSUInteger discardCursor;
+	volatile int32_t clearRequestCount;
+	int32_t clearAppliedCount;
+	UInt64 totalBytesWritten;
+	UInt64 totalBytesRead;
 }
 
 /** Initialize a new buffer. 
  
- Initial size will be zero, with a maximum size as provided.
+ Initial size will be zero, with a maximum size as provided. The buffer will be
+ created in the `SPCircularBufferModeLocking` mode.
  
  @param size The maximum size of the buffer, in bytes. 
  @return Returns the newly created SPCircularBuffer.
  */
 -(id)initWithMaximumLength:(NSUInteger)size;
 
-/** Clears all data from the buffer. */
+/** Initialize a new buffer with the given concurrency mode.
+ 
+ In the `SPCircularBufferModeSingleProducerSingleConsumer` mode, no locks are taken. Instead, 
+ the read and write positions are published with memory barriers, which means exactly one thread
+ may append data and exactly one (other) thread may read data. This is the mode to use when the
+ reader is a real-time thread, such as a Core Audio render callback, that must never block.
+ 
+ @param size The maximum size of the buffer, in bytes.
+ @param aMode The concurrency mode of the buffer.
+ @return Returns the newly created SPCircularBuffer.
+ */
+-(id)initWithMaximumLength:(NSUInteger)size mode:(SPCircularBufferMode)aMode;
+
+/** Initialize a new buffer with the given concurrency mode, optionally backed by mirrored memory.
+ 
+ A mirrored buffer maps the same physical pages twice, back to back, in virtual memory. This means
+ that any span of data in the buffer is contiguous, so reads and writes never have to be split at the
+ end of the buffer, and `SPCircularBufferAcquireReadableRegions()` and `SPCircularBufferAcquireWritableRegions()` 
+ only ever return one non-empty region.
+ 
+ Mirrored buffers must be a multiple of the system's page size, so the maximum length will be rounded 
+ up as needed. If the mirrored mapping can't be created, a regular buffer of the requested size is
+ created instead. Check the `mirrored` property to find out which you got.
+ 
+ @param size The maximum size of the buffer, in bytes.
+ @param aMode The concurrency mode of the buffer.
+ @param shouldMirror Whether to back the buffer with mirrored memory.
+ @return Returns the newly created SPCircularBuffer.
+ */
+-(id)initWithMaximumLength:(NSUInteger)size mode:(SPCircularBufferMode)aMode mirrored:(BOOL)shouldMirror;
+
+/** Clears all data from the buffer. 
+ 
+ In the `SPCircularBufferModeSingleProducerSingleConsumer` mode, this is safe to call from any thread.
+ The data is discarded by the reader the next time it reads from the buffer, and the space it occupied
+ becomes available for writing at that point.
+ */
 -(void)clear;
 
 /** Attempt to copy new data into the buffer.
@@ -105,4 +159,116 @@
 /** Returns the maximum amount of data that the buffer can hold, in bytes. */
 @property (readonly, nonatomic) NSUInteger maximumLength;
 
+/** Returns the concurrency mode of the buffer. */
+@property (readonly, nonatomic) SPCircularBufferMode mode;
+
+/** Returns `YES` if the buffer is backed by mirrored memory, otherwise `NO`. */
+@property (readonly, nonatomic, getter=isMirrored) BOOL mirrored;
+
 @end
+
+///----------------------------
+/// @name Real-Time Access
+///----------------------------
+
+/** Returns the amount of data currently in the buffer, in bytes.
+ 
+ This function is equivalent to `-[SPCircularBuffer length]`, but doesn't send any Objective-C
+ messages. In the `SPCircularBufferModeSingleProducerSingleConsumer` mode it doesn't take any 
+ locks either, making it safe to call from a real-time thread.
+ 
+ @param circularBuffer The buffer to query.
+ @return Returns the amount of data in the buffer, in bytes.
+ */
+extern NSUInteger SPCircularBufferGetLength(__unsafe_unretained SPCircularBuffer *circularBuffer);
+
+/** Read data out of the buffer into a pre-allocated buffer.
+ 
+ This function is equivalent to `-[SPCircularBuffer readDataOfLength:intoAllocatedBuffer:]`, but
+ doesn't send any Objective-C messages. In the `SPCircularBufferModeSingleProducerSingleConsumer` 
+ mode it doesn't take any locks either, making it safe to call from a real-time thread.
+ 
+ @param circularBuffer The buffer to read from.
+ @param outBuffer A buffer at least `desiredLength` bytes long.
+ @param desiredLength The desired number of bytes to copy out.
+ @return Returns the amount of data copied into the given buffer, in bytes.
+ */
+extern NSUInteger SPCircularBufferReadData(__unsafe_unretained SPCircularBuffer *circularBuffer, void *outBuffer, NSUInteger desiredLength);
+
+///----------------------------
+/// @name Zero-Copy Access
+///----------------------------
+
+/** Get the data available for reading without copying it out of the buffer.
+ 
+ Because the data may wrap around the end of the buffer, it's described by up to two regions. The 
+ first region always contains the oldest data. If there's no wraparound, the second region will have
+ a length of zero. Once you're done with the data, call `SPCircularBufferCommitRead()` to release it.
+ 
+ Until the read is committed, the writer can't reuse the space the regions occupy, so the regions
+ remain valid even while data is being appended in the `SPCircularBufferModeSingleProducerSingleConsumer` 
+ mode. In the `SPCircularBufferModeLocking` mode, no lock is held between acquiring and committing, so 
+ you must make sure no other thread reads from or clears the buffer in the meantime.
+ 
+ @param circularBuffer The buffer to read from.
+ @param regions An array of two regions, to be filled with the readable data.
+ @return Returns the total number of readable bytes described by the regions.
+ */
+extern NSUInteger SPCircularBufferAcquireReadableRegions(__unsafe_unretained SPCircularBuffer *circularBuffer, SPCircularBufferRegion regions[2]);
+
+/** Release data obtained through `SPCircularBufferAcquireReadableRegions()`.
+ 
+ @param circularBuffer The buffer that was read from.
+ @param length The number of bytes consumed, starting from the beginning of the first region. Must not
+ be larger than the value returned by the preceding call to `SPCircularBufferAcquireReadableRegions()`.
+ */
+extern void SPCircularBufferCommitRead(__unsafe_unretained SPCircularBuffer *circularBuffer, NSUInteger length);
+
+/** Get the free space in the buffer, so data can be generated directly into it.
+ 
+ Because the free space may wrap around the end of the buffer, it's described by up to two regions,
+ to be filled in order. If there's no wraparound, the second region will have a length of zero. Once 
+ you've written your data, call `SPCircularBufferCommitWrite()` to make it available to the reader.
+ 
+ The same threading rules apply as for `SPCircularBufferAcquireReadableRegions()`.
+ 
+ @param circularBuffer The buffer to write to.
+ @param regions An array of two regions, to be filled with the writable space.
+ @return Returns the total number of writable bytes described by the regions.
+ */
+extern NSUInteger SPCircularBufferAcquireWritableRegions(__unsafe_unretained SPCircularBuffer *circularBuffer, SPCircularBufferRegion regions[2]);
+
+/** Publish data written through `SPCircularBufferAcquireWritableRegions()`.
+ 
+ @param circularBuffer The buffer that was written to.
+ @param length The number of bytes written, starting from the beginning of the first region. Must not
+ be larger than the value returned by the preceding call to `SPCircularBufferAcquireWritableRegions()`.
+ */
+extern void SPCircularBufferCommitWrite(__unsafe_unretained SPCircularBuffer *circularBuffer, NSUInteger length);
+
+///----------------------------
+/// @name Stream Positions
+///----------------------------
+
+/** Returns the total number of bytes ever written to the buffer.
+ 
+ Together with `SPCircularBufferGetTotalBytesRead()`, this lets a position in the stream of data passing 
+ through the buffer be marked on the writing side and recognised on the reading side. In the
+ `SPCircularBufferModeSingleProducerSingleConsumer` mode, only call this from the writing thread.
+ 
+ @param circularBuffer The buffer to query.
+ @return Returns the number of bytes written since the buffer was created.
+ */
+extern UInt64 SPCircularBufferGetTotalBytesWritten(__unsafe_unretained SPCircularBuffer *circularBuffer);
+
+/** Returns the total number of bytes ever read from the buffer.
+ 
+ Bytes discarded by `-clear` count as read, so this always refers to the same position in the stream as 
+ `SPCircularBufferGetTotalBytesWritten()` did when that data was written. In the 
+ `SPCircularBufferModeSingleProducerSingleConsumer` mode, only call this from the reading thread, after 
+ `SPCircularBufferAcquireReadableRegions()` so that any pending clear has been applied.
+ 
+ @param circularBuffer The buffer to query.
+ @return Returns the number of bytes read or discarded since the buffer was created.
+ */
+extern UInt64 SPCircularBufferGetTotalBytesRead(__unsafe_unretained SPCircularBuffer *circularBuffer);
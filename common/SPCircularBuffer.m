@@ -31,6 +31,70 @@
  */
 
 #import "SPCircularBuffer.h"
+#import <libkern/OSAtomic.h>
+#import <unistd.h>
+#import <mach/mach.h>
+
+// The read and write cursors run over [0, 2 * maximumLength) rather than [0, maximumLength). This
+// lets us tell a full buffer from an empty one without a separate flag, which is what allows the
+// reader and writer to each own exactly one cursor in the lock-free mode.
+
+static inline NSUInteger SPCircularBufferDistance(NSUInteger from, NSUInteger to, NSUInteger maximumLength) {
+	return to >= from ? to - from : (2 * maximumLength) - from + to;
+}
+
+static inline NSUInteger SPCircularBufferAdvance(NSUInteger cursor, NSUInteger amount, NSUInteger maximumLength) {
+	cursor += amount;
+	return cursor >= 2 * maximumLength ? cursor - (2 * maximumLength) : cursor;
+}
+
+static inline NSUInteger SPCircularBufferOffset(NSUInteger cursor, NSUInteger maximumLength) {
+	return cursor >= maximumLength ? cursor - maximumLength : cursor;
+}
+
+// Mirrored storage maps the same pages twice, back to back, so that the region starting at any
+// offset in the first copy can run straight on into the second.
+
+static void *SPCircularBufferAllocateMirroredStorage(NSUInteger *ioLength) {
+	
+	NSUInteger pageSize = (NSUInteger)getpagesize();
+	NSUInteger length = ((MAX(*ioLength, 1) + pageSize - 1) / pageSize) * pageSize;
+	
+	// Another thread could grab the address range between us freeing the top half and remapping
+	// it, so retry a few times before giving up.
+	for (NSUInteger attempt = 0; attempt < 3; attempt++) {
+		
+		vm_address_t address = 0;
+		if (vm_allocate(mach_task_self(), &address, length * 2, VM_FLAGS_ANYWHERE) != KERN_SUCCESS)
+			return NULL;
+		
+		if (vm_deallocate(mach_task_self(), address + length, length) != KERN_SUCCESS) {
+			vm_deallocate(mach_task_self(), address, length * 2);
+			return NULL;
+		}
+		
+		vm_address_t mirrorAddress = address + length;
+		vm_prot_t currentProtection, maximumProtection;
+		kern_return_t result = vm_remap(mach_task_self(), &mirrorAddress, length, 0, VM_FLAGS_FIXED,
+										mach_task_self(), address, 0, &currentProtection, &maximumProtection,
+										VM_INHERIT_DEFAULT);
+		
+		if (result == KERN_SUCCESS && mirrorAddress == address + length) {
+			*ioLength = length;
+			return (void *)address;
+		}
+		
+		if (result == KERN_SUCCESS)
+			vm_deallocate(mach_task_self(), mirrorAddress, length);
+		vm_deallocate(mach_task_self(), address, length);
+	}
+	
+	return NULL;
+}
+
+static void SPCircularBufferFreeMirroredStorage(void *storage, NSUInteger length) {
+	vm_deallocate(mach_task_self(), (vm_address_t)storage, length * 2);
+}
 
 @implementation SPCircularBuffer
 
@@ -39,123 +103,344 @@
 }
 
 -(id)initWithMaximumLength:(NSUInteger)size {
+	return [self initWithMaximumLength:size mode:SPCircularBufferModeLocking];
+}
+
+-(id)initWithMaximumLength:(NSUInteger)size mode:(SPCircularBufferMode)aMode {
+	return [self initWithMaximumLength:size mode:aMode mirrored:NO];
+}
+
+-(id)initWithMaximumLength:(NSUInteger)size mode:(SPCircularBufferMode)aMode mirrored:(BOOL)shouldMirror {
 	self = [super init];
     if (self) {
         // Initialization code here.
-		buffer = malloc(size);
 		maximumLength = size;
-		[self clear];
+		mode = aMode;
+		
+		if (shouldMirror) {
+			buffer = SPCircularBufferAllocateMirroredStorage(&maximumLength);
+			mirrored = (buffer != NULL);
+		}
+		
+		if (buffer == NULL) {
+			maximumLength = size;
+			buffer = malloc(size);
+		}
+		
+		memset(buffer, 0, maximumLength);
     }
     
     return self;
 }
 
 -(void)clear {
+	
+	if (mode == SPCircularBufferModeSingleProducerSingleConsumer) {
+		// We can't touch the read cursor from here, so leave a note for the reader
+		// to skip everything that's been written so far.
+		discardCursor = writeCursor;
+		OSAtomicIncrement32Barrier(&clearRequestCount);
+		return;
+	}
+	
 	@synchronized(self) {
 		memset(buffer, 0, maximumLength);
-		dataStartOffset = 0;
-		dataEndOffset = 0;
-		empty = YES;
+		readCursor = 0;
+		writeCursor = 0;
+		totalBytesRead = totalBytesWritten;
+	}
+}
+
+static inline void SPCircularBufferApplyPendingClear(__unsafe_unretained SPCircularBuffer *self) {
+	
+	int32_t requestCount = self->clearRequestCount;
+	if (requestCount == self->clearAppliedCount)
+		return;
+	
+	OSMemoryBarrier();
+	NSUInteger discard = self->discardCursor;
+	NSUInteger write = self->writeCursor;
+	NSUInteger read = self->readCursor;
+	
+	// Only ever skip forwards — if we've already read past the discard point, there's nothing to do.
+	NSUInteger discardLength = SPCircularBufferDistance(read, discard, self->maximumLength);
+	if (discardLength <= SPCircularBufferDistance(read, write, self->maximumLength)) {
+		OSMemoryBarrier();
+		self->readCursor = discard;
+		self->totalBytesRead += discardLength;
 	}
+	
+	self->clearAppliedCount = requestCount;
 }
 
 -(NSUInteger)attemptAppendData:(const void *)data ofLength:(NSUInteger)dataLength {
 	return [self attemptAppendData:data ofLength:dataLength chunkSize:1];
 }
 
+static NSUInteger SPCircularBufferGetWritableRegions(__unsafe_unretained SPCircularBuffer *self, SPCircularBufferRegion regions[2]) {
+	
+	NSUInteger read = self->readCursor;
+	OSMemoryBarrier();
+	NSUInteger write = self->writeCursor;
+	
+	NSUInteger availableBufferSpace = self->maximumLength - SPCircularBufferDistance(read, write, self->maximumLength);
+	NSUInteger writeOffset = SPCircularBufferOffset(write, self->maximumLength);
+	
+	regions[0].data = self->buffer + writeOffset;
+	regions[0].length = self->mirrored ? availableBufferSpace : MIN(availableBufferSpace, self->maximumLength - writeOffset);
+	regions[1].data = self->buffer;
+	regions[1].length = availableBufferSpace - regions[0].length;
+	
+	return availableBufferSpace;
+}
+
+static void SPCircularBufferPublishWrite(__unsafe_unretained SPCircularBuffer *self, NSUInteger length) {
+	// Make sure the data is visible before the reader can see the new write position.
+	OSMemoryBarrier();
+	self->writeCursor = SPCircularBufferAdvance(self->writeCursor, length, self->maximumLength);
+	self->totalBytesWritten += length;
+}
+
+static NSUInteger SPCircularBufferAppendData(__unsafe_unretained SPCircularBuffer *self, const void *data, NSUInteger dataLength, NSUInteger chunkSize) {
+	
+	SPCircularBufferRegion regions[2];
+	NSUInteger availableBufferSpace = SPCircularBufferGetWritableRegions(self, regions);
+	if (chunkSize == 0) chunkSize = 1;
+	
+	// chunkSize is the minimum amount of data we can copy in
+	if (availableBufferSpace < chunkSize)
+		return 0;
+	
+	// First make sure we have a data length that fits into the buffer
+	NSUInteger writableByteCount = MIN(dataLength, availableBufferSpace);
+	// ...that also fits into our chunkSize
+	writableByteCount -= (writableByteCount % chunkSize);
+	
+	NSUInteger directCopyByteCount = MIN(writableByteCount, regions[0].length);
+	NSUInteger wraparoundByteCount = writableByteCount - directCopyByteCount;
+	
+	if (directCopyByteCount > 0)
+		memcpy(regions[0].data, data, directCopyByteCount);
+	
+	if (wraparoundByteCount > 0)
+		memcpy(regions[1].data, data + directCopyByteCount, wraparoundByteCount);
+	
+	SPCircularBufferPublishWrite(self, writableByteCount);
+	return writableByteCount;
+}
+
 -(NSUInteger)attemptAppendData:(const void *)data ofLength:(NSUInteger)dataLength chunkSize:(NSUInteger)chunkSize {
 
+	if (mode == SPCircularBufferModeSingleProducerSingleConsumer)
+		return SPCircularBufferAppendData(self, data, dataLength, chunkSize);
+	
 	@synchronized(self) {
+		return SPCircularBufferAppendData(self, data, dataLength, chunkSize);
+	}
+}
 
-		NSUInteger availableBufferSpace = self.maximumLength - self.length;
-		if (chunkSize == 0) chunkSize = 1;
+static NSUInteger SPCircularBufferGetReadableRegions(__unsafe_unretained SPCircularBuffer *self, SPCircularBufferRegion regions[2]) {
+	
+	SPCircularBufferApplyPendingClear(self);
+	
+	NSUInteger write = self->writeCursor;
+	OSMemoryBarrier();
+	NSUInteger read = self->readCursor;
+	
+	NSUInteger usedBufferSpace = SPCircularBufferDistance(read, write, self->maximumLength);
+	NSUInteger readOffset = SPCircularBufferOffset(read, self->maximumLength);
+	
+	regions[0].data = self->buffer + readOffset;
+	regions[0].length = self->mirrored ? usedBufferSpace : MIN(usedBufferSpace, self->maximumLength - readOffset);
+	regions[1].data = self->buffer;
+	regions[1].length = usedBufferSpace - regions[0].length;
+	
+	return usedBufferSpace;
+}
 
-		// chunkSize is the minimum amount of data we can copy in
-		if (availableBufferSpace < chunkSize)
-			return 0;
+static void SPCircularBufferPublishRead(__unsafe_unretained SPCircularBuffer *self, NSUInteger length) {
+	// Make sure we're done with the data before the writer can see the space as free.
+	OSMemoryBarrier();
+	self->readCursor = SPCircularBufferAdvance(self->readCursor, length, self->maximumLength);
+	self->totalBytesRead += length;
+}
 
-		// First make sure we have a data length that fits into the buffer
-		NSUInteger writableByteCount = MIN(dataLength, availableBufferSpace);
-		// ...that also fits into our chunkSize
-		writableByteCount -= (writableByteCount % chunkSize);
+static NSUInteger SPCircularBufferCopyOut(__unsafe_unretained SPCircularBuffer *self, void *destinationBuffer, NSUInteger desiredLength) {
+	
+	SPCircularBufferRegion regions[2];
+	NSUInteger usedBufferSpace = SPCircularBufferGetReadableRegions(self, regions);
+	if (usedBufferSpace == 0)
+		return 0;
+	
+	NSUInteger readableByteCount = MIN(usedBufferSpace, desiredLength);
+	NSUInteger directCopyByteCount = MIN(readableByteCount, regions[0].length);
+	NSUInteger wraparoundByteCount = readableByteCount - directCopyByteCount;
+	
+	if (directCopyByteCount > 0)
+		memcpy(destinationBuffer, regions[0].data, directCopyByteCount);
+	
+	if (wraparoundByteCount > 0)
+		memcpy(destinationBuffer + directCopyByteCount, regions[1].data, wraparoundByteCount);
+	
+	SPCircularBufferPublishRead(self, readableByteCount);
+	return readableByteCount;
+}
 
-		NSUInteger directCopyByteCount = MIN(writableByteCount, self.maximumLength - (empty ? 0 : dataEndOffset + 1));
-		NSUInteger wraparoundByteCount = writableByteCount - directCopyByteCount;
-		
-		if (directCopyByteCount > 0) {
-			void *writePtr = buffer + (empty ? 0 : dataEndOffset + 1);
-			memcpy(writePtr, data, directCopyByteCount);
-			dataEndOffset += (empty ? directCopyByteCount - 1 : directCopyByteCount);
-		}
-		
-		if (wraparoundByteCount > 0) {
-			memcpy(buffer, data + directCopyByteCount, wraparoundByteCount);
-			dataEndOffset = wraparoundByteCount - 1;
-		}
-		
-		if (writableByteCount > 0)
-			empty = NO;
-		
-		return writableByteCount;
+NSUInteger SPCircularBufferReadData(__unsafe_unretained SPCircularBuffer *circularBuffer, void *outBuffer, NSUInteger desiredLength) {
+	
+	if (circularBuffer == nil || outBuffer == NULL || desiredLength == 0)
+		return 0;
+	
+	if (circularBuffer->mode == SPCircularBufferModeSingleProducerSingleConsumer)
+		return SPCircularBufferCopyOut(circularBuffer, outBuffer, desiredLength);
+	
+	@synchronized(circularBuffer) {
+		return SPCircularBufferCopyOut(circularBuffer, outBuffer, desiredLength);
 	}
 }
 
 -(NSUInteger)readDataOfLength:(NSUInteger)desiredLength intoAllocatedBuffer:(void **)outBuffer {
 	
-	if (outBuffer == NULL || desiredLength == 0)
+	if (outBuffer == NULL)
 		return 0;
 	
-    NSUInteger usedBufferSpace = self.length;
-    
-	@synchronized(self) {
-		
-		if (usedBufferSpace == 0) {
-			return 0;
-		}
-		
-		NSUInteger readableByteCount = MIN(usedBufferSpace, desiredLength);
-		NSUInteger directCopyByteCount = MIN(readableByteCount, self.maximumLength - dataStartOffset);
-		NSUInteger wraparoundByteCount = readableByteCount - directCopyByteCount;
-		
-		void *destinationBuffer = *outBuffer;
-		
-		if (directCopyByteCount > 0) {
-			memcpy(destinationBuffer, buffer + dataStartOffset, directCopyByteCount);
-			dataStartOffset += directCopyByteCount;
-		}
-		
-		if (wraparoundByteCount > 0) {
-			memcpy(destinationBuffer + directCopyByteCount, buffer, wraparoundByteCount);
-			dataStartOffset = wraparoundByteCount;
-		}
-		
-		return readableByteCount;
+	return SPCircularBufferReadData(self, *outBuffer, desiredLength);
+}
+
+static NSUInteger SPCircularBufferUsedLength(__unsafe_unretained SPCircularBuffer *self) {
+	
+	NSUInteger write = self->writeCursor;
+	OSMemoryBarrier();
+	NSUInteger read = self->readCursor;
+	
+	if (self->clearRequestCount != self->clearAppliedCount) {
+		// A clear is waiting for the reader. Report the length as if it's already happened.
+		OSMemoryBarrier();
+		NSUInteger discard = self->discardCursor;
+		if (SPCircularBufferDistance(read, discard, self->maximumLength) <= SPCircularBufferDistance(read, write, self->maximumLength))
+			read = discard;
 	}
 	
+	return SPCircularBufferDistance(read, write, self->maximumLength);
+}
+
+NSUInteger SPCircularBufferGetLength(__unsafe_unretained SPCircularBuffer *circularBuffer) {
+	
+	if (circularBuffer == nil)
+		return 0;
+	
+	if (circularBuffer->mode == SPCircularBufferModeSingleProducerSingleConsumer)
+		return SPCircularBufferUsedLength(circularBuffer);
+	
+	@synchronized(circularBuffer) {
+		return SPCircularBufferUsedLength(circularBuffer);
+	}
 }
 
 -(NSUInteger)length {
-	// Length is the distance between the start offset (start of the data)
-	// and the end offset (end).
-	@synchronized(self) {
-		if (dataStartOffset == dataEndOffset) {
-			// Empty!
-			return 0;
-		} else if (dataEndOffset > dataStartOffset) {
-			return (dataEndOffset - dataStartOffset) + 1;
-		} else {
-			return (maximumLength - dataStartOffset) + dataEndOffset + 1;
-		}
+	return SPCircularBufferGetLength(self);
+}
+
+#pragma mark - Zero-Copy Access
+
+NSUInteger SPCircularBufferAcquireReadableRegions(__unsafe_unretained SPCircularBuffer *circularBuffer, SPCircularBufferRegion regions[2]) {
+	
+	if (circularBuffer == nil) {
+		memset(regions, 0, sizeof(SPCircularBufferRegion) * 2);
+		return 0;
+	}
+	
+	if (circularBuffer->mode == SPCircularBufferModeSingleProducerSingleConsumer)
+		return SPCircularBufferGetReadableRegions(circularBuffer, regions);
+	
+	@synchronized(circularBuffer) {
+		return SPCircularBufferGetReadableRegions(circularBuffer, regions);
+	}
+}
+
+void SPCircularBufferCommitRead(__unsafe_unretained SPCircularBuffer *circularBuffer, NSUInteger length) {
+	
+	if (circularBuffer == nil || length == 0)
+		return;
+	
+	if (circularBuffer->mode == SPCircularBufferModeSingleProducerSingleConsumer) {
+		SPCircularBufferPublishRead(circularBuffer, length);
+		return;
+	}
+	
+	@synchronized(circularBuffer) {
+		SPCircularBufferPublishRead(circularBuffer, length);
+	}
+}
+
+NSUInteger SPCircularBufferAcquireWritableRegions(__unsafe_unretained SPCircularBuffer *circularBuffer, SPCircularBufferRegion regions[2]) {
+	
+	if (circularBuffer == nil) {
+		memset(regions, 0, sizeof(SPCircularBufferRegion) * 2);
+		return 0;
+	}
+	
+	if (circularBuffer->mode == SPCircularBufferModeSingleProducerSingleConsumer)
+		return SPCircularBufferGetWritableRegions(circularBuffer, regions);
+	
+	@synchronized(circularBuffer) {
+		return SPCircularBufferGetWritableRegions(circularBuffer, regions);
+	}
+}
+
+void SPCircularBufferCommitWrite(__unsafe_unretained SPCircularBuffer *circularBuffer, NSUInteger length) {
+	
+	if (circularBuffer == nil || length == 0)
+		return;
+	
+	if (circularBuffer->mode == SPCircularBufferModeSingleProducerSingleConsumer) {
+		SPCircularBufferPublishWrite(circularBuffer, length);
+		return;
+	}
+	
+	@synchronized(circularBuffer) {
+		SPCircularBufferPublishWrite(circularBuffer, length);
+	}
+}
+
+#pragma mark - Stream Positions
+
+UInt64 SPCircularBufferGetTotalBytesWritten(__unsafe_unretained SPCircularBuffer *circularBuffer) {
+	
+	if (circularBuffer == nil)
+		return 0;
+	
+	if (circularBuffer->mode == SPCircularBufferModeSingleProducerSingleConsumer)
+		return circularBuffer->totalBytesWritten;
+	
+	@synchronized(circularBuffer) {
+		return circularBuffer->totalBytesWritten;
+	}
+}
+
+UInt64 SPCircularBufferGetTotalBytesRead(__unsafe_unretained SPCircularBuffer *circularBuffer) {
+	
+	if (circularBuffer == nil)
+		return 0;
+	
+	if (circularBuffer->mode == SPCircularBufferModeSingleProducerSingleConsumer)
+		return circularBuffer->totalBytesRead;
+	
+	@synchronized(circularBuffer) {
+		return circularBuffer->totalBytesRead;
 	}
 }
 
 @synthesize maximumLength;
+@synthesize mode;
+@synthesize mirrored;
 
 - (void)dealloc {
-	@synchronized(self) {
-		memset(buffer, 0, maximumLength);
+	memset(buffer, 0, maximumLength);
+	if (mirrored)
+		SPCircularBufferFreeMirroredStorage(buffer, maximumLength);
+	else
 		free(buffer);
-	}
 }
 
 @end
@@ -41,6 +41,17 @@ typedef void (^SPErrorableOperationCallback)(NSError *error);
  */
 extern inline void SPDispatchSyncIfNeeded(dispatch_block_t block);
 
+/** Call the given block synchronously on the libSpotify thread and return its result.
+
+ This is SPDispatchSyncIfNeeded() for blocks that produce a value, saving the
+ `__block` variable otherwise needed to get the value back to the calling thread.
+ The block is called inline if you're already on the libSpotify thread.
+
+ @param block The block to execute.
+ @return The value returned by `block`.
+ */
+extern id SPDispatchSyncReturning(id (^block)(void));
+
 /** Call the given block asynchronously on the libSpotify thread.
 
  This helper allows you to perform asynchronous operations on the libSpotify thread.
@@ -49,6 +60,39 @@ extern inline void SPDispatchSyncIfNeeded(dispatch_block_t block);
  */
 extern inline void SPDispatchAsync(dispatch_block_t block);
 
+/** The priority of work queued for the libSpotify thread. */
+typedef enum SPDispatchPriority {
+	SPDispatchPriorityBackground = 0, /* Run in the order queued, after any interactive work. The default. */
+	SPDispatchPriorityInteractive = 1 /* Run in the order queued, as soon as the block already running finishes. */
+} SPDispatchPriority;
+
+/** Call the given block asynchronously on the libSpotify thread with the given priority.
+
+ Interactive work, such as controlling playback, runs ahead of any background work that hasn't
+ started yet, so it waits at most for the block already running. Blocks of the same priority run
+ in the order they were queued, but interactive blocks may overtake background blocks queued before them.
+
+ @param priority The priority to queue the block with.
+ @param block The block to execute.
+ */
+extern void SPDispatchAsyncWithPriority(SPDispatchPriority priority, dispatch_block_t block);
+
+/** Call the given block asynchronously on the libSpotify thread, once per target and key.
+ 
+ If work for the same target and key is already waiting to run, the block replaces that work's block
+ and runs in its place in the queue instead of being queued again. Once the work has started,
+ the next call queues it again.
+ 
+ The target is only held weakly while the work is pending, and the work is dropped if the target is
+ deallocated before it runs. For this to happen the block should use the target it's passed, rather than
+ capturing the target itself.
+ 
+ @param target The object the work is for.
+ @param key A unique pointer identifying the work, such as `_cmd` or the address of a static variable.
+ @param block The block to execute. Its parameter is the target.
+ */
+extern void SPDispatchAsyncCoalesced(id target, const void *key, void (^block)(id target));
+
 /** Throw an assertion if the current execution is not on the libSpotify thread.
 
  This helper macro assists debugging operations on the libSpotify thread.
@@ -30,17 +30,40 @@
  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-// This class encapsulates a Core Audio graph that includes
-// an audio format converter, a mixer for iOS volume control and a standard output.
+// This class takes audio from CocoaLibSpotify, buffers it, applies the volume and hands it to an
+// output sink. By default that's a Core Audio graph that includes an audio format converter
+// and a standard output. Sinks don't need Core Audio, but this class does, so it's Apple-only.
 // Clients just need to set the various properties and not worry about the details.
 
 #import <Foundation/Foundation.h>
 #import "CocoaLibSpotifyPlatformImports.h"
 #import "SPSession.h"
 #import <AudioToolbox/AudioToolbox.h>
+#import "SPAudioOutputSink.h"
+#import "SPAUGraphOutputSink.h"
 
 @class SPCoreAudioController;
 
+/** The shapes of curve SPCoreAudioController can crossfade between tracks with. */
+typedef enum SPCoreAudioControllerCrossfadeCurve {
+	SPCoreAudioControllerCrossfadeCurveEqualPower = 0, /* Keeps loudness even through the fade. Suits unrelated tracks. */
+	SPCoreAudioControllerCrossfadeCurveLinear /* Keeps the summed level even through the fade. Suits tracks that are already similar, such as a continuous mix. */
+} SPCoreAudioControllerCrossfadeCurve;
+
+/** Statistics about how long SPCoreAudioController's render callback takes to run. 
+ 
+ Durations are measured into buckets about a fifth wide, and each percentile is reported as the top of 
+ its bucket, so they're an upper bound.
+ */
+typedef struct SPCoreAudioControllerRenderTiming {
+	NSUInteger callbackCount; /* The number of render callbacks measured. */
+	NSUInteger overrunCount; /* The number of callbacks that took longer than the audio they were asked for lasts. */
+	NSTimeInterval medianDuration; /* Half of all callbacks took at most this long, in seconds. */
+	NSTimeInterval ninetiethPercentileDuration; /* 90% of all callbacks took at most this long, in seconds. */
+	NSTimeInterval ninetyNinthPercentileDuration; /* 99% of all callbacks took at most this long, in seconds. */
+	NSTimeInterval maximumDuration; /* The longest any callback took, in seconds. */
+} SPCoreAudioControllerRenderTiming;
+
 /** Provides delegate callbacks for SPCoreAudioController. */
 
 @protocol SPCoreAudioControllerDelegate <NSObject>
@@ -48,16 +71,45 @@
 /** Called repeatedly during audio playback when audio is pushed to the system's audio output.
  
  This can be used to keep track of how much audio has been played back for progress indicators and so on.
+ It's called on the `callbackSession`'s callback queue, every `outputNotificationInterval` seconds during playback
+ and once more when output stops. The durations add up exactly to the audio that has been output.
  
  @param controller The SPCoreAudioController that pushed audio.
  */
 -(void)coreAudioController:(SPCoreAudioController *)controller didOutputAudioOfDuration:(NSTimeInterval)audioDuration;
 
+@optional
+
+/** Called when the end of a track has been pushed to the system's audio output.
+ 
+ Any audio output after this point belongs to the next track loaded into the session, if there is one.
+ All audio before the boundary will have been reported through `-coreAudioController:didOutputAudioOfDuration:` 
+ by the time this is called.
+ 
+ @param controller The SPCoreAudioController that reached the end of the track.
+ @param outputTime The receiver's `outputTime` at the moment the boundary was heard.
+ */
+-(void)coreAudioController:(SPCoreAudioController *)controller didOutputTrackBoundaryAtTime:(NSTimeInterval)outputTime;
+
 @end
 
 /** Provides an audio pipeline from CocoaLibSpotify to the system's audio output. */
 
-@interface SPCoreAudioController : NSObject <SPSessionAudioDeliveryDelegate>
+@interface SPCoreAudioController : NSObject <SPSessionAudioDeliveryDelegate, SPAUGraphOutputSinkDelegate>
+
+///----------------------------
+/// @name Initializing
+///----------------------------
+
+/**
+ Initializes a controller that outputs audio through the given sink.
+ 
+ The `init` method uses an SPAUGraphOutputSink, which plays audio through the system's audio output.
+ 
+ @param aSink The sink to output audio through.
+ @return Returns the initialized controller.
+ */
+-(id)initWithOutputSink:(id <SPAudioOutputSink>)aSink;
 
 ///----------------------------
 /// @name Control
@@ -81,7 +133,8 @@
  If you wish to customise the audio pipeline, you can do so by overriding this method and inserting your 
  own `AUNode` instances between `sourceNode` and `destinationNode`.
  
- This method will be called whenever the audio pipeline needs to be (re)built.
+ This method will be called whenever the audio pipeline needs to be (re)built. It's only
+ used when the receiver is outputting audio through an SPAUGraphOutputSink.
 
  @warning If you override this method and connect the nodes yourself, do not call the `super`
  implementation. You can, however, conditionally decide whether to customise the queue and call `super`
@@ -123,7 +176,123 @@
 /** Whether audio output is enabled. */
 @property (readwrite, nonatomic) BOOL audioOutputEnabled;
 
+/** Returns the number of track endings that have been buffered but not yet output.
+ 
+ While this is non-zero, the receiver still has audio to play from a track that the session
+ has finished delivering.
+ */
+@property (readonly) NSUInteger pendingTrackBoundaryCount;
+
+/** Returns the sink the receiver outputs audio through. */
+@property (readonly, strong, nonatomic) id <SPAudioOutputSink> outputSink;
+
 /** Returns the receiver's delegate. */
 @property (readwrite, nonatomic, assign) __unsafe_unretained id <SPCoreAudioControllerDelegate> delegate;
 
+/** Returns the session whose `callbackQueue` the receiver's delegate messages and KVO notifications are delivered on.
+ 
+ If this is `nil`, they're delivered on the main queue. SPPlaybackManager sets this to its playback session.
+ */
+@property (readwrite, assign) __unsafe_unretained SPSession *callbackSession;
+
+///----------------------------
+/// @name Playback Clock
+///----------------------------
+
+/** Returns the number of frames of audio the receiver has output since it was created. 
+ 
+ This is safe to read from any thread.
+ */
+@property (readonly) UInt64 renderedFrameCount;
+
+/** Returns the duration of audio, in seconds, the receiver has output since it was created.
+ 
+ This is interpolated between render cycles using the output's timestamps, so it advances smoothly
+ and is accurate to the moment it's read. It's safe to read from any thread.
+ */
+@property (readonly) NSTimeInterval outputTime;
+
+/** Returns how often, in seconds, the delegate is told about audio output during playback. Defaults to `0.2`. */
+@property (readwrite) NSTimeInterval outputNotificationInterval;
+
+///----------------------------
+/// @name Crossfading
+///----------------------------
+
+/**
+ Returns the duration, in seconds, that consecutive tracks overlap for. Defaults to `0.0`, which plays tracks gaplessly.
+ 
+ The end of each track is faded out while the start of the next is faded in, and the two are mixed together.
+ Crossfading needs the next track to be loaded into the session as soon as the current one finishes delivering,
+ as SPPlaybackManager does for its queue, and only works with 16-bit audio. 
+ 
+ The end of a track has to stay buffered until it's crossfaded, so the receiver buffers this much more audio 
+ than it otherwise would. Audio buffers are sized for it when they're created for a new audio format, so
+ raising it only takes full effect from the next format change.
+ */
+@property (readwrite) NSTimeInterval crossfadeDuration;
+
+/** Returns the shape of the curve tracks are crossfaded with. Defaults to `SPCoreAudioControllerCrossfadeCurveEqualPower`. */
+@property (readwrite) SPCoreAudioControllerCrossfadeCurve crossfadeCurve;
+
+///----------------------------
+/// @name Render Timing
+///----------------------------
+
+/**
+ Whether the receiver measures how long its render callback takes. Defaults to `NO`.
+ 
+ This is a debugging aid for finding out whether audio glitches are caused by the render callback
+ missing its deadline, which is the duration of the audio it's asked for. Turning it on resets the 
+ statistics in `renderTiming`, and any callback that misses its deadline is logged to the console. 
+ Measuring adds a small amount of work to every callback, so leave it off in production.
+ */
+@property (readwrite, nonatomic) BOOL measuresRenderTiming;
+
+/** Returns statistics about the render callback since `measuresRenderTiming` was turned on or `-resetRenderTiming` was called. */
+@property (readonly) SPCoreAudioControllerRenderTiming renderTiming;
+
+/** Discards the statistics collected so far in `renderTiming`. */
+-(void)resetRenderTiming;
+
+///----------------------------
+/// @name Buffering
+///----------------------------
+
+/**
+ Returns the least amount of audio, in seconds, the receiver will aim to keep buffered. Defaults to `0.25`.
+ 
+ The receiver adjusts the amount of audio it buffers between this value and `maximumBufferDuration`,
+ growing it when playback runs out of audio and shrinking it when audio is arriving comfortably ahead of playback.
+ */
+@property (readwrite) NSTimeInterval minimumBufferDuration;
+
+/**
+ Returns the most audio, in seconds, the receiver will buffer. Defaults to `3.0`.
+ 
+ Audio buffers are sized to this value when they're created for a new audio format, so
+ raising it only takes effect from the next format change.
+ */
+@property (readwrite) NSTimeInterval maximumBufferDuration;
+
+/** Returns the amount of audio, in seconds, the receiver is currently aiming to keep buffered.
+ 
+ Changes are made, and KVO notifications sent, on the `callbackSession`'s callback queue.
+ */
+@property (readonly) NSTimeInterval targetBufferDuration;
+
+/** Returns the number of times playback has run out of buffered audio.
+ 
+ Changes are made, and KVO notifications sent, on the `callbackSession`'s callback queue.
+ */
+@property (readonly) NSUInteger underrunCount;
+
+/**
+ Returns whether audio buffers are backed by mirrored memory where it's available. Defaults to `YES`.
+ 
+ Mirrored buffers let audio that wraps around the end of the buffer be read without copying it. Changes
+ take effect from the next format change.
+ */
+@property (readwrite) BOOL usesMirroredBuffers;
+
 @end
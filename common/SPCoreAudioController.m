@@ -8,11 +8,15 @@
 
 #import "SPCoreAudioController.h"
 #import "SPCircularBuffer.h"
+#import "SPAUGraphOutputSink.h"
+#import "SPAudioKernels.h"
+#import "SPSessionInternal.h"
 
-#import <AudioUnit/AudioUnit.h>
+#import <libkern/OSAtomic.h>
+#include <math.h>
+#include <mach/mach_time.h>
 
 #if TARGET_OS_IPHONE
-#import <AVFoundation/AVFoundation.h>
 #import <CoreAudio/CoreAudioTypes.h>
 #import "CocoaLibSpotify.h"
 #else
@@ -22,58 +26,231 @@
 
 @interface SPCoreAudioController ()
 
-// Core Audio
--(BOOL)setupCoreAudioWithInputFormat:(AudioStreamBasicDescription)inputFormat error:(NSError **)err;
--(void)teardownCoreAudio;
--(void)startAudioQueue;
--(void)stopAudioQueue;
--(void)applyVolumeToMixerAudioUnit:(double)vol;
--(void)applyAudioStreamDescriptionToInputUnit:(AudioStreamBasicDescription)newInputDescription;
+// Output
+-(BOOL)prepareOutputSinkWithInputFormat:(AudioStreamBasicDescription)inputFormat error:(NSError **)err;
+-(BOOL)applyInputAudioDescription:(AudioStreamBasicDescription)newInputDescription error:(NSError **)err;
+
+// Track Boundaries
+-(void)markTrackBoundary;
+-(NSUInteger)unplayedTrackBoundaryCount;
+-(BOOL)prepareMixBuffers;
+-(BOOL)prepareCrossfadeBuffers;
+-(void)invalidateBufferedAudio;
+
+// Playback Clock
+-(void)startOutputNotifications;
+-(void)stopOutputNotifications;
+-(void)notifyDelegateOfOutputProgress;
+-(void)logRenderOverruns;
 
 @property (readwrite, nonatomic) AudioStreamBasicDescription inputAudioDescription;
 
-static OSStatus AudioUnitRenderDelegateCallback(void *inRefCon,
-												AudioUnitRenderActionFlags *ioActionFlags,
-												const AudioTimeStamp *inTimeStamp,
-												UInt32 inBusNumber,
-												UInt32 inNumberFrames,
-												AudioBufferList *ioData);
+static BOOL SPCoreAudioControllerRenderCallback(void *context, uint32_t frameCount, uint64_t hostTime, void **ioData);
+static void fillWithError(NSError **mayBeAnError, NSString *localizedDescription, int code);
 
 @property (readwrite, strong, nonatomic) SPCircularBuffer *audioBuffer;
+@property (readwrite, strong, nonatomic) id <SPAudioOutputSink> outputSink;
+@property (readwrite) NSTimeInterval targetBufferDuration;
+@property (readwrite) NSUInteger underrunCount;
+
+-(NSUInteger)bufferSpaceBelowTargetForDescription:(AudioStreamBasicDescription)audioDescription;
+-(void)adaptBufferTargetAfterDeliveryWasSaturated:(BOOL)saturated;
 
 @end
 
 static NSTimeInterval const kTargetBufferLength = 0.5;
+static NSTimeInterval const kDefaultMinimumBufferLength = 0.25;
+static NSTimeInterval const kDefaultMaximumBufferLength = 3.0;
+
+// On an underrun the target grows quickly. It only shrinks back after libspotify has spent a good
+// while bumping against it, since it retries every few hundred milliseconds once we start refusing audio.
+static double const kBufferTargetGrowthFactor = 1.5;
+static double const kBufferTargetShrinkFactor = 0.9;
+static NSUInteger const kSaturatedDeliveriesBeforeShrink = 50;
+static NSTimeInterval const kMinimumIntervalBetweenShrinks = 30.0;
+
+static int32_t const kMaximumPendingTrackBoundaries = 8;
+
+static NSTimeInterval const kDefaultOutputNotificationInterval = 0.2;
+
+// Crossfades are mixed in scratch buffers sized for this many frames per render.
+static UInt32 const kMaximumCrossfadeSliceFrames = 4096;
+static UInt32 const kMaximumCrossfadeChannelCount = 8;
+
+// Render callback durations are counted exactly below 8ns, then in four buckets for
+// each power of two nanoseconds, up to about four seconds.
+#define kRenderTimingBucketCount 128
+static int32_t const kMaximumPendingRenderOverruns = 16;
+
+// A position in the audio buffer's stream at which one track ends and the next begins.
+typedef struct SPCoreAudioControllerTrackBoundary {
+	UInt64 position; /* The buffer's total bytes written when the track ended. */
+	int32_t generation; /* The value of trackBoundaryGeneration when the boundary was marked. */
+	int32_t clearCount; /* The value of bufferClearCount when the boundary was marked. */
+	BOOL played; /* Set by the render thread if the boundary was output rather than cleared. */
+	NSTimeInterval outputTime; /* The output time at which the boundary was heard. */
+	__unsafe_unretained SPCircularBuffer *buffer; /* The buffer the ending track is in. */
+	__unsafe_unretained SPCircularBuffer *nextBuffer; /* The buffer the next track is in. The same as buffer unless crossfading. */
+	UInt64 nextStartPosition; /* The next buffer's total bytes written when the next track started. */
+	UInt64 crossfadeLength; /* The length of the crossfade, in bytes of each track. */
+	SPCoreAudioControllerCrossfadeCurve crossfadeCurve;
+} SPCoreAudioControllerTrackBoundary;
+
+typedef struct SPCoreAudioControllerRenderOverrun {
+	UInt32 duration; /* How long the render callback took, in nanoseconds. */
+	UInt32 deadline; /* How long the audio it rendered lasts, in nanoseconds. */
+	NSTimeInterval outputTime; /* The output time at the start of the audio it rendered. */
+} SPCoreAudioControllerRenderOverrun;
+
+static BOOL SPCoreAudioControllerCanCrossfadeFormat(AudioStreamBasicDescription format) {
+	return format.mFormatID == kAudioFormatLinearPCM &&
+		(format.mFormatFlags & kAudioFormatFlagIsSignedInteger) &&
+		!(format.mFormatFlags & kAudioFormatFlagIsNonInterleaved) &&
+		(format.mFormatFlags & kAudioFormatFlagIsBigEndian) == (kAudioFormatFlagsNativeEndian & kAudioFormatFlagIsBigEndian) &&
+		format.mBitsPerChannel == 16 &&
+		format.mChannelsPerFrame > 0 && format.mChannelsPerFrame <= kMaximumCrossfadeChannelCount;
+}
+
+// Looked up when the first controller is created rather than on first use, which may be on the render thread.
+static mach_timebase_info_data_t hostTimebase;
+
+static UInt64 SPCoreAudioControllerCurrentHostTime(void) {
+	return (mach_absolute_time() * hostTimebase.numer) / hostTimebase.denom;
+}
 
 @implementation SPCoreAudioController {
 	
-	AUGraph audioProcessingGraph;
-	AudioUnit outputUnit;
-	AudioUnit mixerUnit;
-	AudioUnit inputConverterUnit;
+	// The render callback runs on a real-time thread. It only reads and writes the plain C 
+	// state below: it never sends messages, takes locks or allocates memory, and any object
+	// it touches is kept alive by another thread.
+	
+	// Cached for the render callback.
+	UInt32 renderBytesPerFrame;
+	UInt32 renderChannelCount;
+	volatile Float64 renderSampleRate;
+	
+	// When crossfading, each track goes into the opposite buffer to the one before it so the
+	// end of one and the start of the next can be read at the same time. audioBuffer is always
+	// the buffer the session is delivering into.
+	SPCircularBuffer *alternateAudioBuffer;
+	
+	// Held by the threads that clear, swap or replace the buffers above. The render thread never
+	// takes it: it only picks up a replacement after seeing trackBoundaryGeneration change.
+	OSSpinLock bufferLock;
+	
+	// The render callback reads from the buffers without retaining them, so when they're
+	// replaced we keep the old ones alive until the render thread has moved on to the new ones.
+	NSMutableArray *retiredAudioBuffers;
+	
+	// Only touched on the render thread, apart from being allocated before first use.
+	__unsafe_unretained SPCircularBuffer *renderAudioBuffer;
+	volatile int32_t renderBufferGeneration; /* Also read when retiring buffers. */
+	BOOL renderCrossfadeStarted;
+	NSTimeInterval renderCrossfadeStartTime;
+	__unsafe_unretained SPCircularBuffer *renderFadeInBuffer;
+	UInt64 renderFadeInStartPosition;
+	UInt64 renderFadeInLength;
+	SPCoreAudioControllerCrossfadeCurve renderFadeInCurve;
+	float *renderMixScratch;
+	float *renderMixIncomingScratch;
+	SInt16 *renderMixOutput;
+	BOOL renderCanApplyGain; /* Set with the other cached format details. */
+	float renderGain; /* The gain the last slice ended at. */
+	volatile float renderTargetGain; /* Set from the volume on any thread. */
+	
+	// When the data for a render fits in one contiguous region of the buffer, we give Core Audio 
+	// a pointer straight into the buffer and only release the region on the next render.
+	__unsafe_unretained SPCircularBuffer *pendingReadCommitBuffer;
+	NSUInteger pendingReadCommitLength;
 	
-	AUNode outputNode;
-	AUNode inputConverterNode;
-	AUNode mixerNode;
+	// Written on the render thread, read on the audio delivery thread.
+	volatile int32_t renderUnderrunCount;
+	volatile BOOL renderHasOutputAudio;
 	
-	UInt32 framesSinceLastTimeUpdate;
+	// Only touched on the audio delivery thread.
+	NSTimeInterval activeTargetBufferDuration;
+	int32_t observedUnderrunCount;
+	NSUInteger saturatedDeliveryCount;
+	CFAbsoluteTime lastBufferTargetChange;
 	
-	NSMethodSignature *incrementTrackPositionMethodSignature;
-	NSInvocation *incrementTrackPositionInvocation;
+	// Track boundaries are queued on the audio delivery thread, played out on the render thread
+	// and reported to the delegate on the callback queue. Clearing the buffers bumps the generation, 
+	// which makes the render thread drop anything older.
+	SPCoreAudioControllerTrackBoundary trackBoundaries[kMaximumPendingTrackBoundaries];
+	volatile int32_t trackBoundaryWriteCount;
+	volatile int32_t trackBoundaryReadCount;
+	volatile int32_t trackBoundaryNotifiedCount;
+	volatile int32_t trackBoundaryGeneration;
+	volatile int32_t trackBoundaryClearedCount;
+	volatile int32_t bufferClearCount; /* Unlike the generation, this isn't bumped by format changes. */
+	
+	// libspotify may report a discontinuity when it starts the next track. That mustn't
+	// throw away the end of the previous track, which is still playing.
+	volatile BOOL awaitingTrackStart;
+	
+	// The playback clock. The render thread publishes it under a sequence count, which 
+	// is odd while an update is in progress, so readers never see a torn update.
+	volatile int32_t clockSequence;
+	volatile NSTimeInterval clockOutputTime; /* Output time at the start of the last slice. */
+	volatile NSTimeInterval clockSliceDuration;
+	volatile UInt64 clockSliceHostTime;
+	volatile int64_t renderedFrames;
+	
+	// Only touched on the render thread. Output time is kept as whole frames since the
+	// sample rate last changed, so it doesn't drift.
+	NSTimeInterval renderClockEpochTime;
+	UInt64 renderClockEpochFrames;
+	Float64 renderClockSampleRate;
+	
+	// Render timing, measured on the render thread and read on the callback queue. Resets are
+	// requested by bumping the request count and carried out by the render thread, which 
+	// is the only writer.
+	volatile int32_t renderTimingHistogram[kRenderTimingBucketCount];
+	volatile UInt32 renderTimingMaximumDuration;
+	volatile int32_t renderTimingOverrunCount;
+	volatile int32_t renderTimingResetRequestCount;
+	volatile int32_t renderTimingResetAppliedCount;
+	SPCoreAudioControllerRenderOverrun renderOverruns[kMaximumPendingRenderOverruns];
+	volatile int32_t renderOverrunWriteCount;
+	volatile int32_t renderOverrunLoggedCount;
+	
+	// The timer is only touched on outputNotificationQueue, and notifiedOutputTime only on the callback queue.
+	dispatch_queue_t outputNotificationQueue;
+	dispatch_source_t outputNotificationTimer;
+	NSTimeInterval notifiedOutputTime;
 }
 
 -(id)init {
+	SPAUGraphOutputSink *sink = [[SPAUGraphOutputSink alloc] init];
+	self = [self initWithOutputSink:sink];
+	
+	// Only subclasses can customise the graph, and without a delegate the sink can skip the converter node.
+	if (self && [self class] != [SPCoreAudioController class])
+		sink.delegate = self;
+	return self;
+}
+
+-(id)initWithOutputSink:(id <SPAudioOutputSink>)aSink {
 	self = [super init];
 	
 	if (self) {
+		if (hostTimebase.denom == 0)
+			mach_timebase_info(&hostTimebase);
+		
+		bufferLock = OS_SPINLOCK_INIT;
+		outputNotificationQueue = dispatch_queue_create("com.spotify.CocoaLibSpotify.outputNotifications", DISPATCH_QUEUE_SERIAL);
+		retiredAudioBuffers = [[NSMutableArray alloc] init];
+		self.outputSink = aSink;
 		self.volume = 1.0;
+		renderTargetGain = SPAudioGainForVolume(1.0);
+		renderGain = renderTargetGain;
 		self.audioOutputEnabled = NO; // Don't start audio playback until we're told.
-		
-		SEL incrementTrackPositionSelector = @selector(incrementTrackPositionWithFrameCount:);
-		incrementTrackPositionMethodSignature = [SPCoreAudioController instanceMethodSignatureForSelector:incrementTrackPositionSelector];
-		incrementTrackPositionInvocation = [NSInvocation invocationWithMethodSignature:incrementTrackPositionMethodSignature];
-		[incrementTrackPositionInvocation setSelector:incrementTrackPositionSelector];
-		[incrementTrackPositionInvocation setTarget:self];
+		self.minimumBufferDuration = kDefaultMinimumBufferLength;
+		self.maximumBufferDuration = kDefaultMaximumBufferLength;
+		self.usesMirroredBuffers = YES;
+		self.targetBufferDuration = kTargetBufferLength;
+		activeTargetBufferDuration = kTargetBufferLength;
+		self.outputNotificationInterval = kDefaultOutputNotificationInterval;
 		
 		[self addObserver:self forKeyPath:@"volume" options:0 context:nil];
 		[self addObserver:self forKeyPath:@"audioOutputEnabled" options:0 context:nil];
@@ -89,19 +266,32 @@ static NSTimeInterval const kTargetBufferLength = 0.5;
 	
 	[self clearAudioBuffers];
 	self.audioOutputEnabled = NO;
-	[self teardownCoreAudio];
+	[self.outputSink teardown];
+	
+	if (outputNotificationTimer != NULL) {
+		dispatch_source_cancel(outputNotificationTimer);
+		dispatch_release(outputNotificationTimer);
+	}
+	dispatch_release(outputNotificationQueue);
+	
+	free(renderMixScratch);
+	free(renderMixIncomingScratch);
+	free(renderMixOutput);
 }
 
 -(void)observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(NSDictionary *)change context:(void *)context {
 
 	if ([keyPath isEqualToString:@"volume"]) {
-		[self applyVolumeToMixerAudioUnit:self.volume];
+		renderTargetGain = SPAudioGainForVolume(self.volume);
 		
 	} else if ([keyPath isEqualToString:@"audioOutputEnabled"]) {
-		if (self.audioOutputEnabled)
-			[self startAudioQueue];
-		else
-			[self stopAudioQueue];
+		if (self.audioOutputEnabled) {
+			[self.outputSink startOutput];
+			[self startOutputNotifications];
+		} else {
+			[self.outputSink stopOutput];
+			[self stopOutputNotifications];
+		}
 	} else {
         [super observeValueForKeyPath:keyPath ofObject:object change:change context:context];
     }
@@ -112,6 +302,17 @@ static NSTimeInterval const kTargetBufferLength = 0.5;
 @synthesize audioBuffer;
 @synthesize inputAudioDescription;
 @synthesize delegate;
+@synthesize callbackSession;
+@synthesize outputSink;
+@synthesize minimumBufferDuration;
+@synthesize maximumBufferDuration;
+@synthesize targetBufferDuration;
+@synthesize underrunCount;
+@synthesize usesMirroredBuffers;
+@synthesize outputNotificationInterval;
+@synthesize crossfadeDuration;
+@synthesize crossfadeCurve;
+@synthesize measuresRenderTiming;
 
 #pragma mark -
 #pragma mark CocoaLS Audio Delivery
@@ -119,13 +320,14 @@ static NSTimeInterval const kTargetBufferLength = 0.5;
 -(NSInteger)session:(id <SPSessionPlaybackProvider>)aSession shouldDeliverAudioFrames:(const void *)audioFrames ofCount:(NSInteger)frameCount streamDescription:(AudioStreamBasicDescription)audioDescription {
 	
 	if (frameCount == 0) {
-		[self clearAudioBuffers];
+		if (!awaitingTrackStart)
+			[self clearAudioBuffers];
 		return 0; // Audio discontinuity!
 	}
 	
-    if (audioProcessingGraph == NULL) {
+    if (!self.outputSink.isPrepared) {
         NSError *error = nil;
-        if (![self setupCoreAudioWithInputFormat:audioDescription error:&error]) {
+        if (![self prepareOutputSinkWithInputFormat:audioDescription error:&error]) {
             NSLog(@"[%@ %@]: %@", NSStringFromClass([self class]), NSStringFromSelector(_cmd), error);
             return 0;
         }
@@ -139,300 +341,533 @@ static NSTimeInterval const kTargetBufferLength = 0.5;
 		audioDescription.mFormatFlags != currentAudioInputDescription.mFormatFlags ||
 		audioDescription.mFormatID != currentAudioInputDescription.mFormatID ||
 		audioDescription.mSampleRate != currentAudioInputDescription.mSampleRate) {
-		// New format. Panic!! I mean, calmly tell Core Audio that a new audio format is incoming.
+		// New format. Panic!! I mean, calmly tell the output sink that a new audio format is incoming.
 		[self clearAudioBuffers];
-		[self applyAudioStreamDescriptionToInputUnit:audioDescription];
+		NSError *error = nil;
+		if (![self applyInputAudioDescription:audioDescription error:&error]) {
+			NSLog(@"[%@ %@]: %@", NSStringFromClass([self class]), NSStringFromSelector(_cmd), error);
+			return 0;
+		}
 	}
 
-	NSUInteger bytesToAdd = frameCount * audioDescription.mBytesPerPacket;
+	NSUInteger bytesToAdd = MIN(frameCount * audioDescription.mBytesPerPacket,
+								[self bufferSpaceBelowTargetForDescription:audioDescription]);
 	NSUInteger bytesAdded = [self.audioBuffer attemptAppendData:audioFrames
 													   ofLength:bytesToAdd
 													  chunkSize:audioDescription.mBytesPerPacket];
 
 	NSUInteger framesAdded = bytesAdded / audioDescription.mBytesPerPacket;
+	if (framesAdded > 0)
+		awaitingTrackStart = NO;
+	[self adaptBufferTargetAfterDeliveryWasSaturated:(framesAdded == 0)];
 	return framesAdded;
 }
 
-
 #pragma mark -
-#pragma mark Audio Unit Properties
+#pragma mark Adaptive Buffering
 
--(void)applyVolumeToMixerAudioUnit:(double)vol {
-    
-    if (audioProcessingGraph == NULL || mixerUnit == NULL)
-        return;
+-(NSUInteger)bufferSpaceBelowTargetForDescription:(AudioStreamBasicDescription)audioDescription {
 	
-	OSErr status = AudioUnitSetParameter(mixerUnit,
-										 kMultiChannelMixerParam_Volume,
-										 kAudioUnitScope_Output, 
-										 0,
-										 vol * vol * vol,
-										 0);
+	// The ring is allocated for the maximum duration; the target is only a fill limit,
+	// so moving it never reallocates or throws away audio that's already buffered.
+	NSUInteger bytesPerSecond = audioDescription.mBytesPerFrame * audioDescription.mSampleRate;
+	NSTimeInterval targetDuration = activeTargetBufferDuration;
 	
-	if (status != noErr) {
-		NSError *error;
-        fillWithError(&error, @"Couldn't set input format", status);
-		NSLog(@"[%@ %@]: %@", NSStringFromClass([self class]), NSStringFromSelector(_cmd), error);
-    }
+	// The end of a track has to still be buffered when it finishes delivering, or there's nothing to crossfade.
+	if (self.crossfadeDuration > 0.0 && SPCoreAudioControllerCanCrossfadeFormat(audioDescription))
+		targetDuration += self.crossfadeDuration;
+	
+	NSUInteger targetLength = MIN((NSUInteger)(bytesPerSecond * targetDuration), self.audioBuffer.maximumLength);
+	targetLength -= targetLength % audioDescription.mBytesPerPacket;
+	
+	NSUInteger bufferedLength = SPCircularBufferGetLength(self.audioBuffer);
+	return targetLength > bufferedLength ? targetLength - bufferedLength : 0;
 }
 
--(void)applyAudioStreamDescriptionToInputUnit:(AudioStreamBasicDescription)newInputDescription {
+-(void)adaptBufferTargetAfterDeliveryWasSaturated:(BOOL)saturated {
 	
-	if (audioProcessingGraph == NULL || inputConverterUnit == NULL)
-		return;
+	int32_t underruns = renderUnderrunCount;
+	NSTimeInterval oldTarget = activeTargetBufferDuration;
+	NSTimeInterval newTarget = oldTarget;
+	CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
 	
-	OSStatus status = AudioUnitSetProperty(inputConverterUnit,
-								  kAudioUnitProperty_StreamFormat,
-								  kAudioUnitScope_Input,
-								  0,
-								  &newInputDescription,
-								  sizeof(newInputDescription));
-	if (status != noErr) {
-		NSError *error;
-        fillWithError(&error, @"Couldn't set input format", status);
-		NSLog(@"[%@ %@]: %@", NSStringFromClass([self class]), NSStringFromSelector(_cmd), error);
-    } else {
-		self.inputAudioDescription = newInputDescription;
-		[self clearAudioBuffers];
-		self.audioBuffer = [[SPCircularBuffer alloc] initWithMaximumLength:(newInputDescription.mBytesPerFrame * newInputDescription.mSampleRate) * kTargetBufferLength];
+	if (underruns != observedUnderrunCount) {
+		// We ran dry since the last delivery, so the network is slower than we planned for.
+		newTarget = oldTarget * kBufferTargetGrowthFactor;
+		saturatedDeliveryCount = 0;
+		lastBufferTargetChange = now;
+	} else if (saturated) {
+		// libspotify is keeping us topped up and then some, so trade some headroom for latency.
+		saturatedDeliveryCount++;
+		if (saturatedDeliveryCount >= kSaturatedDeliveriesBeforeShrink &&
+			now - lastBufferTargetChange >= kMinimumIntervalBetweenShrinks) {
+			newTarget = oldTarget * kBufferTargetShrinkFactor;
+			saturatedDeliveryCount = 0;
+			lastBufferTargetChange = now;
+		}
 	}
+	
+	// The bounds may have changed since the buffer was allocated, and the buffer can't hold more than it was created with.
+	AudioStreamBasicDescription description = self.inputAudioDescription;
+	NSTimeInterval bufferCapacity = self.audioBuffer.maximumLength / (description.mBytesPerFrame * description.mSampleRate);
+	newTarget = MAX(newTarget, self.minimumBufferDuration);
+	newTarget = MIN(newTarget, MIN(self.maximumBufferDuration, bufferCapacity));
+	
+	if (newTarget == oldTarget && underruns == observedUnderrunCount)
+		return;
+	
+	activeTargetBufferDuration = newTarget;
+	observedUnderrunCount = underruns;
+	
+	NSUInteger newUnderrunCount = (NSUInteger)underruns;
+	SPDispatchToCallbackQueue(self.callbackSession, ^{
+		self.targetBufferDuration = newTarget;
+		self.underrunCount = newUnderrunCount;
+	});
 }
 
+
 #pragma mark -
-#pragma mark Queue Control
+#pragma mark Output
 
--(void)startAudioQueue {
-    if (audioProcessingGraph == NULL)
-        return;
+-(BOOL)applyInputAudioDescription:(AudioStreamBasicDescription)newInputDescription error:(NSError **)err {
 	
-	Boolean isRunning = NO;
-	AUGraphIsRunning(audioProcessingGraph, &isRunning);
-	if (isRunning)
-		return;
+	if (![self.outputSink applyInputFormat:SPAudioOutputFormatFromStreamDescription(newInputDescription) error:err])
+		return NO;
 	
-    AUGraphStart(audioProcessingGraph);
-	if (outputUnit != NULL)
-		AudioOutputUnitStart(outputUnit);
-}
-
--(void)stopAudioQueue {
-    if (audioProcessingGraph == NULL)
-        return;
-    
-	Boolean isRunning = NO;
-	AUGraphIsRunning(audioProcessingGraph, &isRunning);
+	// A format change flushes the end of the previous track, so move any boundaries 
+	// still waiting to be heard to the start of the new buffer.
+	NSUInteger flushedTrackBoundaryCount = [self unplayedTrackBoundaryCount];
 	
-	if (!isRunning)
-		return;
-
-	AUGraphStop(audioProcessingGraph);
+	self.inputAudioDescription = newInputDescription;
+	
+	// Leave room for the end of a track to stay buffered for a crossfade on top of the usual buffering.
+	NSTimeInterval bufferDuration = MAX(self.maximumBufferDuration, self.minimumBufferDuration);
+	if (SPCoreAudioControllerCanCrossfadeFormat(newInputDescription))
+		bufferDuration += self.crossfadeDuration;
+	
+	SPCircularBuffer *newAudioBuffer = [[SPCircularBuffer alloc] initWithMaximumLength:(newInputDescription.mBytesPerFrame * newInputDescription.mSampleRate) * bufferDuration
+																				 mode:SPCircularBufferModeSingleProducerSingleConsumer
+																			 mirrored:self.usesMirroredBuffers];
+	
+	// Volume is applied with the mix buffers, and sinks that take pointers into the buffer need a copy
+	// when audio wraps around the end of one that isn't mirrored.
+	BOOL canApplyGain = SPCoreAudioControllerCanCrossfadeFormat(newInputDescription);
+	if (canApplyGain || !newAudioBuffer.isMirrored)
+		canApplyGain = [self prepareMixBuffers] && canApplyGain;
+	
+	OSSpinLockLock(&bufferLock);
+	
+	// Once the render thread has caught up with the last replacement, it can't be reading anything retired before it.
+	if (renderBufferGeneration == trackBoundaryGeneration)
+		[retiredAudioBuffers removeAllObjects];
+	if (self.audioBuffer != nil)
+		[retiredAudioBuffers addObject:self.audioBuffer];
+	if (alternateAudioBuffer != nil)
+		[retiredAudioBuffers addObject:alternateAudioBuffer];
+	
+	alternateAudioBuffer = nil;
+	renderBytesPerFrame = newInputDescription.mBytesPerFrame;
+	renderChannelCount = newInputDescription.mChannelsPerFrame;
+	renderSampleRate = newInputDescription.mSampleRate;
+	renderCanApplyGain = canApplyGain;
+	self.audioBuffer = newAudioBuffer;
+	
+	// The render thread switches to the new buffer when it sees the generation change, by which point all of the above is visible to it.
+	[self invalidateBufferedAudio];
+	OSSpinLockUnlock(&bufferLock);
+	
+	for (NSUInteger i = 0; i < flushedTrackBoundaryCount; i++)
+		[self markTrackBoundary];
+	
+	return YES;
 }
 
 -(void)clearAudioBuffers {
+	
+	// Report what has already been heard now, so callers that clear and start something
+	// new don't get told about the old audio afterwards.
+	if (SPIsOnCallbackQueue(self.callbackSession))
+		[self notifyDelegateOfOutputProgress];
+	
+	// The buffers apply the clear on the render thread the next time it reads from them. The lock
+	// stops the delivery thread swapping or replacing them while we do this.
+	OSSpinLockLock(&bufferLock);
 	[self.audioBuffer clear];
+	[alternateAudioBuffer clear];
+	OSAtomicIncrement32Barrier(&bufferClearCount);
+	[self invalidateBufferedAudio];
+	OSSpinLockUnlock(&bufferLock);
+}
+
+-(void)invalidateBufferedAudio {
+	
+	// Must be called with bufferLock held. Running dry after a deliberate clear isn't an underrun.
+	renderHasOutputAudio = NO;
+	trackBoundaryClearedCount = trackBoundaryWriteCount;
+	OSAtomicIncrement32Barrier(&trackBoundaryGeneration);
+	awaitingTrackStart = NO;
 }
 
 #pragma mark -
-#pragma mark Setup and Teardown
+#pragma mark Track Boundaries
 
--(void)teardownCoreAudio {
-    if (audioProcessingGraph == NULL)
-        return;
-    
-    [self stopAudioQueue];
-	[self disposeOfCustomNodesInGraph:audioProcessingGraph];
+-(void)sessionDidEndAudioDelivery:(id <SPSessionPlaybackProvider>)aSession {
+	// This is called on the audio delivery thread, so the buffer's write position is exactly the end of the track.
+	[self markTrackBoundary];
+	awaitingTrackStart = YES;
+}
+
+-(void)markTrackBoundary {
+	
+	// Must only be called on the audio delivery thread.
+	if (trackBoundaryWriteCount - trackBoundaryNotifiedCount >= kMaximumPendingTrackBoundaries)
+		return;
 	
-	AUGraphUninitialize(audioProcessingGraph);
-	DisposeAUGraph(audioProcessingGraph);
+	SPCoreAudioControllerTrackBoundary boundary;
+	boundary.buffer = self.audioBuffer;
+	boundary.position = SPCircularBufferGetTotalBytesWritten(boundary.buffer);
+	boundary.generation = trackBoundaryGeneration;
+	boundary.clearCount = bufferClearCount;
+	boundary.played = NO;
+	boundary.outputTime = 0.0;
+	boundary.nextBuffer = boundary.buffer;
+	boundary.nextStartPosition = boundary.position;
+	boundary.crossfadeLength = 0;
+	boundary.crossfadeCurve = self.crossfadeCurve;
 	
-#if TARGET_OS_IPHONE
-	[[AVAudioSession sharedInstance] setActive:NO error:nil];
-#endif
+	AudioStreamBasicDescription description = self.inputAudioDescription;
+	NSTimeInterval duration = self.crossfadeDuration;
 	
-	audioProcessingGraph = NULL;
-	outputUnit = NULL;
-	mixerUnit = NULL;
-	inputConverterUnit = NULL;
+	if (duration > 0.0 && SPCoreAudioControllerCanCrossfadeFormat(description) && [self prepareCrossfadeBuffers]) {
+		// The crossfade can't be longer than what's left of the ending track.
+		UInt64 length = (UInt64)llround(duration * description.mSampleRate) * description.mBytesPerFrame;
+		length = MIN(length, SPCircularBufferGetLength(boundary.buffer));
+		length -= length % description.mBytesPerFrame;
+		
+		// The other buffer must have finished playing the track before this one.
+		if (length > 0 && SPCircularBufferGetLength(alternateAudioBuffer) == 0 && renderAudioBuffer != alternateAudioBuffer) {
+			boundary.nextBuffer = alternateAudioBuffer;
+			boundary.nextStartPosition = SPCircularBufferGetTotalBytesWritten(alternateAudioBuffer);
+			boundary.crossfadeLength = length;
+		}
+	}
+	
+	trackBoundaries[trackBoundaryWriteCount % kMaximumPendingTrackBoundaries] = boundary;
+	OSMemoryBarrier();
+	trackBoundaryWriteCount++;
+	
+	if (boundary.nextBuffer != boundary.buffer) {
+		// Deliver the next track into the other buffer. The render thread finds the boundary 
+		// before it sees the switch, so it keeps playing the end of this track.
+		OSSpinLockLock(&bufferLock);
+		SPCircularBuffer *endingBuffer = self.audioBuffer;
+		SPCircularBuffer *nextBuffer = alternateAudioBuffer;
+		alternateAudioBuffer = endingBuffer;
+		self.audioBuffer = nextBuffer;
+		OSSpinLockUnlock(&bufferLock);
+	}
 }
 
--(void)disposeOfCustomNodesInGraph:(AUGraph)graph {
-	// Empty implementation — for subclasses to override.
+-(BOOL)prepareMixBuffers {
+	
+	// Must only be called on the audio delivery thread. The render thread only uses these after
+	// it sees a crossfade, a buffer that isn't mirrored or a format it can apply volume to, which are
+	// published after they're allocated.
+	if (renderMixScratch == NULL) {
+		NSUInteger sampleCount = kMaximumCrossfadeSliceFrames * kMaximumCrossfadeChannelCount;
+		float *mixScratch = calloc(sampleCount, sizeof(float));
+		float *incomingScratch = calloc(sampleCount, sizeof(float));
+		SInt16 *mixOutput = calloc(sampleCount, sizeof(SInt16));
+		
+		if (mixScratch == NULL || incomingScratch == NULL || mixOutput == NULL) {
+			free(mixScratch);
+			free(incomingScratch);
+			free(mixOutput);
+			return NO;
+		}
+		
+		renderMixScratch = mixScratch;
+		renderMixIncomingScratch = incomingScratch;
+		renderMixOutput = mixOutput;
+	}
+	
+	return YES;
 }
 
--(BOOL)setupCoreAudioWithInputFormat:(AudioStreamBasicDescription)inputFormat error:(NSError **)err {
-    
-    if (audioProcessingGraph != NULL)
-        [self teardownCoreAudio];
-	
-#if TARGET_OS_IPHONE
-	NSError *error = nil;
-	BOOL success = YES;
-	success &= [[AVAudioSession sharedInstance] setCategory:AVAudioSessionCategoryPlayback error:&error];
-	success &= [[AVAudioSession sharedInstance] setActive:YES error:&error];
+-(BOOL)prepareCrossfadeBuffers {
 	
-	if (!success && err != NULL) {
-		*err = error;
+	// Must only be called on the audio delivery thread.
+	if (![self prepareMixBuffers])
 		return NO;
+	
+	if (alternateAudioBuffer == nil) {
+		SPCircularBuffer *newAlternateAudioBuffer = [[SPCircularBuffer alloc] initWithMaximumLength:self.audioBuffer.maximumLength
+																							   mode:SPCircularBufferModeSingleProducerSingleConsumer
+																						   mirrored:self.usesMirroredBuffers];
+		OSSpinLockLock(&bufferLock);
+		alternateAudioBuffer = newAlternateAudioBuffer;
+		OSSpinLockUnlock(&bufferLock);
 	}
-#endif
 	
-    // A description of the output device we're looking for.
-    AudioComponentDescription outputDescription;
-	outputDescription.componentType = kAudioUnitType_Output;
-#if TARGET_OS_IPHONE
-	outputDescription.componentSubType = kAudioUnitSubType_RemoteIO;
-#else
-    outputDescription.componentSubType = kAudioUnitSubType_DefaultOutput;
-#endif
-    outputDescription.componentManufacturer = kAudioUnitManufacturer_Apple;
-    outputDescription.componentFlags = 0;
-    outputDescription.componentFlagsMask = 0;
-	
-	// A description of the mixer unit
-	AudioComponentDescription mixerDescription;
-	mixerDescription.componentType = kAudioUnitType_Mixer;
-	mixerDescription.componentSubType = kAudioUnitSubType_MultiChannelMixer;
-	mixerDescription.componentManufacturer = kAudioUnitManufacturer_Apple;
-	mixerDescription.componentFlags = 0;
-	mixerDescription.componentFlagsMask = 0;
-	
-	// A description for the libspotify -> standard PCM device
-	AudioComponentDescription converterDescription;
-	converterDescription.componentType = kAudioUnitType_FormatConverter;
-	converterDescription.componentSubType = kAudioUnitSubType_AUConverter;
-	converterDescription.componentManufacturer = kAudioUnitManufacturer_Apple;
-	converterDescription.componentFlags = 0;
-	converterDescription.componentFlagsMask = 0;
-    
-	// Create an AUGraph
-	OSErr status = NewAUGraph(&audioProcessingGraph);
-	if (status != noErr) {
-        fillWithError(err, @"Couldn't init graph", status);
-        return NO;
-    }
+	return alternateAudioBuffer != nil;
+}
+
+static NSUInteger SPCoreAudioControllerLiveBoundaryCount(int32_t writeCount, int32_t consumedCount, int32_t clearedCount) {
+	// Boundaries marked before the last clear are stale, even if they haven't been dropped yet.
+	int32_t firstLiveCount = consumedCount;
+	if (clearedCount - firstLiveCount > 0)
+		firstLiveCount = clearedCount;
+	return writeCount - firstLiveCount > 0 ? (NSUInteger)(writeCount - firstLiveCount) : 0;
+}
+
+-(NSUInteger)pendingTrackBoundaryCount {
+	int32_t writeCount = trackBoundaryWriteCount;
+	OSMemoryBarrier();
+	return SPCoreAudioControllerLiveBoundaryCount(writeCount, trackBoundaryNotifiedCount, trackBoundaryClearedCount);
+}
+
+-(NSUInteger)unplayedTrackBoundaryCount {
+	int32_t writeCount = trackBoundaryWriteCount;
+	OSMemoryBarrier();
+	return SPCoreAudioControllerLiveBoundaryCount(writeCount, trackBoundaryReadCount, trackBoundaryClearedCount);
+}
+
+#pragma mark -
+#pragma mark Playback Clock
+
+-(UInt64)renderedFrameCount {
+	return (UInt64)OSAtomicAdd64Barrier(0, &renderedFrames);
+}
+
+static void SPCoreAudioControllerReadClock(__unsafe_unretained SPCoreAudioController *self, NSTimeInterval *outputTime, NSTimeInterval *sliceDuration, UInt64 *sliceHostTime) {
 	
-	// Open the graph. AudioUnits are open but not initialized (no resource allocation occurs here)
-	AUGraphOpen(audioProcessingGraph);
-	if (status != noErr) {
-        fillWithError(err, @"Couldn't open graph", status);
-        return NO;
-    }
+	int32_t sequence;
+	do {
+		sequence = self->clockSequence;
+		OSMemoryBarrier();
+		*outputTime = self->clockOutputTime;
+		*sliceDuration = self->clockSliceDuration;
+		*sliceHostTime = self->clockSliceHostTime;
+		OSMemoryBarrier();
+	} while ((sequence & 1) || sequence != self->clockSequence);
+}
+
+-(NSTimeInterval)outputTime {
 	
-	// Add audio output...
-	status = AUGraphAddNode(audioProcessingGraph, &outputDescription, &outputNode);
-	if (status != noErr) {
-        fillWithError(err, @"Couldn't add output node", status);
-        return NO;
-    }
+	NSTimeInterval outputTime, sliceDuration;
+	UInt64 sliceHostTime;
+	SPCoreAudioControllerReadClock(self, &outputTime, &sliceDuration, &sliceHostTime);
 	
-	// Get output unit
-	status = AUGraphNodeInfo(audioProcessingGraph, outputNode, NULL, &outputUnit);
-	if (status != noErr) {
-        fillWithError(err, @"Couldn't get output unit", status);
-        return NO;
-    }
+	if (sliceHostTime == 0)
+		return outputTime + sliceDuration;
 	
-	// Add mixer
-	status = AUGraphAddNode(audioProcessingGraph, &mixerDescription, &mixerNode);
-	if (status != noErr) {
-        fillWithError(err, @"Couldn't add mixer node", status);
-        return NO;
-    }
+	// Work out how far through the last slice the hardware has got.
+	UInt64 now = SPCoreAudioControllerCurrentHostTime();
+	NSTimeInterval elapsed = now > sliceHostTime ? (double)(now - sliceHostTime) / NSEC_PER_SEC : 0.0;
+	return outputTime + MIN(elapsed, sliceDuration);
+}
+
+-(void)setOutputNotificationInterval:(NSTimeInterval)interval {
 	
-	// Get mixer unit so we can change volume etc
-	status = AUGraphNodeInfo(audioProcessingGraph, mixerNode, NULL, &mixerUnit);
-	if (status != noErr) {
-        fillWithError(err, @"Couldn't get mixer unit", status);
-        return NO;
-    }
+	dispatch_async(outputNotificationQueue, ^{
+		if (outputNotificationTimer != NULL)
+			dispatch_source_set_timer(outputNotificationTimer, DISPATCH_TIME_NOW, interval * NSEC_PER_SEC, (interval / 10.0) * NSEC_PER_SEC);
+	});
 	
-	// Set mixer bus count
-	UInt32 busCount = 1;
-	status = AudioUnitSetProperty(mixerUnit, kAudioUnitProperty_ElementCount, kAudioUnitScope_Input, 0, &busCount, sizeof(busCount));
-	if (status != noErr) {
-        fillWithError(err, @"Couldn't set mixer bus count", status);
-        return NO;
-    }
+	@synchronized(self) {
+		outputNotificationInterval = interval;
+	}
+}
+
+-(NSTimeInterval)outputNotificationInterval {
+	@synchronized(self) {
+		return outputNotificationInterval;
+	}
+}
+
+-(void)startOutputNotifications {
 	
-	// Set mixer input volume
-	status = AudioUnitSetParameter(mixerUnit, kMultiChannelMixerParam_Volume, kAudioUnitScope_Input, 0, 1.0, 0);
-	if (status != noErr) {
-        fillWithError(err, @"Couldn't set mixer volume", status);
-        return NO;
-    }
+	// The timer ticks on a private queue and hands each tick to the callback queue, so the delegate
+	// hears about output in order with everything else the session delivers.
+	dispatch_async(outputNotificationQueue, ^{
+		
+		if (outputNotificationTimer != NULL)
+			return;
+		
+		NSTimeInterval interval = self.outputNotificationInterval;
+		outputNotificationTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, outputNotificationQueue);
+		dispatch_source_set_timer(outputNotificationTimer, DISPATCH_TIME_NOW, interval * NSEC_PER_SEC, (interval / 10.0) * NSEC_PER_SEC);
+		
+		__unsafe_unretained SPCoreAudioController *weakSelf = self;
+		dispatch_source_set_event_handler(outputNotificationTimer, ^{
+			SPCoreAudioController *strongSelf = weakSelf;
+			SPDispatchToCallbackQueue(strongSelf.callbackSession, ^{ [strongSelf notifyDelegateOfOutputProgress]; });
+		});
+		dispatch_resume(outputNotificationTimer);
+	});
+}
+
+-(void)stopOutputNotifications {
 	
-	// Create PCM converter
-	status = AUGraphAddNode(audioProcessingGraph, &converterDescription, &inputConverterNode);
-	if (status != noErr) {
-        fillWithError(err, @"Couldn't add converter node", status);
-        return NO;
-    }
+	dispatch_async(outputNotificationQueue, ^{
+		
+		if (outputNotificationTimer != NULL) {
+			dispatch_source_cancel(outputNotificationTimer);
+			dispatch_release(outputNotificationTimer);
+			outputNotificationTimer = NULL;
+		}
+		
+		// Report whatever was played between the last tick and stopping. This is sent after any ticks already on their way.
+		SPDispatchToCallbackQueue(self.callbackSession, ^{ [self notifyDelegateOfOutputProgress]; });
+	});
+}
+
+-(void)notifyDelegateOfOutputProgress {
 	
-	status = AUGraphNodeInfo(audioProcessingGraph, inputConverterNode, NULL, &inputConverterUnit);
-	if (status != noErr) {
-        fillWithError(err, @"Couldn't get input unit", status);
-        return NO;
-    }
+	// Must only be called on the callback queue.
+	[self logRenderOverruns];
 	
-	// Connect mixer to output
-	status = AUGraphConnectNodeInput(audioProcessingGraph, mixerNode, 0, outputNode, 0);
-	if (status != noErr) {
-        fillWithError(err, @"Couldn't connect mixer to output", status);
-        return NO;
-    }
+	NSTimeInterval clockOutputTimeAtSlice, sliceDuration;
+	UInt64 sliceHostTime;
+	SPCoreAudioControllerReadClock(self, &clockOutputTimeAtSlice, &sliceDuration, &sliceHostTime);
+	NSTimeInterval renderedOutputTime = clockOutputTimeAtSlice + sliceDuration;
+	
+	int32_t readCount = trackBoundaryReadCount;
+	OSMemoryBarrier();
+	
+	while (trackBoundaryNotifiedCount != readCount) {
+		
+		SPCoreAudioControllerTrackBoundary boundary = trackBoundaries[trackBoundaryNotifiedCount % kMaximumPendingTrackBoundaries];
+		OSMemoryBarrier();
+		trackBoundaryNotifiedCount++;
+		
+		// The render thread may have played a boundary just before a clear and published it just after,
+		// and ticks sent before the clear can run after it. Either way it belongs to audio the caller threw away.
+		if (!boundary.played || boundary.clearCount != bufferClearCount)
+			continue;
+		
+		if (boundary.outputTime > notifiedOutputTime) {
+			[self.delegate coreAudioController:self didOutputAudioOfDuration:boundary.outputTime - notifiedOutputTime];
+			notifiedOutputTime = boundary.outputTime;
+		}
+		
+		if ([self.delegate respondsToSelector:@selector(coreAudioController:didOutputTrackBoundaryAtTime:)])
+			[self.delegate coreAudioController:self didOutputTrackBoundaryAtTime:boundary.outputTime];
+	}
 	
-	if (![self connectOutputBus:0 ofNode:inputConverterNode toInputBus:0 ofNode:mixerNode inGraph:audioProcessingGraph error:err])
+	if (renderedOutputTime > notifiedOutputTime) {
+		[self.delegate coreAudioController:self didOutputAudioOfDuration:renderedOutputTime - notifiedOutputTime];
+		notifiedOutputTime = renderedOutputTime;
+	}
+}
+
+-(BOOL)prepareOutputSinkWithInputFormat:(AudioStreamBasicDescription)inputFormat error:(NSError **)err {
+	
+	if (![self.outputSink prepareWithInputFormat:SPAudioOutputFormatFromStreamDescription(inputFormat)
+								  renderCallback:SPCoreAudioControllerRenderCallback
+										 context:(__bridge void *)self
+										   error:err])
 		return NO;
 	
-	// Set render callback
-	AURenderCallbackStruct rcbs;
-	rcbs.inputProc = AudioUnitRenderDelegateCallback;
-	rcbs.inputProcRefCon = (__bridge void *)(self);
+	return [self applyInputAudioDescription:inputFormat error:err];
+}
+
+#pragma mark -
+#pragma mark Render Timing
+
+static NSUInteger SPCoreAudioControllerRenderTimingBucket(UInt64 nanoseconds) {
 	
-	status = AUGraphSetNodeInputCallback(audioProcessingGraph, inputConverterNode, 0, &rcbs);
-	if (status != noErr) {
-        fillWithError(err, @"Couldn't add render callback", status);
-        return NO;
-    }
+	if (nanoseconds < 8)
+		return (NSUInteger)nanoseconds;
 	
-	// Finally, set the kAudioUnitProperty_MaximumFramesPerSlice of each unit 
-	// to 4096, to allow playback on iOS when the screen is locked.
-	// Code based on http://developer.apple.com/library/ios/#qa/qa1606/_index.html
+	NSUInteger exponent = 63 - __builtin_clzll(nanoseconds);
+	NSUInteger bucket = (exponent * 4) + (NSUInteger)((nanoseconds >> (exponent - 2)) & 3);
+	return MIN(bucket, kRenderTimingBucketCount - 1);
+}
+
+static UInt64 SPCoreAudioControllerRenderTimingBucketFloor(NSUInteger bucket) {
 	
-	UInt32 maxFramesPerSlice = 4096;
-	status = AudioUnitSetProperty(inputConverterUnit, kAudioUnitProperty_MaximumFramesPerSlice, kAudioUnitScope_Global, 0, &maxFramesPerSlice, sizeof(maxFramesPerSlice));
-	if (status != noErr) {
-		fillWithError(err, @"Couldn't set max frames per slice on input converter", status);
-        return NO;
-	}
+	// Buckets 8 to 11 are never used, as 8ns starts the power-of-two buckets at 12.
+	if (bucket < 12)
+		return MIN(bucket, 8);
 	
-	status = AudioUnitSetProperty(mixerUnit, kAudioUnitProperty_MaximumFramesPerSlice, kAudioUnitScope_Global, 0, &maxFramesPerSlice, sizeof(maxFramesPerSlice));
-	if (status != noErr) {
-		fillWithError(err, @"Couldn't set max frames per slice on mixer", status);
-        return NO;
-	}
+	return (UInt64)(4 + (bucket % 4)) << ((bucket / 4) - 2);
+}
+
+-(void)setMeasuresRenderTiming:(BOOL)measure {
 	
-	status = AudioUnitSetProperty(outputUnit, kAudioUnitProperty_MaximumFramesPerSlice, kAudioUnitScope_Global, 0, &maxFramesPerSlice, sizeof(maxFramesPerSlice));
-	if (status != noErr) {
-		fillWithError(err, @"Couldn't set max frames per slice on output", status);
-        return NO;
+	if (measure && !measuresRenderTiming)
+		[self resetRenderTiming];
+	
+	measuresRenderTiming = measure;
+}
+
+-(void)resetRenderTiming {
+	OSAtomicIncrement32Barrier(&renderTimingResetRequestCount);
+}
+
+-(SPCoreAudioControllerRenderTiming)renderTiming {
+	
+	SPCoreAudioControllerRenderTiming timing;
+	memset(&timing, 0, sizeof(timing));
+	
+	// A reset is waiting for the render thread, so there's nothing to report yet.
+	if (renderTimingResetRequestCount != renderTimingResetAppliedCount)
+		return timing;
+	
+	int32_t histogram[kRenderTimingBucketCount];
+	NSUInteger callbackCount = 0;
+	for (NSUInteger bucket = 0; bucket < kRenderTimingBucketCount; bucket++) {
+		histogram[bucket] = renderTimingHistogram[bucket];
+		callbackCount += histogram[bucket];
 	}
 	
-	// Init Queue
-	status = AUGraphInitialize(audioProcessingGraph);
-	if (status != noErr) {
-		fillWithError(err, @"Couldn't initialize graph", status);
-        return NO;
+	UInt32 maximumDuration = renderTimingMaximumDuration;
+	timing.callbackCount = callbackCount;
+	timing.overrunCount = renderTimingOverrunCount;
+	timing.maximumDuration = (double)maximumDuration / NSEC_PER_SEC;
+	
+	double const percentiles[3] = { 0.5, 0.9, 0.99 };
+	NSTimeInterval *durations[3] = { &timing.medianDuration, &timing.ninetiethPercentileDuration, &timing.ninetyNinthPercentileDuration };
+	NSUInteger cumulativeCount = 0;
+	NSUInteger percentile = 0;
+	
+	for (NSUInteger bucket = 0; bucket < kRenderTimingBucketCount && percentile < 3; bucket++) {
+		cumulativeCount += histogram[bucket];
+		while (percentile < 3 && callbackCount > 0 && cumulativeCount >= ceil(percentiles[percentile] * callbackCount)) {
+			// The top of the bucket can be beyond the longest callback we've actually seen.
+			UInt64 duration = MIN(SPCoreAudioControllerRenderTimingBucketFloor(bucket + 1), (UInt64)maximumDuration);
+			*durations[percentile] = (double)duration / NSEC_PER_SEC;
+			percentile++;
+		}
 	}
 	
-	AUGraphUpdate(audioProcessingGraph, NULL);
+	return timing;
+}
+
+-(void)logRenderOverruns {
 	
-	// Apply properties and let's get going!
-    [self startAudioQueue];
-	[self applyAudioStreamDescriptionToInputUnit:inputFormat];
-    [self applyVolumeToMixerAudioUnit:self.volume];
+	// Must only be called on the callback queue.
+	int32_t writeCount = renderOverrunWriteCount;
+	OSMemoryBarrier();
 	
-    return YES;
+	while (renderOverrunLoggedCount != writeCount) {
+		
+		SPCoreAudioControllerRenderOverrun overrun = renderOverruns[renderOverrunLoggedCount % kMaximumPendingRenderOverruns];
+		OSMemoryBarrier();
+		renderOverrunLoggedCount++;
+		
+		NSLog(@"[%@ %@]: Render callback at %.3fs took %.3fms, missing its %.3fms deadline", NSStringFromClass([self class]), NSStringFromSelector(_cmd),
+			  overrun.outputTime, overrun.duration / (double)NSEC_PER_MSEC, overrun.deadline / (double)NSEC_PER_MSEC);
+	}
+}
+
+#pragma mark -
+#pragma mark AUGraph Customization
+
+-(void)disposeOfCustomNodesInGraph:(AUGraph)graph {
+	// Empty implementation — for subclasses to override.
 }
 
 -(BOOL)connectOutputBus:(UInt32)sourceOutputBusNumber ofNode:(AUNode)sourceNode toInputBus:(UInt32)destinationInputBusNumber ofNode:(AUNode)destinationNode inGraph:(AUGraph)graph error:(NSError **)error {
@@ -459,48 +894,420 @@ static void fillWithError(NSError **mayBeAnError, NSString *localizedDescription
     
 }
 
-static OSStatus AudioUnitRenderDelegateCallback(void *inRefCon,
-												AudioUnitRenderActionFlags *ioActionFlags,
-												const AudioTimeStamp *inTimeStamp,
-												UInt32 inBusNumber,
-												UInt32 inNumberFrames,
-												AudioBufferList *ioData) {
+// Returns the next track boundary that hasn't been played yet, skipping any made stale by a clear.
+// Must only be called on the render thread.
+static SPCoreAudioControllerTrackBoundary *SPCoreAudioControllerPeekTrackBoundary(__unsafe_unretained SPCoreAudioController *self) {
 	
-    SPCoreAudioController *self = (__bridge SPCoreAudioController *)inRefCon;
+	int32_t generation = self->trackBoundaryGeneration;
 	
-	AudioBuffer *buffer = &(ioData->mBuffers[0]);
-	UInt32 bytesRequired = buffer->mDataByteSize;
+	while (self->trackBoundaryReadCount != self->trackBoundaryWriteCount) {
+		
+		OSMemoryBarrier();
+		SPCoreAudioControllerTrackBoundary *boundary = &self->trackBoundaries[self->trackBoundaryReadCount % kMaximumPendingTrackBoundaries];
+		
+		if (boundary->generation == generation)
+			return boundary;
+		
+		// Stale, so hand it straight to the callback queue to be skipped.
+		boundary->played = NO;
+		OSMemoryBarrier();
+		self->trackBoundaryReadCount++;
+	}
 	
-	NSUInteger availableData = [self.audioBuffer length];
-	if (availableData < bytesRequired) {
-		buffer->mDataByteSize = 0;
-		*ioActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
-		return noErr;
-    }
-    
-    buffer->mDataByteSize = (UInt32)[self.audioBuffer readDataOfLength:bytesRequired intoAllocatedBuffer:&buffer->mData];
-    
-	self->framesSinceLastTimeUpdate += inNumberFrames;
+	return NULL;
+}
+
+// Returns the next pending track boundary if it falls within the given span of the buffer's
+// stream, or NULL if not. Must only be called on the render thread.
+static SPCoreAudioControllerTrackBoundary *SPCoreAudioControllerNextTrackBoundary(__unsafe_unretained SPCoreAudioController *self, __unsafe_unretained SPCircularBuffer *audioBuffer, UInt64 readPosition, NSUInteger length, UInt32 *framesBeforeBoundary) {
+	
+	SPCoreAudioControllerTrackBoundary *boundary = SPCoreAudioControllerPeekTrackBoundary(self);
+	if (boundary == NULL || boundary->buffer != audioBuffer || boundary->position > readPosition + length)
+		return NULL;
+	
+	*framesBeforeBoundary = boundary->position > readPosition ? (UInt32)((boundary->position - readPosition) / self->renderBytesPerFrame) : 0;
+	return boundary;
+}
+
+// Hands a played boundary over to the callback queue. Must only be called on the render thread.
+static void SPCoreAudioControllerFinishTrackBoundary(__unsafe_unretained SPCoreAudioController *self, SPCoreAudioControllerTrackBoundary *boundary, NSTimeInterval outputTime) {
+	boundary->outputTime = outputTime;
+	boundary->played = YES;
+	OSMemoryBarrier();
+	self->trackBoundaryReadCount++;
+}
+
+// Publishes a slice of output to the playback clock and returns the output time at its start. 
+// Must only be called on the render thread.
+static NSTimeInterval SPCoreAudioControllerAdvanceClock(__unsafe_unretained SPCoreAudioController *self, UInt32 frameCount, UInt64 hostTime) {
+	
+	// Audio is only ever buffered after the format, and so the sample rate, is known.
+	Float64 sampleRate = self->renderSampleRate;
+	
+	if (sampleRate != self->renderClockSampleRate) {
+		if (self->renderClockSampleRate > 0.0)
+			self->renderClockEpochTime += self->renderClockEpochFrames / self->renderClockSampleRate;
+		self->renderClockEpochFrames = 0;
+		self->renderClockSampleRate = sampleRate;
+	}
+	
+	NSTimeInterval sliceStartTime = self->renderClockEpochTime + (self->renderClockEpochFrames / sampleRate);
+	self->renderClockEpochFrames += frameCount;
+	
+	OSAtomicIncrement32Barrier(&self->clockSequence);
+	self->clockOutputTime = sliceStartTime;
+	self->clockSliceDuration = frameCount / sampleRate;
+	self->clockSliceHostTime = hostTime;
+	OSAtomicIncrement32Barrier(&self->clockSequence);
+	
+	OSAtomicAdd64Barrier(frameCount, &self->renderedFrames);
+	return sliceStartTime;
+}
+
+// Picks the buffer to play from. Must only be called on the render thread.
+static __unsafe_unretained SPCircularBuffer *SPCoreAudioControllerRenderBuffer(__unsafe_unretained SPCoreAudioController *self) {
+	
+	// Replacements publish the new buffer before bumping the generation, so read them the other way round.
+	int32_t generation = self->trackBoundaryGeneration;
+	OSMemoryBarrier();
+	__unsafe_unretained SPCircularBuffer *deliveryBuffer = self->audioBuffer;
+	
+	if (generation != self->renderBufferGeneration) {
+		// Everything was cleared, so any crossfade under way is abandoned. The buffer we were 
+		// reading from may have been replaced, so don't touch it again.
+		self->renderBufferGeneration = generation;
+		self->renderAudioBuffer = deliveryBuffer;
+		self->renderCrossfadeStarted = NO;
+		self->renderFadeInBuffer = nil;
+		return deliveryBuffer;
+	}
+	
+	__unsafe_unretained SPCircularBuffer *renderBuffer = self->renderAudioBuffer;
+	if (renderBuffer == deliveryBuffer)
+		return renderBuffer;
+	
+	// Keep playing the end of the previous track until it's drained, then follow the session.
+	SPCoreAudioControllerTrackBoundary *boundary = SPCoreAudioControllerPeekTrackBoundary(self);
+	if (renderBuffer == nil || ((boundary == NULL || boundary->buffer != renderBuffer) && SPCircularBufferGetLength(renderBuffer) == 0))
+		renderBuffer = deliveryBuffer;
+	
+	self->renderAudioBuffer = renderBuffer;
+	return renderBuffer;
+}
+
+static void SPCoreAudioControllerCrossfadeGains(SPCoreAudioControllerCrossfadeCurve curve, double progress, float *fadeOutGain, float *fadeInGain) {
+	
+	progress = MAX(0.0, MIN(progress, 1.0));
+	
+	if (curve == SPCoreAudioControllerCrossfadeCurveLinear) {
+		if (fadeOutGain) *fadeOutGain = (float)(1.0 - progress);
+		if (fadeInGain) *fadeInGain = (float)progress;
+	} else {
+		if (fadeOutGain) *fadeOutGain = (float)cos(progress * M_PI_2);
+		if (fadeInGain) *fadeInGain = (float)sin(progress * M_PI_2);
+	}
+}
+
+// Converts 16-bit samples from a buffer's readable regions, which may wrap, to floating point.
+static void SPCoreAudioControllerCopyFloatSamples(SPCircularBufferRegion regions[2], NSUInteger byteCount, float *output) {
+	NSUInteger directByteCount = MIN(byteCount, regions[0].length);
+	SPAudioConvertInt16ToFloat32(regions[0].data, output, directByteCount / sizeof(SInt16));
+	SPAudioConvertInt16ToFloat32(regions[1].data, output + (directByteCount / sizeof(SInt16)), (byteCount - directByteCount) / sizeof(SInt16));
+}
+
+// Renders a slice in which the end of one track overlaps the start of the next. Both tracks' 
+// audio is mixed in floating point, then converted back to the input format.
+static BOOL SPCoreAudioControllerRenderCrossfade(__unsafe_unretained SPCoreAudioController *self, SPCoreAudioControllerTrackBoundary *boundary, SPCircularBufferRegion regions[2], UInt64 readPosition, UInt32 frameCount, UInt64 hostTime, void **ioData) {
+	
+	if (frameCount > kMaximumCrossfadeSliceFrames)
+		return NO;
+	
+	UInt32 bytesPerFrame = self->renderBytesPerFrame;
+	UInt32 channelCount = self->renderChannelCount;
+	NSUInteger sampleCount = frameCount * channelCount;
+	__unsafe_unretained SPCircularBuffer *audioBuffer = boundary->buffer;
+	__unsafe_unretained SPCircularBuffer *nextBuffer = boundary->nextBuffer;
 	
-	if (self->framesSinceLastTimeUpdate >= 8820) {
-        // Update 5 times per second
+	UInt64 remainingLength = boundary->position - readPosition;
+	UInt32 outgoingFrameCount = (UInt32)MIN(frameCount, remainingLength / bytesPerFrame);
+	
+	// The next track has to cover the whole slice, including any part after the outgoing track ends.
+	SPCircularBufferRegion nextRegions[2];
+	NSUInteger nextAvailableData = SPCircularBufferAcquireReadableRegions(nextBuffer, nextRegions);
+	UInt64 nextReadPosition = SPCircularBufferGetTotalBytesRead(nextBuffer);
+	UInt32 incomingFrameCount = nextAvailableData >= frameCount * bytesPerFrame ? frameCount : 0;
+	
+	NSTimeInterval sliceStartTime = 0.0;
+	
+	if (outgoingFrameCount > 0 || incomingFrameCount > 0) {
 		
-		@autoreleasepool {
-			
-			[self->incrementTrackPositionInvocation setArgument:&self->framesSinceLastTimeUpdate atIndex:2];
-			[self->incrementTrackPositionInvocation performSelectorOnMainThread:@selector(invoke)
-																	 withObject:nil
-																  waitUntilDone:NO];
-			self->framesSinceLastTimeUpdate = 0;
+		float *mix = self->renderMixScratch;
+		float *incoming = self->renderMixIncomingScratch;
+		double length = (double)boundary->crossfadeLength;
+		float startGain, endGain;
+		
+		SPCoreAudioControllerCopyFloatSamples(regions, outgoingFrameCount * bytesPerFrame, mix);
+		memset(mix + (outgoingFrameCount * channelCount), 0, (sampleCount - (outgoingFrameCount * channelCount)) * sizeof(float));
+		SPCoreAudioControllerCrossfadeGains(boundary->crossfadeCurve, 1.0 - (remainingLength / length), &startGain, NULL);
+		SPCoreAudioControllerCrossfadeGains(boundary->crossfadeCurve, 1.0 - ((remainingLength - (outgoingFrameCount * bytesPerFrame)) / length), &endGain, NULL);
+		SPAudioApplyGainRamp(mix, outgoingFrameCount * channelCount, startGain, endGain);
+		
+		if (incomingFrameCount > 0) {
+			double fadedLength = (double)(nextReadPosition - boundary->nextStartPosition);
+			SPCoreAudioControllerCopyFloatSamples(nextRegions, frameCount * bytesPerFrame, incoming);
+			SPCoreAudioControllerCrossfadeGains(boundary->crossfadeCurve, fadedLength / length, NULL, &startGain);
+			SPCoreAudioControllerCrossfadeGains(boundary->crossfadeCurve, (fadedLength + (frameCount * bytesPerFrame)) / length, NULL, &endGain);
+			SPAudioApplyGainRamp(incoming, sampleCount, startGain, endGain);
+			SPAudioMixFloat32(incoming, mix, sampleCount);
+		}
+		
+		// Sinks normally give us somewhere to render to, but a sink that only takes
+		// pointers into the buffer gets the mix buffer instead.
+		if (*ioData == NULL)
+			*ioData = self->renderMixOutput;
+		SPAudioConvertFloat32ToInt16(mix, *ioData, sampleCount);
+		
+		SPCircularBufferCommitRead(audioBuffer, outgoingFrameCount * bytesPerFrame);
+		SPCircularBufferCommitRead(nextBuffer, incomingFrameCount * bytesPerFrame);
+		
+		// If the next track isn't ready yet, only count the end of this one, not the silence after it.
+		sliceStartTime = SPCoreAudioControllerAdvanceClock(self, incomingFrameCount > 0 ? frameCount : outgoingFrameCount, hostTime);
+		self->renderHasOutputAudio = YES;
+		
+		if (incomingFrameCount > 0 && !self->renderCrossfadeStarted) {
+			self->renderCrossfadeStarted = YES;
+			self->renderCrossfadeStartTime = sliceStartTime;
+		}
+	}
+	
+	if (remainingLength > outgoingFrameCount * bytesPerFrame)
+		return YES;
+	
+	// The outgoing track has finished, so the next track becomes current. It starts at the point it was first heard.
+	NSTimeInterval boundaryTime = self->renderCrossfadeStarted ? self->renderCrossfadeStartTime : sliceStartTime + (outgoingFrameCount / self->renderSampleRate);
+	
+	if (nextReadPosition + (incomingFrameCount * bytesPerFrame) < boundary->nextStartPosition + boundary->crossfadeLength) {
+		// The next track arrived late, so it's still fading in.
+		self->renderFadeInBuffer = nextBuffer;
+		self->renderFadeInStartPosition = boundary->nextStartPosition;
+		self->renderFadeInLength = boundary->crossfadeLength;
+		self->renderFadeInCurve = boundary->crossfadeCurve;
+	}
+	
+	self->renderCrossfadeStarted = NO;
+	self->renderAudioBuffer = nextBuffer;
+	SPCoreAudioControllerFinishTrackBoundary(self, boundary, boundaryTime);
+	
+	return outgoingFrameCount > 0 || incomingFrameCount > 0;
+}
+
+// Applies the rest of a fade-in to audio already copied out of the buffer.
+static void SPCoreAudioControllerApplyFadeIn(__unsafe_unretained SPCoreAudioController *self, UInt64 readPosition, UInt32 frameCount, void *samples) {
+	
+	UInt32 bytesPerFrame = self->renderBytesPerFrame;
+	NSUInteger sampleCount = frameCount * self->renderChannelCount;
+	double fadedLength = (double)(readPosition - self->renderFadeInStartPosition);
+	double length = (double)self->renderFadeInLength;
+	float startGain, endGain;
+	
+	if (sampleCount > kMaximumCrossfadeSliceFrames * self->renderChannelCount)
+		return;
+	
+	SPCoreAudioControllerCrossfadeGains(self->renderFadeInCurve, fadedLength / length, NULL, &startGain);
+	SPCoreAudioControllerCrossfadeGains(self->renderFadeInCurve, (fadedLength + (frameCount * bytesPerFrame)) / length, NULL, &endGain);
+	
+	SPAudioConvertInt16ToFloat32(samples, self->renderMixScratch, sampleCount);
+	SPAudioApplyGainRamp(self->renderMixScratch, sampleCount, startGain, endGain);
+	SPAudioConvertFloat32ToInt16(self->renderMixScratch, samples, sampleCount);
+	
+	if (fadedLength + (frameCount * bytesPerFrame) >= length)
+		self->renderFadeInBuffer = nil;
+}
+
+static void SPCoreAudioControllerRecordRenderTiming(__unsafe_unretained SPCoreAudioController *self, UInt64 duration, UInt32 frameCount) {
+	
+	int32_t resetRequestCount = self->renderTimingResetRequestCount;
+	if (resetRequestCount != self->renderTimingResetAppliedCount) {
+		for (NSUInteger bucket = 0; bucket < kRenderTimingBucketCount; bucket++)
+			self->renderTimingHistogram[bucket] = 0;
+		self->renderTimingMaximumDuration = 0;
+		self->renderTimingOverrunCount = 0;
+		OSMemoryBarrier();
+		self->renderTimingResetAppliedCount = resetRequestCount;
+	}
+	
+	UInt32 clampedDuration = (UInt32)MIN(duration, (UInt64)UINT32_MAX);
+	self->renderTimingHistogram[SPCoreAudioControllerRenderTimingBucket(duration)]++;
+	if (clampedDuration > self->renderTimingMaximumDuration)
+		self->renderTimingMaximumDuration = clampedDuration;
+	
+	// The deadline is the length of the audio we were asked for, as by then the hardware will want the next lot.
+	Float64 sampleRate = self->renderSampleRate;
+	if (sampleRate <= 0.0)
+		return;
+	
+	UInt64 deadline = (UInt64)((frameCount / sampleRate) * NSEC_PER_SEC);
+	if (duration <= deadline)
+		return;
+	
+	OSAtomicIncrement32Barrier(&self->renderTimingOverrunCount);
+	
+	// We can't log from here, so leave the details for the callback queue. If it's fallen behind, only the count is kept.
+	int32_t writeCount = self->renderOverrunWriteCount;
+	if (writeCount - self->renderOverrunLoggedCount >= kMaximumPendingRenderOverruns)
+		return;
+	
+	SPCoreAudioControllerRenderOverrun *overrun = &self->renderOverruns[writeCount % kMaximumPendingRenderOverruns];
+	overrun->duration = clampedDuration;
+	overrun->deadline = (UInt32)MIN(deadline, (UInt64)UINT32_MAX);
+	overrun->outputTime = self->clockOutputTime;
+	OSMemoryBarrier();
+	self->renderOverrunWriteCount = writeCount + 1;
+}
+
+static BOOL SPCoreAudioControllerRender(__unsafe_unretained SPCoreAudioController *self, UInt32 frameCount, UInt64 hostTime, void **ioData) {
+	
+	// The sink has finished with the region we gave it last time, so release it to the writer.
+	// If the buffer has since been replaced, there's nothing to release.
+	if (self->pendingReadCommitLength > 0) {
+		if (self->pendingReadCommitBuffer == self->audioBuffer || self->pendingReadCommitBuffer == self->alternateAudioBuffer)
+			SPCircularBufferCommitRead(self->pendingReadCommitBuffer, self->pendingReadCommitLength);
+		self->pendingReadCommitBuffer = nil;
+		self->pendingReadCommitLength = 0;
+	}
+	
+	// This is the real-time thread, so we access the buffer directly through its lock-free
+	// C interface rather than taking locks or sending messages.
+	__unsafe_unretained SPCircularBuffer *audioBuffer = SPCoreAudioControllerRenderBuffer(self);
+	
+	NSUInteger bytesRequired = frameCount * self->renderBytesPerFrame;
+	
+	SPCircularBufferRegion regions[2];
+	NSUInteger availableData = SPCircularBufferAcquireReadableRegions(audioBuffer, regions);
+	UInt64 readPosition = SPCircularBufferGetTotalBytesRead(audioBuffer);
+	UInt32 framesBeforeBoundary = 0;
+	SPCoreAudioControllerTrackBoundary *boundary = SPCoreAudioControllerPeekTrackBoundary(self);
+	
+	if (bytesRequired > 0 && boundary != NULL && boundary->buffer == audioBuffer && boundary->nextBuffer != audioBuffer &&
+		boundary->position - readPosition <= MAX(boundary->crossfadeLength, bytesRequired))
+		return SPCoreAudioControllerRenderCrossfade(self, boundary, regions, readPosition, frameCount, hostTime, ioData);
+	
+	BOOL fadingIn = self->renderFadeInBuffer == audioBuffer && audioBuffer != nil;
+	
+	if (bytesRequired == 0 || availableData < bytesRequired) {
+		
+		if (bytesRequired > 0 && *ioData != NULL &&
+			(boundary = SPCoreAudioControllerNextTrackBoundary(self, audioBuffer, readPosition, availableData, &framesBeforeBoundary)) != NULL) {
+			// The session has finished delivering and nothing follows yet, so play out 
+			// the end of the track and pad the rest with silence.
+			NSUInteger boundaryLength = framesBeforeBoundary * self->renderBytesPerFrame;
+			NSUInteger directCopyLength = MIN(boundaryLength, regions[0].length);
+			memcpy(*ioData, regions[0].data, directCopyLength);
+			memcpy(*ioData + directCopyLength, regions[1].data, boundaryLength - directCopyLength);
+			memset(*ioData + boundaryLength, 0, bytesRequired - boundaryLength);
+			SPCircularBufferCommitRead(audioBuffer, boundaryLength);
 			
+			// Only the track's own audio counts towards the clock, not the padding.
+			NSTimeInterval sliceStartTime = SPCoreAudioControllerAdvanceClock(self, framesBeforeBoundary, hostTime);
+			SPCoreAudioControllerFinishTrackBoundary(self, boundary, sliceStartTime + (framesBeforeBoundary / self->renderSampleRate));
+			self->renderHasOutputAudio = NO;
+			return YES;
+		}
+		
+		if (self->renderHasOutputAudio) {
+			// We were playing and ran out of audio.
+			OSAtomicIncrement32Barrier(&self->renderUnderrunCount);
+			self->renderHasOutputAudio = NO;
 		}
+		return NO;
+    }
+	
+	// Fading in works in buffers sized for kMaximumCrossfadeSliceFrames, so, as with crossfades, larger
+	// slices can't use them. The fade-in is skipped rather than holding up playback.
+	if (frameCount > kMaximumCrossfadeSliceFrames && fadingIn) {
+		self->renderFadeInBuffer = nil;
+		fadingIn = NO;
+	}
+	
+	// A sink that only takes pointers into the buffer gets a copy in the mix output when the audio wraps
+	// around the end of a buffer that isn't mirrored, so it has to fit. If it doesn't, there's nowhere to
+	// put the audio, so it's skipped as if it had played rather than left to block every slice after it.
+	if ((fadingIn || regions[0].length < bytesRequired) && *ioData == NULL &&
+		(self->renderMixOutput == NULL || bytesRequired > kMaximumCrossfadeSliceFrames * kMaximumCrossfadeChannelCount * sizeof(SInt16))) {
+		SPCircularBufferCommitRead(audioBuffer, bytesRequired);
+		NSTimeInterval sliceStartTime = SPCoreAudioControllerAdvanceClock(self, frameCount, hostTime);
+		boundary = SPCoreAudioControllerNextTrackBoundary(self, audioBuffer, readPosition, bytesRequired, &framesBeforeBoundary);
+		if (boundary != NULL)
+			SPCoreAudioControllerFinishTrackBoundary(self, boundary, sliceStartTime + (framesBeforeBoundary / self->renderSampleRate));
+		return NO;
 	}
     
-    return noErr;
+	if (regions[0].length >= bytesRequired && !fadingIn) {
+		// No wraparound, so hand out the buffer's own memory rather than copying.
+		*ioData = regions[0].data;
+		self->pendingReadCommitBuffer = audioBuffer;
+		self->pendingReadCommitLength = bytesRequired;
+	} else {
+		if (*ioData == NULL)
+			*ioData = self->renderMixOutput;
+		NSUInteger directCopyLength = MIN(bytesRequired, regions[0].length);
+		memcpy(*ioData, regions[0].data, directCopyLength);
+		memcpy(*ioData + directCopyLength, regions[1].data, bytesRequired - directCopyLength);
+		if (fadingIn)
+			SPCoreAudioControllerApplyFadeIn(self, readPosition, frameCount, *ioData);
+		SPCircularBufferCommitRead(audioBuffer, bytesRequired);
+	}
+	
+	self->renderHasOutputAudio = YES;
+	
+	NSTimeInterval sliceStartTime = SPCoreAudioControllerAdvanceClock(self, frameCount, hostTime);
+	boundary = SPCoreAudioControllerNextTrackBoundary(self, audioBuffer, readPosition, bytesRequired, &framesBeforeBoundary);
+	if (boundary != NULL)
+		SPCoreAudioControllerFinishTrackBoundary(self, boundary, sliceStartTime + (framesBeforeBoundary / self->renderSampleRate));
+	
+    return YES;
 }
 
--(void)incrementTrackPositionWithFrameCount:(UInt32)framesToAppend {
-	[self.delegate coreAudioController:self didOutputAudioOfDuration:framesToAppend/self.inputAudioDescription.mSampleRate];
+// Applies the volume to a rendered slice in place, ramping across it to any new volume to avoid zipper noise.
+// This is done here rather than in the sink so every sink gets it. At full volume the audio is left untouched.
+static void SPCoreAudioControllerApplyVolume(__unsafe_unretained SPCoreAudioController *self, UInt32 frameCount, SInt16 *samples) {
+	
+	float startGain = self->renderGain;
+	float endGain = self->renderTargetGain;
+	
+	if ((startGain == 1.0f && endGain == 1.0f) || !self->renderCanApplyGain)
+		return;
+	
+	// The scratch buffer holds kMaximumCrossfadeSliceFrames, so larger slices are done in parts along one ramp.
+	UInt32 channelCount = self->renderChannelCount;
+	float gainStep = (endGain - startGain) / frameCount;
+	
+	for (UInt32 frame = 0; frame < frameCount; frame += kMaximumCrossfadeSliceFrames) {
+		UInt32 partFrameCount = MIN(frameCount - frame, kMaximumCrossfadeSliceFrames);
+		NSUInteger sampleCount = partFrameCount * channelCount;
+		SInt16 *partSamples = samples + (frame * channelCount);
+		
+		SPAudioConvertInt16ToFloat32(partSamples, self->renderMixScratch, sampleCount);
+		SPAudioApplyGainRamp(self->renderMixScratch, sampleCount, startGain + (gainStep * frame), startGain + (gainStep * (frame + partFrameCount)));
+		SPAudioConvertFloat32ToInt16(self->renderMixScratch, partSamples, sampleCount);
+	}
+	
+	self->renderGain = endGain;
+}
+
+static BOOL SPCoreAudioControllerRenderCallback(void *context, uint32_t frameCount, uint64_t hostTime, void **ioData) {
+	
+    __unsafe_unretained SPCoreAudioController *self = (__bridge SPCoreAudioController *)context;
+	BOOL measuresTiming = self->measuresRenderTiming;
+	UInt64 start = measuresTiming ? SPCoreAudioControllerCurrentHostTime() : 0;
+	
+	BOOL rendered = SPCoreAudioControllerRender(self, frameCount, hostTime, ioData);
+	if (rendered && *ioData != NULL)
+		SPCoreAudioControllerApplyVolume(self, frameCount, *ioData);
+	
+	if (measuresTiming)
+		SPCoreAudioControllerRecordRenderTiming(self, SPCoreAudioControllerCurrentHostTime() - start, frameCount);
+	return rendered;
 }
 
 @end
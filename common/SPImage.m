@@ -31,7 +31,9 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #import "SPImage.h"
+#import "SPObjectCache.h"
 #import "SPSession.h"
+#import "SPSessionInternal.h"
 #import "SPURLExtensions.h"
 
 @interface SPImageCallbackProxy : NSObject
@@ -58,6 +60,16 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 @end
 
+static NSUInteger SPImageDecodedSize(SPPlatformNativeImage *image) {
+	if (image == nil) return 0;
+#if TARGET_OS_IPHONE
+	CGFloat scale = image.scale;
+#else
+	CGFloat scale = 1.0;
+#endif
+	return (NSUInteger)(image.size.width * scale) * (NSUInteger)(image.size.height * scale) * 4;
+}
+
 static void image_loaded(sp_image *image, void *userdata) {
 	
 	SPImageCallbackProxy *proxy = (__bridge SPImageCallbackProxy *)userdata;
@@ -74,7 +86,7 @@ static void image_loaded(sp_image *image, void *userdata) {
 			im = [[SPPlatformNativeImage alloc] initWithData:[NSData dataWithBytes:data length:size]];
 	}
 
-	dispatch_async(dispatch_get_main_queue(), ^{
+	SPDispatchToCallbackQueue(proxy.image.session, ^{
 		proxy.image.image = im;
 		proxy.image.loaded = isLoaded;
 	});
@@ -84,24 +96,18 @@ static void image_loaded(sp_image *image, void *userdata) {
 	BOOL hasRequestedImage;
 	BOOL hasStartedLoading;
 	SPPlatformNativeImage *_image;
+	NSData *_imageIdData;
 }
 
-static NSMutableDictionary *imageCache;
-
 +(SPImage *)imageWithImageId:(const byte *)imageId inSession:(SPSession *)aSession {
 
 	SPAssertOnLibSpotifyThread();
 	
-    if (imageCache == nil) {
-        imageCache = [[NSMutableDictionary alloc] init];
-    }
-    
 	if (imageId == NULL) {
 		return nil;
 	}
 	
-	NSData *imageIdAsData = [NSData dataWithBytes:imageId length:SPImageIdLength];
-	SPImage *cachedImage = [imageCache objectForKey:imageIdAsData];
+	SPImage *cachedImage = [aSession.imageCache objectForKeyBytes:imageId];
 	
 	if (cachedImage != nil)
 		return cachedImage;
@@ -109,7 +115,7 @@ static NSMutableDictionary *imageCache;
 	cachedImage = [[SPImage alloc] initWithImageStruct:NULL
 											   imageId:imageId
 											 inSession:aSession];
-	[imageCache setObject:cachedImage forKey:imageIdAsData];
+	[aSession.imageCache setObject:cachedImage forKeyBytes:imageId cost:0];
 	return cachedImage;
 }
 
@@ -134,7 +140,7 @@ static NSMutableDictionary *imageCache;
 			sp_image_release(image);
 		}
 		
-		if (block) dispatch_async(dispatch_get_main_queue(), ^() { block(spImage); });
+		if (block) SPDispatchToCallbackQueue(aSession, ^() { block(spImage); });
 	});
 }
 
@@ -148,6 +154,7 @@ static NSMutableDictionary *imageCache;
 		
 		self.session = aSession;
 		self.imageId = anId;
+		if (anId != NULL) _imageIdData = [NSData dataWithBytes:anId length:SPImageIdLength];
 		
 		if (anImage != NULL) {
 			self.spImage = anImage;
@@ -171,7 +178,7 @@ static NSMutableDictionary *imageCache;
 					im = [[SPPlatformNativeImage alloc] initWithData:[NSData dataWithBytes:data length:size]];
 			}
 
-			dispatch_async(dispatch_get_main_queue(), ^{
+			SPDispatchToCallbackQueue(self.session, ^{
 				[self cacheSpotifyURL];
 				self.image = im;
 				self.loaded = isLoaded;
@@ -204,6 +211,8 @@ static NSMutableDictionary *imageCache;
 -(void)setImage:(SPPlatformNativeImage *)anImage {
 	if (_image != anImage) {
 		_image = anImage;
+		// Decoded bitmaps are what the image cache is budgeting for.
+		[self.session.imageCache setCost:SPImageDecodedSize(anImage) forKeyBytes:_imageIdData.bytes];
 	}
 }
 
@@ -214,40 +223,40 @@ static NSMutableDictionary *imageCache;
 	if (hasStartedLoading) return;
 	hasStartedLoading = YES;
 	
-	SPDispatchAsync(^{
+	SPDispatchAsyncCoalesced(self, _cmd, ^(SPImage *image) {
 		
-		if (self.spImage != NULL)
+		if (image.spImage != NULL)
 			return;
 		
-		sp_image *newImage = sp_image_create(self.session.session, self.imageId);
-		self.spImage = newImage;
+		sp_image *newImage = sp_image_create(image.session.session, image.imageId);
+		image.spImage = newImage;
 		
-		if (self.spImage != NULL) {
-			[self cacheSpotifyURL];
+		if (image.spImage != NULL) {
+			[image cacheSpotifyURL];
 			
 			// Clear out previous proxy.
-			self.callbackProxy.image = nil;
-			self.callbackProxy = nil;
+			image.callbackProxy.image = nil;
+			image.callbackProxy = nil;
 			
-			self.callbackProxy = [[SPImageCallbackProxy alloc] init];
-			self.callbackProxy.image = self;
+			image.callbackProxy = [[SPImageCallbackProxy alloc] init];
+			image.callbackProxy.image = image;
 			
-			sp_image_add_load_callback(self.spImage, &image_loaded, (__bridge void *)(self.callbackProxy));
-			BOOL isLoaded = sp_image_is_loaded(self.spImage);
+			sp_image_add_load_callback(image.spImage, &image_loaded, (__bridge void *)(image.callbackProxy));
+			BOOL isLoaded = sp_image_is_loaded(image.spImage);
 			SPPlatformNativeImage *im = nil;
 			
 			if (isLoaded) {
 				size_t size;
-				const byte *data = sp_image_data(self.spImage, &size);
+				const byte *data = sp_image_data(image.spImage, &size);
 				
 				if (size > 0)
 					im = [[SPPlatformNativeImage alloc] initWithData:[NSData dataWithBytes:data length:size]];
 			}
 			
-			dispatch_async(dispatch_get_main_queue(), ^{
-				hasRequestedImage = YES;
-				self.image = im;
-				self.loaded = isLoaded;
+			SPDispatchToCallbackQueue(image.session, ^{
+				image->hasRequestedImage = YES;
+				image.image = im;
+				image.loaded = isLoaded;
 			});
 		}
 	});
@@ -269,18 +278,18 @@ static NSMutableDictionary *imageCache;
 
 -(void)cacheSpotifyURL {
 	
-	SPDispatchAsync(^{
+	SPDispatchAsyncCoalesced(self, _cmd, ^(SPImage *image) {
 
-		if (self.spotifyURL != NULL)
+		if (image.spotifyURL != NULL)
 			return;
 		
-		sp_link *link = sp_link_create_from_image(self.spImage);
+		sp_link *link = sp_link_create_from_image(image.spImage);
 		
 		if (link != NULL) {
 			NSURL *url = [NSURL urlWithSpotifyLink:link];
 			sp_link_release(link);
-			dispatch_async(dispatch_get_main_queue(), ^{
-				self.spotifyURL = url;
+			SPDispatchToCallbackQueue(image.session, ^{
+				image.spotifyURL = url;
 			});
 		}
 	});
@@ -0,0 +1,82 @@
+//
+//  SPKeyTable.h
+//  CocoaLibSpotify
+//
+/*
+ Copyright (c) 2011, Spotify AB
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of Spotify AB nor the names of its contributors may 
+ be used to endorse or promote products derived from this software 
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL SPOTIFY AB BE LIABLE FOR ANY DIRECT, INDIRECT,
+ INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// A hash table from fixed-length keys, such as libSpotify struct pointers or image IDs, to pointers.
+// Keys are copied into the table itself and compared as bytes, so looking something up never allocates
+// or sends a message. It uses open addressing with linear probing, and grows to stay at most half full.
+// It isn't thread-safe; callers do their own locking.
+
+#import <Foundation/Foundation.h>
+
+/** The longest key a table can have, in bytes. */
+#define SPKeyTableMaximumKeyLength 32
+
+typedef struct SPKeyTable SPKeyTable;
+
+/** Creates an empty table.
+ 
+ @param keyLength The length of every key in the table, in bytes. At most `SPKeyTableMaximumKeyLength`.
+ @return Returns the new table, to be destroyed with SPKeyTableDestroy().
+ */
+extern SPKeyTable *SPKeyTableCreate(size_t keyLength);
+
+/** Destroys a table. The values in it are left alone. */
+extern void SPKeyTableDestroy(SPKeyTable *table);
+
+/** Returns the length of the table's keys, in bytes. */
+extern size_t SPKeyTableGetKeyLength(const SPKeyTable *table);
+
+/** Returns the number of keys in the table. */
+extern NSUInteger SPKeyTableGetCount(const SPKeyTable *table);
+
+/** Returns the value for the given key, or `NULL` if the key isn't in the table.
+ 
+ @param table The table to look in.
+ @param key The key, which is `SPKeyTableGetKeyLength()` bytes long.
+ */
+extern void *SPKeyTableGetValue(const SPKeyTable *table, const void *key);
+
+/** Sets the value for the given key, and returns the value it replaced, if any.
+ 
+ @param table The table to change.
+ @param key The key, which is `SPKeyTableGetKeyLength()` bytes long. It's copied.
+ @param value The value. Must not be `NULL`.
+ */
+extern void *SPKeyTableSetValue(SPKeyTable *table, const void *key, void *value);
+
+/** Removes the given key, and returns its value, if any. */
+extern void *SPKeyTableRemoveValue(SPKeyTable *table, const void *key);
+
+/** Removes every key. The values are left alone. */
+extern void SPKeyTableRemoveAllValues(SPKeyTable *table);
+
+/** Calls the given function with every key and value in the table. The function mustn't change the table. */
+extern void SPKeyTableApplyFunction(const SPKeyTable *table, void (*function)(const void *key, void *value, void *context), void *context);
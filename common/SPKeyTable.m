@@ -0,0 +1,210 @@
+//
+//  SPKeyTable.m
+//  CocoaLibSpotify
+//
+/*
+ Copyright (c) 2011, Spotify AB
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of Spotify AB nor the names of its contributors may 
+ be used to endorse or promote products derived from this software 
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL SPOTIFY AB BE LIABLE FOR ANY DIRECT, INDIRECT,
+ INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "SPKeyTable.h"
+
+static NSUInteger const kSPKeyTableMinimumCapacity = 16; // Always a power of two.
+
+// A slot is its key's hash and value, followed by the key. An empty slot has a NULL value.
+typedef struct SPKeyTableSlot {
+	NSUInteger hash;
+	void *value;
+	uint8_t key[];
+} SPKeyTableSlot;
+
+struct SPKeyTable {
+	size_t keyLength;
+	size_t slotSize;
+	NSUInteger capacity;
+	NSUInteger count;
+	uint8_t *slots;
+};
+
+static inline SPKeyTableSlot *SPKeyTableSlotAtIndex(const SPKeyTable *table, NSUInteger index) {
+	return (SPKeyTableSlot *)(table->slots + (index * table->slotSize));
+}
+
+static inline NSUInteger SPKeyTableHash(const SPKeyTable *table, const void *key) {
+	
+	if (table->keyLength == sizeof(uint64_t) || table->keyLength == sizeof(uint32_t)) {
+		// Pointers and IDs. Their low bits are often all the same, so mix the whole value into them.
+		uint64_t value = 0;
+		memcpy(&value, key, table->keyLength);
+		value ^= value >> 33;
+		value *= 0xff51afd7ed558ccdULL;
+		value ^= value >> 33;
+		value *= 0xc4ceb9fe1a85ec53ULL;
+		value ^= value >> 33;
+		return (NSUInteger)value;
+	}
+	
+	// FNV-1a.
+	const uint8_t *bytes = key;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t index = 0; index < table->keyLength; index++) {
+		hash ^= bytes[index];
+		hash *= 0x100000001b3ULL;
+	}
+	return (NSUInteger)(hash ^ (hash >> 32));
+}
+
+// Returns the slot holding the key, or the empty slot it would go in.
+static inline SPKeyTableSlot *SPKeyTableFindSlot(const SPKeyTable *table, const void *key, NSUInteger hash) {
+	NSUInteger mask = table->capacity - 1;
+	for (NSUInteger index = hash & mask; ; index = (index + 1) & mask) {
+		SPKeyTableSlot *slot = SPKeyTableSlotAtIndex(table, index);
+		if (slot->value == NULL || (slot->hash == hash && memcmp(slot->key, key, table->keyLength) == 0))
+			return slot;
+	}
+}
+
+static void SPKeyTableResize(SPKeyTable *table, NSUInteger capacity) {
+	
+	uint8_t *oldSlots = table->slots;
+	NSUInteger oldCapacity = table->capacity;
+	
+	table->slots = calloc(capacity, table->slotSize);
+	table->capacity = capacity;
+	
+	for (NSUInteger index = 0; index < oldCapacity; index++) {
+		SPKeyTableSlot *oldSlot = (SPKeyTableSlot *)(oldSlots + (index * table->slotSize));
+		if (oldSlot->value != NULL)
+			memcpy(SPKeyTableFindSlot(table, oldSlot->key, oldSlot->hash), oldSlot, table->slotSize);
+	}
+	
+	free(oldSlots);
+}
+
+SPKeyTable *SPKeyTableCreate(size_t keyLength) {
+	
+	if (keyLength == 0 || keyLength > SPKeyTableMaximumKeyLength)
+		return NULL;
+	
+	SPKeyTable *table = calloc(1, sizeof(SPKeyTable));
+	table->keyLength = keyLength;
+	// Keep every slot's header aligned.
+	table->slotSize = (sizeof(SPKeyTableSlot) + keyLength + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	table->capacity = kSPKeyTableMinimumCapacity;
+	table->slots = calloc(table->capacity, table->slotSize);
+	return table;
+}
+
+void SPKeyTableDestroy(SPKeyTable *table) {
+	if (table == NULL) return;
+	free(table->slots);
+	free(table);
+}
+
+size_t SPKeyTableGetKeyLength(const SPKeyTable *table) {
+	return table->keyLength;
+}
+
+NSUInteger SPKeyTableGetCount(const SPKeyTable *table) {
+	return table->count;
+}
+
+void *SPKeyTableGetValue(const SPKeyTable *table, const void *key) {
+	return SPKeyTableFindSlot(table, key, SPKeyTableHash(table, key))->value;
+}
+
+void *SPKeyTableSetValue(SPKeyTable *table, const void *key, void *value) {
+	
+	if (value == NULL)
+		return SPKeyTableRemoveValue(table, key);
+	
+	NSUInteger hash = SPKeyTableHash(table, key);
+	SPKeyTableSlot *slot = SPKeyTableFindSlot(table, key, hash);
+	
+	if (slot->value != NULL) {
+		void *oldValue = slot->value;
+		slot->value = value;
+		return oldValue;
+	}
+	
+	if ((table->count + 1) * 2 > table->capacity) {
+		SPKeyTableResize(table, table->capacity * 2);
+		slot = SPKeyTableFindSlot(table, key, hash);
+	}
+	
+	slot->hash = hash;
+	slot->value = value;
+	memcpy(slot->key, key, table->keyLength);
+	table->count++;
+	return NULL;
+}
+
+void *SPKeyTableRemoveValue(SPKeyTable *table, const void *key) {
+	
+	SPKeyTableSlot *slot = SPKeyTableFindSlot(table, key, SPKeyTableHash(table, key));
+	void *oldValue = slot->value;
+	if (oldValue == NULL)
+		return NULL;
+	
+	// Shift back any later slots in the run that would no longer be found past the gap.
+	NSUInteger mask = table->capacity - 1;
+	NSUInteger gap = (NSUInteger)(((uint8_t *)slot - table->slots) / table->slotSize);
+	for (NSUInteger index = (gap + 1) & mask; ; index = (index + 1) & mask) {
+		SPKeyTableSlot *next = SPKeyTableSlotAtIndex(table, index);
+		if (next->value == NULL)
+			break;
+		
+		NSUInteger home = next->hash & mask;
+		BOOL homeIsAfterGap = (index > gap) ? (home > gap && home <= index) : (home > gap || home <= index);
+		if (homeIsAfterGap)
+			continue;
+		
+		memcpy(SPKeyTableSlotAtIndex(table, gap), next, table->slotSize);
+		gap = index;
+	}
+	
+	SPKeyTableSlotAtIndex(table, gap)->value = NULL;
+	table->count--;
+	
+	if (table->capacity > kSPKeyTableMinimumCapacity && table->count * 8 < table->capacity)
+		SPKeyTableResize(table, table->capacity / 2);
+	
+	return oldValue;
+}
+
+void SPKeyTableRemoveAllValues(SPKeyTable *table) {
+	free(table->slots);
+	table->capacity = kSPKeyTableMinimumCapacity;
+	table->slots = calloc(table->capacity, table->slotSize);
+	table->count = 0;
+}
+
+void SPKeyTableApplyFunction(const SPKeyTable *table, void (*function)(const void *key, void *value, void *context), void *context) {
+	for (NSUInteger index = 0; index < table->capacity; index++) {
+		SPKeyTableSlot *slot = SPKeyTableSlotAtIndex(table, index);
+		if (slot->value != NULL)
+			function(slot->key, slot->value, context);
+	}
+}
@@ -0,0 +1,90 @@
+//
+//  SPNullAudioOutputSink.h
+//  CocoaLibSpotify
+//
+/*
+ Copyright (c) 2011, Spotify AB
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of Spotify AB nor the names of its contributors may 
+ be used to endorse or promote products derived from this software 
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL SPOTIFY AB BE LIABLE FOR ANY DIRECT, INDIRECT,
+ INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// This class consumes audio on a timer without needing any audio hardware, optionally writing
+// the raw PCM to a file. It's useful for headless playback, testing and benchmarking.
+
+#import <Foundation/Foundation.h>
+#import "SPAudioOutputSink.h"
+
+/**
+ Outputs audio to nowhere, or to a file, at the rate it would be played back.
+ 
+ The sink pulls audio on a high-resolution timer, working out how many frames are due from the
+ host clock, so it consumes audio at the same average rate a real audio device would.
+ */
+
+@interface SPNullAudioOutputSink : NSObject <SPAudioOutputSink>
+
+/**
+ Initializes a sink that writes the audio it pulls to the given file.
+ 
+ Audio is written as raw PCM in the format it was delivered in. Any existing file
+ at the URL is replaced when the sink is prepared.
+ 
+ @param aFileURL The file URL to write audio to, or `nil` to discard audio.
+ @return Returns the initialized sink.
+ */
+-(id)initWithFileURL:(NSURL *)aFileURL;
+
+/** Returns the file URL audio is written to, or `nil` if audio is discarded. */
+@property (readonly, nonatomic, copy) NSURL *fileURL;
+
+/** 
+ Returns the number of frames the sink pulls at a time. Defaults to `512`.
+ 
+ Changes take effect the next time the sink is prepared.
+ */
+@property (readwrite, nonatomic) uint32_t framesPerSlice;
+
+/** 
+ Returns how fast the sink consumes audio compared to real time. Defaults to `1.0`.
+ 
+ Raising this allows the audio pipeline to be benchmarked faster than real time. Changes take
+ effect the next time output is started.
+ */
+@property (readwrite, nonatomic) double playbackRate;
+
+/** 
+ Returns whether the sink gives the render callback a buffer to render into. Defaults to `YES`.
+ 
+ Set this to `NO` to pull audio the way the AUGraph sink's hardware path does, taking a pointer
+ to audio the render callback already has instead.
+ */
+@property (readwrite) BOOL providesOutputBuffer;
+
+/** Returns the number of frames of audio the sink has consumed. */
+@property (readonly) uint64_t renderedFrameCount;
+
+/** Returns the number of frames of silence the sink output because no audio was available. */
+@property (readonly) uint64_t silentFrameCount;
+
+@end
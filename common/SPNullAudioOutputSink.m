@@ -0,0 +1,278 @@
+//
+//  SPNullAudioOutputSink.m
+//  CocoaLibSpotify
+//
+/*
+ Copyright (c) 2011, Spotify AB
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of Spotify AB nor the names of its contributors may 
+ be used to endorse or promote products derived from this software 
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL SPOTIFY AB BE LIABLE FOR ANY DIRECT, INDIRECT,
+ INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "SPNullAudioOutputSink.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <mach/mach_time.h>
+
+static uint32_t const kDefaultFramesPerSlice = 512;
+
+// If we fall further behind than this (for instance, the process was suspended), 
+// skip ahead like a real audio device would rather than pulling everything we missed at once.
+static NSTimeInterval const kMaximumCatchUpDuration = 0.25;
+
+static NSTimeInterval SPNullAudioOutputSinkCurrentTime(void) {
+	static mach_timebase_info_data_t timebase;
+	if (timebase.denom == 0)
+		mach_timebase_info(&timebase);
+	return ((double)mach_absolute_time() * timebase.numer / timebase.denom) / NSEC_PER_SEC;
+}
+
+@interface SPNullAudioOutputSink ()
+
+@property (readwrite, nonatomic, copy) NSURL *fileURL;
+
+-(void)pullDueFrames;
+
+@end
+
+@implementation SPNullAudioOutputSink {
+	
+	dispatch_queue_t outputQueue;
+	dispatch_source_t outputTimer;
+	
+	SPAudioOutputFormat inputFormat;
+	SPAudioOutputRenderCallback renderCallback;
+	void *renderContext;
+	BOOL prepared;
+	
+	void *sliceBuffer;
+	uint32_t sliceFrameCount;
+	FILE *outputFile;
+	
+	// Only touched on outputQueue.
+	NSTimeInterval clockStartTime;
+	uint64_t framesPulledSinceClockStart;
+	
+	_Atomic uint64_t renderedFrameCount;
+	_Atomic uint64_t silentFrameCount;
+}
+
+-(id)init {
+	return [self initWithFileURL:nil];
+}
+
+-(id)initWithFileURL:(NSURL *)aFileURL {
+	self = [super init];
+	
+	if (self) {
+		self.fileURL = aFileURL;
+		self.framesPerSlice = kDefaultFramesPerSlice;
+		self.playbackRate = 1.0;
+		self.providesOutputBuffer = YES;
+		
+		outputQueue = dispatch_queue_create("com.spotify.CocoaLibSpotify.nullaudiooutput", DISPATCH_QUEUE_SERIAL);
+		dispatch_set_target_queue(outputQueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0));
+	}
+	return self;
+}
+
+-(void)dealloc {
+	[self teardown];
+	dispatch_release(outputQueue);
+}
+
+@synthesize fileURL;
+@synthesize framesPerSlice;
+@synthesize playbackRate;
+@synthesize providesOutputBuffer;
+
+-(BOOL)isPrepared {
+	return prepared;
+}
+
+-(uint64_t)renderedFrameCount {
+	return atomic_load(&renderedFrameCount);
+}
+
+-(uint64_t)silentFrameCount {
+	return atomic_load(&silentFrameCount);
+}
+
+#pragma mark -
+#pragma mark Setup and Teardown
+
+-(BOOL)prepareWithInputFormat:(SPAudioOutputFormat)format
+			   renderCallback:(SPAudioOutputRenderCallback)callback
+					  context:(void *)context
+						error:(NSError **)error {
+	
+	if (prepared)
+		[self teardown];
+	
+	if (self.fileURL != nil) {
+		outputFile = fopen([[self.fileURL path] fileSystemRepresentation], "wb");
+		if (outputFile == NULL) {
+			if (error != NULL)
+				*error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+			return NO;
+		}
+	}
+	
+	renderCallback = callback;
+	renderContext = context;
+	sliceFrameCount = MAX(self.framesPerSlice, 1);
+	prepared = YES;
+	
+	if (![self applyInputFormat:format error:error]) {
+		[self teardown];
+		return NO;
+	}
+	
+	[self startOutput];
+	return YES;
+}
+
+-(BOOL)applyInputFormat:(SPAudioOutputFormat)format error:(NSError **)error {
+	
+	if (!prepared)
+		return NO;
+	
+	if (format.bytesPerFrame == 0 || format.sampleRate <= 0.0) {
+		if (error != NULL)
+			*error = [NSError errorWithDomain:NSPOSIXErrorDomain code:EINVAL userInfo:nil];
+		return NO;
+	}
+	
+	// Swap the format over between pulls, and restart the clock since frames are now a different length.
+	void *newSliceBuffer = calloc(sliceFrameCount, format.bytesPerFrame);
+	__block void *oldSliceBuffer = NULL;
+	
+	dispatch_sync(outputQueue, ^{
+		inputFormat = format;
+		oldSliceBuffer = sliceBuffer;
+		sliceBuffer = newSliceBuffer;
+		clockStartTime = SPNullAudioOutputSinkCurrentTime();
+		framesPulledSinceClockStart = 0;
+	});
+	
+	free(oldSliceBuffer);
+	return YES;
+}
+
+-(void)teardown {
+	
+	if (!prepared)
+		return;
+	
+	[self stopOutput];
+	
+	if (outputFile != NULL) {
+		fclose(outputFile);
+		outputFile = NULL;
+	}
+	
+	free(sliceBuffer);
+	sliceBuffer = NULL;
+	renderCallback = NULL;
+	renderContext = NULL;
+	prepared = NO;
+}
+
+#pragma mark -
+#pragma mark Output Control
+
+-(void)startOutput {
+	
+	if (!prepared || outputTimer != NULL)
+		return;
+	
+	double rate = self.playbackRate > 0.0 ? self.playbackRate : 1.0;
+	NSTimeInterval sliceDuration = sliceFrameCount / inputFormat.sampleRate;
+	uint64_t interval = (uint64_t)((sliceDuration / rate) * NSEC_PER_SEC);
+	
+	outputTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, outputQueue);
+	dispatch_source_set_timer(outputTimer, dispatch_time(DISPATCH_TIME_NOW, interval), interval, interval / 10);
+	
+	__unsafe_unretained SPNullAudioOutputSink *weakSelf = self;
+	dispatch_source_set_event_handler(outputTimer, ^{
+		[weakSelf pullDueFrames];
+	});
+	
+	dispatch_sync(outputQueue, ^{
+		clockStartTime = SPNullAudioOutputSinkCurrentTime();
+		framesPulledSinceClockStart = 0;
+	});
+	
+	dispatch_resume(outputTimer);
+}
+
+-(void)stopOutput {
+	
+	if (outputTimer == NULL)
+		return;
+	
+	dispatch_source_cancel(outputTimer);
+	dispatch_release(outputTimer);
+	outputTimer = NULL;
+	
+	// Wait for any pull that's already under way, so the render callback isn't called after we return.
+	dispatch_sync(outputQueue, ^{});
+}
+
+#pragma mark -
+#pragma mark Pulling Audio
+
+-(void)pullDueFrames {
+	
+	if (renderCallback == NULL || sliceBuffer == NULL)
+		return;
+	
+	double rate = self.playbackRate > 0.0 ? self.playbackRate : 1.0;
+	NSTimeInterval elapsed = (SPNullAudioOutputSinkCurrentTime() - clockStartTime) * rate;
+	uint64_t framesDue = (uint64_t)(elapsed * inputFormat.sampleRate);
+	
+	if (framesDue > framesPulledSinceClockStart + (kMaximumCatchUpDuration * inputFormat.sampleRate))
+		framesPulledSinceClockStart = framesDue - sliceFrameCount;
+	
+	while (framesDue >= framesPulledSinceClockStart + sliceFrameCount) {
+		
+		// Only a real-time clock lines up with the host's, so there's no meaningful timestamp otherwise.
+		uint64_t hostTime = 0;
+		if (rate == 1.0)
+			hostTime = (uint64_t)((clockStartTime + ((double)framesPulledSinceClockStart / inputFormat.sampleRate)) * NSEC_PER_SEC);
+		
+		void *data = self.providesOutputBuffer ? sliceBuffer : NULL;
+		if (renderCallback(renderContext, sliceFrameCount, hostTime, &data)) {
+			if (outputFile != NULL)
+				fwrite(data, inputFormat.bytesPerFrame, sliceFrameCount, outputFile);
+			atomic_fetch_add(&renderedFrameCount, sliceFrameCount);
+		} else {
+			atomic_fetch_add(&silentFrameCount, sliceFrameCount);
+		}
+		
+		framesPulledSinceClockStart += sliceFrameCount;
+	}
+}
+
+@end
@@ -0,0 +1,168 @@
+//
+//  SPObjectCache.h
+//  CocoaLibSpotify
+//
+/*
+ Copyright (c) 2011, Spotify AB
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of Spotify AB nor the names of its contributors may 
+ be used to endorse or promote products derived from this software 
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL SPOTIFY AB BE LIABLE FOR ANY DIRECT, INDIRECT,
+ INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** This class caches the objects CocoaLibSpotify wraps libSpotify's metadata in, within a budget.
+ 
+ The cache holds up to `countLimit` objects, and up to `totalCostLimit` in total cost, strongly. When either
+ limit is passed, the least recently used objects are evicted. An evicted object is only dropped by the cache,
+ though: as long as something else still holds it, looking up its key returns it again, so there's only ever
+ one object per key. Once nothing holds an evicted object, it's deallocated and its key misses.
+ 
+ Keys are a fixed number of bytes, such as a libSpotify struct pointer or an image ID, and are looked up
+ without allocating anything. To use a pointer as a key, pass the address of the variable holding it.
+ 
+ All methods are thread-safe.
+ */
+
+#import <Foundation/Foundation.h>
+
+@interface SPObjectCache : NSObject
+
+/** Initialize a new cache keyed by pointers.
+ 
+ @param countLimit The number of objects to hold strongly, or `0` for no limit.
+ @param costLimit The total cost of the objects to hold strongly, or `0` for no limit.
+ @return Returns the newly created SPObjectCache.
+ */
+-(id)initWithCountLimit:(NSUInteger)countLimit totalCostLimit:(NSUInteger)costLimit;
+
+/** Initialize a new cache with keys of the given length.
+ 
+ @param keyLength The length of every key, in bytes. At most 32.
+ @param countLimit The number of objects to hold strongly, or `0` for no limit.
+ @param costLimit The total cost of the objects to hold strongly, or `0` for no limit.
+ @return Returns the newly created SPObjectCache.
+ */
+-(id)initWithKeyLength:(size_t)keyLength countLimit:(NSUInteger)countLimit totalCostLimit:(NSUInteger)costLimit;
+
+/** Returns the length of the cache's keys, in bytes. */
+@property (nonatomic, readonly) size_t keyLength;
+
+///----------------------------
+/// @name Accessing Objects
+///----------------------------
+
+/** Returns the object for the given key, or `nil` if there isn't one.
+ 
+ An object that's been evicted but is still held elsewhere is returned, and held strongly again.
+ 
+ @param key The key to look up, which is `keyLength` bytes long.
+ @return Returns the object for the key.
+ */
+-(id)objectForKeyBytes:(const void *)key;
+
+/** Adds an object to the cache, replacing any object already there for the key.
+ 
+ @param object The object to add.
+ @param key The key for the object, which is `keyLength` bytes long. It is copied.
+ @param cost The cost of holding the object, such as its size in bytes.
+ */
+-(void)setObject:(id)object forKeyBytes:(const void *)key cost:(NSUInteger)cost;
+
+/** Changes the cost of the object for the given key, for objects whose cost changes after they're added.
+ 
+ If there's no object for the key, this does nothing.
+ 
+ @param cost The new cost of holding the object.
+ @param key The key for the object, which is `keyLength` bytes long.
+ */
+-(void)setCost:(NSUInteger)cost forKeyBytes:(const void *)key;
+
+/** Returns every object that can be looked up: those held strongly, and evicted objects still held elsewhere. */
+-(NSArray *)allObjects;
+
+/** Removes the object for the given key. 
+ 
+ @param key The key for the object, which is `keyLength` bytes long.
+ */
+-(void)removeObjectForKeyBytes:(const void *)key;
+
+/** Removes all objects. */
+-(void)removeAllObjects;
+
+///----------------------------
+/// @name Limits
+///----------------------------
+
+/** Returns the number of objects held strongly before the least recently used are evicted, or `0` for no limit. */
+@property (nonatomic, readwrite) NSUInteger countLimit;
+
+/** Returns the total cost of the objects held strongly before the least recently used are evicted, or `0` for no limit. */
+@property (nonatomic, readwrite) NSUInteger totalCostLimit;
+
+/** Returns the number of objects held strongly. */
+@property (readonly) NSUInteger count;
+
+/** Returns the total cost of the objects held strongly. */
+@property (readonly) NSUInteger totalCost;
+
+///----------------------------
+/// @name Statistics
+///----------------------------
+
+/** Returns the number of lookups that returned an object, including evicted objects that were still held elsewhere. */
+@property (readonly) NSUInteger hitCount;
+
+/** Returns the number of lookups that didn't return an object. */
+@property (readonly) NSUInteger missCount;
+
+/** Returns the number of objects evicted to stay within the limits. */
+@property (readonly) NSUInteger evictionCount;
+
+/** Returns the cache's counts and limits, all taken at the same moment. See Constants for keys. */
+-(NSDictionary *)statistics;
+
+@end
+
+///----------------------------
+/// @name Object Cache Statistics Keys
+///----------------------------
+
+/** @constant The number of objects held strongly as an `NSNumber`. */
+static NSString * const SPObjectCacheCountKey = @"SPObjectCacheCount";
+
+/** @constant The total cost of the objects held strongly as an `NSNumber`. */
+static NSString * const SPObjectCacheTotalCostKey = @"SPObjectCacheTotalCost";
+
+/** @constant The number of objects held strongly before the least recently used are evicted as an `NSNumber`. `0` means no limit. */
+static NSString * const SPObjectCacheCountLimitKey = @"SPObjectCacheCountLimit";
+
+/** @constant The total cost of the objects held strongly before the least recently used are evicted as an `NSNumber`. `0` means no limit. */
+static NSString * const SPObjectCacheTotalCostLimitKey = @"SPObjectCacheTotalCostLimit";
+
+/** @constant The number of lookups that returned an object as an `NSNumber`. */
+static NSString * const SPObjectCacheHitCountKey = @"SPObjectCacheHitCount";
+
+/** @constant The number of lookups that didn't return an object as an `NSNumber`. */
+static NSString * const SPObjectCacheMissCountKey = @"SPObjectCacheMissCount";
+
+/** @constant The number of objects evicted to stay within the limits as an `NSNumber`. */
+static NSString * const SPObjectCacheEvictionCountKey = @"SPObjectCacheEvictionCount";
@@ -0,0 +1,349 @@
+//
+//  SPObjectCache.m
+//  CocoaLibSpotify
+//
+/*
+ Copyright (c) 2011, Spotify AB
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of Spotify AB nor the names of its contributors may 
+ be used to endorse or promote products derived from this software 
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL SPOTIFY AB BE LIABLE FOR ANY DIRECT, INDIRECT,
+ INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "SPObjectCache.h"
+#import "SPKeyTable.h"
+#import <libkern/OSAtomic.h>
+
+// Evicted entries are only dropped once their object is gone, so sweep them out once there are this many
+// more of them than there are objects held strongly.
+static NSUInteger const kSPObjectCacheSweepSlack = 256;
+
+@interface SPObjectCacheEntry : NSObject {
+@public
+	uint8_t key[SPKeyTableMaximumKeyLength];
+}
+@property (nonatomic, readwrite, strong) id object; // nil once evicted.
+@property (nonatomic, readwrite, weak) id weakObject;
+@property (nonatomic, readwrite) NSUInteger cost;
+@property (nonatomic, readwrite, assign) __unsafe_unretained SPObjectCacheEntry *previous;
+@property (nonatomic, readwrite, assign) __unsafe_unretained SPObjectCacheEntry *next;
+@end
+
+@implementation SPObjectCacheEntry
+@synthesize object;
+@synthesize weakObject;
+@synthesize cost;
+@synthesize previous;
+@synthesize next;
+@end
+
+@implementation SPObjectCache {
+	OSSpinLock _lock;
+	// Keys to retained SPObjectCacheEntry objects.
+	SPKeyTable *_entries;
+	// Objects held strongly, most recently used first.
+	__unsafe_unretained SPObjectCacheEntry *_mostRecentlyUsed;
+	__unsafe_unretained SPObjectCacheEntry *_leastRecentlyUsed;
+}
+
+-(id)init {
+	return [self initWithCountLimit:0 totalCostLimit:0];
+}
+
+-(id)initWithCountLimit:(NSUInteger)aCountLimit totalCostLimit:(NSUInteger)aCostLimit {
+	return [self initWithKeyLength:sizeof(void *) countLimit:aCountLimit totalCostLimit:aCostLimit];
+}
+
+-(id)initWithKeyLength:(size_t)aKeyLength countLimit:(NSUInteger)aCountLimit totalCostLimit:(NSUInteger)aCostLimit {
+	
+	if (aKeyLength == 0 || aKeyLength > SPKeyTableMaximumKeyLength)
+		return nil;
+	
+	if ((self = [super init])) {
+		_lock = OS_SPINLOCK_INIT;
+		_entries = SPKeyTableCreate(aKeyLength);
+		keyLength = aKeyLength;
+		countLimit = aCountLimit;
+		totalCostLimit = aCostLimit;
+	}
+	return self;
+}
+
+-(void)dealloc {
+	[self removeAllObjects];
+	SPKeyTableDestroy(_entries);
+}
+
+@synthesize keyLength;
+@synthesize countLimit;
+@synthesize totalCostLimit;
+@synthesize count;
+@synthesize totalCost;
+@synthesize hitCount;
+@synthesize missCount;
+@synthesize evictionCount;
+
+-(void)setCountLimit:(NSUInteger)aLimit {
+	NSMutableArray *evicted = nil;
+	OSSpinLockLock(&_lock);
+	countLimit = aLimit;
+	[self evictIntoArray:&evicted];
+	OSSpinLockUnlock(&_lock);
+}
+
+-(void)setTotalCostLimit:(NSUInteger)aLimit {
+	NSMutableArray *evicted = nil;
+	OSSpinLockLock(&_lock);
+	totalCostLimit = aLimit;
+	[self evictIntoArray:&evicted];
+	OSSpinLockUnlock(&_lock);
+}
+
+#pragma mark -
+
+-(id)objectForKeyBytes:(const void *)key {
+	
+	if (key == NULL) return nil;
+	
+	NSMutableArray *evicted = nil;
+	OSSpinLockLock(&_lock);
+	
+	SPObjectCacheEntry *entry = (__bridge SPObjectCacheEntry *)SPKeyTableGetValue(_entries, key);
+	id object = entry.object;
+	
+	if (object != nil) {
+		if (entry != _mostRecentlyUsed) {
+			[self unlinkEntry:entry];
+			[self linkEntry:entry];
+		}
+		
+	} else if (entry != nil && (object = entry.weakObject) != nil) {
+		// Still alive elsewhere, so it's in use again.
+		entry.object = object;
+		[self linkEntry:entry];
+		count++;
+		totalCost += entry.cost;
+		[self evictIntoArray:&evicted];
+		
+	} else if (entry != nil) {
+		evicted = [[NSMutableArray alloc] initWithObjects:entry, nil];
+		CFRelease(SPKeyTableRemoveValue(_entries, key));
+	}
+	
+	if (object != nil)
+		hitCount++;
+	else
+		missCount++;
+	
+	OSSpinLockUnlock(&_lock);
+	return object;
+}
+
+-(void)setObject:(id)object forKeyBytes:(const void *)key cost:(NSUInteger)cost {
+	
+	if (key == NULL) return;
+	if (object == nil) {
+		[self removeObjectForKeyBytes:key];
+		return;
+	}
+	
+	SPObjectCacheEntry *entry = [[SPObjectCacheEntry alloc] init];
+	memcpy(entry->key, key, keyLength);
+	entry.object = object;
+	entry.weakObject = object;
+	entry.cost = cost;
+	
+	NSMutableArray *evicted = nil;
+	OSSpinLockLock(&_lock);
+	
+	SPObjectCacheEntry *oldEntry = (__bridge SPObjectCacheEntry *)SPKeyTableGetValue(_entries, key);
+	if (oldEntry != nil)
+		[self dropEntry:oldEntry intoArray:&evicted];
+	
+	SPKeyTableSetValue(_entries, key, (__bridge_retained void *)entry);
+	[self linkEntry:entry];
+	count++;
+	totalCost += cost;
+	
+	[self evictIntoArray:&evicted];
+	
+	if (SPKeyTableGetCount(_entries) > (count * 2) + kSPObjectCacheSweepSlack)
+		[self sweepIntoArray:&evicted];
+	
+	OSSpinLockUnlock(&_lock);
+}
+
+-(void)setCost:(NSUInteger)cost forKeyBytes:(const void *)key {
+	
+	if (key == NULL) return;
+	
+	NSMutableArray *evicted = nil;
+	OSSpinLockLock(&_lock);
+	
+	SPObjectCacheEntry *entry = (__bridge SPObjectCacheEntry *)SPKeyTableGetValue(_entries, key);
+	if (entry != nil) {
+		if (entry.object != nil) {
+			totalCost -= entry.cost;
+			totalCost += cost;
+		}
+		entry.cost = cost;
+		[self evictIntoArray:&evicted];
+	}
+	
+	OSSpinLockUnlock(&_lock);
+}
+
+-(NSDictionary *)statistics {
+	
+	OSSpinLockLock(&_lock);
+	NSUInteger currentCount = count, currentTotalCost = totalCost, currentCountLimit = countLimit, currentTotalCostLimit = totalCostLimit;
+	NSUInteger currentHitCount = hitCount, currentMissCount = missCount, currentEvictionCount = evictionCount;
+	OSSpinLockUnlock(&_lock);
+	
+	NSMutableDictionary *mutableStats = [NSMutableDictionary dictionaryWithCapacity:7];
+	[mutableStats setValue:[NSNumber numberWithUnsignedInteger:currentCount] forKey:SPObjectCacheCountKey];
+	[mutableStats setValue:[NSNumber numberWithUnsignedInteger:currentTotalCost] forKey:SPObjectCacheTotalCostKey];
+	[mutableStats setValue:[NSNumber numberWithUnsignedInteger:currentCountLimit] forKey:SPObjectCacheCountLimitKey];
+	[mutableStats setValue:[NSNumber numberWithUnsignedInteger:currentTotalCostLimit] forKey:SPObjectCacheTotalCostLimitKey];
+	[mutableStats setValue:[NSNumber numberWithUnsignedInteger:currentHitCount] forKey:SPObjectCacheHitCountKey];
+	[mutableStats setValue:[NSNumber numberWithUnsignedInteger:currentMissCount] forKey:SPObjectCacheMissCountKey];
+	[mutableStats setValue:[NSNumber numberWithUnsignedInteger:currentEvictionCount] forKey:SPObjectCacheEvictionCountKey];
+	return [NSDictionary dictionaryWithDictionary:mutableStats];
+}
+
+static void SPObjectCacheCollectObject(const void *key, void *value, void *context) {
+	id object = ((__bridge SPObjectCacheEntry *)value).weakObject;
+	if (object != nil)
+		[(__bridge NSMutableArray *)context addObject:object];
+}
+
+-(NSArray *)allObjects {
+	
+	NSMutableArray *objects = [[NSMutableArray alloc] init];
+	OSSpinLockLock(&_lock);
+	SPKeyTableApplyFunction(_entries, SPObjectCacheCollectObject, (__bridge void *)objects);
+	OSSpinLockUnlock(&_lock);
+	return objects;
+}
+
+-(void)removeObjectForKeyBytes:(const void *)key {
+	
+	if (key == NULL) return;
+	
+	NSMutableArray *removed = nil;
+	OSSpinLockLock(&_lock);
+	SPObjectCacheEntry *entry = (__bridge SPObjectCacheEntry *)SPKeyTableGetValue(_entries, key);
+	if (entry != nil)
+		[self dropEntry:entry intoArray:&removed];
+	OSSpinLockUnlock(&_lock);
+}
+
+static void SPObjectCacheCollectEntry(const void *key, void *value, void *context) {
+	[(__bridge NSMutableArray *)context addObject:(__bridge_transfer SPObjectCacheEntry *)value];
+}
+
+-(void)removeAllObjects {
+	
+	NSMutableArray *removed = [[NSMutableArray alloc] init];
+	OSSpinLockLock(&_lock);
+	SPKeyTableApplyFunction(_entries, SPObjectCacheCollectEntry, (__bridge void *)removed);
+	SPKeyTableRemoveAllValues(_entries);
+	_mostRecentlyUsed = nil;
+	_leastRecentlyUsed = nil;
+	count = 0;
+	totalCost = 0;
+	OSSpinLockUnlock(&_lock);
+}
+
+#pragma mark - Internal
+
+// All of these are called with the lock held. Objects the cache lets go of are added to an array
+// the caller releases after unlocking, so no object is deallocated under the lock. The array is
+// only created if something is let go of, so lookups that hit don't allocate.
+
+-(void)linkEntry:(SPObjectCacheEntry *)entry {
+	entry.previous = nil;
+	entry.next = _mostRecentlyUsed;
+	if (_mostRecentlyUsed != nil)
+		_mostRecentlyUsed.previous = entry;
+	_mostRecentlyUsed = entry;
+	if (_leastRecentlyUsed == nil)
+		_leastRecentlyUsed = entry;
+}
+
+-(void)unlinkEntry:(SPObjectCacheEntry *)entry {
+	if (entry.previous != nil)
+		entry.previous.next = entry.next;
+	else
+		_mostRecentlyUsed = entry.next;
+	
+	if (entry.next != nil)
+		entry.next.previous = entry.previous;
+	else
+		_leastRecentlyUsed = entry.previous;
+	
+	entry.previous = nil;
+	entry.next = nil;
+}
+
+-(void)dropEntry:(SPObjectCacheEntry *)entry intoArray:(NSMutableArray * __strong *)released {
+	if (*released == nil) *released = [[NSMutableArray alloc] init];
+	[*released addObject:entry];
+	if (entry.object != nil) {
+		[self unlinkEntry:entry];
+		count--;
+		totalCost -= entry.cost;
+	}
+	CFRelease(SPKeyTableRemoveValue(_entries, entry->key));
+}
+
+-(void)evictIntoArray:(NSMutableArray * __strong *)evicted {
+	
+	// The most recently used object is always kept, however much it costs.
+	while (_leastRecentlyUsed != nil && _leastRecentlyUsed != _mostRecentlyUsed &&
+		   ((countLimit > 0 && count > countLimit) || (totalCostLimit > 0 && totalCost > totalCostLimit))) {
+		
+		SPObjectCacheEntry *entry = _leastRecentlyUsed;
+		[self unlinkEntry:entry];
+		if (*evicted == nil) *evicted = [[NSMutableArray alloc] init];
+		[*evicted addObject:entry.object];
+		entry.object = nil;
+		count--;
+		totalCost -= entry.cost;
+		evictionCount++;
+	}
+}
+
+static void SPObjectCacheCollectDeadEntry(const void *key, void *value, void *context) {
+	SPObjectCacheEntry *entry = (__bridge SPObjectCacheEntry *)value;
+	if (entry.object == nil && entry.weakObject == nil)
+		[(__bridge NSMutableArray *)context addObject:entry];
+}
+
+-(void)sweepIntoArray:(NSMutableArray * __strong *)released {
+	NSMutableArray *deadEntries = [[NSMutableArray alloc] init];
+	SPKeyTableApplyFunction(_entries, SPObjectCacheCollectDeadEntry, (__bridge void *)deadEntries);
+	for (SPObjectCacheEntry *entry in deadEntries)
+		[self dropEntry:entry intoArray:released];
+}
+
+@end
@@ -43,7 +43,7 @@
 
 @protocol SPPlaybackManagerDelegate <NSObject>
 
-/** Called when audio starts playing.
+/** Called on the playback session's callback queue when audio starts playing.
  
  @param aPlaybackManager The playback manager that started playing.
  */
@@ -99,15 +99,45 @@
  */
 -(void)playTrack:(SPTrack *)aTrack callback:(SPErrorableOperationCallback)block;
 
+///----------------------------
+/// @name Queueing Tracks
+///----------------------------
+
+/** Returns the tracks that will be played after the current track, in order.
+ 
+ The first track in the queue is preloaded while the current track plays, and its audio
+ is appended directly after the current track's so there's no gap between them. 
+ `currentTrack` and `trackPosition` change over at the moment the boundary between 
+ the two tracks is actually heard.
+ */
+@property (nonatomic, readonly, copy) NSArray *queuedTracks;
+
+/** Adds a track to the end of the queue.
+ 
+ @param aTrack The track that should be played after the tracks already queued.
+ */
+-(void)enqueueTrack:(SPTrack *)aTrack;
+
+/** Removes all tracks from the queue. The current track continues to play. */
+-(void)clearQueue;
+
 /** Seek the current playback position to the given time. 
  
  @param newPosition The time at which to seek to. Must be between 0.0 and the duration of the playing track.
  */
 -(void)seekToTrackPosition:(NSTimeInterval)newPosition;
 
-/** Returns the playback position of the current track, in the range 0.0 to the current track's duration. */
+/** Returns the playback position of the current track, in the range 0.0 to the current track's duration. 
+ 
+ This is worked out from the audio controller's playback clock whenever it's read, so it's accurate to 
+ the moment it's read. Key-value observers are notified every `trackPositionUpdateInterval` seconds
+ during playback.
+ */
 @property (readonly) NSTimeInterval trackPosition;
 
+/** Returns how often, in seconds, key-value observers of `trackPosition` are notified during playback. Defaults to `0.2`. */
+@property (readwrite) NSTimeInterval trackPositionUpdateInterval;
+
 /** Returns the current playback volume, in the range 0.0 to 1.0. */
 @property (readwrite) double volume;
 
@@ -34,6 +34,7 @@
 #import "SPCoreAudioController.h"
 #import "SPTrack.h"
 #import "SPSession.h"
+#import "SPSessionInternal.h"
 #import "SPErrorExtensions.h"
 
 @interface SPPlaybackManager ()
@@ -45,24 +46,39 @@
 @property (readwrite) NSTimeInterval trackPosition;
 
 -(void)informDelegateOfAudioPlaybackStarting;
+-(void)preloadNextQueuedTrack;
+-(void)loadNextQueuedTrack;
+-(void)sessionDidEndPlaybackOnCallbackQueue:(SPSession *)aSession;
 
 @end
 
 static void * const kSPPlaybackManagerKVOContext = @"kSPPlaybackManagerKVOContext"; 
 
 @implementation SPPlaybackManager {
-	NSMethodSignature *incrementTrackPositionMethodSignature;
-	NSInvocation *incrementTrackPositionInvocation;
+	NSMutableArray *trackQueue;
+	// Tracks that have been loaded into the session but whose audio hasn't been heard yet.
+	NSMutableArray *tracksAwaitingBoundary;
+	// Track boundaries that were output before the session had loaded the next track.
+	NSUInteger unclaimedTrackBoundaryCount;
+	
+	// trackPosition is trackStartOffset plus however much audio has been output since trackStartOutputTime.
+	NSTimeInterval trackStartOffset;
+	NSTimeInterval trackStartOutputTime;
+	BOOL hasStartedPlayingTrack;
 }
 
 -(id)initWithPlaybackSession:(SPSession *)aSession {
     
     if ((self = [super init])) {
         
+        trackQueue = [[NSMutableArray alloc] init];
+		tracksAwaitingBoundary = [[NSMutableArray alloc] init];
+		
         self.playbackSession = aSession;
 		self.playbackSession.playbackDelegate = (id)self;
 		self.audioController = [[SPCoreAudioController alloc] init];
 		self.audioController.delegate = self;
+		self.audioController.callbackSession = self.playbackSession;
 		self.playbackSession.audioDeliveryDelegate = self.audioController;
 		
 		[self addObserver:self
@@ -80,6 +96,7 @@ static void * const kSPPlaybackManagerKVOContext = @"kSPPlaybackManagerKVOContex
 	if (self) {
 		self.audioController = aController;
 		self.audioController.delegate = self;
+		self.audioController.callbackSession = self.playbackSession;
 		self.playbackSession.audioDeliveryDelegate = self.audioController;
 	}
 	
@@ -100,7 +117,6 @@ static void * const kSPPlaybackManagerKVOContext = @"kSPPlaybackManagerKVOContex
 
 @synthesize audioController;
 @synthesize playbackSession;
-@synthesize trackPosition;
 @synthesize delegate;
 
 +(NSSet *)keyPathsForValuesAffectingVolume {
@@ -122,6 +138,11 @@ static void * const kSPPlaybackManagerKVOContext = @"kSPPlaybackManagerKVOContex
 	self.playbackSession.playing = NO;
 	[self.playbackSession unloadPlayback];
 	[self.audioController clearAudioBuffers];
+	self.audioController.audioOutputEnabled = NO;
+	
+	[tracksAwaitingBoundary removeAllObjects];
+	unclaimedTrackBoundaryCount = 0;
+	hasStartedPlayingTrack = NO;
 	
 	if (aTrack.availability != SP_TRACK_AVAILABILITY_AVAILABLE) {
 		if (block) block([NSError spotifyErrorWithCode:SP_ERROR_TRACK_NOT_PLAYABLE]);
@@ -133,9 +154,10 @@ static void * const kSPPlaybackManagerKVOContext = @"kSPPlaybackManagerKVOContex
 	
 	[self.playbackSession playTrack:self.currentTrack callback:^(NSError *error) {
 		
-		if (!error)
+		if (!error) {
 			self.playbackSession.playing = YES;
-		else
+			[self preloadNextQueuedTrack];
+		} else
 			self.currentTrack = nil;
 		
 		if (block) {
@@ -144,11 +166,164 @@ static void * const kSPPlaybackManagerKVOContext = @"kSPPlaybackManagerKVOContex
 	}];
 }
 
+#pragma mark -
+#pragma mark Queue
+
+-(NSArray *)queuedTracks {
+	return [NSArray arrayWithArray:trackQueue];
+}
+
+-(void)enqueueTrack:(SPTrack *)aTrack {
+	
+	if (aTrack == nil) return;
+	
+	[self willChangeValueForKey:@"queuedTracks"];
+	[trackQueue addObject:aTrack];
+	[self didChangeValueForKey:@"queuedTracks"];
+	
+	if (trackQueue.count == 1 && self.currentTrack != nil)
+		[self preloadNextQueuedTrack];
+}
+
+-(void)clearQueue {
+	[self willChangeValueForKey:@"queuedTracks"];
+	[trackQueue removeAllObjects];
+	[self didChangeValueForKey:@"queuedTracks"];
+}
+
+-(void)preloadNextQueuedTrack {
+	
+	if (trackQueue.count == 0) return;
+	
+	SPTrack *nextTrack = [trackQueue objectAtIndex:0];
+	if (nextTrack.availability == SP_TRACK_AVAILABILITY_AVAILABLE)
+		[self.playbackSession preloadTrackForPlayback:nextTrack callback:nil];
+}
+
+-(void)loadNextQueuedTrack {
+	
+	// The session has finished delivering the current track. Load the next one straight 
+	// away, without unloading or clearing the audio buffers, so its audio directly follows 
+	// the end of the current track.
+	
+	SPTrack *nextTrack = nil;
+	
+	while (trackQueue.count > 0 && nextTrack == nil) {
+		[self willChangeValueForKey:@"queuedTracks"];
+		SPTrack *candidate = [trackQueue objectAtIndex:0];
+		[trackQueue removeObjectAtIndex:0];
+		[self didChangeValueForKey:@"queuedTracks"];
+		
+		if (candidate.availability == SP_TRACK_AVAILABILITY_AVAILABLE)
+			nextTrack = candidate;
+	}
+	
+	if (nextTrack == nil) {
+		if (unclaimedTrackBoundaryCount > 0) {
+			// Nothing playable was left in the queue after all.
+			unclaimedTrackBoundaryCount = 0;
+			self.currentTrack = nil;
+			if (!self.playbackSession.isPlaying)
+				self.audioController.audioOutputEnabled = NO;
+		}
+		return;
+	}
+	
+	if (unclaimedTrackBoundaryCount > 0) {
+		// The end of the previous track has already been heard.
+		unclaimedTrackBoundaryCount--;
+		self.currentTrack = nextTrack;
+		self.trackPosition = 0.0;
+		hasStartedPlayingTrack = NO;
+	} else {
+		[tracksAwaitingBoundary addObject:nextTrack];
+	}
+	
+	[self.playbackSession playTrack:nextTrack callback:^(NSError *error) {
+		
+		if (!error) {
+			self.playbackSession.playing = YES;
+			[self preloadNextQueuedTrack];
+			return;
+		}
+		
+		if ([tracksAwaitingBoundary containsObject:nextTrack])
+			[tracksAwaitingBoundary removeObject:nextTrack];
+		else if (self.currentTrack == nextTrack)
+			self.currentTrack = nil;
+		
+		[self loadNextQueuedTrack];
+	}];
+}
+
 -(void)seekToTrackPosition:(NSTimeInterval)newPosition {
-	if (newPosition <= self.currentTrack.duration) {
+	
+	if (newPosition > self.currentTrack.duration)
+		return;
+	
+	if (tracksAwaitingBoundary.count == 0) {
 		[self.playbackSession seekPlaybackToOffset:newPosition];
 		self.trackPosition = newPosition;
-	}	
+		return;
+	}
+	
+	// The session has already moved on to the next track, so seeking it would seek the wrong
+	// track. Throw away the end of the current track and the start of the next, put the
+	// tracks waiting for their boundary back on the queue, and reload the current track.
+	SPTrack *track = self.currentTrack;
+	BOOL wasPlaying = self.playbackSession.isPlaying;
+	
+	[self willChangeValueForKey:@"queuedTracks"];
+	[trackQueue replaceObjectsInRange:NSMakeRange(0, 0) withObjectsFromArray:tracksAwaitingBoundary];
+	[self didChangeValueForKey:@"queuedTracks"];
+	[tracksAwaitingBoundary removeAllObjects];
+	unclaimedTrackBoundaryCount = 0;
+	
+	self.playbackSession.playing = NO;
+	[self.playbackSession unloadPlayback];
+	[self.audioController clearAudioBuffers];
+	self.trackPosition = newPosition;
+	
+	[self.playbackSession playTrack:track callback:^(NSError *error) {
+		
+		if (error) {
+			if (self.currentTrack == track)
+				self.currentTrack = nil;
+			return;
+		}
+		
+		[self.playbackSession seekPlaybackToOffset:newPosition];
+		self.playbackSession.playing = wasPlaying;
+		[self preloadNextQueuedTrack];
+	}];
+}
+
+#pragma mark -
+#pragma mark Track Position
+
+-(NSTimeInterval)trackPosition {
+	
+	NSTimeInterval position = trackStartOffset + MAX(0.0, self.audioController.outputTime - trackStartOutputTime);
+	
+	// The end of a track can be heard slightly before we're told about the boundary.
+	NSTimeInterval duration = self.currentTrack.duration;
+	if (duration > 0.0)
+		position = MIN(position, duration);
+	
+	return position;
+}
+
+-(void)setTrackPosition:(NSTimeInterval)newPosition {
+	trackStartOffset = newPosition;
+	trackStartOutputTime = self.audioController.outputTime;
+}
+
+-(NSTimeInterval)trackPositionUpdateInterval {
+	return self.audioController.outputNotificationInterval;
+}
+
+-(void)setTrackPositionUpdateInterval:(NSTimeInterval)interval {
+	self.audioController.outputNotificationInterval = interval;
 }
 
 +(NSSet *)keyPathsForValuesAffectingIsPlaying {
@@ -161,12 +336,16 @@ static void * const kSPPlaybackManagerKVOContext = @"kSPPlaybackManagerKVOContex
 
 -(void)setIsPlaying:(BOOL)isPlaying {
 	self.playbackSession.playing = isPlaying;
+	self.audioController.audioOutputEnabled = isPlaying;
 }
 
 - (void)observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(NSDictionary *)change context:(void *)context {
     
 	if ([keyPath isEqualToString:@"playbackSession.playing"] && context == kSPPlaybackManagerKVOContext) {
-        self.audioController.audioOutputEnabled = self.playbackSession.isPlaying;
+		// The session stops playing when it reaches the end of a track, but the end of that 
+		// track is still buffered. Keep outputting until it has been heard.
+		if (self.playbackSession.isPlaying || self.audioController.pendingTrackBoundaryCount == 0)
+			self.audioController.audioOutputEnabled = self.playbackSession.isPlaying;
 	} else {
 		[super observeValueForKeyPath:keyPath ofObject:object change:change context:context];
 	}
@@ -175,12 +354,43 @@ static void * const kSPPlaybackManagerKVOContext = @"kSPPlaybackManagerKVOContex
 #pragma mark -
 #pragma mark Audio Controller Delegate
 
+// The audio controller calls these on the playback session's callback queue, where the rest of our state lives.
+// They're handled directly: sending them on again would let one queued before -playTrack:callback: run after it.
+
 -(void)coreAudioController:(SPCoreAudioController *)controller didOutputAudioOfDuration:(NSTimeInterval)audioDuration {
 	
-	if (self.trackPosition == 0.0)
-		dispatch_async(dispatch_get_main_queue(), ^{ [self.delegate playbackManagerWillStartPlayingAudio:self]; });
+	if (!hasStartedPlayingTrack) {
+		hasStartedPlayingTrack = YES;
+		[self.delegate playbackManagerWillStartPlayingAudio:self];
+	}
 	
-	self.trackPosition += audioDuration;
+	// trackPosition is read from the playback clock, so this is just a rate-limited change notification.
+	[self willChangeValueForKey:@"trackPosition"];
+	[self didChangeValueForKey:@"trackPosition"];
+}
+
+-(void)coreAudioController:(SPCoreAudioController *)controller didOutputTrackBoundaryAtTime:(NSTimeInterval)outputTime {
+	
+	if (tracksAwaitingBoundary.count > 0) {
+		self.currentTrack = [tracksAwaitingBoundary objectAtIndex:0];
+		[tracksAwaitingBoundary removeObjectAtIndex:0];
+		[self willChangeValueForKey:@"trackPosition"];
+		trackStartOffset = 0.0;
+		trackStartOutputTime = outputTime;
+		[self didChangeValueForKey:@"trackPosition"];
+		hasStartedPlayingTrack = NO;
+		return;
+	}
+	
+	if (trackQueue.count > 0) {
+		// The next track will be loaded shortly, and its audio will start from here.
+		unclaimedTrackBoundaryCount++;
+		return;
+	}
+	
+	self.currentTrack = nil;
+	if (!self.playbackSession.isPlaying)
+		self.audioController.audioOutputEnabled = NO;
 }
 
 #pragma mark -
@@ -198,23 +408,18 @@ static void * const kSPPlaybackManagerKVOContext = @"kSPPlaybackManagerKVOContex
 	
 	// This delegate is called when playback stops naturally, at the end of a track.
 	
-	// Not routing this through to the main thread causes odd locks and crashes.
-	[self performSelectorOnMainThread:@selector(sessionDidEndPlaybackOnMainThread:)
-						   withObject:aSession
-						waitUntilDone:NO];
+	// Not routing this through to the callback queue causes odd locks and crashes.
+	SPDispatchToCallbackQueue(aSession, ^{ [self sessionDidEndPlaybackOnCallbackQueue:aSession]; });
 }
 
--(void)sessionDidEndPlaybackOnMainThread:(SPSession *)aSession {
-	self.currentTrack = nil;	
+-(void)sessionDidEndPlaybackOnCallbackQueue:(SPSession *)aSession {
+	// currentTrack is cleared or advanced when the end of the track is actually heard.
+	[self loadNextQueuedTrack];
 }
 
 
 -(void)informDelegateOfAudioPlaybackStarting {
-	if (![NSThread isMainThread]) {
-		[self performSelectorOnMainThread:_cmd withObject:nil waitUntilDone:NO];
-		return;
-	}
-	[self.delegate playbackManagerWillStartPlayingAudio:self];
+	SPDispatchToCallbackQueue(self.playbackSession, ^{ [self.delegate playbackManagerWillStartPlayingAudio:self]; });
 }
 
 @end
@@ -33,6 +33,7 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #import "SPPlaylist.h"
 #import "SPPlaylistInternal.h"
 #import "SPSession.h"
+#import "SPSessionInternal.h"
 #import "SPTrack.h"
 #import "SPTrackInternal.h"
 #import "SPImage.h"
@@ -78,9 +79,10 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 -(void)resetItemIndexes;
 -(NSArray *)playlistSnapshot;
 
--(void)setPlaylistNameFromLibSpotifyUpdate:(NSString *)newName;
--(void)setPlaylistDescriptionFromLibSpotifyUpdate:(NSString *)newDescription;
--(void)setCollaborativeFromLibSpotifyUpdate:(BOOL)collaborative;
+// These set what libSpotify reports without KVO notifications or telling it about the change again,
+// for SPEnqueuePropertyUpdateWithSetter().
+-(void)applyNameFromLibSpotifyUpdate:(NSString *)newName;
+-(void)applyCollaborativeFromLibSpotifyUpdate:(BOOL)newCollaborative;
 
 @end
 
@@ -119,7 +121,7 @@ static void tracks_added(sp_playlist *pl, sp_track *const *tracks, int num_track
 		[playlist.addCallbackStack removeObjectAtIndex:0];
 	}
 
-	dispatch_async(dispatch_get_main_queue(), ^{
+	SPDispatchToCallbackQueue(playlist.session, ^{
 
 		if ([itemsAtCallbackTime isEqualToArray:playlist.items] && indexesAreValid) {
 
@@ -189,7 +191,7 @@ static void	tracks_removed(sp_playlist *pl, const int *tracks, int num_tracks, v
 		[playlist.removeCallbackStack removeObjectAtIndex:0];
 	}
 	
-	dispatch_async(dispatch_get_main_queue(), ^{
+	SPDispatchToCallbackQueue(playlist.session, ^{
 
 		if ([itemsAtCallbackTime isEqualToArray:playlist.items] && indexesAreValid) {
 			
@@ -260,7 +262,7 @@ static void	tracks_moved(sp_playlist *pl, const int *tracks, int num_tracks, int
 		[playlist.moveCallbackStack removeObjectAtIndex:0];
 	}
 
-	dispatch_async(dispatch_get_main_queue(), ^{
+	SPDispatchToCallbackQueue(playlist.session, ^{
 
 		if ([itemsAtCallbackTime isEqualToArray:playlist.items] && indexesAreValid) {
 
@@ -309,9 +311,7 @@ static void	playlist_renamed(sp_playlist *pl, void *userdata) {
 	if (!playlist) return;
 	
     NSString *name = [NSString stringWithUTF8String:sp_playlist_name(pl)];
-	dispatch_async(dispatch_get_main_queue(), ^{
-		[playlist setPlaylistNameFromLibSpotifyUpdate:name];
-	});
+	SPEnqueuePropertyUpdateWithSetter(playlist.session, playlist, @"name", @selector(applyNameFromLibSpotifyUpdate:), name);
 }
 
 /*
@@ -333,7 +333,7 @@ static void	playlist_state_changed(sp_playlist *pl, void *userdata) {
 	
 	BOOL isLoaded = sp_playlist_is_loaded(pl);
 	
-	dispatch_async(dispatch_get_main_queue(), ^{
+	SPDispatchToCallbackQueue(playlist.session, ^{
 		if (isLoaded)
 			[playlist loadPlaylistData];
 	});
@@ -346,7 +346,7 @@ static void	playlist_update_in_progress(sp_playlist *pl, bool done, void *userda
 	SPPlaylist *playlist = proxy.playlist;
 	if (!playlist) return;
 	
-	dispatch_async(dispatch_get_main_queue(), ^{
+	SPDispatchToCallbackQueue(playlist.session, ^{
 		if (playlist.isUpdating == done)
 			playlist.updating = !done;
 	});
@@ -361,18 +361,19 @@ static void	playlist_metadata_updated(sp_playlist *pl, void *userdata) {
     
 	@autoreleasepool {
 		
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(playlist.session, ^{
+			NSMutableArray *tracks = [NSMutableArray arrayWithCapacity:playlist.items.count];
 			for (SPPlaylistItem *playlistItem in playlist.items) {
-				if (playlistItem.itemClass == [SPTrack class]) {
-					SPTrack *track = playlistItem.item;
-					// This is so bad it makes my head hurt
-					SPDispatchAsync(^{
-						sp_track_offline_status status = sp_track_offline_get_status(track.track);
-						dispatch_async(dispatch_get_main_queue(), ^() { [track setOfflineStatusFromLibSpotifyUpdate:status]; });
-					});
-				}
+				if (playlistItem.itemClass == [SPTrack class])
+					[tracks addObject:playlistItem.item];
 			}
 			
+			SPDispatchAsync(^{
+				for (SPTrack *track in tracks)
+					SPEnqueuePropertyUpdate(playlist.session, track, @"offlineStatus",
+											[NSNumber numberWithInt:sp_track_offline_get_status(track.track)]);
+			});
+			
 			if ([[playlist delegate] respondsToSelector:@selector(itemsInPlaylistDidUpdateMetadata:)]) {
 				[playlist.delegate itemsInPlaylistDidUpdateMetadata:playlist];
 			}
@@ -389,7 +390,7 @@ static void	track_created_changed(sp_playlist *pl, int position, sp_user *user,
 	
 	SPUser *spUser = [SPUser userWithUserStruct:user inSession:playlist.session];
 	
-	dispatch_async(dispatch_get_main_queue(), ^{
+	SPDispatchToCallbackQueue(playlist.session, ^{
 		SPPlaylistItem *item = [playlist.items objectAtIndex:position];
 		
 		[item setDateCreatedFromLibSpotify:[NSDate dateWithTimeIntervalSince1970:when]];
@@ -404,7 +405,7 @@ static void	track_seen_changed(sp_playlist *pl, int position, bool seen, void *u
 	SPPlaylist *playlist = proxy.playlist;
 	if (!playlist) return;
 	
-	dispatch_async(dispatch_get_main_queue(), ^{
+	SPDispatchToCallbackQueue(playlist.session, ^{
 		SPPlaylistItem *item = [playlist.items objectAtIndex:position];
 		[item setUnreadFromLibSpotify:!seen];
 	});
@@ -418,10 +419,7 @@ static void	description_changed(sp_playlist *pl, const char *desc, void *userdat
 	if (!playlist) return;
 	
 	NSString *newDesc = [NSString stringWithUTF8String:desc];
-	
-	dispatch_async(dispatch_get_main_queue(), ^{
-		[playlist setPlaylistDescriptionFromLibSpotifyUpdate:newDesc];
-	});
+	SPEnqueuePropertyUpdate(playlist.session, playlist, @"playlistDescription", newDesc);
 }
 
 static void	image_changed(sp_playlist *pl, const byte *image, void *userdata) {
@@ -432,7 +430,7 @@ static void	image_changed(sp_playlist *pl, const byte *image, void *userdata) {
 	
 	SPImage *spImage = [SPImage imageWithImageId:image inSession:playlist.session];
 	
-	dispatch_async(dispatch_get_main_queue(), ^{ playlist.image = spImage; });
+	SPDispatchToCallbackQueue(playlist.session, ^{ playlist.image = spImage; });
 }
 
 // Called when message attribute for a playlist entry changes
@@ -444,7 +442,7 @@ static void	track_message_changed(sp_playlist *pl, int position, const char *mes
 	
 	NSString *newMessage = message == NULL ? nil : [NSString stringWithUTF8String:message];
 	
-	dispatch_async(dispatch_get_main_queue(), ^{ 
+	SPDispatchToCallbackQueue(playlist.session, ^{ 
 		SPPlaylistItem *item = [playlist.items objectAtIndex:position];
 		[item setMessageFromLibSpotify:newMessage];
 	});
@@ -478,8 +476,6 @@ static sp_playlist_callbacks _playlistCallbacks = {
 
 #pragma mark -
 
-static NSString * const kSPPlaylistKVOContext = @"kSPPlaylistKVOContext";
-
 @implementation SPPlaylist (SPPlaylistInternal)
 
 -(void)offlineSyncStatusMayHaveChanged {
@@ -489,10 +485,8 @@ static NSString * const kSPPlaylistKVOContext = @"kSPPlaylistKVOContext";
 	sp_playlist_offline_status newStatus = sp_playlist_get_offline_status(self.session.session, self.playlist);
 	float newProgress = sp_playlist_get_offline_download_completed(self.session.session, self.playlist) / 100.0;
 	
-	dispatch_async(dispatch_get_main_queue(), ^{
-		self.offlineStatus = newStatus;
-		self.offlineDownloadProgress = newProgress;
-	});
+	SPEnqueuePropertyUpdate(self.session, self, @"offlineStatus", [NSNumber numberWithInt:newStatus]);
+	SPEnqueuePropertyUpdate(self.session, self, @"offlineDownloadProgress", [NSNumber numberWithFloat:newProgress]);
 }
 
 @end
@@ -514,23 +508,6 @@ static NSString * const kSPPlaylistKVOContext = @"kSPPlaylistKVOContext";
     if ((self = [super init])) {
         self.session = aSession;
         self.playlist = pl;
-
-		// Add Observers
-        
-        [self addObserver:self
-               forKeyPath:@"name"
-                  options:0
-                  context:(__bridge void *)kSPPlaylistKVOContext];
-        
-        [self addObserver:self
-               forKeyPath:@"playlistDescription"
-                  options:0
-                  context:(__bridge void *)kSPPlaylistKVOContext];
-        
-        [self addObserver:self
-               forKeyPath:@"collaborative"
-                  options:0
-                  context:(__bridge void *)kSPPlaylistKVOContext];
 		
 		if (self.playlist != NULL) {
 			sp_playlist_add_ref(self.playlist);
@@ -540,7 +517,7 @@ static NSString * const kSPPlaylistKVOContext = @"kSPPlaylistKVOContext";
 			self.removeCallbackStack = [NSMutableArray new];
 		
 			if (aSession.loadingPolicy == SPAsyncLoadingImmediate)
-				dispatch_async(dispatch_get_main_queue(), ^() { 
+				SPDispatchToCallbackQueue(self.session, ^() { 
 					[self startLoading];
 				});
 		}
@@ -597,12 +574,12 @@ static NSString * const kSPPlaylistKVOContext = @"kSPPlaylistKVOContext";
 
 -(void)loadPlaylistData {
 	
-	SPDispatchAsync(^() {
+	SPDispatchAsyncCoalesced(self, _cmd, ^(SPPlaylist *playlist) {
 
-		if (self.playlist == NULL)
+		if (playlist.playlist == NULL)
 			return;
 		
-		BOOL isLoaded = sp_playlist_is_loaded(self.playlist);
+		BOOL isLoaded = sp_playlist_is_loaded(playlist.playlist);
 		
 		if (!isLoaded)
 			return;
@@ -615,44 +592,43 @@ static NSString * const kSPPlaylistKVOContext = @"kSPPlaylistKVOContext";
 		BOOL newCollaborative = NO;
 		BOOL newHasPendingChanges = NO;
 		
-		sp_link *link = sp_link_create_from_playlist(self.playlist);
+		sp_link *link = sp_link_create_from_playlist(playlist.playlist);
 		if (link != NULL) {
 			newURL = [NSURL urlWithSpotifyLink:link];
 			sp_link_release(link);
 		}
 		
-		const char *nameBuf = sp_playlist_name(self.playlist);
+		const char *nameBuf = sp_playlist_name(playlist.playlist);
 		if (nameBuf != NULL)
 			newName = [NSString stringWithUTF8String:nameBuf];
 		
-		const char *desc = sp_playlist_get_description(self.playlist);
+		const char *desc = sp_playlist_get_description(playlist.playlist);
 		if (desc != NULL)
 			newDesc = [NSString stringWithUTF8String:desc];
 		
 		byte imageId[20];
-		if (sp_playlist_get_image(self.playlist, imageId)) {
-			newImage = [SPImage imageWithImageId:imageId inSession:self.session];
+		if (sp_playlist_get_image(playlist.playlist, imageId)) {
+			newImage = [SPImage imageWithImageId:imageId inSession:playlist.session];
 		}
 		
-		newOwner = [SPUser userWithUserStruct:sp_playlist_owner(self.playlist) inSession:self.session];
-		newCollaborative = sp_playlist_is_collaborative(self.playlist);
-		newHasPendingChanges = sp_playlist_has_pending_changes(self.playlist);
-		NSArray *newItems = [self playlistSnapshot];
-		
-		dispatch_async(dispatch_get_main_queue(), ^() {
-			self.spotifyURL = newURL;
-			self.image = newImage;
-			self.owner = newOwner;
-			self.items = newItems;
-			self.hasPendingChanges = newHasPendingChanges;
-			[self setPlaylistNameFromLibSpotifyUpdate:newName];
-			[self setPlaylistDescriptionFromLibSpotifyUpdate:newDesc];
-			[self setCollaborativeFromLibSpotifyUpdate:newCollaborative];
-			self.loaded = isLoaded;
-		});
-		
-		[self offlineSyncStatusMayHaveChanged];
-		sp_playlist_update_subscribers(self.session.session, self.playlist);
+		newOwner = [SPUser userWithUserStruct:sp_playlist_owner(playlist.playlist) inSession:playlist.session];
+		newCollaborative = sp_playlist_is_collaborative(playlist.playlist);
+		newHasPendingChanges = sp_playlist_has_pending_changes(playlist.playlist);
+		NSArray *newItems = [playlist playlistSnapshot];
+		
+		SPEnqueuePropertyUpdate(playlist.session, playlist, @"spotifyURL", newURL);
+		SPEnqueuePropertyUpdate(playlist.session, playlist, @"image", newImage);
+		SPEnqueuePropertyUpdate(playlist.session, playlist, @"owner", newOwner);
+		SPEnqueuePropertyUpdate(playlist.session, playlist, @"items", newItems);
+		SPEnqueuePropertyUpdate(playlist.session, playlist, @"hasPendingChanges", [NSNumber numberWithBool:newHasPendingChanges]);
+		SPEnqueuePropertyUpdateWithSetter(playlist.session, playlist, @"name", @selector(applyNameFromLibSpotifyUpdate:), newName);
+		SPEnqueuePropertyUpdate(playlist.session, playlist, @"playlistDescription", newDesc);
+		SPEnqueuePropertyUpdateWithSetter(playlist.session, playlist, @"collaborative", @selector(applyCollaborativeFromLibSpotifyUpdate:),
+										  [NSNumber numberWithBool:newCollaborative]);
+		[playlist offlineSyncStatusMayHaveChanged];
+		SPEnqueuePropertyUpdate(playlist.session, playlist, @"loaded", [NSNumber numberWithBool:isLoaded]);
+		
+		sp_playlist_update_subscribers(playlist.session.session, playlist.playlist);
 		
 	});
 }
@@ -667,7 +643,7 @@ static NSString * const kSPPlaylistKVOContext = @"kSPPlaylistKVOContext";
 		// tracks to the delta callbacks can safely be applied.
 		NSArray *newItems = [self playlistSnapshot];
 		
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(self.session, ^{
 			self.items = newItems;
 			SPDispatchAsync(^() {
 
@@ -681,7 +657,7 @@ static NSString * const kSPPlaylistKVOContext = @"kSPPlaylistKVOContext";
 				sp_playlist_set_in_ram(self.session.session, self.playlist, true);
 				BOOL isLoaded = sp_playlist_is_loaded(self.playlist);
 
-				dispatch_async(dispatch_get_main_queue(), ^() {
+				SPDispatchToCallbackQueue(self.session, ^() {
 					if (isLoaded)
 						[self loadPlaylistData];
 				});
@@ -690,51 +666,22 @@ static NSString * const kSPPlaylistKVOContext = @"kSPPlaylistKVOContext";
 	});
 }
 				   
-- (void)observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(NSDictionary *)change context:(void *)context {
-    
-    if (context == (__bridge void *)kSPPlaylistKVOContext) {
-        if ([keyPath isEqualToString:@"name"]) {
-            SPDispatchAsync(^() { sp_playlist_rename(self.playlist, [self.name UTF8String]); });
-            return;
-        } else if ([keyPath isEqualToString:@"collaborative"]) {
-            SPDispatchAsync(^() { sp_playlist_set_collaborative(self.playlist, self.isCollaborative); });
-            return;
-        }
-    } 
-    [super observeValueForKeyPath:keyPath ofObject:object change:change context:context];
-}
-
--(void)setPlaylistNameFromLibSpotifyUpdate:(NSString *)newName {
-	if ([newName isEqualToString:self.name])
-		return;
-	
-    // Remove observers otherwise we'll create an infinite loop!
-    [self removeObserver:self forKeyPath:@"name"];
-    [self setName:newName];
-    [self addObserver:self
-           forKeyPath:@"name"
-              options:0
-              context:(__bridge void *)kSPPlaylistKVOContext];
-}
-
--(void)setPlaylistDescriptionFromLibSpotifyUpdate:(NSString *)newDescription {
-    // Remove observers otherwise we'll create an infinite loop!
-    [self removeObserver:self forKeyPath:@"playlistDescription"];
-    [self setPlaylistDescription:newDescription];
-    [self addObserver:self
-           forKeyPath:@"playlistDescription"
-              options:0
-              context:(__bridge void *)kSPPlaylistKVOContext];
-}
-
--(void)setCollaborativeFromLibSpotifyUpdate:(BOOL)newCollaborative {
-    // Remove observers otherwise we'll create an infinite loop!
-    [self removeObserver:self forKeyPath:@"collaborative"];
-    [self setCollaborative:newCollaborative];
-    [self addObserver:self
-           forKeyPath:@"collaborative"
-              options:0
-              context:(__bridge void *)kSPPlaylistKVOContext];
+-(void)setName:(NSString *)newName {
+	name = [newName copy];
+	SPDispatchAsync(^() { sp_playlist_rename(self.playlist, [newName UTF8String]); });
+}
+
+-(void)setCollaborative:(BOOL)newCollaborative {
+	collaborative = newCollaborative;
+	SPDispatchAsync(^() { sp_playlist_set_collaborative(self.playlist, newCollaborative); });
+}
+
+-(void)applyNameFromLibSpotifyUpdate:(NSString *)newName {
+	name = [newName copy];
+}
+
+-(void)applyCollaborativeFromLibSpotifyUpdate:(BOOL)newCollaborative {
+	collaborative = newCollaborative;
 }
 
 #pragma mark -
@@ -767,7 +714,7 @@ static NSString * const kSPPlaylistKVOContext = @"kSPPlaylistKVOContext";
 		
 	}
 	
-	dispatch_async(dispatch_get_main_queue(), ^{
+	SPDispatchToCallbackQueue(self.session, ^{
 		if (![self.subscribers isEqualToArray:newSubscribers])
 			self.subscribers = newSubscribers;
 	});
@@ -807,7 +754,7 @@ static NSString * const kSPPlaylistKVOContext = @"kSPPlaylistKVOContext";
 	SPDispatchAsync(^{
 		
 		if (newItems.count == 0) {
-			dispatch_async(dispatch_get_main_queue(), ^{
+			SPDispatchToCallbackQueue(self.session, ^{
 				if (block) block([NSError spotifyErrorWithCode:SP_ERROR_INVALID_INDATA]);
 			});
 			return;
@@ -845,7 +792,7 @@ static NSString * const kSPPlaylistKVOContext = @"kSPPlaylistKVOContext";
 		
 		if (error && block) {
 			[self.addCallbackStack removeObject:block];
-			dispatch_async(dispatch_get_main_queue(), ^{ block(error); });
+			SPDispatchToCallbackQueue(self.session, ^{ block(error); });
 		}
 	});
 }
@@ -867,7 +814,7 @@ static NSString * const kSPPlaylistKVOContext = @"kSPPlaylistKVOContext";
 		
 		if (error && block) {
 			[self.removeCallbackStack removeObject:block];
-			dispatch_async(dispatch_get_main_queue(), ^{ block(error); });
+			SPDispatchToCallbackQueue(self.session, ^{ block(error); });
 		}
 	});
 
@@ -898,17 +845,13 @@ static NSString * const kSPPlaylistKVOContext = @"kSPPlaylistKVOContext";
 		
 		if (error && block) {
 			[self.moveCallbackStack removeObject:block];
-			dispatch_async(dispatch_get_main_queue(), ^{ block(error); });
+			SPDispatchToCallbackQueue(self.session, ^{ block(error); });
 		}
 	});
 }
 
 -(void)dealloc {
     
-    [self removeObserver:self forKeyPath:@"name"];
-    [self removeObserver:self forKeyPath:@"playlistDescription"];
-    [self removeObserver:self forKeyPath:@"collaborative"];
-    
     self.delegate = nil;
     self.session = nil;
 	
@@ -34,6 +34,7 @@
 #import "SPPlaylistFolder.h"
 #import "SPUser.h"
 #import "SPSession.h"
+#import "SPSessionInternal.h"
 #import "SPPlaylist.h"
 #import "SPErrorExtensions.h"
 #import "SPPlaylistContainerInternal.h"
@@ -90,7 +91,7 @@ static void playlist_added(sp_playlistcontainer *pc, sp_playlist *playlist, int
 		[container.playlistAddCallbackStack removeObjectAtIndex:0];
 	}
 	
-	dispatch_async(dispatch_get_main_queue(), ^() {
+	SPDispatchToCallbackQueue(container.session, ^() {
 		container.playlists = newTree;
 		if (callback) callback(newPlaylist);
 	});
@@ -111,7 +112,7 @@ static void playlist_removed(sp_playlistcontainer *pc, sp_playlist *playlist, in
 		[container.playlistRemoveCallbackStack removeObjectAtIndex:0];
 	}
 	
-	dispatch_async(dispatch_get_main_queue(), ^() {
+	SPDispatchToCallbackQueue(container.session, ^() {
 		container.playlists = newTree;
 		if (callback) callback(nil);
 	});
@@ -131,7 +132,7 @@ static void container_loaded(sp_playlistcontainer *pc, void *userdata) {
 	SPUser *user = [SPUser userWithUserStruct:sp_playlistcontainer_owner(container.container) inSession:container.session];
 	NSArray *newTree = [container createPlaylistTree];
 	
-	dispatch_async(dispatch_get_main_queue(), ^() {
+	SPDispatchToCallbackQueue(container.session, ^() {
 		container.owner = user;
 		container.playlists = newTree;
 		container.loaded = YES;
@@ -188,7 +189,7 @@ static sp_playlistcontainer_callbacks playlistcontainer_callbacks = {
 		if (isLoaded)
 			user = [SPUser userWithUserStruct:sp_playlistcontainer_owner(self.container) inSession:self.session];
 		
-		dispatch_async(dispatch_get_main_queue(), ^() {
+		SPDispatchToCallbackQueue(self.session, ^() {
 			self.owner = user;
 			self.playlists = newTree;
 			self.loaded = isLoaded;
@@ -372,7 +373,7 @@ static sp_playlistcontainer_callbacks playlistcontainer_callbacks = {
 		
 		if ([[name stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]] length] == 0 ||
 			[name length] > 255) {
-			dispatch_async(dispatch_get_main_queue(), ^() { if (block) block(nil); });
+			SPDispatchToCallbackQueue(self.session, ^() { if (block) block(nil); });
 			return;
 		}
 		
@@ -382,7 +383,7 @@ static sp_playlistcontainer_callbacks playlistcontainer_callbacks = {
 		sp_playlist *newPlaylist = sp_playlistcontainer_add_new_playlist(self.container, [name UTF8String]);
 		if (newPlaylist == NULL && block) {
 			[self.playlistAddCallbackStack removeObject:block];
-			dispatch_async(dispatch_get_main_queue(), ^{ block(nil); });
+			SPDispatchToCallbackQueue(self.session, ^{ block(nil); });
 		}
 	});
 }
@@ -403,7 +404,7 @@ static sp_playlistcontainer_callbacks playlistcontainer_callbacks = {
 		else if (error != NULL)
 			error = [NSError spotifyErrorWithCode:errorCode];
 		
-		dispatch_async(dispatch_get_main_queue(), ^() { if (block) block(folder, error); });
+		SPDispatchToCallbackQueue(self.session, ^() { if (block) block(folder, error); });
 		
 	});
 }
@@ -422,7 +423,7 @@ static sp_playlistcontainer_callbacks playlistcontainer_callbacks = {
 -(void)removePlaylist:(SPPlaylist *)aPlaylist callback:(SPErrorableOperationCallback)block {
 	
 	if (aPlaylist == nil)
-		if (block) dispatch_async(dispatch_get_main_queue(), ^{ block([NSError spotifyErrorWithCode:SP_ERROR_INVALID_INDATA]); });
+		if (block) SPDispatchToCallbackQueue(self.session, ^{ block([NSError spotifyErrorWithCode:SP_ERROR_INVALID_INDATA]); });
 	
 	SPDispatchAsync(^{
 		
@@ -447,7 +448,7 @@ static sp_playlistcontainer_callbacks playlistcontainer_callbacks = {
 		
 		if (error) {
 			[self.playlistRemoveCallbackStack removeObject:block];
-			dispatch_async(dispatch_get_main_queue(), ^{ block(error); });
+			SPDispatchToCallbackQueue(self.session, ^{ block(error); });
 		}
 	});
 }
@@ -455,7 +456,7 @@ static sp_playlistcontainer_callbacks playlistcontainer_callbacks = {
 -(void)removeFolderFromTree:(SPPlaylistFolder *)aFolder callback:(SPErrorableOperationCallback)block {
 	
 	if (aFolder == nil)
-		if (block) dispatch_async(dispatch_get_main_queue(), ^{ block([NSError spotifyErrorWithCode:SP_ERROR_INVALID_INDATA]); });
+		if (block) SPDispatchToCallbackQueue(self.session, ^{ block([NSError spotifyErrorWithCode:SP_ERROR_INVALID_INDATA]); });
 	
 	SPDispatchAsync(^{
 		
@@ -478,7 +479,7 @@ static sp_playlistcontainer_callbacks playlistcontainer_callbacks = {
 		sp_playlistcontainer_add_callbacks(self.container, &playlistcontainer_callbacks, (__bridge void *)(self.callbackProxy));
 		
 		NSArray *newTree = [self createPlaylistTree];
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(self.session, ^{
 			self.playlists = newTree;
 			if (block) block(nil);
 		});
@@ -508,23 +509,23 @@ static sp_playlistcontainer_callbacks playlistcontainer_callbacks = {
 			}
 			
 			if (sourceIndex == NSNotFound) {
-				dispatch_async(dispatch_get_main_queue(), ^{ if (block) block([NSError spotifyErrorWithCode:SP_ERROR_INVALID_INDATA]); });
+				SPDispatchToCallbackQueue(self.session, ^{ if (block) block([NSError spotifyErrorWithCode:SP_ERROR_INVALID_INDATA]); });
 				return;
 			}
 			
 			NSInteger destinationIndex = [self indexInFlattenedListForIndex:newIndex inFolder:aParentFolderOrNil];
 			
 			if (destinationIndex == NSNotFound) {
-				dispatch_async(dispatch_get_main_queue(), ^{ if (block) block([NSError spotifyErrorWithCode:SP_ERROR_INDEX_OUT_OF_RANGE]); });
+				SPDispatchToCallbackQueue(self.session, ^{ if (block) block([NSError spotifyErrorWithCode:SP_ERROR_INDEX_OUT_OF_RANGE]); });
 				return;
 			}
 			
 			sp_error errorCode = sp_playlistcontainer_move_playlist(self.container, (int)sourceIndex, (int)destinationIndex, false);
 			
 			if (errorCode != SP_ERROR_OK)
-				dispatch_async(dispatch_get_main_queue(), ^{ if (block) block([NSError spotifyErrorWithCode:errorCode]); });
+				SPDispatchToCallbackQueue(self.session, ^{ if (block) block([NSError spotifyErrorWithCode:errorCode]); });
 			else if (block)
-				dispatch_async(dispatch_get_main_queue(), ^{ block(nil); });
+				SPDispatchToCallbackQueue(self.session, ^{ block(nil); });
 		});
 		
 		
@@ -543,14 +544,14 @@ static sp_playlistcontainer_callbacks playlistcontainer_callbacks = {
 			sourceIndex = folderRange.location;
 			
 			if (sourceIndex == NSNotFound) {
-				dispatch_async(dispatch_get_main_queue(), ^{ if (block) block([NSError spotifyErrorWithCode:SP_ERROR_INVALID_INDATA]); });
+				SPDispatchToCallbackQueue(self.session, ^{ if (block) block([NSError spotifyErrorWithCode:SP_ERROR_INVALID_INDATA]); });
 				return;
 			}
 			
 			NSInteger destinationIndex = [self indexInFlattenedListForIndex:newIndex inFolder:aParentFolderOrNil];
 			
 			if (destinationIndex == NSNotFound) {
-				dispatch_async(dispatch_get_main_queue(), ^{ if (block) block([NSError spotifyErrorWithCode:SP_ERROR_INDEX_OUT_OF_RANGE]); });
+				SPDispatchToCallbackQueue(self.session, ^{ if (block) block([NSError spotifyErrorWithCode:SP_ERROR_INDEX_OUT_OF_RANGE]); });
 				return;
 			}
 			
@@ -560,7 +561,7 @@ static sp_playlistcontainer_callbacks playlistcontainer_callbacks = {
 				NSError *error = errorCode == SP_ERROR_OK ? nil : [NSError spotifyErrorWithCode:errorCode];
 				
 				if (error) {
-					dispatch_async(dispatch_get_main_queue(), ^() { if (block) block(error); });
+					SPDispatchToCallbackQueue(self.session, ^() { if (block) block(error); });
 					return;
 				}
 				
@@ -576,7 +577,7 @@ static sp_playlistcontainer_callbacks playlistcontainer_callbacks = {
 			if (sp_playlistcontainer_is_loaded(self.container))
 				container_loaded(self.container, (__bridge void *)(self.callbackProxy));
 			
-			dispatch_async(dispatch_get_main_queue(), ^() { if (block) block(nil); });
+			SPDispatchToCallbackQueue(self.session, ^() { if (block) block(nil); });
 			
 		});
 		
@@ -603,7 +604,7 @@ static sp_playlistcontainer_callbacks playlistcontainer_callbacks = {
 		link = NULL;
 
 			if (block)
-				dispatch_async(dispatch_get_main_queue(), ^{
+				SPDispatchToCallbackQueue(self.session, ^{
 					NSError *error = nil;
 					if (subbedPlaylist == NULL)
 						error = [NSError spotifyErrorWithCode:SP_ERROR_OTHER_PERMANENT];
@@ -644,7 +645,7 @@ static sp_playlistcontainer_callbacks playlistcontainer_callbacks = {
 		self.playlistRemoveCallbackStack = [NSMutableArray new];
 		
 		if (self.session.loadingPolicy == SPAsyncLoadingImmediate)
-			dispatch_async(dispatch_get_main_queue(), ^() { [self startLoading]; });
+			SPDispatchToCallbackQueue(self.session, ^() { [self startLoading]; });
     }
     return self;
 }
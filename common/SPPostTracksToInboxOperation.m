@@ -32,6 +32,7 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #import "SPPostTracksToInboxOperation.h"
 #import "SPSession.h"
+#import "SPSessionInternal.h"
 #import "SPErrorExtensions.h"
 #import "SPTrack.h"
 
@@ -63,7 +64,7 @@ void inboxpost_complete(sp_inbox *result, void *userdata) {
 		if (errorCode != SP_ERROR_OK)
 			error = [NSError spotifyErrorWithCode:errorCode];
 		
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(operation.session, ^{
 			if (operation.completionBlock) operation.completionBlock(error);
 			operation.completionBlock = nil;
 		});
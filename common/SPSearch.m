@@ -32,6 +32,7 @@
 
 #import "SPSearch.h"
 #import "SPSession.h"
+#import "SPSessionInternal.h"
 #import "SPURLExtensions.h"
 #import "SPAlbum.h"
 #import "SPArtist.h"
@@ -376,7 +377,7 @@ void search_complete(sp_search *result, void *userdata) {
 	
 	self.activeSearch = NULL;
 	
-	dispatch_async(dispatch_get_main_queue(), ^{
+	SPDispatchToCallbackQueue(self.session, ^{
 		
 		self.searchError = error;
 		self.suggestedSearchQuery = newSuggestion;
@@ -481,7 +482,7 @@ void search_complete(sp_search *result, void *userdata) {
 			sp_link *searchLink = sp_link_create_from_search(self.activeSearch);
 			if (searchLink != NULL) {
 				NSURL *url = [NSURL urlWithSpotifyLink:searchLink];
-				dispatch_async(dispatch_get_main_queue(), ^() { self.spotifyURL = url; });
+				SPDispatchToCallbackQueue(self.session, ^() { self.spotifyURL = url; });
 				sp_link_release(searchLink);
 			}
 		}
@@ -96,9 +96,21 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
  @param block The block to execute.
  @param wait If `YES`, this method will block until the block has completed executing. This is not recommended.
+ If called on the libspotify thread with `wait` set to `YES`, the block is executed immediately.
  */
 +(void)dispatchToLibSpotifyThread:(dispatch_block_t)block waitUntilDone:(BOOL)wait;
 
+/** Executes the given block on the libspotify thread with the given priority.
+ 
+ Blocks queued with +[SPSession dispatchToLibSpotifyThread:] are in the background lane. Interactive blocks
+ run ahead of background blocks that haven't started yet, so they wait at most for the block already running.
+ Use this for work a user is waiting on, such as controlling playback.
+ 
+ @param block The block to execute.
+ @param priority The lane to queue the block in.
+ */
++(void)dispatchToLibSpotifyThread:(dispatch_block_t)block priority:(SPDispatchPriority)priority;
+
 /** Returns the runloop that is running libspotify.
  
  Calls to the libspotify C API and certain CocoaLibSpotify methods must be made on this
@@ -109,6 +121,29 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 +(CFRunLoopRef)libSpotifyRunloop;
 
+/** Starts timing the blocks run on the libspotify thread.
+ 
+ While monitoring, every block passed to the libspotify thread is timestamped as it's queued and timed as it runs,
+ which costs a little on every dispatch. Blocks that run for longer than `threshold` are logged, named by the method
+ they were written in, and so is a block that's still running after that long. Monitoring starts from fresh statistics.
+ 
+ @param threshold The time, in seconds, a block can run before it's reported as stalling the thread. Pass `0.0` to
+ collect statistics without reporting stalls.
+ @see +[SPSession libSpotifyThreadStatistics]
+ */
++(void)startMonitoringLibSpotifyThreadWithStallThreshold:(NSTimeInterval)threshold;
+
+/** Stops timing the blocks run on the libspotify thread. The statistics collected so far are kept. */
++(void)stopMonitoringLibSpotifyThread;
+
+/** Returns a dictionary of statistics about the libspotify thread's work queue. See Constants for keys.
+ 
+ The counts of coalesced and cancelled blocks are kept whether or not the thread is being monitored.
+ 
+ @see +[SPSession startMonitoringLibSpotifyThreadWithStallThreshold:]
+ */
++(NSDictionary *)libSpotifyThreadStatistics;
+
 /** Returns `YES` if the Spotify client is installed on the current device/machine. */
 +(BOOL)spotifyClientInstalled;
 
@@ -289,6 +324,31 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /** Returns the loading policy of the session. */
 @property (nonatomic, readonly) SPAsyncLoadingPolicy loadingPolicy;
 
+/** Returns the queue the session and the objects it creates deliver their callbacks on. Defaults to the main queue.
+ 
+ Completion blocks, delegate messages and changes to the properties of the session and its objects
+ (and therefore KVO notifications) are all delivered on this queue, as are SPAsyncLoading and SPPlaybackManager
+ callbacks for the session's objects. Setting `NULL` restores the main queue.
+ 
+ Set a queue of your own to keep a session's callbacks off the main thread, or to give several sessions
+ independent queues. Callbacks are always delivered one at a time and in order, since the properties of
+ the session's objects aren't atomic: a concurrent queue is used through a private serial queue that targets it.
+ 
+ On iOS, SPLoginViewController is a UIKit class, so it's always updated on the main thread, after the callbacks
+ already sent to this queue.
+ */
+@property (readwrite) dispatch_queue_t callbackQueue;
+
+/** Returns the longest time, in seconds, changes to the session's objects are held back so they can be made together. Defaults to `0.0`.
+ 
+ Metadata loaded by libSpotify is collected and applied to the objects it belongs to in one go on the
+ callback queue, rather than one object at a time. Changes go out whenever libSpotify runs out of work
+ to do, and this caps how long they wait while it stays busy. At `0.0`, they go out as soon as libSpotify
+ finishes what it's currently doing. Longer latencies collect more changes per batch under load, at the
+ cost of slower updates.
+ */
+@property (readwrite) NSTimeInterval maximumPropertyUpdateLatency;
+
 ///----------------------------
 /// @name Social and Scrobbling
 ///----------------------------
@@ -535,6 +595,9 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  This method caches SPTrack objects using the same cache the +[SPTrack track...] 
  convenience methods use.
  
+ The session keeps the most recently used SPTrack objects, and beyond that only keeps those still in use
+ elsewhere, so a given struct always has the same SPTrack while it's in use.
+ 
  @warning This method *must* be called on the libSpotify thread. See the
  "Threading" section of the library's readme for more information.
  
@@ -548,6 +611,9 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  This method caches SPUser objects using the same cache the +[SPUser user...] 
  convenience methods use.
  
+ The session keeps the most recently used SPUser objects, and beyond that only keeps those still in use
+ elsewhere, so a given struct always has the same SPUser while it's in use.
+ 
  @warning This method *must* be called on the libSpotify thread. See the
  "Threading" section of the library's readme for more information.
  
@@ -556,6 +622,15 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 -(SPUser *)userForUserStruct:(sp_user *)user;
 
+/** Returns statistics about the session's caches of SPTrack, SPAlbum, SPArtist, SPImage, SPUser, SPPlaylist and
+ SPPlaylistFolder objects.
+ 
+ The session keeps the most recently used objects of each type, and beyond that only keeps those still in use
+ elsewhere. Its caches are emptied when it logs out. The dictionary has an entry for each cache, which is itself a
+ dictionary of the cache's counts and limits. See Constants for keys, and SPObjectCache for the keys of each entry.
+ */
+-(NSDictionary *)cacheStatistics;
+
 ///----------------------------
 /// @name Audio Playback
 ///----------------------------
@@ -584,6 +659,18 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 @property (nonatomic, readwrite, assign) __unsafe_unretained id <SPSessionAudioDeliveryDelegate> audioDeliveryDelegate;
 
+/** Returns the least amount of audio, in seconds, the session collects before passing it to the audio delivery delegate. Defaults to `0.0`.
+ 
+ libspotify delivers audio in small, frequent chunks. When this is above zero, the session copies each chunk
+ into a staging buffer and only calls the audio delivery delegate once at least this much audio has built up,
+ which makes delivery much cheaper on libspotify's audio thread. Staged audio is passed on early when the audio
+ format changes, at the end of a track and once it's been waiting this long, and is thrown away at a discontinuity.
+ 
+ While batching, the audio delivery delegate may be called from a queue owned by the session as well as 
+ from libspotify's audio thread, but never from both at once.
+ */
+@property (readwrite) NSTimeInterval audioDeliveryBatchDuration;
+
 /** Preloads playback assets for the given track.
  
  For smooth changes between tracks, you can use this method to start loading track playback 
@@ -816,6 +903,21 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 -(NSInteger)session:(id <SPSessionPlaybackProvider>)aSession shouldDeliverAudioFrames:(const void *)audioFrames ofCount:(NSInteger)frameCount streamDescription:(AudioStreamBasicDescription)audioDescription;
 
+@optional
+
+/** Called when all of the audio for the current track has been delivered.
+ 
+ This is called on the same thread as `-session:shouldDeliverAudioFrames:ofCount:streamDescription:`, straight
+ after the last audio of the track was accepted, so the end of the track can be marked exactly in your audio buffers. 
+ Audio for the next track loaded will follow without a discontinuity.
+ 
+ @warning This function is called from an internal session thread - you need to have 
+ proper synchronization!
+ 
+ @param aSession The session that finished delivering audio.
+ */
+-(void)sessionDidEndAudioDelivery:(id <SPSessionPlaybackProvider>)aSession;
+
 @end
 
 
@@ -850,6 +952,74 @@ static NSString * const SPOfflineStatisticsWillNotCopyTrackCountKey = @"SPOfflin
 /** Whether tracks are currently being synced as a boolean `NSNumber`. */
 static NSString * const SPOfflineStatisticsIsSyncingKey = @"SPOfflineStatisticsIsSyncing";
 
+///----------------------------
+/// @name libSpotify Thread Statistics Keys
+///----------------------------
+
+/** @constant Whether the libspotify thread is being monitored as a boolean `NSNumber`. */
+static NSString * const SPLibSpotifyThreadIsMonitoredKey = @"SPLibSpotifyThreadIsMonitored";
+
+/** @constant The number of blocks run while monitoring as an `NSNumber`. */
+static NSString * const SPLibSpotifyThreadBlockCountKey = @"SPLibSpotifyThreadBlockCount";
+
+/** @constant The number of blocks queued while monitoring that are yet to finish running as an `NSNumber`. */
+static NSString * const SPLibSpotifyThreadQueueDepthKey = @"SPLibSpotifyThreadQueueDepth";
+
+/** @constant The most blocks queued while monitoring that were waiting to finish at once as an `NSNumber`. */
+static NSString * const SPLibSpotifyThreadMaximumQueueDepthKey = @"SPLibSpotifyThreadMaximumQueueDepth";
+
+/** @constant The longest time, in seconds, a block waited to run as an `NSNumber`. */
+static NSString * const SPLibSpotifyThreadMaximumQueueTimeKey = @"SPLibSpotifyThreadMaximumQueueTime";
+
+/** @constant The longest time, in seconds, a block took to run as an `NSNumber`. */
+static NSString * const SPLibSpotifyThreadMaximumExecutionTimeKey = @"SPLibSpotifyThreadMaximumExecutionTime";
+
+/** @constant An `NSArray` of block counts by time waiting to run. The first counts blocks that waited under a microsecond,
+ and each after that counts blocks that waited up to twice as long as the one before. The last has no upper limit. */
+static NSString * const SPLibSpotifyThreadQueueTimeHistogramKey = @"SPLibSpotifyThreadQueueTimeHistogram";
+
+/** @constant An `NSArray` of block counts by time taken to run, in the same buckets as `SPLibSpotifyThreadQueueTimeHistogramKey`. */
+static NSString * const SPLibSpotifyThreadExecutionTimeHistogramKey = @"SPLibSpotifyThreadExecutionTimeHistogram";
+
+/** @constant The number of blocks that ran for longer than the stall threshold as an `NSNumber`. */
+static NSString * const SPLibSpotifyThreadStallCountKey = @"SPLibSpotifyThreadStallCount";
+
+/** @constant An `NSArray` of descriptions of the most recent blocks that ran for longer than the stall threshold, oldest first. */
+static NSString * const SPLibSpotifyThreadRecentStallsKey = @"SPLibSpotifyThreadRecentStalls";
+
+/** @constant The number of blocks passed to SPDispatchAsyncCoalesced() that were folded into work already pending as an `NSNumber`.
+ Counted whether or not the thread is being monitored. */
+static NSString * const SPLibSpotifyThreadCoalescedBlockCountKey = @"SPLibSpotifyThreadCoalescedBlockCount";
+
+/** @constant The number of blocks passed to SPDispatchAsyncCoalesced() that were dropped because their target was deallocated
+ before they ran as an `NSNumber`. Counted whether or not the thread is being monitored. */
+static NSString * const SPLibSpotifyThreadCancelledBlockCountKey = @"SPLibSpotifyThreadCancelledBlockCount";
+
+///----------------------------
+/// @name Cache Statistics Keys
+///----------------------------
+
+/** @constant Statistics for the session's cache of SPTrack objects as an `NSDictionary`. */
+static NSString * const SPSessionTrackCacheKey = @"SPSessionTrackCache";
+
+/** @constant Statistics for the session's cache of SPAlbum objects as an `NSDictionary`. */
+static NSString * const SPSessionAlbumCacheKey = @"SPSessionAlbumCache";
+
+/** @constant Statistics for the session's cache of SPArtist objects as an `NSDictionary`. */
+static NSString * const SPSessionArtistCacheKey = @"SPSessionArtistCache";
+
+/** @constant Statistics for the session's cache of SPImage objects as an `NSDictionary`. Each image costs the size of its decoded bitmap in bytes. */
+static NSString * const SPSessionImageCacheKey = @"SPSessionImageCache";
+
+/** @constant Statistics for the session's cache of SPUser objects as an `NSDictionary`. */
+static NSString * const SPSessionUserCacheKey = @"SPSessionUserCache";
+
+/** @constant Statistics for the session's cache of SPPlaylist objects as an `NSDictionary`. */
+static NSString * const SPSessionPlaylistCacheKey = @"SPSessionPlaylistCache";
+
+/** @constant Statistics for the session's cache of SPPlaylistFolder objects as an `NSDictionary`. */
+static NSString * const SPSessionPlaylistFolderCacheKey = @"SPSessionPlaylistFolderCache";
+
 ///----------------------------
 /// @name NSNotification Keys
 ///----------------------------
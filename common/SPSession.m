@@ -50,6 +50,13 @@
 #import "SPPlaylistItem.h"
 #import "SPUnknownPlaylist.h"
 #import "SPSessionInternal.h"
+#import "SPAudioDeliveryBatcher.h"
+#import "SPObjectCache.h"
+#import <libkern/OSAtomic.h>
+#import <pthread.h>
+#import <mach/mach_time.h>
+#import <dlfcn.h>
+#import <objc/runtime.h>
 
 @interface NSObject (SPLoadedObject)
 -(BOOL)checkLoaded;
@@ -61,9 +68,10 @@
 @property (nonatomic, readwrite, strong) NSLocale *locale;
 
 @property (nonatomic, readwrite) sp_connectionstate connectionState;
-@property (nonatomic, readwrite, strong) NSMutableDictionary *playlistCache;
-@property (nonatomic, readwrite, strong) NSMutableDictionary *userCache;
-@property (nonatomic, readwrite, strong) NSMutableDictionary *trackCache;
+@property (nonatomic, readwrite, strong) SPObjectCache *playlistCache;
+@property (nonatomic, readwrite, strong) SPObjectCache *playlistFolderCache;
+@property (nonatomic, readwrite, strong) SPObjectCache *userCache;
+@property (nonatomic, readwrite, strong) SPObjectCache *trackCache;
 @property (nonatomic, readwrite, strong) NSError *offlineSyncError;
 
 @property (nonatomic, readwrite) sp_session *session;
@@ -78,23 +86,21 @@
 @property (nonatomic, readwrite, copy) NSDictionary *offlineStatistics;
 
 @property (nonatomic, readwrite, strong) NSMutableSet *loadingObjects;
+@property (nonatomic, readwrite, strong) SPAudioDeliveryBatcher *audioDeliveryBatcher;
 
 @property (nonatomic, copy, readwrite) NSString *userAgent;
 @property (nonatomic, readwrite) SPAsyncLoadingPolicy loadingPolicy;
 
-@property (readwrite, strong) NSTimer *prodTimeoutTimer;
-
 @property (nonatomic, readwrite, copy) void (^logoutCompletionBlock) ();
 
 -(void)checkLoadingObjects;
 -(void)prodSessionForcefully;
+-(void)requestProdSession;
 
 @end
 
 #pragma mark Session Callbacks
 
-static AudioStreamBasicDescription libSpotifyAudioDescription;
-
 /* ------------------------  BEGIN SESSION CALLBACKS  ---------------------- */
 /**
  * This callback is called when the user was logged in, but the connection to
@@ -108,7 +114,7 @@ static void connection_error(sp_session *session, sp_error errorCode) {
 		sp_connectionstate newState = sp_session_connectionstate(session);
 		NSError *error = [NSError spotifyErrorWithCode:errorCode];
 		
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(sess, ^{
 			sess.connectionState = newState;
 			
 			if ([sess.delegate respondsToSelector:@selector(session:didEncounterNetworkError:)]) {
@@ -129,7 +135,7 @@ static void logged_in(sp_session *session, sp_error errorCode) {
 		sp_connectionstate newState = sp_session_connectionstate(session);
 		NSError *error = errorCode == SP_ERROR_OK ? nil : [NSError spotifyErrorWithCode:errorCode];
 		
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(sess, ^{
 			sess.connectionState = newState;
 			
 			if (error != nil) {
@@ -167,7 +173,7 @@ static void logged_out(sp_session *session) {
 		
 		sp_connectionstate newState = sp_session_connectionstate(session);
 		
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(sess, ^{
 			sess.connectionState = newState;
 			
 			[[NSNotificationCenter defaultCenter] postNotificationName:SPSessionDidLogoutNotification object:sess];
@@ -202,9 +208,7 @@ static void logged_out(sp_session *session) {
  */
 static void notify_main_thread(sp_session *session) {
     SPSession *sess = (__bridge SPSession *)sp_session_userdata(session);
-	SPDispatchAsync(^{
-		[sess prodSessionForcefully];
-	});
+	[sess requestProdSession];
 }
 
 /**
@@ -217,7 +221,7 @@ static void log_message(sp_session *session, const char *data) {
 		
 		NSString *message = [NSString stringWithUTF8String:data];
 		
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(sess, ^{
 			if ([sess.delegate respondsToSelector:@selector(session:didLogMessage:)]) {
 				[sess.delegate session:sess didLogMessage:message];
 			}
@@ -239,7 +243,7 @@ static void metadata_updated(sp_session *session) {
 		// Call this on the libSpotify thread
 		[sess checkLoadingObjects];
 		
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(sess, ^{
 
 			// Delegate before notification because Voxar said so
 			if ([sess.delegate respondsToSelector:@selector(sessionDidChangeMetadata:)]) {
@@ -267,7 +271,7 @@ static void message_to_user(sp_session *session, const char *msg) {
 		
 		NSString *message = [NSString stringWithUTF8String:msg];
 		
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(sess, ^{
 			if ([sess.delegate respondsToSelector:@selector(session:recievedMessageForUser:)]) {
 				[sess.delegate session:sess recievedMessageForUser:message];
 			}
@@ -299,26 +303,14 @@ static int music_delivery(sp_session *session, const sp_audioformat *format, con
 	
 	SPSession *sess = (__bridge SPSession *)sp_session_userdata(session);
 	
+	// Audio for the audio delivery delegate goes through the session's own batcher, which keeps the 
+	// stream's format. It only sends messages when it passes audio on, and brings its own autorelease pool.
+	__unsafe_unretained SPAudioDeliveryBatcher *batcher = sess.audioDeliveryBatcher;
+	if (SPAudioDeliveryBatcherIsActive(batcher))
+		return (int)SPAudioDeliveryBatcherDeliverFrames(batcher, format, frames, num_frames);
+	
 	@autoreleasepool {
 		
-		id <SPSessionAudioDeliveryDelegate> audioDeliveryDelegate = sess.audioDeliveryDelegate;
-		if (audioDeliveryDelegate != nil) {
-			
-			if (format->sample_rate != (float)libSpotifyAudioDescription.mSampleRate || format->channels != libSpotifyAudioDescription.mChannelsPerFrame) {
-				// Update the libSpotify audio description to match the current data
-				libSpotifyAudioDescription.mSampleRate = (float)format->sample_rate;
-				libSpotifyAudioDescription.mBytesPerPacket = format->channels * sizeof(SInt16);
-				libSpotifyAudioDescription.mBytesPerFrame = libSpotifyAudioDescription.mBytesPerPacket;
-				libSpotifyAudioDescription.mChannelsPerFrame = format->channels;
-			}
-			
-			int framesConsumed = (int)[audioDeliveryDelegate session:sess
-											shouldDeliverAudioFrames:frames
-															 ofCount:num_frames
-												   streamDescription:libSpotifyAudioDescription];
-			return framesConsumed;
-		}
-		
 		id <SPSessionPlaybackDelegate> playbackDelegate = sess.playbackDelegate;
 		if ([playbackDelegate respondsToSelector:@selector(session:shouldDeliverAudioFrames:ofCount:format:)]) {
 			int framesConsumed = (int)[playbackDelegate session:sess
@@ -342,7 +334,7 @@ static void play_token_lost(sp_session *session) {
 	
 	@autoreleasepool {
 		
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(sess, ^{
 			
 			sess.playing = NO;
 			if ([[sess playbackDelegate] respondsToSelector:@selector(sessionDidLosePlayToken:)]) {
@@ -366,16 +358,17 @@ static void end_of_track(sp_session *session) {
 	
 	@autoreleasepool {
 		
-		dispatch_async(dispatch_get_main_queue(), ^{
+		// Tell the audio delivery delegate right away, on this thread, so it can mark
+		// exactly where the track ends before any audio from the next track arrives.
+		// If audio is being batched, the end of the track has to wait until the last batch is passed on.
+		SPAudioDeliveryBatcherEndTrack(sess.audioDeliveryBatcher);
+		
+		SPDispatchToCallbackQueue(sess, ^{
 			
 			sess.playing = NO;
 			
-			SEL selector = @selector(sessionDidEndPlayback:);
-			if ([[sess playbackDelegate] respondsToSelector:selector]) { 
-				[(NSObject *)[sess playbackDelegate] performSelectorOnMainThread:selector
-																	  withObject:sess
-																   waitUntilDone:NO];
-			}
+			if ([[sess playbackDelegate] respondsToSelector:@selector(sessionDidEndPlayback:)])
+				[[sess playbackDelegate] sessionDidEndPlayback:sess];
 		});
     }
 }
@@ -388,7 +381,7 @@ static void streaming_error(sp_session *session, sp_error errorCode) {
 		
 		NSError *error = [NSError spotifyErrorWithCode:errorCode];
 		
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(sess, ^{
 			if ([[sess playbackDelegate] respondsToSelector:@selector(session:didEncounterStreamingError:)]) {
 				[(id <SPSessionPlaybackDelegate>)sess.playbackDelegate session:sess didEncounterStreamingError:error];
 			}
@@ -424,12 +417,12 @@ static void offline_status_updated(sp_session *session) {
 		[mutableStats setValue:[NSNumber numberWithInt:status.willnotcopy_tracks] forKey:SPOfflineStatisticsWillNotCopyTrackCountKey];
 		[mutableStats setValue:[NSNumber numberWithBool:status.syncing] forKey:SPOfflineStatisticsIsSyncingKey];
 		
-		for (id playlistOrFolder in [sess.playlistCache allValues]) {
+		for (id playlistOrFolder in [[sess.playlistCache allObjects] arrayByAddingObjectsFromArray:[sess.playlistFolderCache allObjects]]) {
 			if ([playlistOrFolder respondsToSelector:@selector(offlineSyncStatusMayHaveChanged)])
 				[playlistOrFolder offlineSyncStatusMayHaveChanged];
 		}
 		
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(sess, ^{
 			
 			sess.offlineTracksRemaining = offlineTracksRemaining;
 			sess.offlinePlaylistsRemaining = offlinePlaylistsRemaining;
@@ -445,7 +438,7 @@ static void offline_error(sp_session *session, sp_error error) {
 	SPSession *sess = (__bridge SPSession *)sp_session_userdata(session);
 	NSError *err = [NSError spotifyErrorWithCode:error];
 	
-	dispatch_async(dispatch_get_main_queue(), ^{
+	SPDispatchToCallbackQueue(sess, ^{
 		sess.offlineSyncError = err;
 	});
 }
@@ -461,7 +454,7 @@ static void credentials_blob_updated(sp_session *session, const char *blob) {
 		NSString *loginUserName = user_name == NULL ? nil : [NSString stringWithUTF8String:user_name];
 		if (loginUserName.length == 0) loginUserName = nil;
 		
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(sess, ^{
 			
 			SEL selector = @selector(session:didGenerateLoginCredentials:forUserName:);
 			
@@ -479,7 +472,7 @@ static void connectionstate_updated(sp_session *session) {
 	sp_connectionstate state = sp_session_connectionstate(session);
 
 	@autoreleasepool {
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(sess, ^{
 			sess.connectionState = state;
 		});
 	}
@@ -493,7 +486,7 @@ static void scrobble_error(sp_session *session, sp_error error) {
 		
 		NSError *err = [NSError spotifyErrorWithCode:error];
 		
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(sess, ^{
 			
 			SEL selector = @selector(session:didEncounterScrobblingError:);
 			
@@ -510,7 +503,7 @@ static void private_session_mode_changed(sp_session *session, bool is_private) {
 	SPSession *sess = (__bridge SPSession *)sp_session_userdata(session);
 	
 	@autoreleasepool {
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(sess, ^{
 			[sess setPrivateSessionFromLibSpotifyUpdate:is_private];
 		});
 	}
@@ -521,15 +514,27 @@ static void private_session_mode_changed(sp_session *session, bool is_private) {
 #import "SPLoginViewController.h"
 #import "SPLoginViewControllerInternal.h"
 
+// The login controller is UIKit, so it has to be updated on the main thread. Going through the callback
+// queue first keeps it in order with the session's other callbacks, such as the login completing.
+static void SPSessionDispatchToLoginController(SPSession *sess, dispatch_block_t block) {
+	SPDispatchToCallbackQueue(sess, ^{
+		if ([NSThread isMainThread])
+			block();
+		else
+			dispatch_async(dispatch_get_main_queue(), block);
+	});
+}
+
 static void show_signup_page(sp_session *session, sp_signup_page page, bool pageIsLoading, int featureMask, const char *recentUserName) {
 	
 	SPSession *sess = (__bridge SPSession *)sp_session_userdata(session);
 	@autoreleasepool {
-		dispatch_async(dispatch_get_main_queue(), ^{
+		NSString *recentUserNameStr = [NSString stringWithUTF8String:recentUserName];
+		SPSessionDispatchToLoginController(sess, ^{
 			[[SPLoginViewController loginControllerForSession:sess] handleShowSignupPage:page
 																				 loading:pageIsLoading
 																			 featureMask:featureMask
-																		  recentUserName:[NSString stringWithUTF8String:recentUserName]];
+																		  recentUserName:recentUserNameStr];
 		});
 	}
 }
@@ -538,7 +543,7 @@ static void show_signup_error_page(sp_session *session, sp_signup_page page, sp_
 	
 	SPSession *sess = (__bridge SPSession *)sp_session_userdata(session);
 	@autoreleasepool {
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPSessionDispatchToLoginController(sess, ^{
 			[[SPLoginViewController loginControllerForSession:sess] handleShowSignupErrorPage:page
 																						error:[NSError spotifyErrorWithCode:error]];
 		});
@@ -553,7 +558,7 @@ static void connect_to_facebook(sp_session *session, const char **permissions, i
 		for (int i = 0; i < permission_count; i++)
 			[permissionStrs addObject:[NSString stringWithUTF8String:permissions[i]]];
 		
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPSessionDispatchToLoginController(sess, ^{
 			[[SPLoginViewController loginControllerForSession:sess] handleConnectToFacebookWithPermissions:permissionStrs];
 		});
 	}
@@ -589,23 +594,170 @@ static sp_session_callbacks _callbacks = {
 #pragma mark -
 
 static NSString * const kSPSessionKVOContext = @"kSPSessionKVOContext";
+static char kSPSessionCallbackQueueKey; // Set on each private callback queue to the queue itself.
+static NSTimeInterval const kSPSessionMaximumProdInterval = 5.0;
+static CFTimeInterval const kSPSessionDistantFuture = 1.0e10; // For timers we only ever fire by re-arming them.
+
+// Wrappers past these are only kept while something else uses them.
+static NSUInteger const kSPSessionTrackCacheCountLimit = 1000;
+static NSUInteger const kSPSessionUserCacheCountLimit = 250;
+static NSUInteger const kSPSessionPlaylistCacheCountLimit = 250;
+static NSUInteger const kSPSessionAlbumCacheCountLimit = 1000;
+static NSUInteger const kSPSessionArtistCacheCountLimit = 1000;
+static NSUInteger const kSPSessionImageCacheCountLimit = 250;
+static NSUInteger const kSPSessionImageCacheTotalCostLimit = 32 * 1024 * 1024; // Images cost the size of their decoded bitmap.
+
+static void SPSessionProdTimerFired(CFRunLoopTimerRef timer, void *info) {
+	[(__bridge SPSession *)info prodSessionForcefully];
+}
+
+// Sets a property for SPPendingPropertyUpdates, which sends the KVO notifications around it.
+// Where KVO has overridden the setter to notify, it's called as the object's own class implements it:
+// -class is documented to return the class as written, not KVO's subclass. Types the cast calls below
+// don't cover go through KVC instead, which may nest a second set of notifications but never drops the change.
+static void SPSetValueWithoutNotifying(id object, NSString *key, SEL setter, id value) {
+	
+	Class objectClass = [object class];
+	NSMethodSignature *signature = [objectClass instanceMethodSignatureForSelector:setter];
+	
+	if (signature.numberOfArguments != 3) {
+		NSCAssert(NO, @"%@ doesn't have a setter named %@", objectClass, NSStringFromSelector(setter));
+		[object setValue:value forKey:key];
+		return;
+	}
+	
+	// Objects nothing is observing haven't been subclassed, so their setters can be used as they are.
+	BOOL isObserved = object_getClass(object) != objectClass;
+	IMP implementation = isObserved ? class_getMethodImplementation(objectClass, setter) : [object methodForSelector:setter];
+	
+	switch (*[signature getArgumentTypeAtIndex:2]) {
+		case _C_ID: ((void (*)(id, SEL, id))implementation)(object, setter, value); break;
+		case _C_CHR: ((void (*)(id, SEL, char))implementation)(object, setter, [value charValue]); break;
+		case _C_UCHR: ((void (*)(id, SEL, unsigned char))implementation)(object, setter, [value unsignedCharValue]); break;
+		case _C_BOOL: ((void (*)(id, SEL, bool))implementation)(object, setter, [value boolValue]); break;
+		case _C_SHT: ((void (*)(id, SEL, short))implementation)(object, setter, [value shortValue]); break;
+		case _C_USHT: ((void (*)(id, SEL, unsigned short))implementation)(object, setter, [value unsignedShortValue]); break;
+		case _C_INT: ((void (*)(id, SEL, int))implementation)(object, setter, [value intValue]); break;
+		case _C_UINT: ((void (*)(id, SEL, unsigned int))implementation)(object, setter, [value unsignedIntValue]); break;
+		case _C_LNG: ((void (*)(id, SEL, long))implementation)(object, setter, [value longValue]); break;
+		case _C_ULNG: ((void (*)(id, SEL, unsigned long))implementation)(object, setter, [value unsignedLongValue]); break;
+		case _C_LNG_LNG: ((void (*)(id, SEL, long long))implementation)(object, setter, [value longLongValue]); break;
+		case _C_ULNG_LNG: ((void (*)(id, SEL, unsigned long long))implementation)(object, setter, [value unsignedLongLongValue]); break;
+		case _C_FLT: ((void (*)(id, SEL, float))implementation)(object, setter, [value floatValue]); break;
+		case _C_DBL: ((void (*)(id, SEL, double))implementation)(object, setter, [value doubleValue]); break;
+		default:
+			// Structs and anything more exotic. KVC unboxes NSValues into structs itself.
+			[object setValue:value forKey:key];
+			break;
+	}
+}
+
+// Property changes waiting to be made to one object, in the order they were last queued.
+@interface SPPendingPropertyUpdates : NSObject
+
+-(id)initWithObject:(id)anObject;
+-(void)setValue:(id)value forPendingKey:(NSString *)key setter:(SEL)setter;
+-(void)apply;
+
+@end
+
+@implementation SPPendingPropertyUpdates {
+	id _object;
+	NSMutableArray *_keys;
+	NSMutableDictionary *_values;
+	NSMutableDictionary *_setterNames;
+}
+
+-(id)initWithObject:(id)anObject {
+	if ((self = [super init])) {
+		_object = anObject;
+		_keys = [[NSMutableArray alloc] initWithCapacity:16];
+		_values = [[NSMutableDictionary alloc] initWithCapacity:16];
+		_setterNames = [[NSMutableDictionary alloc] initWithCapacity:16];
+	}
+	return self;
+}
+
+-(void)setValue:(id)value forPendingKey:(NSString *)key setter:(SEL)setter {
+	
+	// A key queued again moves to the back, so the keys are set as if every change had been made in turn.
+	// The exception is loaded, which always stays last so it's never set before the metadata it announces.
+	if ([_values objectForKey:key] != nil)
+		[_keys removeObject:key];
+	
+	if (![key isEqualToString:@"loaded"] && [_values objectForKey:@"loaded"] != nil)
+		[_keys insertObject:key atIndex:_keys.count - 1];
+	else
+		[_keys addObject:key];
+	
+	if (setter == NULL)
+		setter = NSSelectorFromString([NSString stringWithFormat:@"set%@%@:",
+									   [[key substringToIndex:1] uppercaseString], [key substringFromIndex:1]]);
+	
+	[_values setObject:value == nil ? [NSNull null] : value forKey:key];
+	[_setterNames setObject:NSStringFromSelector(setter) forKey:key];
+}
+
+-(void)apply {
+	
+	// Every change is made inside one set of notifications, so observers of any key see all of them made.
+	// The notifications nest, so the will-changes go out newest first and the did-changes in the order the
+	// keys were queued, which leaves loaded's until last.
+	for (NSString *key in [_keys reverseObjectEnumerator])
+		[_object willChangeValueForKey:key];
+	
+	for (NSString *key in _keys) {
+		id value = [_values objectForKey:key];
+		SPSetValueWithoutNotifying(_object, key, NSSelectorFromString([_setterNames objectForKey:key]), value == [NSNull null] ? nil : value);
+	}
+	
+	for (NSString *key in _keys)
+		[_object didChangeValueForKey:key];
+}
+
+@end
+
+// Coalesced work waiting to run for one object. It's attached to the object while it's pending, so a
+// second request finds it, and it only holds the object weakly, so work for a deallocated object is dropped.
+@interface SPCoalescedWork : NSObject
+
+@property (nonatomic, readwrite, weak) id target;
+@property (nonatomic, readwrite, copy) void (^block)(id target);
+
+@end
+
+@implementation SPCoalescedWork
+
+@synthesize target;
+@synthesize block;
+
+@end
 
 @implementation SPSession {
 	BOOL _playing;
 	BOOL _cachedIsUsingNormalization;
 	BOOL _privateSession;
+	CFRunLoopTimerRef _prodTimer;
+	volatile int32_t _prodRequested;
+	dispatch_queue_t _callbackQueue; // What we dispatch to: the main queue, or a serial queue targeting _callbackTargetQueue.
+	dispatch_queue_t _callbackTargetQueue; // What the callbackQueue property returns.
+	OSSpinLock _callbackQueueLock;
+	NSMutableArray *_pendingPropertyUpdates;
+	NSMutableDictionary *_pendingPropertyUpdatesByObject;
+	CFRunLoopObserverRef _propertyUpdateObserver;
+	CFRunLoopTimerRef _propertyUpdateTimer;
+	SPObjectCache *_albumCache;
+	SPObjectCache *_artistCache;
+	SPObjectCache *_imageCache;
 }
 
 static CFRunLoopRef libspotify_runloop;
-static NSConditionLock *runloopReadyLock;
 static NSThread *libspotifyThread;
-static CFRunLoopSourceRef libspotify_runloop_source;
+static CFRunLoopSourceRef volatile libspotify_runloop_source;
 
 +(void)initialize {
 	static dispatch_once_t onceToken;
 	dispatch_once(&onceToken, ^{
-
-		runloopReadyLock = [[NSConditionLock alloc] initWithCondition:0];
 		
 		[NSThread detachNewThreadSelector:@selector(runBackgroundRunloop:)
 								 toTarget:self
@@ -613,10 +765,439 @@ static CFRunLoopSourceRef libspotify_runloop_source;
 	});
 }
 
+#pragma mark - Property Updates
+
+// Changes to our objects' properties are queued up on the libspotify thread and made in one block on the
+// callback queue when the run loop runs out of work. If it stays busy, a timer sends them once the oldest
+// has waited maximumPropertyUpdateLatency, so they're never held back for longer than that.
+// Anything else sent to the callback queue from the libspotify thread is sent after them, so nothing overtakes them.
+
+static void SPSessionDispatchToCallbackQueue(SPSession *session, dispatch_block_t block) {
+	// Dispatching under the lock keeps the queue from being released out from under us by a concurrent set.
+	OSSpinLockLock(&session->_callbackQueueLock);
+	dispatch_async(session->_callbackQueue, block);
+	OSSpinLockUnlock(&session->_callbackQueueLock);
+}
+
+static void SPSessionFlushPropertyUpdates(SPSession *session) {
+	
+	if (session->_pendingPropertyUpdates.count == 0)
+		return;
+	
+	CFRunLoopTimerSetNextFireDate(session->_propertyUpdateTimer, kSPSessionDistantFuture);
+	NSArray *updates = session->_pendingPropertyUpdates;
+	session->_pendingPropertyUpdates = [[NSMutableArray alloc] init];
+	[session->_pendingPropertyUpdatesByObject removeAllObjects];
+	
+	SPSessionDispatchToCallbackQueue(session, ^{
+		for (SPPendingPropertyUpdates *update in updates)
+			[update apply];
+	});
+}
+
+static void SPSessionPropertyUpdateObserverFired(CFRunLoopObserverRef observer, CFRunLoopActivity activity, void *info) {
+	
+	// Going to sleep means there's nothing more coming for now, so there's no point holding them back.
+	SPSessionFlushPropertyUpdates((__bridge SPSession *)info);
+}
+
+static void SPSessionPropertyUpdateTimerFired(CFRunLoopTimerRef timer, void *info) {
+	SPSessionFlushPropertyUpdates((__bridge SPSession *)info);
+}
+
+void SPEnqueuePropertyUpdate(SPSession *session, id object, NSString *key, id value) {
+	SPEnqueuePropertyUpdateWithSetter(session, object, key, NULL, value);
+}
+
+void SPEnqueuePropertyUpdateWithSetter(SPSession *session, id object, NSString *key, SEL setter, id value) {
+	
+	NSCAssert(CFRunLoopGetCurrent() == libspotify_runloop, @"Not on correct thread!");
+	
+	if (session == nil) {
+		SPPendingPropertyUpdates *updates = [[SPPendingPropertyUpdates alloc] initWithObject:object];
+		[updates setValue:value forPendingKey:key setter:setter];
+		dispatch_async(dispatch_get_main_queue(), ^{ [updates apply]; });
+		return;
+	}
+	
+	NSValue *objectKey = [NSValue valueWithPointer:(__bridge void *)object];
+	SPPendingPropertyUpdates *updates = [session->_pendingPropertyUpdatesByObject objectForKey:objectKey];
+	
+	if (updates == nil) {
+		updates = [[SPPendingPropertyUpdates alloc] initWithObject:object];
+		[session->_pendingPropertyUpdatesByObject setObject:updates forKey:objectKey];
+		[session->_pendingPropertyUpdates addObject:updates];
+		
+		// Armed even at zero latency, so updates still go out if the run loop never gets as far as waiting.
+		if (session->_pendingPropertyUpdates.count == 1)
+			CFRunLoopTimerSetNextFireDate(session->_propertyUpdateTimer, CFAbsoluteTimeGetCurrent() + MAX(session.maximumPropertyUpdateLatency, 0.0));
+	}
+	
+	[updates setValue:value forPendingKey:key setter:setter];
+}
+
+#pragma mark - libSpotify Thread Monitoring
+
+// When monitoring, each block is stamped as it's queued, timed as it runs and logged if it runs for longer
+// than the stall threshold. A watchdog on another thread also logs a block that's still running past it.
+// Blocks are named by their invoke function, which dladdr() resolves to the method they were written in.
+#define kSPLibSpotifyThreadHistogramBucketCount 24
+#define kSPLibSpotifyThreadMaximumStallReports 16
+
+struct SPBlockLiteral {
+	void *isa;
+	int flags;
+	int reserved;
+	void *invoke;
+};
+
+typedef struct SPLibSpotifyThreadStatistics {
+	uint64_t blockCount;
+	uint64_t stallCount;
+	int32_t maximumQueueDepth;
+	uint64_t maximumQueueTime; /* In mach absolute time units. */
+	uint64_t maximumExecutionTime; /* In mach absolute time units. */
+	uint64_t queueTimeHistogram[kSPLibSpotifyThreadHistogramBucketCount];
+	uint64_t executionTimeHistogram[kSPLibSpotifyThreadHistogramBucketCount];
+} SPLibSpotifyThreadStatistics;
+
+static volatile int32_t libspotify_thread_monitoring;
+static uint64_t libspotify_thread_stall_threshold;
+static mach_timebase_info_data_t libspotify_thread_timebase;
+static OSSpinLock libspotify_thread_statistics_lock = OS_SPINLOCK_INIT;
+static SPLibSpotifyThreadStatistics libspotify_thread_statistics;
+static volatile int32_t libspotify_thread_queue_depth;
+static NSMutableArray *libspotify_thread_stall_reports;
+static volatile uint64_t libspotify_thread_block_start;
+static void * volatile libspotify_thread_block_invoke;
+static dispatch_source_t libspotify_thread_watchdog;
+
+static void *SPBlockInvokeAddress(id block) {
+	return block == nil ? NULL : ((__bridge struct SPBlockLiteral *)block)->invoke;
+}
+
+static NSString *SPBlockInvokeDescription(void *invoke) {
+	Dl_info info;
+	if (dladdr(invoke, &info) && info.dli_sname != NULL)
+		return [NSString stringWithUTF8String:info.dli_sname];
+	return [NSString stringWithFormat:@"%p", invoke];
+}
+
+static NSTimeInterval SPLibSpotifyThreadSeconds(uint64_t machTime) {
+	return (double)machTime * libspotify_thread_timebase.numer / libspotify_thread_timebase.denom / NSEC_PER_SEC;
+}
+
+static NSUInteger SPLibSpotifyThreadHistogramBucket(uint64_t machTime) {
+	// Bucket 0 is under a microsecond, and bucket n is from 2^(n-1) up to 2^n microseconds.
+	uint64_t microseconds = machTime * libspotify_thread_timebase.numer / libspotify_thread_timebase.denom / NSEC_PER_USEC;
+	if (microseconds == 0) return 0;
+	return MIN(kSPLibSpotifyThreadHistogramBucketCount - 1, 64 - __builtin_clzll(microseconds));
+}
+
+static void SPLibSpotifyThreadMonitorDidQueue(void) {
+	int32_t depth = OSAtomicIncrement32Barrier(&libspotify_thread_queue_depth);
+	int32_t maximum;
+	do {
+		maximum = libspotify_thread_statistics.maximumQueueDepth;
+	} while (depth > maximum && !OSAtomicCompareAndSwap32Barrier(maximum, depth, &libspotify_thread_statistics.maximumQueueDepth));
+}
+
+static uint64_t SPLibSpotifyThreadMonitorWillRun(void *invoke) {
+	uint64_t start = mach_absolute_time();
+	libspotify_thread_block_invoke = invoke;
+	OSMemoryBarrier();
+	libspotify_thread_block_start = start;
+	return start;
+}
+
+static void SPLibSpotifyThreadMonitorDidRun(uint64_t enqueueTime, uint64_t startTime, void *invoke) {
+	
+	uint64_t endTime = mach_absolute_time();
+	libspotify_thread_block_start = 0;
+	OSAtomicDecrement32Barrier(&libspotify_thread_queue_depth);
+	
+	uint64_t queueTime = startTime - enqueueTime;
+	uint64_t executionTime = endTime - startTime;
+	BOOL stalled = libspotify_thread_stall_threshold > 0 && executionTime > libspotify_thread_stall_threshold;
+	
+	OSSpinLockLock(&libspotify_thread_statistics_lock);
+	libspotify_thread_statistics.blockCount++;
+	libspotify_thread_statistics.queueTimeHistogram[SPLibSpotifyThreadHistogramBucket(queueTime)]++;
+	libspotify_thread_statistics.executionTimeHistogram[SPLibSpotifyThreadHistogramBucket(executionTime)]++;
+	libspotify_thread_statistics.maximumQueueTime = MAX(libspotify_thread_statistics.maximumQueueTime, queueTime);
+	libspotify_thread_statistics.maximumExecutionTime = MAX(libspotify_thread_statistics.maximumExecutionTime, executionTime);
+	if (stalled) libspotify_thread_statistics.stallCount++;
+	OSSpinLockUnlock(&libspotify_thread_statistics_lock);
+	
+	if (!stalled)
+		return;
+	
+	NSString *report = [NSString stringWithFormat:@"%@ ran for %.3fs after waiting %.3fs",
+						SPBlockInvokeDescription(invoke), SPLibSpotifyThreadSeconds(executionTime), SPLibSpotifyThreadSeconds(queueTime)];
+	NSLog(@"[%@ %@]: %@", NSStringFromClass([SPSession class]), NSStringFromSelector(@selector(libSpotifyThreadStatistics)), report);
+	
+	@synchronized(libspotify_thread_stall_reports) {
+		[libspotify_thread_stall_reports addObject:report];
+		if (libspotify_thread_stall_reports.count > kSPLibSpotifyThreadMaximumStallReports)
+			[libspotify_thread_stall_reports removeObjectAtIndex:0];
+	}
+}
+
+static void SPLibSpotifyThreadWatchdogFired(void) {
+	
+	static uint64_t reportedStart;
+	
+	uint64_t start = libspotify_thread_block_start;
+	OSMemoryBarrier();
+	void *invoke = libspotify_thread_block_invoke;
+	if (start == 0 || start == reportedStart)
+		return;
+	
+	uint64_t busyTime = mach_absolute_time() - start;
+	if (busyTime <= libspotify_thread_stall_threshold)
+		return;
+	
+	// Only once per block, which is also logged when it finally finishes.
+	reportedStart = start;
+	NSLog(@"[%@ %@]: The libSpotify thread has been running %@ for %.3fs, and %d blocks are waiting.",
+		  NSStringFromClass([SPSession class]), NSStringFromSelector(@selector(libSpotifyThreadStatistics)), SPBlockInvokeDescription(invoke),
+		  SPLibSpotifyThreadSeconds(busyTime), libspotify_thread_queue_depth - 1);
+}
+
 #pragma mark - Runloop & Thread Management
 
+// Work for the libspotify thread is pushed onto a lock-free stack by any number of threads. The
+// libspotify thread takes the whole stack at once, puts it back in the order it was queued and runs it.
+// Only a push onto an empty stack signals the run loop, so a burst of work only wakes the thread once.
+//
+// There's a stack for each priority. Interactive work is checked for before every background block, so it
+// never waits for more than the block already running. Background work runs in slices of at most
+// kSPLibSpotifyBackgroundWorkSlice, and what's left carries over to the next pass of the run loop so
+// timers and observers get a turn.
+typedef struct SPLibSpotifyWorkItem {
+	struct SPLibSpotifyWorkItem *next;
+	void *block; /* A retained heap copy of the block, or the waiting caller's own block if semaphore is set. */
+	dispatch_semaphore_t semaphore; /* Set if the item lives on the stack of a caller waiting on this semaphore. */
+	uint64_t enqueueTime; /* Zero unless the libspotify thread was being monitored when the item was queued. */
+	void *invoke; /* The invoke function of the block the work was queued for, which names it in stall reports. */
+} SPLibSpotifyWorkItem;
+
+static CFTimeInterval const kSPLibSpotifyBackgroundWorkSlice = 0.01;
+
+static SPLibSpotifyWorkItem * volatile libspotify_work_stacks[2]; /* Indexed by SPDispatchPriority. */
+static SPLibSpotifyWorkItem *libspotify_background_backlog; /* Only touched on the libspotify thread. */
+static SPLibSpotifyWorkItem *libspotify_background_backlog_tail;
+
+static OSSpinLock libspotify_coalesced_work_lock = OS_SPINLOCK_INIT;
+static volatile int64_t libspotify_coalesced_block_count;
+static volatile int64_t libspotify_cancelled_block_count;
+
+static void SPLibSpotifyWorkQueuePushItem(SPLibSpotifyWorkItem *item, SPDispatchPriority priority) {
+	
+	item->enqueueTime = 0;
+	if (libspotify_thread_monitoring) {
+		SPLibSpotifyThreadMonitorDidQueue();
+		item->enqueueTime = mach_absolute_time();
+	}
+	
+	SPLibSpotifyWorkItem * volatile *stack = &libspotify_work_stacks[priority];
+	SPLibSpotifyWorkItem *head;
+	do {
+		head = *stack;
+		item->next = head;
+	} while (!OSAtomicCompareAndSwapPtrBarrier(head, item, (void * volatile *)stack));
+	
+	if (head != NULL)
+		return; // Whoever pushed onto the empty stack has already woken the thread.
+	
+	// Before the run loop is ready, the thread runs whatever's been queued as soon as it is.
+	CFRunLoopSourceRef source = libspotify_runloop_source;
+	if (source != NULL) {
+		CFRunLoopSourceSignal(source);
+		CFRunLoopWakeUp(libspotify_runloop);
+	}
+}
+
+static void SPLibSpotifyWorkQueuePush(dispatch_block_t block, SPDispatchPriority priority, void *invoke) {
+	SPLibSpotifyWorkItem *item = malloc(sizeof(SPLibSpotifyWorkItem));
+	item->block = (__bridge_retained void *)[block copy];
+	item->semaphore = NULL;
+	item->invoke = invoke;
+	SPLibSpotifyWorkQueuePushItem(item, priority);
+}
+
+// Each thread that waits on the libspotify thread keeps one semaphore for its lifetime. The semaphore
+// is back at zero whenever a wait returns, so it can be reused straight away.
+static pthread_key_t libspotify_sync_semaphore_key;
+static pthread_once_t libspotify_sync_semaphore_key_once = PTHREAD_ONCE_INIT;
+
+static void SPLibSpotifySyncSemaphoreDestroy(void *semaphore) {
+	dispatch_release((dispatch_semaphore_t)semaphore);
+}
+
+static void SPLibSpotifySyncSemaphoreKeyCreate(void) {
+	pthread_key_create(&libspotify_sync_semaphore_key, SPLibSpotifySyncSemaphoreDestroy);
+}
+
+static void SPLibSpotifyWorkQueuePushAndWait(dispatch_block_t block, void *invoke) {
+	
+	pthread_once(&libspotify_sync_semaphore_key_once, SPLibSpotifySyncSemaphoreKeyCreate);
+	dispatch_semaphore_t semaphore = pthread_getspecific(libspotify_sync_semaphore_key);
+	if (semaphore == NULL) {
+		semaphore = dispatch_semaphore_create(0);
+		pthread_setspecific(libspotify_sync_semaphore_key, semaphore);
+	}
+	
+	// We don't return until the block has run, so neither the item nor the block need to leave our stack.
+	SPLibSpotifyWorkItem item;
+	item.block = (__bridge void *)block;
+	item.semaphore = semaphore;
+	item.invoke = invoke;
+	SPLibSpotifyWorkQueuePushItem(&item, SPDispatchPriorityBackground);
+	dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+}
+
+static SPLibSpotifyWorkItem *SPLibSpotifyWorkQueueTake(SPDispatchPriority priority, SPLibSpotifyWorkItem **outTail) {
+	
+	SPLibSpotifyWorkItem * volatile *stack = &libspotify_work_stacks[priority];
+	SPLibSpotifyWorkItem *item;
+	do {
+		item = *stack;
+	} while (!OSAtomicCompareAndSwapPtrBarrier(item, NULL, (void * volatile *)stack));
+	
+	// The stack is newest first.
+	SPLibSpotifyWorkItem *queue = NULL;
+	if (outTail != NULL) *outTail = item;
+	while (item != NULL) {
+		SPLibSpotifyWorkItem *next = item->next;
+		item->next = queue;
+		queue = item;
+		item = next;
+	}
+	return queue;
+}
+
+static void SPLibSpotifyWorkItemRun(SPLibSpotifyWorkItem *item) {
+	
+	uint64_t enqueueTime = item->enqueueTime;
+	void *invoke = item->invoke;
+	uint64_t startTime = enqueueTime != 0 ? SPLibSpotifyThreadMonitorWillRun(invoke) : 0;
+	
+	if (item->semaphore != NULL) {
+		// The item belongs to the waiting caller, and is gone as soon as it's signalled.
+		dispatch_semaphore_t semaphore = item->semaphore;
+		@autoreleasepool { ((__bridge dispatch_block_t)item->block)(); }
+		dispatch_semaphore_signal(semaphore);
+	} else {
+		dispatch_block_t block = (__bridge_transfer dispatch_block_t)item->block;
+		free(item);
+		@autoreleasepool { block(); }
+	}
+	
+	if (enqueueTime != 0)
+		SPLibSpotifyThreadMonitorDidRun(enqueueTime, startTime, invoke);
+}
+
+static void SPLibSpotifyWorkQueuePerform(void *info) {
+	
+	CFAbsoluteTime sliceEnd = CFAbsoluteTimeGetCurrent() + kSPLibSpotifyBackgroundWorkSlice;
+	
+	SPLibSpotifyWorkItem *tail = NULL;
+	SPLibSpotifyWorkItem *background = SPLibSpotifyWorkQueueTake(SPDispatchPriorityBackground, &tail);
+	if (background != NULL) {
+		if (libspotify_background_backlog_tail != NULL)
+			libspotify_background_backlog_tail->next = background;
+		else
+			libspotify_background_backlog = background;
+		libspotify_background_backlog_tail = tail;
+	}
+	
+	// Background work queued from here on signals the source again, and runs on the next pass of the run loop.
+	while (YES) {
+		
+		while (libspotify_work_stacks[SPDispatchPriorityInteractive] != NULL) {
+			SPLibSpotifyWorkItem *interactive = SPLibSpotifyWorkQueueTake(SPDispatchPriorityInteractive, NULL);
+			while (interactive != NULL) {
+				SPLibSpotifyWorkItem *next = interactive->next;
+				SPLibSpotifyWorkItemRun(interactive);
+				interactive = next;
+			}
+		}
+		
+		SPLibSpotifyWorkItem *item = libspotify_background_backlog;
+		if (item == NULL)
+			break;
+		
+		if (CFAbsoluteTimeGetCurrent() >= sliceEnd) {
+			CFRunLoopSourceSignal(libspotify_runloop_source);
+			break;
+		}
+		
+		libspotify_background_backlog = item->next;
+		if (libspotify_background_backlog == NULL)
+			libspotify_background_backlog_tail = NULL;
+		SPLibSpotifyWorkItemRun(item);
+	}
+}
+
+// Helpers that wrap their caller's block pass its invoke function as `invoke`, so the thread monitor
+// names the caller's work rather than the wrapper.
+static void SPLibSpotifyDispatch(dispatch_block_t block, SPDispatchPriority priority, BOOL wait, void *invoke) {
+	
+	if (block == nil)
+		return;
+	
+	if (!wait)
+		SPLibSpotifyWorkQueuePush(block, priority, invoke);
+	else if (CFRunLoopGetCurrent() == libspotify_runloop)
+		block(); // Waiting on ourselves would never return.
+	else
+		SPLibSpotifyWorkQueuePushAndWait(block, invoke);
+}
+
 inline void SPDispatchAsync(dispatch_block_t blockForLibSpotifyThread) { [SPSession dispatchToLibSpotifyThread:blockForLibSpotifyThread]; }
 
+void SPDispatchAsyncWithPriority(SPDispatchPriority priority, dispatch_block_t block) {
+	[SPSession dispatchToLibSpotifyThread:block priority:priority];
+}
+
+void SPDispatchAsyncCoalesced(id target, const void *key, void (^block)(id target)) {
+	
+	if (target == nil || block == nil)
+		return;
+	
+	OSSpinLockLock(&libspotify_coalesced_work_lock);
+	SPCoalescedWork *pending = objc_getAssociatedObject(target, key);
+	if (pending != nil) {
+		// Keep the pending work's place in the queue, but run the newest block.
+		pending.block = block;
+		OSSpinLockUnlock(&libspotify_coalesced_work_lock);
+		OSAtomicIncrement64(&libspotify_coalesced_block_count);
+		return;
+	}
+	
+	SPCoalescedWork *work = [[SPCoalescedWork alloc] init];
+	work.target = target;
+	work.block = block;
+	objc_setAssociatedObject(target, key, work, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+	OSSpinLockUnlock(&libspotify_coalesced_work_lock);
+	
+	SPLibSpotifyDispatch(^{
+		
+		OSSpinLockLock(&libspotify_coalesced_work_lock);
+		id strongTarget = work.target;
+		void (^workBlock)(id) = work.block;
+		if (strongTarget != nil)
+			objc_setAssociatedObject(strongTarget, key, nil, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+		OSSpinLockUnlock(&libspotify_coalesced_work_lock);
+		
+		if (strongTarget == nil)
+			OSAtomicIncrement64(&libspotify_cancelled_block_count);
+		else
+			workBlock(strongTarget);
+	}, SPDispatchPriorityBackground, NO, SPBlockInvokeAddress(block));
+}
+
 inline void SPDispatchSyncIfNeeded(dispatch_block_t block) {
 	if (CFRunLoopGetCurrent() == [SPSession libSpotifyRunloop])
 		block();
@@ -624,56 +1205,126 @@ inline void SPDispatchSyncIfNeeded(dispatch_block_t block) {
 		[SPSession dispatchToLibSpotifyThread:block waitUntilDone:YES];
 }
 
+id SPDispatchSyncReturning(id (^block)(void)) {
+	__block id result = nil;
+	SPLibSpotifyDispatch(^() { result = block(); }, SPDispatchPriorityBackground, YES, SPBlockInvokeAddress(block));
+	return result;
+}
+
 +(CFRunLoopRef)libSpotifyRunloop {
 	return libspotify_runloop;
 }
 
-+(void)dispatchToLibSpotifyThread:(dispatch_block_t)block {
-	[self dispatchToLibSpotifyThread:block waitUntilDone:NO];
++(void)startMonitoringLibSpotifyThreadWithStallThreshold:(NSTimeInterval)threshold {
+	
+	[self stopMonitoringLibSpotifyThread];
+	
+	@synchronized(self) {
+		mach_timebase_info(&libspotify_thread_timebase);
+		libspotify_thread_stall_threshold = (uint64_t)(threshold * NSEC_PER_SEC * libspotify_thread_timebase.denom / libspotify_thread_timebase.numer);
+		
+		OSSpinLockLock(&libspotify_thread_statistics_lock);
+		memset(&libspotify_thread_statistics, 0, sizeof(SPLibSpotifyThreadStatistics));
+		OSSpinLockUnlock(&libspotify_thread_statistics_lock);
+		
+		if (libspotify_thread_stall_reports == nil)
+			libspotify_thread_stall_reports = [[NSMutableArray alloc] init];
+		@synchronized(libspotify_thread_stall_reports) {
+			[libspotify_thread_stall_reports removeAllObjects];
+		}
+		
+		if (threshold > 0.0) {
+			libspotify_thread_watchdog = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0,
+																dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+			uint64_t interval = (uint64_t)(threshold * NSEC_PER_SEC / 2.0);
+			dispatch_source_set_timer(libspotify_thread_watchdog, dispatch_time(DISPATCH_TIME_NOW, interval), interval, interval / 4);
+			dispatch_source_set_event_handler(libspotify_thread_watchdog, ^{ SPLibSpotifyThreadWatchdogFired(); });
+			dispatch_resume(libspotify_thread_watchdog);
+		}
+		
+		OSAtomicCompareAndSwap32Barrier(0, 1, &libspotify_thread_monitoring);
+	}
 }
 
-+(void)dispatchToLibSpotifyThread:(dispatch_block_t)block waitUntilDone:(BOOL)wait {
-
-	NSLock *waitingLock = nil;
-	if (wait) waitingLock = [NSLock new];
-
-	// Make sure we only queue one thing at a time, and only
-	// when the runloop is ready for it.
-	[runloopReadyLock lockWhenCondition:1];
-
-	CFRunLoopPerformBlock(libspotify_runloop, kCFRunLoopDefaultMode, ^() {
-		[waitingLock lock];
-		if (block) { @autoreleasepool { block(); } }
-		[waitingLock unlock];
-	});
++(void)stopMonitoringLibSpotifyThread {
+	@synchronized(self) {
+		OSAtomicCompareAndSwap32Barrier(1, 0, &libspotify_thread_monitoring);
+		if (libspotify_thread_watchdog != NULL) {
+			dispatch_source_cancel(libspotify_thread_watchdog);
+			dispatch_release(libspotify_thread_watchdog);
+			libspotify_thread_watchdog = NULL;
+		}
+	}
+}
 
-	if (CFRunLoopIsWaiting(libspotify_runloop)) {
-		CFRunLoopSourceSignal(libspotify_runloop_source);
-		CFRunLoopWakeUp(libspotify_runloop);
++(NSDictionary *)libSpotifyThreadStatistics {
+	
+	OSSpinLockLock(&libspotify_thread_statistics_lock);
+	SPLibSpotifyThreadStatistics statistics = libspotify_thread_statistics;
+	OSSpinLockUnlock(&libspotify_thread_statistics_lock);
+	
+	NSMutableArray *queueTimeHistogram = [NSMutableArray arrayWithCapacity:kSPLibSpotifyThreadHistogramBucketCount];
+	NSMutableArray *executionTimeHistogram = [NSMutableArray arrayWithCapacity:kSPLibSpotifyThreadHistogramBucketCount];
+	for (NSUInteger bucket = 0; bucket < kSPLibSpotifyThreadHistogramBucketCount; bucket++) {
+		[queueTimeHistogram addObject:[NSNumber numberWithUnsignedLongLong:statistics.queueTimeHistogram[bucket]]];
+		[executionTimeHistogram addObject:[NSNumber numberWithUnsignedLongLong:statistics.executionTimeHistogram[bucket]]];
 	}
 	
-	[runloopReadyLock unlock];
-	if (wait) {
-		[waitingLock lock];
-		[waitingLock unlock];
+	NSArray *stalls = nil;
+	if (libspotify_thread_stall_reports != nil) {
+		@synchronized(libspotify_thread_stall_reports) {
+			stalls = [NSArray arrayWithArray:libspotify_thread_stall_reports];
+		}
 	}
+	
+	NSMutableDictionary *mutableStats = [NSMutableDictionary dictionaryWithCapacity:12];
+	[mutableStats setValue:[NSNumber numberWithBool:libspotify_thread_monitoring != 0] forKey:SPLibSpotifyThreadIsMonitoredKey];
+	[mutableStats setValue:[NSNumber numberWithUnsignedLongLong:statistics.blockCount] forKey:SPLibSpotifyThreadBlockCountKey];
+	[mutableStats setValue:[NSNumber numberWithInt:libspotify_thread_queue_depth] forKey:SPLibSpotifyThreadQueueDepthKey];
+	[mutableStats setValue:[NSNumber numberWithInt:statistics.maximumQueueDepth] forKey:SPLibSpotifyThreadMaximumQueueDepthKey];
+	[mutableStats setValue:[NSNumber numberWithDouble:SPLibSpotifyThreadSeconds(statistics.maximumQueueTime)] forKey:SPLibSpotifyThreadMaximumQueueTimeKey];
+	[mutableStats setValue:[NSNumber numberWithDouble:SPLibSpotifyThreadSeconds(statistics.maximumExecutionTime)] forKey:SPLibSpotifyThreadMaximumExecutionTimeKey];
+	[mutableStats setValue:queueTimeHistogram forKey:SPLibSpotifyThreadQueueTimeHistogramKey];
+	[mutableStats setValue:executionTimeHistogram forKey:SPLibSpotifyThreadExecutionTimeHistogramKey];
+	[mutableStats setValue:[NSNumber numberWithUnsignedLongLong:statistics.stallCount] forKey:SPLibSpotifyThreadStallCountKey];
+	[mutableStats setValue:stalls forKey:SPLibSpotifyThreadRecentStallsKey];
+	[mutableStats setValue:[NSNumber numberWithLongLong:libspotify_coalesced_block_count] forKey:SPLibSpotifyThreadCoalescedBlockCountKey];
+	[mutableStats setValue:[NSNumber numberWithLongLong:libspotify_cancelled_block_count] forKey:SPLibSpotifyThreadCancelledBlockCountKey];
+	return [NSDictionary dictionaryWithDictionary:mutableStats];
+}
+
++(void)dispatchToLibSpotifyThread:(dispatch_block_t)block {
+	[self dispatchToLibSpotifyThread:block waitUntilDone:NO];
+}
+
++(void)dispatchToLibSpotifyThread:(dispatch_block_t)block priority:(SPDispatchPriority)priority {
+	SPLibSpotifyDispatch(block, priority, NO, SPBlockInvokeAddress(block));
+}
+
++(void)dispatchToLibSpotifyThread:(dispatch_block_t)block waitUntilDone:(BOOL)wait {
+	SPLibSpotifyDispatch(block, SPDispatchPriorityBackground, wait, SPBlockInvokeAddress(block));
 }
 
 +(void)runBackgroundRunloop:(dispatch_block_t)runLoopReadyBlock {
 	@autoreleasepool {
 		[NSThread currentThread].name = @"com.spotify.CocoaLibSpotify";
-		[runloopReadyLock lock];
 		libspotify_runloop = CFRunLoopGetCurrent();
-		sleep(1);
 		libspotifyThread = [NSThread currentThread];
 
-		// Use a custom, no-op run loop source to keep the loop alive and fast.
+		// The work queue's run loop source also keeps the loop alive.
 		CFRunLoopSourceContext libspotify_source_context;
 		memset(&libspotify_source_context, 0, sizeof(CFRunLoopSourceContext));
-		libspotify_runloop_source = CFRunLoopSourceCreate(NULL, 0, &libspotify_source_context);
-		CFRunLoopAddSource(libspotify_runloop, libspotify_runloop_source, kCFRunLoopDefaultMode);
-
-		[runloopReadyLock unlockWithCondition:1];
+		libspotify_source_context.perform = SPLibSpotifyWorkQueuePerform;
+		CFRunLoopSourceRef source = CFRunLoopSourceCreate(NULL, 0, &libspotify_source_context);
+		CFRunLoopAddSource(libspotify_runloop, source, kCFRunLoopDefaultMode);
+		
+		// Once the source is published, anyone who queues work signals it. Anything
+		// queued before then is waiting for us.
+		OSMemoryBarrier();
+		libspotify_runloop_source = source;
+		OSMemoryBarrier();
+		SPLibSpotifyWorkQueuePerform(NULL);
+		
 		CFRunLoopRun();
 
 		CFRelease(libspotify_runloop_source);
@@ -745,11 +1396,29 @@ static SPSession *sharedSession;
 
 		self.userAgent = aUserAgent;
 		self.loadingPolicy = policy;
-
-		self.trackCache = [[NSMutableDictionary alloc] init];
-		self.userCache = [[NSMutableDictionary alloc] init];
-		self.playlistCache = [[NSMutableDictionary alloc] init];
+		
+		_pendingPropertyUpdates = [[NSMutableArray alloc] init];
+		_pendingPropertyUpdatesByObject = [[NSMutableDictionary alloc] init];
+		
+		_callbackQueue = dispatch_get_main_queue();
+		dispatch_retain(_callbackQueue);
+		_callbackTargetQueue = dispatch_get_main_queue();
+		dispatch_retain(_callbackTargetQueue);
+		_callbackQueueLock = OS_SPINLOCK_INIT;
+
+		self.trackCache = [[SPObjectCache alloc] initWithCountLimit:kSPSessionTrackCacheCountLimit totalCostLimit:0];
+		self.userCache = [[SPObjectCache alloc] initWithCountLimit:kSPSessionUserCacheCountLimit totalCostLimit:0];
+		self.playlistCache = [[SPObjectCache alloc] initWithCountLimit:kSPSessionPlaylistCacheCountLimit totalCostLimit:0];
+		self.playlistFolderCache = [[SPObjectCache alloc] initWithKeyLength:sizeof(sp_uint64)
+																 countLimit:kSPSessionPlaylistCacheCountLimit
+															 totalCostLimit:0];
+		_albumCache = [[SPObjectCache alloc] initWithCountLimit:kSPSessionAlbumCacheCountLimit totalCostLimit:0];
+		_artistCache = [[SPObjectCache alloc] initWithCountLimit:kSPSessionArtistCacheCountLimit totalCostLimit:0];
+		_imageCache = [[SPObjectCache alloc] initWithKeyLength:SPImageIdLength
+													countLimit:kSPSessionImageCacheCountLimit
+												totalCostLimit:kSPSessionImageCacheTotalCostLimit];
 		self.loadingObjects = [[NSMutableSet alloc] init];
+		self.audioDeliveryBatcher = [[SPAudioDeliveryBatcher alloc] initWithSession:self];
 		
 		self.connectionState = SP_CONNECTION_STATE_UNDEFINED;
 		
@@ -832,14 +1501,6 @@ static SPSession *sharedSession;
 		}
 #endif
 		
-		// Set the audio description - other fields will be filled in when we start getting audio.
-		memset(&libSpotifyAudioDescription, 0, sizeof(libSpotifyAudioDescription));
-		libSpotifyAudioDescription.mFormatID = kAudioFormatLinearPCM;
-		libSpotifyAudioDescription.mFormatFlags = kLinearPCMFormatFlagIsSignedInteger | kLinearPCMFormatFlagIsPacked | kAudioFormatFlagsNativeEndian;
-		libSpotifyAudioDescription.mFramesPerPacket = 1;
-		libSpotifyAudioDescription.mBitsPerChannel = 16;
-		libSpotifyAudioDescription.mReserved = 0;
-
 		__block NSError *creationError = nil;
 		
 		SPDispatchSyncIfNeeded(^() {
@@ -856,10 +1517,31 @@ static SPSession *sharedSession;
 			config.userdata = (__bridge void *)self;
 			config.callbacks = &_callbacks;
 			
+			// libspotify is prodded by this timer, re-armed after each prod with the timeout libspotify gives us.
+			// It repeats so that it's never invalidated by firing.
+			CFRunLoopTimerContext prodTimerContext = { 0, (__bridge void *)self, NULL, NULL, NULL };
+			_prodTimer = CFRunLoopTimerCreate(NULL, CFAbsoluteTimeGetCurrent() + kSPSessionMaximumProdInterval,
+											  kSPSessionMaximumProdInterval, 0, 0, SPSessionProdTimerFired, &prodTimerContext);
+			CFRunLoopAddTimer(CFRunLoopGetCurrent(), _prodTimer, kCFRunLoopDefaultMode);
+			
+			// Queued property updates go out when the run loop is about to sleep, or when the timer says they've waited long enough.
+			CFRunLoopObserverContext propertyUpdateObserverContext = { 0, (__bridge void *)self, NULL, NULL, NULL };
+			_propertyUpdateObserver = CFRunLoopObserverCreate(NULL, kCFRunLoopBeforeWaiting | kCFRunLoopExit, true, 0,
+															  SPSessionPropertyUpdateObserverFired, &propertyUpdateObserverContext);
+			CFRunLoopAddObserver(CFRunLoopGetCurrent(), _propertyUpdateObserver, kCFRunLoopDefaultMode);
+			
+			CFRunLoopTimerContext propertyUpdateTimerContext = { 0, (__bridge void *)self, NULL, NULL, NULL };
+			_propertyUpdateTimer = CFRunLoopTimerCreate(NULL, kSPSessionDistantFuture, kSPSessionDistantFuture, 0, 0,
+														SPSessionPropertyUpdateTimerFired, &propertyUpdateTimerContext);
+			CFRunLoopAddTimer(CFRunLoopGetCurrent(), _propertyUpdateTimer, kCFRunLoopDefaultMode);
+			
 			sp_error createErrorCode = sp_session_create(&config, &_session);
 			if (createErrorCode != SP_ERROR_OK) {
 				self.session = NULL;
 				creationError = [NSError spotifyErrorWithCode:createErrorCode];
+				CFRunLoopTimerInvalidate(_prodTimer);
+				CFRunLoopObserverInvalidate(_propertyUpdateObserver);
+				CFRunLoopTimerInvalidate(_propertyUpdateTimer);
 			} else {
 				_cachedIsUsingNormalization = sp_session_get_volume_normalization(_session);
 				[self prodSessionForcefully];
@@ -909,14 +1591,14 @@ static SPSession *sharedSession;
 		const char *user_name = sp_session_user_name(self.session);
 		NSString *loginUserName = user_name == NULL ? nil : [NSString stringWithUTF8String:user_name];
 		if (loginUserName.length == 0) loginUserName = nil;
-		dispatch_async(dispatch_get_main_queue(), ^{ if (block) block(loginUserName); });
+		SPDispatchToCallbackQueue(self, ^{ if (block) block(loginUserName); });
 	});
 }
 
 -(void)flushCaches:(void (^)())completionBlock {
 	SPDispatchAsync(^() {
 		if (self.session) sp_session_flush_caches(self.session); 
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(self, ^{
 			if (completionBlock) completionBlock();
 		});
 	});
@@ -940,14 +1622,14 @@ static SPSession *sharedSession;
 			[someItems addObjectsFromArray:newStarredItems];
 			[someItems addObjectsFromArray:oldStarredItems];
 			
-			dispatch_async(dispatch_get_main_queue(), ^{
+			SPDispatchToCallbackQueue(self, ^{
 				for (SPPlaylistItem *playlistItem in someItems) {
 					if (playlistItem.itemClass == [SPTrack class]) {
 						
 						SPTrack *track = playlistItem.item;
 						SPDispatchAsync(^() { 
 							BOOL starred = sp_track_is_starred(self.session, track.track);
-							dispatch_async(dispatch_get_main_queue(), ^() { [track setStarredFromLibSpotifyUpdate:starred]; });
+							SPDispatchToCallbackQueue(self, ^() { [track setStarredFromLibSpotifyUpdate:starred]; });
 						});
 					}
 				}
@@ -963,7 +1645,7 @@ static SPSession *sharedSession;
 					sp_playlist *pl = sp_session_inbox_create(self.session);
 					if (pl == NULL) return;
 					SPPlaylist *playlist = [self playlistForPlaylistStruct:pl];
-					dispatch_async(dispatch_get_main_queue(), ^() {
+					SPDispatchToCallbackQueue(self, ^() {
 						// We don't want to overwrite our old instances
 						if (self.inboxPlaylist == nil)
 							self.inboxPlaylist = playlist;
@@ -975,7 +1657,7 @@ static SPSession *sharedSession;
 					sp_playlist *pl = sp_session_starred_create(self.session);
 					if (pl == NULL) return;
 					SPPlaylist *playlist = [self playlistForPlaylistStruct:pl];
-					dispatch_async(dispatch_get_main_queue(), ^() {
+					SPDispatchToCallbackQueue(self, ^() {
 						// We don't want to overwrite our old instances
 						if (self.starredPlaylist == nil)
 							self.starredPlaylist = playlist;
@@ -987,7 +1669,7 @@ static SPSession *sharedSession;
 					sp_playlistcontainer *plc = sp_session_playlistcontainer(self.session);
 					if (plc == NULL) return;
 					SPPlaylistContainer *container = [[SPPlaylistContainer alloc] initWithContainerStruct:plc inSession:self];
-					dispatch_async(dispatch_get_main_queue(), ^() {
+					SPDispatchToCallbackQueue(self, ^() {
 						// We don't want to overwrite our old instances
 						if (self.userPlaylists == nil)
 							self.userPlaylists = container;
@@ -997,7 +1679,7 @@ static SPSession *sharedSession;
 				SPDispatchAsync(^() {
 					sp_user *userStruct = sp_session_user(self.session);
 					SPUser *newUser = [SPUser userWithUserStruct:userStruct inSession:self];
-					dispatch_async(dispatch_get_main_queue(), ^() { self.user = newUser; });
+					SPDispatchToCallbackQueue(self, ^() { self.user = newUser; });
 				});
 				
 				SPDispatchAsync(^() {
@@ -1008,7 +1690,7 @@ static SPSession *sharedSession;
 					localeId[2] = 0;
 					NSString *localeString = [NSString stringWithUTF8String:(const char *)&localeId];
 					NSLocale *newLocale = [[NSLocale alloc] initWithLocaleIdentifier:localeString];
-					dispatch_async(dispatch_get_main_queue(), ^() { self.locale = newLocale; });
+					SPDispatchToCallbackQueue(self, ^() { self.locale = newLocale; });
 				});
 			}
             
@@ -1029,6 +1711,9 @@ static SPSession *sharedSession;
 -(void)logout:(void (^)())completionBlock {
 	[self.trackCache removeAllObjects];
 	[self.userCache removeAllObjects];
+	[self.albumCache removeAllObjects];
+	[self.artistCache removeAllObjects];
+	[self.imageCache removeAllObjects];
 	self.inboxPlaylist = nil;
 	self.starredPlaylist = nil;
 	self.userPlaylists = nil;
@@ -1048,10 +1733,11 @@ static SPSession *sharedSession;
 	SPDispatchAsync(^() {
 		
 		[self.playlistCache removeAllObjects];
+		[self.playlistFolderCache removeAllObjects];
 		sp_connectionstate state = sp_session_connectionstate(outgoing_session);
 		
 		if (state == SP_CONNECTION_STATE_LOGGED_OUT || state == SP_CONNECTION_STATE_UNDEFINED) {
-			dispatch_async(dispatch_get_main_queue(), ^{
+			SPDispatchToCallbackQueue(self, ^{
 				self.logoutCompletionBlock = nil;
 				if (completionBlock) completionBlock();
 			});
@@ -1064,6 +1750,7 @@ static SPSession *sharedSession;
 
 @synthesize connectionState;
 @synthesize playlistCache;
+@synthesize playlistFolderCache;
 @synthesize trackCache;
 @synthesize userCache;
 @synthesize inboxPlaylist;
@@ -1118,7 +1805,7 @@ static SPSession *sharedSession;
 		if (errorCode != SP_ERROR_OK)
 			error = [NSError spotifyErrorWithCode:errorCode];
 		
-		dispatch_async(dispatch_get_main_queue(), ^{ if (block) block(error); });
+		SPDispatchToCallbackQueue(self, ^{ if (block) block(error); });
 	});
 }
 
@@ -1131,7 +1818,7 @@ static SPSession *sharedSession;
 	
 	SPDispatchAsync(^{
 		sp_session_set_social_credentials(self.session, service, userName.UTF8String, password.UTF8String);
-		dispatch_async(dispatch_get_main_queue(), ^{ if (block) block(nil); });
+		SPDispatchToCallbackQueue(self, ^{ if (block) block(nil); });
 	});
 }
 
@@ -1146,7 +1833,7 @@ static SPSession *sharedSession;
 		if (errorCode != SP_ERROR_OK)
 			error = [NSError spotifyErrorWithCode:errorCode];
 		
-		dispatch_async(dispatch_get_main_queue(), ^{ if (block) block(out_state, error); });
+		SPDispatchToCallbackQueue(self, ^{ if (block) block(out_state, error); });
 	});
 }
 
@@ -1161,7 +1848,7 @@ static SPSession *sharedSession;
 		if (errorCode != SP_ERROR_OK)
 			error = [NSError spotifyErrorWithCode:errorCode];
 		
-		dispatch_async(dispatch_get_main_queue(), ^{ if (block) block(out_state, error); });
+		SPDispatchToCallbackQueue(self, ^{ if (block) block(out_state, error); });
 	});
 }
 
@@ -1175,8 +1862,7 @@ static SPSession *sharedSession;
 	if (spTrack == NULL)
 		return nil;
 
-	NSValue *ptrValue = [NSValue valueWithPointer:spTrack];
-	SPTrack *cachedTrack = [self.trackCache objectForKey:ptrValue];
+	SPTrack *cachedTrack = [self.trackCache objectForKeyBytes:&spTrack];
 	
     if (cachedTrack != nil) {
         // track may have been cached without album browse specific fields
@@ -1187,7 +1873,7 @@ static SPSession *sharedSession;
 	cachedTrack = [[SPTrack alloc] initWithTrackStruct:spTrack
 											 inSession:self];
 	
-    [self.trackCache setObject:cachedTrack forKey:ptrValue];
+    [self.trackCache setObject:cachedTrack forKeyBytes:&spTrack cost:0];
     return cachedTrack;
 }
 
@@ -1196,8 +1882,7 @@ static SPSession *sharedSession;
     
 	SPAssertOnLibSpotifyThread();
 	
-    NSValue *ptrValue = [NSValue valueWithPointer:spUser];
-	SPUser *cachedUser = [self.userCache objectForKey:ptrValue];
+	SPUser *cachedUser = [self.userCache objectForKeyBytes:&spUser];
     
     if (cachedUser != nil) {
         return cachedUser;
@@ -1207,7 +1892,7 @@ static SPSession *sharedSession;
 										  inSession:self];
     
 	if (cachedUser != nil)
-		[self.userCache setObject:cachedUser forKey:ptrValue];
+		[self.userCache setObject:cachedUser forKeyBytes:&spUser cost:0];
 	
     return cachedUser;
 }
@@ -1217,8 +1902,7 @@ static SPSession *sharedSession;
 	
 	SPAssertOnLibSpotifyThread();
 	
-	NSValue *ptrValue = [NSValue valueWithPointer:playlist];
-	SPPlaylist *cachedPlaylist = [playlistCache objectForKey:ptrValue];
+	SPPlaylist *cachedPlaylist = [playlistCache objectForKeyBytes:&playlist];
 	
 	if (cachedPlaylist != nil) {
 		return cachedPlaylist;
@@ -1227,7 +1911,7 @@ static SPSession *sharedSession;
 	cachedPlaylist = [[SPPlaylist alloc] initWithPlaylistStruct:playlist
 													  inSession:self];
 	
-	[playlistCache setObject:cachedPlaylist forKey:ptrValue];
+	[playlistCache setObject:cachedPlaylist forKeyBytes:&playlist cost:0];
 	return cachedPlaylist;
 }
 
@@ -1235,8 +1919,7 @@ static SPSession *sharedSession;
 	
 	SPAssertOnLibSpotifyThread();
 	
-	NSNumber *wrappedId = [NSNumber numberWithUnsignedLongLong:playlistId];
-	SPPlaylistFolder *cachedPlaylistFolder = [playlistCache objectForKey:wrappedId];
+	SPPlaylistFolder *cachedPlaylistFolder = [playlistFolderCache objectForKeyBytes:&playlistId];
 	
 	if (cachedPlaylistFolder != nil) {
 		return cachedPlaylistFolder;
@@ -1246,7 +1929,7 @@ static SPSession *sharedSession;
 																	container:aContainer
 																	inSession:self];
 	
-	[playlistCache setObject:cachedPlaylistFolder forKey:wrappedId];
+	[playlistFolderCache setObject:cachedPlaylistFolder forKeyBytes:&playlistId cost:0];
 	return cachedPlaylistFolder;
 }
 
@@ -1254,6 +1937,38 @@ static SPSession *sharedSession;
 	return (SPUnknownPlaylist*) [self playlistForPlaylistStruct:playlist];
 }
 
+-(SPObjectCache *)albumCache {
+	return _albumCache;
+}
+
+-(SPObjectCache *)artistCache {
+	return _artistCache;
+}
+
+-(SPObjectCache *)imageCache {
+	return _imageCache;
+}
+
+-(NSDictionary *)cachesByStatisticsKey {
+	NSMutableDictionary *caches = [NSMutableDictionary dictionaryWithCapacity:7];
+	[caches setValue:self.trackCache forKey:SPSessionTrackCacheKey];
+	[caches setValue:self.albumCache forKey:SPSessionAlbumCacheKey];
+	[caches setValue:self.artistCache forKey:SPSessionArtistCacheKey];
+	[caches setValue:self.imageCache forKey:SPSessionImageCacheKey];
+	[caches setValue:self.userCache forKey:SPSessionUserCacheKey];
+	[caches setValue:self.playlistCache forKey:SPSessionPlaylistCacheKey];
+	[caches setValue:self.playlistFolderCache forKey:SPSessionPlaylistFolderCacheKey];
+	return caches;
+}
+
+-(NSDictionary *)cacheStatistics {
+	NSDictionary *caches = [self cachesByStatisticsKey];
+	NSMutableDictionary *mutableStats = [NSMutableDictionary dictionaryWithCapacity:caches.count];
+	for (NSString *key in caches)
+		[mutableStats setValue:[[caches objectForKey:key] statistics] forKey:key];
+	return [NSDictionary dictionaryWithDictionary:mutableStats];
+}
+
 -(void)trackForURL:(NSURL *)url callback:(void (^)(SPTrack *track))block {
 	
 	sp_linktype linkType = [url spotifyLinkType];
@@ -1274,7 +1989,7 @@ static SPSession *sharedSession;
 			sp_link_release(link);
 		}
 		
-		if (block) dispatch_async(dispatch_get_main_queue(), ^() { block(trackObj); });
+		if (block) SPDispatchToCallbackQueue(self, ^() { block(trackObj); });
 	});
 }
 
@@ -1296,7 +2011,7 @@ static SPSession *sharedSession;
 			sp_user_release(aUser);
 		}
 		
-		if (block) dispatch_async(dispatch_get_main_queue(), ^() { block(userObj); });
+		if (block) SPDispatchToCallbackQueue(self, ^() { block(userObj); });
 	});
 }
 
@@ -1317,7 +2032,7 @@ static SPSession *sharedSession;
 			sp_playlist_release(aPlaylist);
 		}
 		
-		if (block) dispatch_async(dispatch_get_main_queue(), ^() { block(playlist); });
+		if (block) SPDispatchToCallbackQueue(self, ^() { block(playlist); });
 	});
 }
 
@@ -1470,7 +2185,7 @@ static SPSession *sharedSession;
 		NSTimeInterval interval = 0.0;
 		if (self.session) interval = sp_offline_time_left(self.session);
 		
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(self, ^{
 			if (block) block(interval);
 		});
 	});
@@ -1484,8 +2199,85 @@ static SPSession *sharedSession;
 @synthesize delegate;
 @synthesize playbackDelegate;
 @synthesize audioDeliveryDelegate;
+@synthesize audioDeliveryBatcher;
+@synthesize maximumPropertyUpdateLatency;
 @synthesize session = _session;
 
+-(void)setAudioDeliveryDelegate:(id <SPSessionAudioDeliveryDelegate>)aDelegate {
+	audioDeliveryDelegate = aDelegate;
+	self.audioDeliveryBatcher.delegate = aDelegate;
+}
+
+-(NSTimeInterval)audioDeliveryBatchDuration {
+	return self.audioDeliveryBatcher.batchDuration;
+}
+
+-(void)setAudioDeliveryBatchDuration:(NSTimeInterval)duration {
+	self.audioDeliveryBatcher.batchDuration = duration;
+}
+
+-(dispatch_queue_t)callbackQueue {
+	OSSpinLockLock(&_callbackQueueLock);
+	dispatch_queue_t queue = _callbackTargetQueue;
+	OSSpinLockUnlock(&_callbackQueueLock);
+	return queue;
+}
+
+-(void)setCallbackQueue:(dispatch_queue_t)queue {
+	
+	if (queue == NULL)
+		queue = dispatch_get_main_queue();
+	
+	// Our objects' properties aren't atomic, so callbacks must never run concurrently, even on a 
+	// concurrent queue. The main queue is already serial; anything else gets a serial queue in front of it.
+	dispatch_queue_t deliveryQueue = queue;
+	if (queue == dispatch_get_main_queue()) {
+		dispatch_retain(deliveryQueue);
+	} else {
+		deliveryQueue = dispatch_queue_create("com.spotify.CocoaLibSpotify.callbacks", DISPATCH_QUEUE_SERIAL);
+		dispatch_queue_set_specific(deliveryQueue, &kSPSessionCallbackQueueKey, (__bridge void *)deliveryQueue, NULL);
+		dispatch_set_target_queue(deliveryQueue, queue);
+	}
+	
+	dispatch_retain(queue);
+	OSSpinLockLock(&_callbackQueueLock);
+	dispatch_queue_t outgoing_queue = _callbackQueue;
+	dispatch_queue_t outgoing_target_queue = _callbackTargetQueue;
+	_callbackQueue = deliveryQueue;
+	_callbackTargetQueue = queue;
+	OSSpinLockUnlock(&_callbackQueueLock);
+	dispatch_release(outgoing_queue);
+	dispatch_release(outgoing_target_queue);
+}
+
+BOOL SPIsOnCallbackQueue(SPSession *session) {
+	
+	if (session == nil)
+		return [NSThread isMainThread];
+	
+	OSSpinLockLock(&session->_callbackQueueLock);
+	dispatch_queue_t queue = session->_callbackQueue;
+	OSSpinLockUnlock(&session->_callbackQueueLock);
+	
+	if (queue == dispatch_get_main_queue())
+		return [NSThread isMainThread];
+	
+	return dispatch_get_specific(&kSPSessionCallbackQueueKey) == (__bridge void *)queue;
+}
+
+void SPDispatchToCallbackQueue(SPSession *session, dispatch_block_t block) {
+	
+	if (session == nil) {
+		dispatch_async(dispatch_get_main_queue(), block);
+		return;
+	}
+	
+	if (CFRunLoopGetCurrent() == libspotify_runloop)
+		SPSessionFlushPropertyUpdates(session);
+	
+	SPSessionDispatchToCallbackQueue(session, block);
+}
+
 -(sp_session *)session {
 	
 #if DEBUG 
@@ -1498,7 +2290,7 @@ static SPSession *sharedSession;
 
 -(void)preloadTrackForPlayback:(SPTrack *)aTrack callback:(SPErrorableOperationCallback)block {
 	
-	SPDispatchAsync(^() {
+	SPDispatchAsyncWithPriority(SPDispatchPriorityInteractive, ^() {
 		
 		sp_error errorCode = SP_ERROR_TRACK_NOT_PLAYABLE;
 		NSError *error = nil;
@@ -1509,13 +2301,13 @@ static SPSession *sharedSession;
 		if (errorCode != SP_ERROR_OK)
 			error = [NSError spotifyErrorWithCode:errorCode];
 			
-		dispatch_async(dispatch_get_main_queue(), ^{ if (block) block(error); });
+		SPDispatchToCallbackQueue(self, ^{ if (block) block(error); });
 	});
 }
 
 -(void)playTrack:(SPTrack *)aTrack callback:(SPErrorableOperationCallback)block {
 	
-	SPDispatchAsync(^() {
+	SPDispatchAsyncWithPriority(SPDispatchPriorityInteractive, ^() {
 		
 		sp_error errorCode = SP_ERROR_TRACK_NOT_PLAYABLE;
 		NSError *error = nil;
@@ -1524,21 +2316,21 @@ static SPSession *sharedSession;
 			errorCode = sp_session_player_load(self.session, aTrack.track);
 		
 		if (errorCode == SP_ERROR_OK) {
-			dispatch_async(dispatch_get_main_queue(), ^{ self.playing = YES; });
+			SPDispatchToCallbackQueue(self, ^{ self.playing = YES; });
 		} else {
 			error = [NSError spotifyErrorWithCode:errorCode];
 		}
 		
-		dispatch_async(dispatch_get_main_queue(), ^{ if (block) block(error); });
+		SPDispatchToCallbackQueue(self, ^{ if (block) block(error); });
 	});
 }
 
 -(void)seekPlaybackToOffset:(NSTimeInterval)offset {
-	SPDispatchAsync(^() { if (self.session != NULL) sp_session_player_seek(self.session, (int)offset * 1000); });
+	SPDispatchAsyncWithPriority(SPDispatchPriorityInteractive, ^() { if (self.session != NULL) sp_session_player_seek(self.session, (int)offset * 1000); });
 }
 
 -(void)setPlaying:(BOOL)nowPlaying {
-	SPDispatchAsync(^() { if (self.session) sp_session_player_play(self.session, nowPlaying); });
+	SPDispatchAsyncWithPriority(SPDispatchPriorityInteractive, ^() { if (self.session) sp_session_player_play(self.session, nowPlaying); });
 	_playing = nowPlaying;
 }
 
@@ -1561,7 +2353,7 @@ static SPSession *sharedSession;
 
 -(void)unloadPlayback {
 	self.playing = NO;
-	SPDispatchAsync(^() { if (self.session) sp_session_player_unload(self.session); });
+	SPDispatchAsyncWithPriority(SPDispatchPriorityInteractive, ^() { if (self.session) sp_session_player_unload(self.session); });
 }
 
 
@@ -1572,33 +2364,24 @@ static SPSession *sharedSession;
 	SPAssertOnLibSpotifyThread();
 
 	@autoreleasepool {
+		// Requests from here on need another prod, since we can't tell whether this one will see them.
+		OSAtomicCompareAndSwap32Barrier(1, 0, &_prodRequested);
+		
 		int timeout = 0;
 		sp_session_process_events(self.session, &timeout);
-		NSTimeInterval nextNaturalProd = MIN(5.0, ((double)timeout) / 1000.0);
-		dispatch_async(dispatch_get_main_queue(), ^{
-			[self resetProdTimerWithTimeout:nextNaturalProd];
-		});
+		NSTimeInterval nextNaturalProd = MIN(kSPSessionMaximumProdInterval, ((double)timeout) / 1000.0);
+		CFRunLoopTimerSetNextFireDate(_prodTimer, CFAbsoluteTimeGetCurrent() + nextNaturalProd);
 		
+		// A request made since we started may have brought the timer forward before we pushed it back.
+		if (_prodRequested)
+			CFRunLoopTimerSetNextFireDate(_prodTimer, CFAbsoluteTimeGetCurrent());
 	}
 }
 
--(void)resetProdTimerWithTimeout:(NSTimeInterval)timeout {
-
-	NSAssert(dispatch_get_current_queue() == dispatch_get_main_queue(), @"Not on main thread!");
-
-	[self.prodTimeoutTimer invalidate];
-	self.prodTimeoutTimer = nil;
-	self.prodTimeoutTimer = [NSTimer scheduledTimerWithTimeInterval:timeout
-															 target:self
-														   selector:@selector(prodSessionAfterTimeout:)
-														   userInfo:nil
-															repeats:NO];
-}
-
--(void)prodSessionAfterTimeout:(NSTimer *)aTimer {
-    SPDispatchAsync(^{
-		[self prodSessionForcefully];
-	});
+-(void)requestProdSession {
+	// Called from any thread. Until the prod happens, further requests have nothing to add.
+	if (OSAtomicCompareAndSwap32Barrier(0, 1, &_prodRequested))
+		CFRunLoopTimerSetNextFireDate(_prodTimer, CFAbsoluteTimeGetCurrent());
 }
 
 #pragma mark -
@@ -1608,8 +2391,27 @@ static SPSession *sharedSession;
 	[self removeObserver:self forKeyPath:@"connectionState"];
 	[self removeObserver:self forKeyPath:@"starredPlaylist.items"];
 
-	[self.prodTimeoutTimer invalidate];
-	self.prodTimeoutTimer = nil;
+	// The timers and observer call us on the libspotify thread, so they have to be stopped there before we go away.
+	CFRunLoopTimerRef outgoing_timer = _prodTimer;
+	CFRunLoopObserverRef outgoing_update_observer = _propertyUpdateObserver;
+	CFRunLoopTimerRef outgoing_update_timer = _propertyUpdateTimer;
+	if (outgoing_timer) {
+		SPDispatchSyncIfNeeded(^{
+			CFRunLoopTimerInvalidate(outgoing_timer);
+			CFRelease(outgoing_timer);
+			CFRunLoopObserverInvalidate(outgoing_update_observer);
+			CFRelease(outgoing_update_observer);
+			CFRunLoopTimerInvalidate(outgoing_update_timer);
+			CFRelease(outgoing_update_timer);
+		});
+	}
+	
+	// Any batch still to be passed on would be handed a session that no longer exists.
+	self.audioDeliveryBatcher.delegate = nil;
+	
+	// Let go of our wrappers now, so they release their libSpotify objects before the session goes.
+	for (SPObjectCache *cache in [[self cachesByStatisticsKey] allValues])
+		[cache removeAllObjects];
 
 	sp_session *outgoing_session = _session;
 	
@@ -1618,6 +2420,9 @@ static SPSession *sharedSession;
 		sp_session_player_unload(outgoing_session);
 		sp_session_logout(outgoing_session);
 	});
+	
+	if (_callbackQueue) dispatch_release(_callbackQueue);
+	if (_callbackTargetQueue) dispatch_release(_callbackTargetQueue);
 }
 
 @end
@@ -27,9 +27,39 @@
 
 #import "CocoaLibSpotifyPlatformImports.h"
 
+@class SPObjectCache;
+
+/** Call the given block asynchronously on the session's callback queue, or the main queue if `session` is `nil`. */
+extern void SPDispatchToCallbackQueue(SPSession *session, dispatch_block_t block);
+
+/** Returns `YES` if called from the session's callback queue, or the main thread if `session` is `nil`. */
+extern BOOL SPIsOnCallbackQueue(SPSession *session);
+
+/** Queue a change to one of `object`'s properties, to be made on the session's callback queue along with others.
+ 
+ Must be called on the libSpotify thread. `key` is set with its setter, so scalars need boxing.
+ A later value for a key replaces one that hasn't been set yet, and `loaded` is always set last.
+ All of an object's changes are made between one set of KVO notifications, with `loaded`'s sent last.
+ Blocks sent with SPDispatchToCallbackQueue() from the libSpotify thread always run after the changes
+ queued before them.
+ */
+extern void SPEnqueuePropertyUpdate(SPSession *session, id object, NSString *key, id value);
+
+/** As SPEnqueuePropertyUpdate(), but sets `key` by calling `setter` with the value.
+ 
+ Use this when the property's own setter does more than set it, such as telling libSpotify about the change.
+ `setter` shouldn't send KVO notifications for `key`, since they're sent around it.
+ */
+extern void SPEnqueuePropertyUpdateWithSetter(SPSession *session, id object, NSString *key, SEL setter, id value);
+
 @interface SPSession (SPSessionInternal)
 
 -(void)addLoadingObject:(id)object;
 -(void)setPrivateSessionFromLibSpotifyUpdate:(BOOL)isPrivate;
 
+// The session's caches of SPAlbum, SPArtist and SPImage objects, emptied when it logs out.
+@property (nonatomic, readonly, strong) SPObjectCache *albumCache;
+@property (nonatomic, readonly, strong) SPObjectCache *artistCache;
+@property (nonatomic, readonly, strong) SPObjectCache *imageCache;
+
 @end
@@ -32,6 +32,7 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #import "SPToplist.h"
 #import "SPSession.h"
+#import "SPSessionInternal.h"
 #import "SPErrorExtensions.h"
 #import "SPTrack.h"
 #import "SPArtist.h"
@@ -85,7 +86,7 @@ void toplistbrowse_tracks_complete(sp_toplistbrowse *result, void *userdata) {
 			newTracks = [NSArray arrayWithArray:tracks];
 		}
 		
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(toplist.session, ^{
 			toplist.loadError = error;
 			toplist.tracks = newTracks;
 			toplist.tracksLoaded = tracksAreLoaded;
@@ -119,7 +120,7 @@ void toplistbrowse_artists_complete(sp_toplistbrowse *result, void *userdata) {
 			newArtists = [NSArray arrayWithArray:artists];
 		}
 		
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(toplist.session, ^{
 			toplist.loadError = error;
 			toplist.artists = newArtists;
 			toplist.artistsLoaded = artistsAreLoaded;
@@ -153,7 +154,7 @@ void toplistbrowse_albums_complete(sp_toplistbrowse *result, void *userdata) {
 			newAlbums = [NSArray arrayWithArray:albums];
 		}
 		
-		dispatch_async(dispatch_get_main_queue(), ^{
+		SPDispatchToCallbackQueue(toplist.session, ^{
 			toplist.loadError = error;
 			toplist.albums = newAlbums;
 			toplist.albumsLoaded = albumsAreLoaded;
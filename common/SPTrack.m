@@ -43,6 +43,10 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 -(BOOL)checkLoaded;
 -(void)loadTrackData;
 
+// Sets what libSpotify reports without KVO notifications or telling it about the change again,
+// for SPEnqueuePropertyUpdateWithSetter().
+-(void)applyStarredFromLibSpotifyUpdate:(BOOL)starred;
+
 @property (nonatomic, readwrite, strong) SPAlbum *album;
 @property (nonatomic, readwrite, strong) NSArray *artists;
 @property (nonatomic, readwrite, copy) NSURL *spotifyURL;
@@ -66,7 +70,7 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 -(void)setStarredFromLibSpotifyUpdate:(BOOL)starred {
 	[self willChangeValueForKey:@"starred"];
-	_starred = starred;
+	[self applyStarredFromLibSpotifyUpdate:starred];
 	[self didChangeValueForKey:@"starred"];
 }
 
@@ -187,39 +191,38 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 		}
 	}
 	
-	dispatch_async(dispatch_get_main_queue(), ^{
-		self.spotifyURL = trackURL;
-		self.album = newAlbum;
-		self.name = newName;
-		self.local = newLocal;
-		self.trackNumber = newTrackNumber;
-		self.discNumber = newDiscNumber;
-		self.popularity = newPopularity;
-		self.duration = newDuration;
-		self.availability = newAvailability;
-		self.offlineStatus = newOfflineStatus;
-		[self setStarredFromLibSpotifyUpdate:newStarred];
-		self.artists = newArtists;
-		self.loaded = newLoaded;
-	});
+	SPEnqueuePropertyUpdate(self.session, self, @"spotifyURL", trackURL);
+	SPEnqueuePropertyUpdate(self.session, self, @"album", newAlbum);
+	SPEnqueuePropertyUpdate(self.session, self, @"name", newName);
+	SPEnqueuePropertyUpdate(self.session, self, @"local", [NSNumber numberWithBool:newLocal]);
+	SPEnqueuePropertyUpdate(self.session, self, @"trackNumber", [NSNumber numberWithUnsignedInteger:newTrackNumber]);
+	SPEnqueuePropertyUpdate(self.session, self, @"discNumber", [NSNumber numberWithUnsignedInteger:newDiscNumber]);
+	SPEnqueuePropertyUpdate(self.session, self, @"popularity", [NSNumber numberWithUnsignedInteger:newPopularity]);
+	SPEnqueuePropertyUpdate(self.session, self, @"duration", [NSNumber numberWithDouble:newDuration]);
+	SPEnqueuePropertyUpdate(self.session, self, @"availability", [NSNumber numberWithInt:newAvailability]);
+	SPEnqueuePropertyUpdate(self.session, self, @"offlineStatus", [NSNumber numberWithInt:newOfflineStatus]);
+	SPEnqueuePropertyUpdateWithSetter(self.session, self, @"starred", @selector(applyStarredFromLibSpotifyUpdate:), [NSNumber numberWithBool:newStarred]);
+	SPEnqueuePropertyUpdate(self.session, self, @"artists", newArtists);
+	SPEnqueuePropertyUpdate(self.session, self, @"loaded", [NSNumber numberWithBool:newLoaded]);
 }
 
 -(void)sessionUpdatedMetadata:(NSNotification *)notification {
 
-	SPDispatchAsync(^{
-
-		BOOL newLocal = sp_track_is_local(self.session.session, self.track);
-		NSUInteger newPopularity = sp_track_popularity(self.track);
-		sp_track_availability newAvailability = sp_track_get_availability(self.session.session, self.track);
-		sp_track_offline_status newOfflineStatus = sp_track_offline_get_status(self.track);
-		BOOL newStarred = sp_track_is_starred(self.session.session, self.track);
-
-		dispatch_async(dispatch_get_main_queue(), ^{
-			if (self.isLocal != newLocal) self.local = newLocal;
-			if (self.popularity != newPopularity) self.popularity = newPopularity;
-			if (self.availability != newAvailability) self.availability = newAvailability;
-			if (self.offlineStatus != newOfflineStatus) self.offlineStatus = newOfflineStatus;
-			if (self.starred != newStarred) [self setStarredFromLibSpotifyUpdate:newStarred];
+	// Every track gets this for every metadata update, so only one read per track is ever pending.
+	SPDispatchAsyncCoalesced(self, _cmd, ^(SPTrack *track) {
+
+		BOOL newLocal = sp_track_is_local(track.session.session, track.track);
+		NSUInteger newPopularity = sp_track_popularity(track.track);
+		sp_track_availability newAvailability = sp_track_get_availability(track.session.session, track.track);
+		sp_track_offline_status newOfflineStatus = sp_track_offline_get_status(track.track);
+		BOOL newStarred = sp_track_is_starred(track.session.session, track.track);
+
+		SPDispatchToCallbackQueue(track.session, ^{
+			if (track.isLocal != newLocal) track.local = newLocal;
+			if (track.popularity != newPopularity) track.popularity = newPopularity;
+			if (track.availability != newAvailability) track.availability = newAvailability;
+			if (track.offlineStatus != newOfflineStatus) track.offlineStatus = newOfflineStatus;
+			if (track.starred != newStarred) [track setStarredFromLibSpotifyUpdate:newStarred];
 		});
 	});
 }
@@ -279,6 +282,10 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 	return [[artistNames sortedArrayUsingSelector:@selector(caseInsensitiveCompare:)] componentsJoinedByString:@", "];
 }
 
+-(void)applyStarredFromLibSpotifyUpdate:(BOOL)starred {
+	_starred = starred;
+}
+
 -(void)setStarred:(BOOL)starred {
     SPDispatchAsync(^() {
 		sp_track *track = self.track;
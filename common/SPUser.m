@@ -125,12 +125,10 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 			displayString = [NSString stringWithUTF8String:display];
 		}
 		
-		dispatch_async(dispatch_get_main_queue(), ^{
-			self.canonicalName = [canonicalString length] > 0 ? canonicalString : nil;
-			self.displayName = [displayString length] > 0 ? displayString : nil;
-			self.spotifyURL = url;
-			self.loaded = userLoaded;
-		});
+		SPEnqueuePropertyUpdate(self.session, self, @"canonicalName", [canonicalString length] > 0 ? canonicalString : nil);
+		SPEnqueuePropertyUpdate(self.session, self, @"displayName", [displayString length] > 0 ? displayString : nil);
+		SPEnqueuePropertyUpdate(self.session, self, @"spotifyURL", url);
+		SPEnqueuePropertyUpdate(self.session, self, @"loaded", [NSNumber numberWithBool:userLoaded]);
 	}
 }
 
@@ -0,0 +1,662 @@
+//
+//  SPAudioOutputTests.m
+//  CocoaLibSpotify
+//
+/*
+ Copyright (c) 2011, Spotify AB
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of Spotify AB nor the names of its contributors may 
+ be used to endorse or promote products derived from this software 
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL SPOTIFY AB BE LIABLE FOR ANY DIRECT, INDIRECT,
+ INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "SPAudioOutputTests.h"
+#import "SPNullAudioOutputSink.h"
+#import "SPAudioKernels.h"
+#import "SPAudioDeliveryBatcher.h"
+
+static NSUInteger const kAudioOutputTestFrameCount = 44100 * 10;
+static NSUInteger const kAudioOutputTestDeliveryFrameCount = 2048;
+static double const kAudioOutputTestPlaybackRate = 40.0;
+static NSTimeInterval const kAudioOutputTestTimeout = 20.0;
+// Whole numbers of the null sink's 512-frame slices, so every slice is either all crossfade or none of it.
+static NSUInteger const kCrossfadeTestTrackFrameCount = 512 * 86;
+static NSUInteger const kCrossfadeTestOverlapFrameCount = 512 * 43;
+static SInt16 const kCrossfadeTestLevel = 16384;
+static NSUInteger const kBatchingTestChunkFrameCount = 441; // A typical libspotify delivery.
+static NSUInteger const kBatchingTestChunkCount = 100;
+static NSTimeInterval const kBatchingTestBatchDuration = 0.05;
+static NSUInteger const kConcurrentDeliveryTestChunkCount = 400;
+static NSUInteger const kConcurrentDeliveryTestChunksPerFormat = 25;
+static NSUInteger const kAudioKernelsTestFrameCount = 1027; // Deliberately not a multiple of any vector width.
+static NSUInteger const kAudioKernelsBenchmarkFrameCount = 512;
+static NSUInteger const kAudioKernelsBenchmarkIterations = 20000;
+
+// Delivers frames numbered from zero in 16-bit stereo, with the right channel inverted, as fast as the controller takes them.
+static void SPDeliverNumberedTestAudio(SPCoreAudioController *audioController, AudioStreamBasicDescription description, NSUInteger frameCount) {
+	
+	SInt16 frames[kAudioOutputTestDeliveryFrameCount * 2];
+	NSUInteger framesDelivered = 0;
+	
+	while (framesDelivered < frameCount) {
+		
+		NSUInteger chunkFrameCount = MIN(kAudioOutputTestDeliveryFrameCount, frameCount - framesDelivered);
+		for (NSUInteger frame = 0; frame < chunkFrameCount; frame++) {
+			frames[frame * 2] = (SInt16)(framesDelivered + frame);
+			frames[(frame * 2) + 1] = (SInt16)~(framesDelivered + frame);
+		}
+		
+		NSInteger accepted = [audioController session:nil shouldDeliverAudioFrames:frames ofCount:chunkFrameCount streamDescription:description];
+		if (accepted > 0)
+			// Like libspotify, redeliver whatever wasn't accepted.
+			framesDelivered += accepted;
+		else
+			usleep(1000);
+	}
+}
+
+// Returns the first frame of SPDeliverNumberedTestAudio()'s output that's wrong, or NSNotFound.
+static NSUInteger SPFirstCorruptNumberedTestFrame(NSData *output, NSUInteger frameCount) {
+	const SInt16 *samples = output.bytes;
+	for (NSUInteger frame = 0; frame < frameCount; frame++) {
+		if (samples[frame * 2] != (SInt16)frame || samples[(frame * 2) + 1] != (SInt16)~frame)
+			return frame;
+	}
+	return NSNotFound;
+}
+
+// Checks that every delivery it's given comes from the session it expects, and that the
+// audio matches the stream description, whose sample rate each sample is set to a tenth of.
+@interface SPAudioDeliveryRecorder : NSObject <SPSessionAudioDeliveryDelegate>
+@property (nonatomic, readwrite, assign) __unsafe_unretained id expectedSession;
+@property (nonatomic, readwrite) NSUInteger frameCount;
+@property (nonatomic, readwrite) NSUInteger mismatchCount;
+@property (nonatomic, readwrite) BOOL didEndTrack;
+@end
+
+@implementation SPAudioDeliveryRecorder
+
+@synthesize expectedSession;
+@synthesize frameCount;
+@synthesize mismatchCount;
+@synthesize didEndTrack;
+
+-(NSInteger)session:(id <SPSessionPlaybackProvider>)aSession shouldDeliverAudioFrames:(const void *)audioFrames ofCount:(NSInteger)count streamDescription:(AudioStreamBasicDescription)audioDescription {
+	
+	const SInt16 *samples = audioFrames;
+	SInt16 expectedSample = (SInt16)(audioDescription.mSampleRate / 10.0);
+	
+	if (aSession != self.expectedSession || audioDescription.mBytesPerFrame != audioDescription.mChannelsPerFrame * sizeof(SInt16))
+		self.mismatchCount++;
+	
+	for (NSUInteger sample = 0; sample < count * audioDescription.mChannelsPerFrame; sample++) {
+		if (samples[sample] != expectedSample) {
+			self.mismatchCount++;
+			break;
+		}
+	}
+	
+	self.frameCount += count;
+	return count;
+}
+
+-(void)sessionDidEndAudioDelivery:(id <SPSessionPlaybackProvider>)aSession {
+	self.didEndTrack = YES;
+}
+
+@end
+
+@interface SPAudioOutputTests ()
+@property (nonatomic, readwrite, strong) SPCoreAudioController *controller;
+@property (nonatomic, readwrite) NSTimeInterval reportedDuration;
+@property (nonatomic, readwrite) NSUInteger reportedTrackBoundaryCount;
+@property (nonatomic, readwrite) NSTimeInterval reportedTrackBoundaryTime;
+@property (nonatomic, readwrite, strong) NSMutableData *deliveredAudio;
+@property (nonatomic, readwrite) NSUInteger deliveryCount;
+@property (nonatomic, readwrite) NSUInteger deliveredFrameCountAtTrackEnd;
+@end
+
+@implementation SPAudioOutputTests
+
+@synthesize controller;
+@synthesize reportedDuration;
+@synthesize reportedTrackBoundaryCount;
+@synthesize reportedTrackBoundaryTime;
+@synthesize deliveredAudio;
+@synthesize deliveryCount;
+@synthesize deliveredFrameCountAtTrackEnd;
+
+-(void)testNullSinkPlayback {
+	
+	SPAssertTestCompletesInTimeInterval(kAudioOutputTestTimeout);
+	
+	// Stream ten seconds of 16-bit stereo audio in libspotify's format through the whole pipeline,
+	// faster than real time, and check it all comes out of the other end in order.
+	AudioStreamBasicDescription description;
+	memset(&description, 0, sizeof(description));
+	description.mSampleRate = 44100.0;
+	description.mFormatID = kAudioFormatLinearPCM;
+	description.mFormatFlags = kAudioFormatFlagIsSignedInteger | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked;
+	description.mBytesPerPacket = 4;
+	description.mFramesPerPacket = 1;
+	description.mBytesPerFrame = 4;
+	description.mChannelsPerFrame = 2;
+	description.mBitsPerChannel = 16;
+	
+	NSURL *fileURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:@"SPAudioOutputTests.pcm"]];
+	SPNullAudioOutputSink *sink = [[SPNullAudioOutputSink alloc] initWithFileURL:fileURL];
+	sink.playbackRate = kAudioOutputTestPlaybackRate;
+	
+	self.reportedDuration = 0.0;
+	self.controller = [[SPCoreAudioController alloc] initWithOutputSink:sink];
+	self.controller.delegate = self;
+	self.controller.measuresRenderTiming = YES;
+	self.controller.audioOutputEnabled = YES;
+	SPCoreAudioController *audioController = self.controller;
+	
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		
+		NSDate *start = [NSDate date];
+		SPDeliverNumberedTestAudio(audioController, description, kAudioOutputTestFrameCount);
+		
+		while (sink.renderedFrameCount < kAudioOutputTestFrameCount && -[start timeIntervalSinceNow] < kAudioOutputTestTimeout)
+			usleep(1000);
+		
+		NSTimeInterval duration = -[start timeIntervalSinceNow];
+		audioController.audioOutputEnabled = NO;
+		
+		dispatch_async(dispatch_get_main_queue(), ^{
+			
+			[audioController.outputSink teardown];
+			printf(" %.1fx real time.", (kAudioOutputTestFrameCount / description.mSampleRate) / duration);
+			
+			SPTestAssert(sink.renderedFrameCount == kAudioOutputTestFrameCount, @"Sink rendered %llu frames, expected %lu",
+						 (unsigned long long)sink.renderedFrameCount, (unsigned long)kAudioOutputTestFrameCount);
+			SPTestAssert(audioController.renderedFrameCount == kAudioOutputTestFrameCount, @"Controller counted %llu frames, expected %lu",
+						 (unsigned long long)audioController.renderedFrameCount, (unsigned long)kAudioOutputTestFrameCount);
+			
+			SPCoreAudioControllerRenderTiming timing = audioController.renderTiming;
+			SPTestAssert(timing.callbackCount >= kAudioOutputTestFrameCount / 512, @"Controller measured %lu render callbacks", (unsigned long)timing.callbackCount);
+			SPTestAssert(timing.medianDuration <= timing.ninetiethPercentileDuration && timing.ninetiethPercentileDuration <= timing.ninetyNinthPercentileDuration &&
+						 timing.ninetyNinthPercentileDuration <= timing.maximumDuration && timing.maximumDuration > 0.0, @"Render timing percentiles are out of order");
+			
+			// Progress is reported from a frame count, so it should add up exactly once output has stopped.
+			SPTestAssert(fabs(self.reportedDuration - (kAudioOutputTestFrameCount / description.mSampleRate)) < 1e-6,
+						 @"Controller reported %f seconds of playback, expected %f", self.reportedDuration, kAudioOutputTestFrameCount / description.mSampleRate);
+			
+			NSData *output = [NSData dataWithContentsOfURL:fileURL];
+			[[NSFileManager defaultManager] removeItemAtURL:fileURL error:nil];
+			SPTestAssert(output.length == kAudioOutputTestFrameCount * description.mBytesPerFrame, @"Sink wrote %lu bytes, expected %lu",
+						 (unsigned long)output.length, (unsigned long)(kAudioOutputTestFrameCount * description.mBytesPerFrame));
+			
+			NSUInteger corruptFrame = SPFirstCorruptNumberedTestFrame(output, kAudioOutputTestFrameCount);
+			SPTestAssert(corruptFrame == NSNotFound, @"Output audio is corrupt at frame %lu", (unsigned long)corruptFrame);
+			SPPassTest();
+		});
+	});
+}
+
+-(void)testUnmirroredBufferWithoutOutputBuffer {
+	
+	SPAssertTestCompletesInTimeInterval(kAudioOutputTestTimeout);
+	
+	// A sink that takes pointers to audio rather than giving us a buffer has to get a copy whenever a read
+	// wraps around the end of a buffer that isn't mirrored. Ten seconds of audio wraps a few times.
+	AudioStreamBasicDescription description;
+	memset(&description, 0, sizeof(description));
+	description.mSampleRate = 44100.0;
+	description.mFormatID = kAudioFormatLinearPCM;
+	description.mFormatFlags = kAudioFormatFlagIsSignedInteger | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked;
+	description.mBytesPerPacket = 4;
+	description.mFramesPerPacket = 1;
+	description.mBytesPerFrame = 4;
+	description.mChannelsPerFrame = 2;
+	description.mBitsPerChannel = 16;
+	
+	NSURL *fileURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:@"SPAudioOutputTests-unmirrored.pcm"]];
+	SPNullAudioOutputSink *sink = [[SPNullAudioOutputSink alloc] initWithFileURL:fileURL];
+	sink.playbackRate = kAudioOutputTestPlaybackRate;
+	sink.providesOutputBuffer = NO;
+	
+	self.controller = [[SPCoreAudioController alloc] initWithOutputSink:sink];
+	self.controller.usesMirroredBuffers = NO;
+	self.controller.audioOutputEnabled = YES;
+	SPCoreAudioController *audioController = self.controller;
+	
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		
+		NSDate *start = [NSDate date];
+		SPDeliverNumberedTestAudio(audioController, description, kAudioOutputTestFrameCount);
+		BOOL bufferWasMirrored = [[audioController valueForKey:@"audioBuffer"] isMirrored];
+		
+		while (sink.renderedFrameCount < kAudioOutputTestFrameCount && -[start timeIntervalSinceNow] < kAudioOutputTestTimeout)
+			usleep(1000);
+		
+		audioController.audioOutputEnabled = NO;
+		
+		dispatch_async(dispatch_get_main_queue(), ^{
+			
+			[audioController.outputSink teardown];
+			NSData *output = [NSData dataWithContentsOfURL:fileURL];
+			[[NSFileManager defaultManager] removeItemAtURL:fileURL error:nil];
+			
+			SPTestAssert(!bufferWasMirrored, @"Controller used a mirrored buffer");
+			SPTestAssert(sink.renderedFrameCount == kAudioOutputTestFrameCount, @"Sink rendered %llu frames, expected %lu",
+						 (unsigned long long)sink.renderedFrameCount, (unsigned long)kAudioOutputTestFrameCount);
+			SPTestAssert(output.length == kAudioOutputTestFrameCount * description.mBytesPerFrame, @"Sink wrote %lu bytes, expected %lu",
+						 (unsigned long)output.length, (unsigned long)(kAudioOutputTestFrameCount * description.mBytesPerFrame));
+			
+			NSUInteger corruptFrame = SPFirstCorruptNumberedTestFrame(output, kAudioOutputTestFrameCount);
+			SPTestAssert(corruptFrame == NSNotFound, @"Output audio is corrupt at frame %lu", (unsigned long)corruptFrame);
+			SPPassTest();
+		});
+	});
+}
+
+-(void)testCrossfade {
+	
+	SPAssertTestCompletesInTimeInterval(kAudioOutputTestTimeout);
+	
+	// Two tracks at the same constant level, crossfaded linearly, should play at that level throughout, 
+	// with the second track starting exactly where the overlap does.
+	AudioStreamBasicDescription description;
+	memset(&description, 0, sizeof(description));
+	description.mSampleRate = 44100.0;
+	description.mFormatID = kAudioFormatLinearPCM;
+	description.mFormatFlags = kAudioFormatFlagIsSignedInteger | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked;
+	description.mBytesPerPacket = 4;
+	description.mFramesPerPacket = 1;
+	description.mBytesPerFrame = 4;
+	description.mChannelsPerFrame = 2;
+	description.mBitsPerChannel = 16;
+	
+	NSURL *fileURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:@"SPAudioOutputTestsCrossfade.pcm"]];
+	SPNullAudioOutputSink *sink = [[SPNullAudioOutputSink alloc] initWithFileURL:fileURL];
+	sink.playbackRate = kAudioOutputTestPlaybackRate;
+	
+	self.reportedDuration = 0.0;
+	self.reportedTrackBoundaryCount = 0;
+	self.controller = [[SPCoreAudioController alloc] initWithOutputSink:sink];
+	self.controller.delegate = self;
+	self.controller.crossfadeDuration = kCrossfadeTestOverlapFrameCount / description.mSampleRate;
+	self.controller.crossfadeCurve = SPCoreAudioControllerCrossfadeCurveLinear;
+	SPCoreAudioController *audioController = self.controller;
+	
+	SInt16 frames[kAudioOutputTestDeliveryFrameCount * 2];
+	for (NSUInteger sample = 0; sample < kAudioOutputTestDeliveryFrameCount * 2; sample++)
+		frames[sample] = kCrossfadeTestLevel;
+	
+	// Buffer both tracks before starting output, so the second is ready when the crossfade starts.
+	for (NSUInteger track = 0; track < 2; track++) {
+		NSUInteger framesDelivered = 0;
+		while (framesDelivered < kCrossfadeTestTrackFrameCount) {
+			NSUInteger chunkFrameCount = MIN(kAudioOutputTestDeliveryFrameCount, kCrossfadeTestTrackFrameCount - framesDelivered);
+			NSInteger accepted = [audioController session:nil shouldDeliverAudioFrames:frames ofCount:chunkFrameCount streamDescription:description];
+			SPTestAssert(accepted > 0, @"Controller didn't buffer all of track %lu", (unsigned long)track + 1);
+			framesDelivered += accepted;
+		}
+		if (track == 0)
+			[audioController sessionDidEndAudioDelivery:nil];
+	}
+	
+	NSUInteger expectedFrameCount = (kCrossfadeTestTrackFrameCount * 2) - kCrossfadeTestOverlapFrameCount;
+	audioController.audioOutputEnabled = YES;
+	
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		
+		NSDate *start = [NSDate date];
+		while (sink.renderedFrameCount < expectedFrameCount && -[start timeIntervalSinceNow] < kAudioOutputTestTimeout)
+			usleep(1000);
+		
+		audioController.audioOutputEnabled = NO;
+		
+		dispatch_async(dispatch_get_main_queue(), ^{
+			
+			[audioController.outputSink teardown];
+			
+			SPTestAssert(sink.renderedFrameCount == expectedFrameCount, @"Sink rendered %llu frames, expected %lu",
+						 (unsigned long long)sink.renderedFrameCount, (unsigned long)expectedFrameCount);
+			SPTestAssert(self.reportedTrackBoundaryCount == 1, @"Controller reported %lu track boundaries, expected 1", (unsigned long)self.reportedTrackBoundaryCount);
+			SPTestAssert(fabs(self.reportedTrackBoundaryTime - ((kCrossfadeTestTrackFrameCount - kCrossfadeTestOverlapFrameCount) / description.mSampleRate)) < 1e-9,
+						 @"Second track started at %f seconds", self.reportedTrackBoundaryTime);
+			SPTestAssert(fabs(self.reportedDuration - (expectedFrameCount / description.mSampleRate)) < 1e-6,
+						 @"Controller reported %f seconds of playback", self.reportedDuration);
+			
+			NSData *output = [NSData dataWithContentsOfURL:fileURL];
+			[[NSFileManager defaultManager] removeItemAtURL:fileURL error:nil];
+			SPTestAssert(output.length == expectedFrameCount * description.mBytesPerFrame, @"Sink wrote %lu bytes", (unsigned long)output.length);
+			
+			const SInt16 *samples = output.bytes;
+			for (NSUInteger sample = 0; sample < expectedFrameCount * 2; sample++) {
+				SPTestAssert(abs(samples[sample] - kCrossfadeTestLevel) <= 1, @"Level is %d at frame %lu, expected %d",
+							 samples[sample], (unsigned long)(sample / 2), kCrossfadeTestLevel);
+			}
+			SPPassTest();
+		});
+	});
+}
+
+-(void)testVolume {
+	
+	SPAssertTestCompletesInTimeInterval(kAudioOutputTestTimeout);
+	
+	// The controller applies the volume itself, so even a sink that does nothing with the audio plays it
+	// quieter. After the first slice, which ramps down from full volume, the level should be steady.
+	AudioStreamBasicDescription description;
+	memset(&description, 0, sizeof(description));
+	description.mSampleRate = 44100.0;
+	description.mFormatID = kAudioFormatLinearPCM;
+	description.mFormatFlags = kAudioFormatFlagIsSignedInteger | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked;
+	description.mBytesPerPacket = 4;
+	description.mFramesPerPacket = 1;
+	description.mBytesPerFrame = 4;
+	description.mChannelsPerFrame = 2;
+	description.mBitsPerChannel = 16;
+	
+	NSURL *fileURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:@"SPAudioOutputTestsVolume.pcm"]];
+	SPNullAudioOutputSink *sink = [[SPNullAudioOutputSink alloc] initWithFileURL:fileURL];
+	sink.playbackRate = kAudioOutputTestPlaybackRate;
+	
+	self.controller = [[SPCoreAudioController alloc] initWithOutputSink:sink];
+	self.controller.volume = 0.5;
+	SPCoreAudioController *audioController = self.controller;
+	
+	SInt16 frames[kAudioOutputTestDeliveryFrameCount * 2];
+	for (NSUInteger sample = 0; sample < kAudioOutputTestDeliveryFrameCount * 2; sample++)
+		frames[sample] = kCrossfadeTestLevel;
+	
+	NSUInteger framesDelivered = 0;
+	while (framesDelivered < kCrossfadeTestTrackFrameCount) {
+		NSUInteger chunkFrameCount = MIN(kAudioOutputTestDeliveryFrameCount, kCrossfadeTestTrackFrameCount - framesDelivered);
+		NSInteger accepted = [audioController session:nil shouldDeliverAudioFrames:frames ofCount:chunkFrameCount streamDescription:description];
+		SPTestAssert(accepted > 0, @"Controller didn't buffer all of the audio");
+		framesDelivered += accepted;
+	}
+	
+	audioController.audioOutputEnabled = YES;
+	
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		
+		NSDate *start = [NSDate date];
+		while (sink.renderedFrameCount < kCrossfadeTestTrackFrameCount && -[start timeIntervalSinceNow] < kAudioOutputTestTimeout)
+			usleep(1000);
+		
+		audioController.audioOutputEnabled = NO;
+		
+		dispatch_async(dispatch_get_main_queue(), ^{
+			
+			[audioController.outputSink teardown];
+			NSData *output = [NSData dataWithContentsOfURL:fileURL];
+			[[NSFileManager defaultManager] removeItemAtURL:fileURL error:nil];
+			SPTestAssert(output.length == kCrossfadeTestTrackFrameCount * description.mBytesPerFrame, @"Sink wrote %lu bytes", (unsigned long)output.length);
+			
+			SInt16 expectedLevel = (SInt16)lrintf(kCrossfadeTestLevel * SPAudioGainForVolume(0.5));
+			const SInt16 *samples = output.bytes;
+			for (NSUInteger sample = sink.framesPerSlice * 2; sample < kCrossfadeTestTrackFrameCount * 2; sample++) {
+				SPTestAssert(abs(samples[sample] - expectedLevel) <= 1, @"Level is %d at frame %lu, expected %d",
+							 samples[sample], (unsigned long)(sample / 2), expectedLevel);
+			}
+			SPPassTest();
+		});
+	});
+}
+
+-(void)testDeliveryBatching {
+	
+	SPAssertTestCompletesInTimeInterval(kAudioOutputTestTimeout);
+	
+	// Deliver a second of audio in libspotify-sized chunks, and check it all arrives in order, in far fewer
+	// calls, with the end of the track after the last of it.
+	SPAudioDeliveryBatcher *batcher = [[SPAudioDeliveryBatcher alloc] initWithSession:nil];
+	batcher.delegate = self;
+	batcher.batchDuration = kBatchingTestBatchDuration;
+	
+	self.deliveredAudio = [NSMutableData data];
+	self.deliveryCount = 0;
+	self.deliveredFrameCountAtTrackEnd = NSNotFound;
+	
+	sp_audioformat format;
+	format.sample_type = SP_SAMPLETYPE_INT16_NATIVE_ENDIAN;
+	format.sample_rate = 44100;
+	format.channels = 2;
+	
+	SInt16 frames[kBatchingTestChunkFrameCount * 2];
+	NSUInteger frameCount = kBatchingTestChunkFrameCount * kBatchingTestChunkCount;
+	
+	for (NSUInteger chunk = 0; chunk < kBatchingTestChunkCount; chunk++) {
+		for (NSUInteger frame = 0; frame < kBatchingTestChunkFrameCount; frame++) {
+			frames[frame * 2] = (SInt16)((chunk * kBatchingTestChunkFrameCount) + frame);
+			frames[(frame * 2) + 1] = (SInt16)~((chunk * kBatchingTestChunkFrameCount) + frame);
+		}
+		
+		NSInteger accepted = SPAudioDeliveryBatcherDeliverFrames(batcher, &format, frames, kBatchingTestChunkFrameCount);
+		SPTestAssert(accepted == (NSInteger)kBatchingTestChunkFrameCount, @"Batcher accepted %ld frames of chunk %lu", (long)accepted, (unsigned long)chunk);
+	}
+	
+	SPAudioDeliveryBatcherEndTrack(batcher);
+	batcher.delegate = nil;
+	
+	SPTestAssert(self.deliveredAudio.length == frameCount * 4, @"Delegate was given %lu bytes, expected %lu",
+				 (unsigned long)self.deliveredAudio.length, (unsigned long)(frameCount * 4));
+	SPTestAssert(self.deliveredFrameCountAtTrackEnd == frameCount, @"Track ended after %lu frames, expected %lu",
+				 (unsigned long)self.deliveredFrameCountAtTrackEnd, (unsigned long)frameCount);
+	
+	NSUInteger expectedDeliveryCount = (NSUInteger)ceil(frameCount / (kBatchingTestBatchDuration * format.sample_rate));
+	SPTestAssert(self.deliveryCount <= expectedDeliveryCount + 1, @"Delegate was called %lu times for %lu chunks",
+				 (unsigned long)self.deliveryCount, (unsigned long)kBatchingTestChunkCount);
+	
+	const SInt16 *samples = self.deliveredAudio.bytes;
+	for (NSUInteger frame = 0; frame < frameCount; frame++) {
+		SPTestAssert(samples[frame * 2] == (SInt16)frame && samples[(frame * 2) + 1] == (SInt16)~frame,
+					 @"Frame %lu was delivered out of order", (unsigned long)frame);
+	}
+	
+	SPPassTest();
+}
+
+-(void)testConcurrentSessionDelivery {
+	
+	SPAssertTestCompletesInTimeInterval(kAudioOutputTestTimeout);
+	
+	// Two sessions delivering at once, switching between different formats, must each keep their own 
+	// stream description. One batches its audio and the other passes it straight through.
+	NSObject *firstSession = [NSObject new];
+	NSObject *secondSession = [NSObject new];
+	
+	SPAudioDeliveryRecorder *firstRecorder = [SPAudioDeliveryRecorder new];
+	firstRecorder.expectedSession = firstSession;
+	SPAudioDeliveryRecorder *secondRecorder = [SPAudioDeliveryRecorder new];
+	secondRecorder.expectedSession = secondSession;
+	
+	SPAudioDeliveryBatcher *firstBatcher = [[SPAudioDeliveryBatcher alloc] initWithSession:(id)firstSession];
+	firstBatcher.delegate = firstRecorder;
+	firstBatcher.batchDuration = kBatchingTestBatchDuration;
+	SPAudioDeliveryBatcher *secondBatcher = [[SPAudioDeliveryBatcher alloc] initWithSession:(id)secondSession];
+	secondBatcher.delegate = secondRecorder;
+	
+	void (^deliver)(SPAudioDeliveryBatcher *, int, int, int) = ^(SPAudioDeliveryBatcher *batcher, int channels, int sampleRate, int alternateSampleRate) {
+		
+		SInt16 frames[kBatchingTestChunkFrameCount * 2];
+		sp_audioformat format;
+		format.sample_type = SP_SAMPLETYPE_INT16_NATIVE_ENDIAN;
+		format.channels = channels;
+		
+		for (NSUInteger chunk = 0; chunk < kConcurrentDeliveryTestChunkCount; chunk++) {
+			
+			format.sample_rate = (chunk / kConcurrentDeliveryTestChunksPerFormat) % 2 == 0 ? sampleRate : alternateSampleRate;
+			for (NSUInteger sample = 0; sample < kBatchingTestChunkFrameCount * channels; sample++)
+				frames[sample] = (SInt16)(format.sample_rate / 10);
+			
+			// Like libspotify, redeliver whatever wasn't accepted.
+			NSInteger framesDelivered = 0;
+			while (framesDelivered < (NSInteger)kBatchingTestChunkFrameCount)
+				framesDelivered += SPAudioDeliveryBatcherDeliverFrames(batcher, &format, frames + (framesDelivered * channels),
+																	   kBatchingTestChunkFrameCount - framesDelivered);
+		}
+		
+		SPAudioDeliveryBatcherEndTrack(batcher);
+	};
+	
+	dispatch_group_t group = dispatch_group_create();
+	dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{ deliver(firstBatcher, 2, 44100, 22050); });
+	dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{ deliver(secondBatcher, 1, 48000, 96000); });
+	
+	dispatch_group_notify(group, dispatch_get_main_queue(), ^{
+		
+		firstBatcher.delegate = nil;
+		secondBatcher.delegate = nil;
+		
+		NSUInteger expectedFrameCount = kBatchingTestChunkFrameCount * kConcurrentDeliveryTestChunkCount;
+		for (SPAudioDeliveryRecorder *recorder in [NSArray arrayWithObjects:firstRecorder, secondRecorder, nil]) {
+			SPTestAssert(recorder.mismatchCount == 0, @"%lu deliveries didn't match their session or format", (unsigned long)recorder.mismatchCount);
+			SPTestAssert(recorder.frameCount == expectedFrameCount, @"Delegate was given %lu frames, expected %lu",
+						 (unsigned long)recorder.frameCount, (unsigned long)expectedFrameCount);
+			SPTestAssert(recorder.didEndTrack, @"Delegate wasn't told the track ended");
+		}
+		SPPassTest();
+	});
+	dispatch_release(group);
+}
+
+-(void)testKernels {
+	
+	SInt16 input[kAudioKernelsTestFrameCount * 2];
+	float converted[kAudioKernelsTestFrameCount * 2];
+	float left[kAudioKernelsTestFrameCount];
+	float right[kAudioKernelsTestFrameCount];
+	float interleaved[kAudioKernelsTestFrameCount * 2];
+	float * const channels[2] = { left, right };
+	
+	for (NSUInteger sample = 0; sample < kAudioKernelsTestFrameCount * 2; sample++)
+		input[sample] = (SInt16)((sample * 7919) - 32768);
+	input[0] = INT16_MIN;
+	input[1] = INT16_MAX;
+	
+	SPAudioConvertInt16ToFloat32(input, converted, kAudioKernelsTestFrameCount * 2);
+	for (NSUInteger sample = 0; sample < kAudioKernelsTestFrameCount * 2; sample++)
+		SPTestAssert(converted[sample] == input[sample] / 32768.0f, @"Sample %lu converted incorrectly", (unsigned long)sample);
+	
+	SInt16 roundTripped[kAudioKernelsTestFrameCount * 2];
+	SPAudioConvertFloat32ToInt16(converted, roundTripped, kAudioKernelsTestFrameCount * 2);
+	SPTestAssert(memcmp(roundTripped, input, sizeof(input)) == 0, @"Converting back to 16-bit didn't restore the original samples");
+	
+	float doubled[kAudioKernelsTestFrameCount * 2];
+	memcpy(doubled, converted, sizeof(converted));
+	SPAudioMixFloat32(converted, doubled, kAudioKernelsTestFrameCount * 2);
+	for (NSUInteger sample = 0; sample < kAudioKernelsTestFrameCount * 2; sample++)
+		SPTestAssert(doubled[sample] == converted[sample] * 2.0f, @"Sample %lu mixed incorrectly", (unsigned long)sample);
+	
+	SPAudioDeinterleaveFloat32(converted, channels, 2, kAudioKernelsTestFrameCount);
+	for (NSUInteger frame = 0; frame < kAudioKernelsTestFrameCount; frame++)
+		SPTestAssert(left[frame] == converted[frame * 2] && right[frame] == converted[(frame * 2) + 1], @"Frame %lu deinterleaved incorrectly", (unsigned long)frame);
+	
+	SPAudioInterleaveFloat32((const float * const *)channels, interleaved, 2, kAudioKernelsTestFrameCount);
+	SPTestAssert(memcmp(interleaved, converted, sizeof(converted)) == 0, @"Interleaving didn't restore the original samples");
+	
+	float startGain = SPAudioGainForVolume(0.25);
+	float endGain = SPAudioGainForVolume(0.75);
+	SPTestAssert(startGain == 0.25f * 0.25f * 0.25f, @"Volume taper isn't cubic");
+	SPAudioApplyGainRamp(left, kAudioKernelsTestFrameCount, startGain, endGain);
+	for (NSUInteger frame = 0; frame < kAudioKernelsTestFrameCount; frame++) {
+		float gain = startGain + (frame * ((endGain - startGain) / kAudioKernelsTestFrameCount));
+		SPTestAssert(fabsf(left[frame] - (converted[frame * 2] * gain)) < 1e-6f, @"Gain ramp is wrong at frame %lu", (unsigned long)frame);
+	}
+	
+	SPPassTest();
+}
+
+-(void)testKernelClippingAndRounding {
+	
+	// The vector paths have to clip and round exactly as the scalar code does. Each value is repeated across the
+	// buffer, which isn't a multiple of any vector width, so it goes through both the vector code and the scalar tail.
+	float const values[] = { 1e10f, -1e10f, INFINITY, -INFINITY, 2.0f, -2.0f, 1.0f, -1.0f,
+		0.5f / 32768.0f, -0.5f / 32768.0f, 1.5f / 32768.0f, -1.5f / 32768.0f, 2.5f / 32768.0f, -2.5f / 32768.0f,
+		32766.5f / 32768.0f, -32767.5f / 32768.0f };
+	NSUInteger const valueCount = sizeof(values) / sizeof(values[0]);
+	
+	float input[kAudioKernelsTestFrameCount];
+	SInt16 output[kAudioKernelsTestFrameCount];
+	for (NSUInteger sample = 0; sample < kAudioKernelsTestFrameCount; sample++)
+		input[sample] = values[sample % valueCount];
+	
+	SPAudioConvertFloat32ToInt16(input, output, kAudioKernelsTestFrameCount);
+	
+	for (NSUInteger sample = 0; sample < kAudioKernelsTestFrameCount; sample++) {
+		float scaled = input[sample] * 32768.0f;
+		SInt16 expected = scaled >= 32767.0f ? INT16_MAX : (scaled <= -32768.0f ? INT16_MIN : (SInt16)lrintf(scaled));
+		SPTestAssert(output[sample] == expected, @"%s converted %g to %d at sample %lu, expected %d",
+					 SPAudioKernelsInstructionSetName(), input[sample], output[sample], (unsigned long)sample, expected);
+	}
+	
+	SPPassTest();
+}
+
+-(void)testKernelThroughputBenchmark {
+	
+	SPAssertTestCompletesInTimeInterval(kAudioOutputTestTimeout);
+	
+	// Run the same steps as the software render path, at a typical render slice size.
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		
+		static SInt16 input[512 * 2];
+		static float converted[512 * 2];
+		static float left[512];
+		static float right[512];
+		float * const channels[2] = { left, right };
+		
+		NSDate *start = [NSDate date];
+		for (NSUInteger iteration = 0; iteration < kAudioKernelsBenchmarkIterations; iteration++) {
+			SPAudioConvertInt16ToFloat32(input, converted, kAudioKernelsBenchmarkFrameCount * 2);
+			SPAudioDeinterleaveFloat32(converted, channels, 2, kAudioKernelsBenchmarkFrameCount);
+			SPAudioApplyGainRamp(left, kAudioKernelsBenchmarkFrameCount, 0.5f, 0.6f);
+			SPAudioApplyGainRamp(right, kAudioKernelsBenchmarkFrameCount, 0.5f, 0.6f);
+		}
+		NSTimeInterval duration = -[start timeIntervalSinceNow];
+		double frames = (double)kAudioKernelsBenchmarkFrameCount * kAudioKernelsBenchmarkIterations;
+		
+		dispatch_async(dispatch_get_main_queue(), ^{
+			printf(" %s: %.0f million frames/s.", SPAudioKernelsInstructionSetName(), (frames / duration) / 1000000.0);
+			SPPassTest();
+		});
+	});
+}
+
+-(void)coreAudioController:(SPCoreAudioController *)aController didOutputAudioOfDuration:(NSTimeInterval)audioDuration {
+	self.reportedDuration += audioDuration;
+}
+
+-(NSInteger)session:(id <SPSessionPlaybackProvider>)aSession shouldDeliverAudioFrames:(const void *)audioFrames ofCount:(NSInteger)frameCount streamDescription:(AudioStreamBasicDescription)audioDescription {
+	[self.deliveredAudio appendBytes:audioFrames length:frameCount * audioDescription.mBytesPerFrame];
+	self.deliveryCount++;
+	return frameCount;
+}
+
+-(void)sessionDidEndAudioDelivery:(id <SPSessionPlaybackProvider>)aSession {
+	self.deliveredFrameCountAtTrackEnd = self.deliveredAudio.length / 4;
+}
+
+-(void)coreAudioController:(SPCoreAudioController *)aController didOutputTrackBoundaryAtTime:(NSTimeInterval)outputTime {
+	self.reportedTrackBoundaryCount++;
+	self.reportedTrackBoundaryTime = outputTime;
+}
+
+@end
@@ -0,0 +1,268 @@
+//
+//  SPCircularBufferTests.m
+//  CocoaLibSpotify
+//
+/*
+ Copyright (c) 2011, Spotify AB
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of Spotify AB nor the names of its contributors may 
+ be used to endorse or promote products derived from this software 
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL SPOTIFY AB BE LIABLE FOR ANY DIRECT, INDIRECT,
+ INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "SPCircularBufferTests.h"
+#import "SPCircularBuffer.h"
+
+static NSUInteger const kCircularBufferTestLength = 4096;
+static NSUInteger const kCircularBufferTestTransferLength = 16 * 1024 * 1024;
+static NSUInteger const kCircularBufferBenchmarkLength = 44100 * 4 / 2;
+static NSUInteger const kCircularBufferBenchmarkTransferLength = 256 * 1024 * 1024;
+
+@interface SPCircularBufferTests ()
+-(NSTimeInterval)timeTransferThroughBuffer:(SPCircularBuffer *)buffer;
+@end
+
+@implementation SPCircularBufferTests
+
+-(void)testBasicReadAndWrite {
+	
+	SPCircularBuffer *buffer = [[SPCircularBuffer alloc] initWithMaximumLength:16];
+	UInt8 input[24];
+	UInt8 output[24];
+	for (NSUInteger i = 0; i < sizeof(input); i++) input[i] = i;
+	
+	SPTestAssert([buffer attemptAppendData:input ofLength:10] == 10, @"Couldn't write 10 bytes into empty buffer");
+	SPTestAssert(buffer.length == 10, @"Buffer length is %lu, expected 10", (unsigned long)buffer.length);
+	SPTestAssert([buffer attemptAppendData:input + 10 ofLength:10] == 6, @"Buffer accepted more data than its maximum length");
+	SPTestAssert(buffer.length == 16, @"Buffer length is %lu, expected 16", (unsigned long)buffer.length);
+	
+	void *outPtr = output;
+	SPTestAssert([buffer readDataOfLength:12 intoAllocatedBuffer:&outPtr] == 12, @"Couldn't read 12 bytes from full buffer");
+	SPTestAssert(memcmp(input, output, 12) == 0, @"Read data doesn't match written data");
+	
+	// This write wraps around the end of the buffer.
+	SPTestAssert([buffer attemptAppendData:input + 16 ofLength:8] == 8, @"Couldn't write wrapping data");
+	SPTestAssert([buffer readDataOfLength:sizeof(output) intoAllocatedBuffer:&outPtr] == 12, @"Couldn't read wrapped data");
+	SPTestAssert(memcmp(input + 12, output, 12) == 0, @"Wrapped data doesn't match written data");
+	SPTestAssert(buffer.length == 0, @"Buffer isn't empty after reading everything out");
+	
+	[buffer attemptAppendData:input ofLength:8];
+	[buffer clear];
+	SPTestAssert(buffer.length == 0, @"Buffer isn't empty after clear");
+	SPPassTest();
+}
+
+-(void)testMirroredRegions {
+	
+	SPCircularBuffer *buffer = [[SPCircularBuffer alloc] initWithMaximumLength:kCircularBufferTestLength
+																		 mode:SPCircularBufferModeSingleProducerSingleConsumer
+																	 mirrored:YES];
+	SPTestAssert(buffer.isMirrored, @"Couldn't create mirrored buffer");
+	SPTestAssert(buffer.maximumLength % getpagesize() == 0, @"Mirrored buffer length isn't a multiple of the page size");
+	
+	NSUInteger length = buffer.maximumLength;
+	SPCircularBufferRegion regions[2];
+	
+	// Move the cursors close to the end of the buffer so the next write wraps.
+	SPCircularBufferAcquireWritableRegions(buffer, regions);
+	SPCircularBufferCommitWrite(buffer, length - 8);
+	SPCircularBufferAcquireReadableRegions(buffer, regions);
+	SPCircularBufferCommitRead(buffer, length - 8);
+	
+	SPTestAssert(SPCircularBufferAcquireWritableRegions(buffer, regions) == length, @"Empty mirrored buffer isn't fully writable");
+	SPTestAssert(regions[0].length == length && regions[1].length == 0, @"Mirrored buffer returned split writable regions");
+	for (NSUInteger i = 0; i < 32; i++) ((UInt8 *)regions[0].data)[i] = (UInt8)i;
+	SPCircularBufferCommitWrite(buffer, 32);
+	
+	UInt8 output[32];
+	SPTestAssert(SPCircularBufferReadData(buffer, output, sizeof(output)) == 32, @"Couldn't read back wrapped data");
+	for (NSUInteger i = 0; i < 32; i++)
+		SPTestAssert(output[i] == (UInt8)i, @"Wrapped data is corrupt at byte %lu", (unsigned long)i);
+	SPPassTest();
+}
+
+-(void)testMirroredThroughputBenchmark {
+	
+	SPAssertTestCompletesInTimeInterval(60.0);
+	
+	// Compare the standard buffer against the mirrored one using libspotify-sized delivery chunks
+	// and Core Audio-sized render chunks, so that most transfers wrap at some point.
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		
+		SPCircularBuffer *standardBuffer = [[SPCircularBuffer alloc] initWithMaximumLength:kCircularBufferBenchmarkLength
+																					  mode:SPCircularBufferModeSingleProducerSingleConsumer];
+		SPCircularBuffer *mirroredBuffer = [[SPCircularBuffer alloc] initWithMaximumLength:kCircularBufferBenchmarkLength
+																					  mode:SPCircularBufferModeSingleProducerSingleConsumer
+																				  mirrored:YES];
+		
+		NSTimeInterval standardDuration = [self timeTransferThroughBuffer:standardBuffer];
+		NSTimeInterval mirroredDuration = [self timeTransferThroughBuffer:mirroredBuffer];
+		double megabytes = kCircularBufferBenchmarkTransferLength / (1024.0 * 1024.0);
+		
+		dispatch_async(dispatch_get_main_queue(), ^{
+			printf(" Standard: %.0f MB/s, mirrored: %.0f MB/s.", megabytes / standardDuration, megabytes / mirroredDuration);
+			SPTestAssert(mirroredBuffer.isMirrored, @"Couldn't create mirrored buffer");
+			SPPassTest();
+		});
+	});
+}
+
+-(NSTimeInterval)timeTransferThroughBuffer:(SPCircularBuffer *)buffer {
+	
+	static UInt8 deliveryChunk[2048 * 4];
+	static UInt8 renderChunk[512 * 4];
+	NSUInteger transferred = 0;
+	NSDate *start = [NSDate date];
+	
+	while (transferred < kCircularBufferBenchmarkTransferLength) {
+		[buffer attemptAppendData:deliveryChunk ofLength:sizeof(deliveryChunk) chunkSize:4];
+		NSUInteger read = 0;
+		while ((read = SPCircularBufferReadData(buffer, renderChunk, sizeof(renderChunk))) > 0)
+			transferred += read;
+	}
+	
+	return -[start timeIntervalSinceNow];
+}
+
+-(void)testRegions {
+	
+	SPCircularBuffer *buffer = [[SPCircularBuffer alloc] initWithMaximumLength:16
+																		 mode:SPCircularBufferModeSingleProducerSingleConsumer];
+	SPCircularBufferRegion regions[2];
+	
+	SPTestAssert(SPCircularBufferAcquireWritableRegions(buffer, regions) == 16, @"Empty buffer doesn't have 16 writable bytes");
+	SPTestAssert(regions[0].length == 16 && regions[1].length == 0, @"Empty buffer has split writable regions");
+	memset(regions[0].data, 0xAA, 12);
+	SPCircularBufferCommitWrite(buffer, 12);
+	
+	SPTestAssert(SPCircularBufferAcquireReadableRegions(buffer, regions) == 12, @"Buffer doesn't have 12 readable bytes");
+	SPTestAssert(((UInt8 *)regions[0].data)[11] == 0xAA, @"Readable region doesn't contain written data");
+	SPCircularBufferCommitRead(buffer, 8);
+	
+	// Free space now wraps around the end of the buffer.
+	SPTestAssert(SPCircularBufferAcquireWritableRegions(buffer, regions) == 12, @"Buffer doesn't have 12 writable bytes");
+	SPTestAssert(regions[0].length == 4 && regions[1].length == 8, @"Writable regions are %lu and %lu bytes, expected 4 and 8",
+				 (unsigned long)regions[0].length, (unsigned long)regions[1].length);
+	memset(regions[0].data, 0xBB, 4);
+	memset(regions[1].data, 0xCC, 2);
+	SPCircularBufferCommitWrite(buffer, 6);
+	
+	SPTestAssert(SPCircularBufferAcquireReadableRegions(buffer, regions) == 10, @"Buffer doesn't have 10 readable bytes");
+	SPTestAssert(regions[0].length == 8 && regions[1].length == 2, @"Readable regions are %lu and %lu bytes, expected 8 and 2",
+				 (unsigned long)regions[0].length, (unsigned long)regions[1].length);
+	SPTestAssert(((UInt8 *)regions[1].data)[0] == 0xCC, @"Wrapped readable region doesn't contain written data");
+	SPCircularBufferCommitRead(buffer, 10);
+	SPTestAssert(buffer.length == 0, @"Buffer isn't empty after committing all reads");
+	SPPassTest();
+}
+
+-(void)testSingleProducerSingleConsumer {
+	
+	SPAssertTestCompletesInTimeInterval(30.0);
+	
+	SPCircularBuffer *buffer = [[SPCircularBuffer alloc] initWithMaximumLength:kCircularBufferTestLength
+																		 mode:SPCircularBufferModeSingleProducerSingleConsumer];
+	
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		
+		UInt8 chunk[997];
+		NSUInteger written = 0;
+		
+		while (written < kCircularBufferTestTransferLength) {
+			NSUInteger chunkLength = MIN(sizeof(chunk), kCircularBufferTestTransferLength - written);
+			for (NSUInteger i = 0; i < chunkLength; i++) chunk[i] = (UInt8)(written + i);
+			
+			NSUInteger offset = 0;
+			while (offset < chunkLength)
+				offset += [buffer attemptAppendData:chunk + offset ofLength:chunkLength - offset];
+			
+			written += chunkLength;
+		}
+	});
+	
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
+		
+		UInt8 chunk[509];
+		NSUInteger read = 0;
+		BOOL corrupt = NO;
+		
+		while (read < kCircularBufferTestTransferLength && !corrupt) {
+			NSUInteger readLength = SPCircularBufferReadData(buffer, chunk, sizeof(chunk));
+			for (NSUInteger i = 0; i < readLength; i++) {
+				if (chunk[i] != (UInt8)(read + i)) {
+					corrupt = YES;
+					break;
+				}
+			}
+			read += readLength;
+		}
+		
+		dispatch_async(dispatch_get_main_queue(), ^{
+			SPTestAssert(!corrupt, @"Data corrupted after %lu bytes", (unsigned long)read);
+			SPTestAssert(SPCircularBufferGetLength(buffer) == 0, @"Buffer isn't empty after transfer");
+			SPPassTest();
+		});
+	});
+}
+
+-(void)testSingleProducerSingleConsumerClear {
+	
+	SPCircularBuffer *buffer = [[SPCircularBuffer alloc] initWithMaximumLength:16
+																		 mode:SPCircularBufferModeSingleProducerSingleConsumer];
+	UInt8 input[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+	UInt8 output[8];
+	
+	[buffer attemptAppendData:input ofLength:8];
+	[buffer clear];
+	SPTestAssert(buffer.length == 0, @"Buffer reports data after clear");
+	
+	[buffer attemptAppendData:input ofLength:4];
+	SPTestAssert(buffer.length == 4, @"Buffer length is %lu after clear and write, expected 4", (unsigned long)buffer.length);
+	SPTestAssert(SPCircularBufferReadData(buffer, output, sizeof(output)) == 4, @"Reader didn't skip cleared data");
+	SPTestAssert(memcmp(input, output, 4) == 0, @"Data written after clear doesn't match");
+	SPPassTest();
+}
+
+-(void)testStreamPositions {
+	
+	SPCircularBuffer *buffer = [[SPCircularBuffer alloc] initWithMaximumLength:16
+																		 mode:SPCircularBufferModeSingleProducerSingleConsumer];
+	UInt8 input[12] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+	UInt8 output[12];
+	
+	// Wrap the buffer a few times to make sure positions keep counting past its length.
+	for (NSUInteger pass = 0; pass < 4; pass++) {
+		[buffer attemptAppendData:input ofLength:sizeof(input)];
+		SPCircularBufferReadData(buffer, output, sizeof(output));
+	}
+	
+	SPTestAssert(SPCircularBufferGetTotalBytesWritten(buffer) == 48, @"Total written is %llu, expected 48", SPCircularBufferGetTotalBytesWritten(buffer));
+	SPTestAssert(SPCircularBufferGetTotalBytesRead(buffer) == 48, @"Total read is %llu, expected 48", SPCircularBufferGetTotalBytesRead(buffer));
+	
+	[buffer attemptAppendData:input ofLength:8];
+	[buffer clear];
+	SPCircularBufferReadData(buffer, output, sizeof(output));
+	SPTestAssert(SPCircularBufferGetTotalBytesRead(buffer) == 56, @"Cleared data wasn't counted as read");
+	SPPassTest();
+}
+
+@end
@@ -32,16 +32,302 @@
 
 #import "SPConcurrencyTests.h"
 #import "SPSession.h"
+#import "SPSessionInternal.h"
 #import "SPAlbum.h"
 #import "SPArtist.h"
 #import "SPImage.h"
 #import "SPPlaylist.h"
 #import "SPTrack.h"
 #import "SPUser.h"
+#import "SPObjectCache.h"
+#import "SPAsyncLoading.h"
 #import "TestConstants.h"
+#import <libkern/OSAtomic.h>
+#import <mach/mach_time.h>
+#import <mach/mach.h>
+
+static NSUInteger const kDispatchBenchmarkBlockCount = 160000;
+static NSUInteger const kSyncDispatchBenchmarkRoundTripCount = 10000;
+static volatile int32_t dispatchBenchmarkExecutedCount;
+static NSUInteger const kPriorityDispatchBacklogCount = 200;
+static NSUInteger const kTrackMemoryBenchmarkTrackCount = 100000;
+static NSUInteger const kTrackMemoryBenchmarkBatchSize = 1000;
+
+static int SPCompareRoundTripDurations(const void *a, const void *b) {
+	uint64_t first = *(const uint64_t *)a, second = *(const uint64_t *)b;
+	return first < second ? -1 : (first > second ? 1 : 0);
+}
+
+// Something for batched property updates to change, which records the KVO notifications it sends.
+@interface SPPropertyUpdateTestObject : NSObject
+
+@property (nonatomic, readwrite, copy) NSString *name;
+@property (nonatomic, readwrite) NSUInteger count;
+@property (nonatomic, readwrite, getter=isLoaded) BOOL loaded;
+@property (nonatomic, readwrite) short level;
+@property (nonatomic, readwrite) NSRange range;
+
+@property (nonatomic, readonly, strong) NSMutableArray *notifiedKeys;
+@property (nonatomic, readwrite) CFAbsoluteTime firstNotificationTime;
+@property (nonatomic, readwrite) BOOL wasFullyUpdatedAtFirstNotification;
+
+@end
+
+@implementation SPPropertyUpdateTestObject
+
+@synthesize name;
+@synthesize count;
+@synthesize loaded;
+@synthesize level;
+@synthesize range;
+@synthesize notifiedKeys;
+@synthesize firstNotificationTime;
+@synthesize wasFullyUpdatedAtFirstNotification;
+
+-(id)init {
+	if ((self = [super init])) {
+		notifiedKeys = [[NSMutableArray alloc] init];
+		for (NSString *key in [NSArray arrayWithObjects:@"name", @"count", @"loaded", @"level", @"range", nil])
+			[self addObserver:self forKeyPath:key options:0 context:NULL];
+	}
+	return self;
+}
+
+-(void)observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(NSDictionary *)change context:(void *)context {
+	if (self.notifiedKeys.count == 0) {
+		self.firstNotificationTime = CFAbsoluteTimeGetCurrent();
+		self.wasFullyUpdatedAtFirstNotification = [self.name isEqualToString:@"Second"] && self.count == 2 && self.isLoaded;
+	}
+	[self.notifiedKeys addObject:keyPath];
+}
+
+-(void)dealloc {
+	for (NSString *key in [NSArray arrayWithObjects:@"name", @"count", @"loaded", @"level", @"range", nil])
+		[self removeObserver:self forKeyPath:key];
+}
+
+@end
+
+static vm_size_t SPResidentSize(void) {
+	struct task_basic_info info;
+	mach_msg_type_number_t count = TASK_BASIC_INFO_COUNT;
+	if (task_info(mach_task_self(), TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+		return 0;
+	return info.resident_size;
+}
 
 @implementation SPConcurrencyTests
 
+-(void)testDispatchThroughputBenchmark {
+	
+	SPAssertTestCompletesInTimeInterval(kDefaultNonAsyncLoadingTestTimeout);
+	
+	// Measure how fast blocks can be queued for the libspotify thread from 1, 4 and 16 threads at once.
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		
+		NSUInteger const producerCounts[3] = { 1, 4, 16 };
+		NSMutableArray *results = [NSMutableArray array];
+		
+		for (NSUInteger run = 0; run < 3; run++) {
+			
+			NSUInteger producerCount = producerCounts[run];
+			NSUInteger blocksPerProducer = kDispatchBenchmarkBlockCount / producerCount;
+			dispatchBenchmarkExecutedCount = 0;
+			
+			dispatch_group_t group = dispatch_group_create();
+			NSDate *start = [NSDate date];
+			
+			for (NSUInteger producer = 0; producer < producerCount; producer++) {
+				dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+					for (NSUInteger block = 0; block < blocksPerProducer; block++)
+						[SPSession dispatchToLibSpotifyThread:^{ OSAtomicIncrement32(&dispatchBenchmarkExecutedCount); }];
+				});
+			}
+			
+			dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+			NSTimeInterval duration = -[start timeIntervalSinceNow];
+			dispatch_release(group);
+			
+			// Let the libspotify thread catch up before the next run.
+			NSDate *drainStart = [NSDate date];
+			while (dispatchBenchmarkExecutedCount < (int32_t)(blocksPerProducer * producerCount) && -[drainStart timeIntervalSinceNow] < kDefaultNonAsyncLoadingTestTimeout)
+				usleep(1000);
+			
+			[results addObject:[NSString stringWithFormat:@"%lu thread%@: %.2f million/s.", (unsigned long)producerCount, producerCount == 1 ? @"" : @"s",
+								((blocksPerProducer * producerCount) / duration) / 1000000.0]];
+		}
+		
+		int32_t finalExecutedCount = dispatchBenchmarkExecutedCount;
+		dispatch_async(dispatch_get_main_queue(), ^{
+			printf(" %s", [[results componentsJoinedByString:@" "] UTF8String]);
+			SPTestAssert(finalExecutedCount == (int32_t)kDispatchBenchmarkBlockCount, @"Only %d of %lu blocks ran on the libspotify thread",
+						 finalExecutedCount, (unsigned long)kDispatchBenchmarkBlockCount);
+			SPPassTest();
+		});
+	});
+}
+
+-(void)testSyncDispatchLatencyBenchmark {
+	
+	SPAssertTestCompletesInTimeInterval(kDefaultNonAsyncLoadingTestTimeout);
+	
+	// Measure the round trip from another thread to the libspotify thread and back.
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		
+		mach_timebase_info_data_t timebase;
+		mach_timebase_info(&timebase);
+		
+		uint64_t *roundTrips = malloc(sizeof(uint64_t) * kSyncDispatchBenchmarkRoundTripCount);
+		NSUInteger correctResultCount = 0;
+		
+		for (NSUInteger roundTrip = 0; roundTrip < kSyncDispatchBenchmarkRoundTripCount; roundTrip++) {
+			uint64_t start = mach_absolute_time();
+			NSNumber *result = SPDispatchSyncReturning(^id{
+				return CFRunLoopGetCurrent() == [SPSession libSpotifyRunloop] ? [NSNumber numberWithUnsignedInteger:roundTrip] : nil;
+			});
+			roundTrips[roundTrip] = mach_absolute_time() - start;
+			if (result != nil && [result unsignedIntegerValue] == roundTrip) correctResultCount++;
+		}
+		
+		qsort(roundTrips, kSyncDispatchBenchmarkRoundTripCount, sizeof(uint64_t), SPCompareRoundTripDurations);
+		double median = (double)roundTrips[kSyncDispatchBenchmarkRoundTripCount / 2] * timebase.numer / timebase.denom / 1000.0;
+		double ninetyNinth = (double)roundTrips[(kSyncDispatchBenchmarkRoundTripCount * 99) / 100] * timebase.numer / timebase.denom / 1000.0;
+		free(roundTrips);
+		
+		dispatch_async(dispatch_get_main_queue(), ^{
+			printf(" Median %.1fµs, 99th percentile %.1fµs.", median, ninetyNinth);
+			SPTestAssert(correctResultCount == kSyncDispatchBenchmarkRoundTripCount, @"Only %lu of %lu round trips ran on the libspotify thread and returned their result",
+						 (unsigned long)correctResultCount, (unsigned long)kSyncDispatchBenchmarkRoundTripCount);
+			SPPassTest();
+		});
+	});
+}
+
+-(void)testInteractiveDispatchOvertakesBackgroundWork {
+	
+	SPAssertTestCompletesInTimeInterval(kDefaultNonAsyncLoadingTestTimeout);
+	
+	// Queue a second or so of slow background work, then an interactive block that should run almost straight away.
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		
+		__block NSUInteger backgroundExecutedCount = 0;
+		__block NSUInteger backgroundCountWhenInteractiveRan = NSNotFound;
+		
+		for (NSUInteger block = 0; block < kPriorityDispatchBacklogCount; block++)
+			SPDispatchAsync(^{ usleep(5000); backgroundExecutedCount++; });
+		
+		SPDispatchAsyncWithPriority(SPDispatchPriorityInteractive, ^{ backgroundCountWhenInteractiveRan = backgroundExecutedCount; });
+		
+		// Synchronous work is in the background lane, so this waits for the whole backlog.
+		[SPSession dispatchToLibSpotifyThread:^{} waitUntilDone:YES];
+		
+		NSUInteger finalExecutedCount = backgroundExecutedCount;
+		NSUInteger overtakenCount = backgroundCountWhenInteractiveRan;
+		dispatch_async(dispatch_get_main_queue(), ^{
+			printf(" Interactive block ran after %lu of %lu background blocks.", (unsigned long)overtakenCount, (unsigned long)kPriorityDispatchBacklogCount);
+			SPTestAssert(finalExecutedCount == kPriorityDispatchBacklogCount, @"Only %lu of %lu background blocks ran",
+						 (unsigned long)finalExecutedCount, (unsigned long)kPriorityDispatchBacklogCount);
+			SPTestAssert(overtakenCount < kPriorityDispatchBacklogCount / 4, @"Interactive block waited for %lu background blocks", (unsigned long)overtakenCount);
+			SPPassTest();
+		});
+	});
+}
+
+-(void)testCoalescedDispatch {
+	
+	SPAssertTestCompletesInTimeInterval(kDefaultNonAsyncLoadingTestTimeout);
+	
+	// Hold up the libspotify thread, then queue the same work for one object many times and once for an object that goes away.
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		
+		NSDictionary *statisticsBefore = [SPSession libSpotifyThreadStatistics];
+		dispatch_semaphore_t holdSemaphore = dispatch_semaphore_create(0);
+		SPDispatchAsync(^{ dispatch_semaphore_wait(holdSemaphore, DISPATCH_TIME_FOREVER); });
+		
+		static char coalescedKey;
+		NSObject *target = [[NSObject alloc] init];
+		__block NSUInteger runCount = 0;
+		__block NSUInteger lastRunIndex = NSNotFound;
+		__block BOOL cancelledBlockRan = NO;
+		
+		for (NSUInteger index = 0; index < 100; index++)
+			SPDispatchAsyncCoalesced(target, &coalescedKey, ^(id object) { runCount++; lastRunIndex = index; });
+		
+		@autoreleasepool {
+			NSObject *doomedTarget = [[NSObject alloc] init];
+			SPDispatchAsyncCoalesced(doomedTarget, &coalescedKey, ^(id object) { cancelledBlockRan = YES; });
+			doomedTarget = nil;
+		}
+		
+		dispatch_semaphore_signal(holdSemaphore);
+		[SPSession dispatchToLibSpotifyThread:^{} waitUntilDone:YES];
+		dispatch_release(holdSemaphore);
+		
+		NSDictionary *statisticsAfter = [SPSession libSpotifyThreadStatistics];
+		long long coalescedCount = [[statisticsAfter valueForKey:SPLibSpotifyThreadCoalescedBlockCountKey] longLongValue] -
+		[[statisticsBefore valueForKey:SPLibSpotifyThreadCoalescedBlockCountKey] longLongValue];
+		long long cancelledCount = [[statisticsAfter valueForKey:SPLibSpotifyThreadCancelledBlockCountKey] longLongValue] -
+		[[statisticsBefore valueForKey:SPLibSpotifyThreadCancelledBlockCountKey] longLongValue];
+		
+		dispatch_async(dispatch_get_main_queue(), ^{
+			SPTestAssert(runCount == 1, @"Coalesced work ran %lu times", (unsigned long)runCount);
+			SPTestAssert(lastRunIndex == 99, @"Coalesced work didn't run the newest block, but block %lu", (unsigned long)lastRunIndex);
+			SPTestAssert(coalescedCount >= 99, @"Only %lld blocks were counted as coalesced", coalescedCount);
+			SPTestAssert(!cancelledBlockRan, @"Work for a deallocated object ran");
+			SPTestAssert(cancelledCount >= 1, @"Cancelled work wasn't counted");
+			SPTestAssert(target != nil, @"Target went away");
+			SPPassTest();
+		});
+	});
+}
+
+-(void)testTrackMemoryBenchmark {
+	
+	SPAssertTestCompletesInTimeInterval(kDefaultNonAsyncLoadingTestTimeout * 3);
+	
+	// Surface 100k tracks without holding on to any, and see whether their wrappers go away.
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		
+		SPSession *session = [SPSession sharedSession];
+		vm_size_t residentBefore = SPResidentSize();
+		__block __weak SPTrack *firstTrack = nil;
+		NSDate *start = [NSDate date];
+		
+		for (NSUInteger batch = 0; batch < kTrackMemoryBenchmarkTrackCount / kTrackMemoryBenchmarkBatchSize; batch++) {
+			[SPSession dispatchToLibSpotifyThread:^{
+				for (NSUInteger index = batch * kTrackMemoryBenchmarkBatchSize; index < (batch + 1) * kTrackMemoryBenchmarkBatchSize; index++) {
+					@autoreleasepool {
+						char title[32];
+						snprintf(title, sizeof(title), "Track %lu", (unsigned long)index);
+						sp_track *track = sp_localtrack_create("CocoaLibSpotify", title, "Memory Benchmark", 180000);
+						SPTrack *wrapper = [session trackForTrackStruct:track];
+						if (index == 0) firstTrack = wrapper;
+						sp_track_release(track);
+					}
+				}
+			} waitUntilDone:YES];
+		}
+		
+		NSTimeInterval duration = -[start timeIntervalSinceNow];
+		
+		// Let the callback queue and the libspotify thread finish with the wrappers.
+		dispatch_async(dispatch_get_main_queue(), ^{
+			[SPSession dispatchToLibSpotifyThread:^{
+				vm_size_t residentAfter = SPResidentSize();
+				BOOL firstTrackWasReleased = firstTrack == nil;
+				
+				dispatch_async(dispatch_get_main_queue(), ^{
+					printf(" Surfaced %lu tracks in %.2fs. Resident size went from %.1fMB to %.1fMB.",
+						   (unsigned long)kTrackMemoryBenchmarkTrackCount, duration,
+						   residentBefore / (1024.0 * 1024.0), residentAfter / (1024.0 * 1024.0));
+					SPTestAssert(firstTrackWasReleased, @"Track wrapper wasn't released after nothing used it");
+					SPPassTest();
+				});
+			}];
+		});
+	});
+}
+
 -(void)testSessionPropertyCallbacks {
 
 	SPAssertTestCompletesInTimeInterval(kDefaultNonAsyncLoadingTestTimeout);
@@ -59,6 +345,134 @@
 	}];
 }
 
+-(void)testLibSpotifyThreadMonitoring {
+	
+	SPAssertTestCompletesInTimeInterval(kDefaultNonAsyncLoadingTestTimeout);
+	
+	// Ensure blocks are counted, and ones that hold up the thread are reported by name, even when sent through a helper.
+	[SPSession startMonitoringLibSpotifyThreadWithStallThreshold:0.05];
+	
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		
+		SPDispatchAsync(^{ usleep(100000); });
+		SPDispatchSyncReturning(^id{ usleep(100000); return nil; });
+		for (NSUInteger block = 0; block < 100; block++)
+			SPDispatchAsync(^{});
+		SPDispatchSyncIfNeeded(^{});
+		
+		[SPSession stopMonitoringLibSpotifyThread];
+		NSDictionary *statistics = [SPSession libSpotifyThreadStatistics];
+		
+		dispatch_async(dispatch_get_main_queue(), ^{
+			NSArray *stalls = [statistics valueForKey:SPLibSpotifyThreadRecentStallsKey];
+			NSUInteger executionTimeCount = 0;
+			for (NSNumber *count in [statistics valueForKey:SPLibSpotifyThreadExecutionTimeHistogramKey])
+				executionTimeCount += [count unsignedIntegerValue];
+			
+			SPTestAssert([[statistics valueForKey:SPLibSpotifyThreadBlockCountKey] unsignedIntegerValue] >= 102, @"Not all blocks were counted: %@", statistics);
+			SPTestAssert(executionTimeCount == [[statistics valueForKey:SPLibSpotifyThreadBlockCountKey] unsignedIntegerValue], @"Histogram doesn't add up: %@", statistics);
+			SPTestAssert([[statistics valueForKey:SPLibSpotifyThreadMaximumQueueDepthKey] intValue] > 1, @"Queue depth wasn't tracked: %@", statistics);
+			SPTestAssert([[statistics valueForKey:SPLibSpotifyThreadStallCountKey] unsignedIntegerValue] >= 1, @"Stall wasn't counted: %@", statistics);
+			NSUInteger stallIndex = [stalls indexOfObjectPassingTest:^BOOL(id report, NSUInteger index, BOOL *stop) {
+				return [report rangeOfString:NSStringFromSelector(_cmd)].location != NSNotFound;
+			}];
+			SPTestAssert(stallIndex != NSNotFound, @"Stall wasn't reported with its call site: %@", stalls);
+			NSUInteger helperStallIndex = [stalls indexOfObjectPassingTest:^BOOL(id report, NSUInteger index, BOOL *stop) {
+				return [report rangeOfString:@"SPDispatchSyncReturning"].location != NSNotFound;
+			}];
+			SPTestAssert(helperStallIndex == NSNotFound, @"Stall was reported as the helper rather than its caller: %@", stalls);
+			SPPassTest();
+		});
+	});
+}
+
+-(void)testCustomCallbackQueue {
+	
+	SPAssertTestCompletesInTimeInterval(kDefaultNonAsyncLoadingTestTimeout);
+	
+	// Ensure callbacks follow the session's callback queue, and go back to the main queue when it's reset.
+	// Callbacks to a concurrent queue go through a serial queue targeting it, so look for the queue by a key set on it.
+	static char callbackQueueKey;
+	SPSession *session = [SPSession sharedSession];
+	dispatch_queue_t callbackQueue = dispatch_queue_create("com.spotify.CocoaLibSpotify.tests.callbacks", DISPATCH_QUEUE_CONCURRENT);
+	dispatch_queue_set_specific(callbackQueue, &callbackQueueKey, &callbackQueueKey, NULL);
+	session.callbackQueue = callbackQueue;
+	SPTestAssert(session.callbackQueue == callbackQueue, @"Session returned a different callback queue to the one it was given.");
+	
+	[session fetchLoginUserName:^(NSString *loginUserName) {
+		BOOL wasOnCallbackQueue = dispatch_get_specific(&callbackQueueKey) == &callbackQueueKey;
+		session.callbackQueue = NULL;
+		dispatch_release(callbackQueue);
+		
+		[session fetchOfflineKeyTimeRemaining:^(NSTimeInterval remainingTime) {
+			SPTestAssert(wasOnCallbackQueue, @"FetchLoginUserName callback not on the session's callback queue.");
+			SPTestAssert(dispatch_get_current_queue() == dispatch_get_main_queue(), @"OfflineKeyTimeRemaining callback not back on the main queue.");
+			SPPassTest();
+		}];
+	}];
+}
+
+-(void)testPropertyUpdatesAreCoalesced {
+	
+	SPAssertTestCompletesInTimeInterval(kDefaultNonAsyncLoadingTestTimeout);
+	
+	// Queue changes from separate blocks on the libspotify thread, with loaded queued first, and ensure they're
+	// made in one go no later than the maximum latency, with each key notified once and loaded notified last.
+	// The blocks are queued from the libspotify thread, so they all run before it next waits.
+	static NSTimeInterval const latency = 0.25;
+	static NSTimeInterval const schedulingAllowance = 0.1;
+	SPSession *session = [SPSession sharedSession];
+	SPPropertyUpdateTestObject *object = [[SPPropertyUpdateTestObject alloc] init];
+	__block CFAbsoluteTime firstQueuedTime = 0.0;
+	session.maximumPropertyUpdateLatency = latency;
+	
+	SPDispatchAsync(^{
+		SPDispatchAsync(^{
+			firstQueuedTime = CFAbsoluteTimeGetCurrent();
+			SPEnqueuePropertyUpdate(session, object, @"loaded", [NSNumber numberWithBool:YES]);
+			SPEnqueuePropertyUpdate(session, object, @"name", @"First");
+		});
+		SPDispatchAsync(^{ SPEnqueuePropertyUpdate(session, object, @"count", [NSNumber numberWithUnsignedInteger:2]); });
+		SPDispatchAsync(^{ SPEnqueuePropertyUpdate(session, object, @"name", @"Second"); });
+	});
+	
+	dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(latency * 4.0 * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+		session.maximumPropertyUpdateLatency = 0.0;
+		NSArray *expectedKeys = [NSArray arrayWithObjects:@"count", @"name", @"loaded", nil];
+		NSTimeInterval delay = object.firstNotificationTime - firstQueuedTime;
+		
+		SPTestAssert([object.notifiedKeys isEqualToArray:expectedKeys], @"Expected notifications for %@, got %@", expectedKeys, object.notifiedKeys);
+		SPTestAssert(object.wasFullyUpdatedAtFirstNotification, @"Changes weren't all made before the first notification");
+		SPTestAssert(delay <= latency + schedulingAllowance, @"Changes took %.3fs to arrive, with a maximum latency of %.3fs", delay, latency);
+		SPPassTest();
+	});
+}
+
+-(void)testPropertyUpdatesOfOtherTypes {
+	
+	SPAssertTestCompletesInTimeInterval(kDefaultNonAsyncLoadingTestTimeout);
+	
+	// Ensure scalar types the setter is called with directly are notified once, and that
+	// structs, which are set through KVC, are still set rather than dropped.
+	SPSession *session = [SPSession sharedSession];
+	SPPropertyUpdateTestObject *object = [[SPPropertyUpdateTestObject alloc] init];
+	
+	SPDispatchAsync(^{
+		SPEnqueuePropertyUpdate(session, object, @"level", [NSNumber numberWithShort:-2]);
+		SPEnqueuePropertyUpdate(session, object, @"range", [NSValue valueWithRange:NSMakeRange(3, 4)]);
+		SPDispatchToCallbackQueue(session, ^{
+			NSUInteger levelNotificationCount = [object.notifiedKeys indexesOfObjectsPassingTest:^BOOL(id key, NSUInteger index, BOOL *stop) {
+				return [key isEqualToString:@"level"];
+			}].count;
+			
+			SPTestAssert(object.level == -2, @"level is %d, expected -2", object.level);
+			SPTestAssert(NSEqualRanges(object.range, NSMakeRange(3, 4)), @"range is %@, expected {3, 4}", NSStringFromRange(object.range));
+			SPTestAssert(levelNotificationCount == 1, @"level was notified %lu times, expected once", (unsigned long)levelNotificationCount);
+			SPPassTest();
+		});
+	});
+}
+
 -(void)testInvalidGetterCallbacks {
 
 	SPAssertTestCompletesInTimeInterval(kDefaultNonAsyncLoadingTestTimeout);
@@ -159,6 +573,33 @@
 	}];
 }
 
+-(void)testSessionCacheStatistics {
+
+	SPAssertTestCompletesInTimeInterval(kDefaultNonAsyncLoadingTestTimeout);
+
+	// Album lookups go through the session's own album cache. Logging out empties it, which SPSessionTeardownTests checks,
+	// since the rest of the tests need the session logged in.
+	SPSession *session = [SPSession sharedSession];
+
+	[session albumForURL:[NSURL URLWithString:kAlbumLoadingTestURI] callback:^(SPAlbum *album) {
+		SPTestAssert(album != nil, @"Album callback with valid URL gave nil");
+
+		NSDictionary *statistics = [session cacheStatistics];
+		NSArray *expectedKeys = [NSArray arrayWithObjects:SPSessionTrackCacheKey, SPSessionAlbumCacheKey, SPSessionArtistCacheKey,
+								 SPSessionImageCacheKey, SPSessionUserCacheKey, SPSessionPlaylistCacheKey,
+								 SPSessionPlaylistFolderCacheKey, nil];
+
+		for (NSString *key in expectedKeys)
+			SPTestAssert([statistics objectForKey:key] != nil, @"Cache statistics missing %@", key);
+
+		NSDictionary *albumStatistics = [statistics valueForKey:SPSessionAlbumCacheKey];
+		SPTestAssert([[albumStatistics valueForKey:SPObjectCacheCountKey] unsignedIntegerValue] > 0, @"Album cache is empty after loading an album");
+		SPTestAssert([[albumStatistics valueForKey:SPObjectCacheHitCountKey] unsignedIntegerValue] +
+					 [[albumStatistics valueForKey:SPObjectCacheMissCountKey] unsignedIntegerValue] > 0, @"Album cache recorded no lookups");
+		SPPassTest();
+	}];
+}
+
 -(void)testInvalidConstructorCallbacks {
 
 	SPAssertTestCompletesInTimeInterval(kDefaultNonAsyncLoadingTestTimeout);
@@ -0,0 +1,172 @@
+//
+//  SPObjectCacheTests.m
+//  CocoaLibSpotify
+//
+/*
+ Copyright (c) 2011, Spotify AB
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ * Neither the name of Spotify AB nor the names of its contributors may 
+ be used to endorse or promote products derived from this software 
+ without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL SPOTIFY AB BE LIABLE FOR ANY DIRECT, INDIRECT,
+ INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#import "SPObjectCacheTests.h"
+#import "SPObjectCache.h"
+#import <mach/mach_time.h>
+
+static NSUInteger const kObjectCacheBenchmarkKeyCount = 10000;
+static NSUInteger const kObjectCacheBenchmarkLookupCount = 1000000;
+
+// Keys for tests. Each key is a pointer, and the cache is given its address.
+static const void *kKey1 = (void *)0x1000, *kKey2 = (void *)0x2000, *kKey3 = (void *)0x3000;
+
+@interface SPObjectCacheTests ()
+-(double)nanosecondsFromMachTime:(uint64_t)machTime;
+@end
+
+@implementation SPObjectCacheTests
+
+-(void)testLeastRecentlyUsedEviction {
+	
+	SPObjectCache *cache = [[SPObjectCache alloc] initWithCountLimit:2 totalCostLimit:0];
+	
+	@autoreleasepool {
+		[cache setObject:[NSMutableString stringWithString:@"one"] forKeyBytes:&kKey1 cost:0];
+		[cache setObject:[NSMutableString stringWithString:@"two"] forKeyBytes:&kKey2 cost:0];
+		SPTestAssert([cache objectForKeyBytes:&kKey1] != nil, @"Object missing before the cache was full");
+		// The second object is now the least recently used.
+		[cache setObject:[NSMutableString stringWithString:@"three"] forKeyBytes:&kKey3 cost:0];
+	}
+	
+	SPTestAssert(cache.count == 2, @"Cache holds %lu objects, expected 2", (unsigned long)cache.count);
+	SPTestAssert(cache.evictionCount == 1, @"Cache evicted %lu objects, expected 1", (unsigned long)cache.evictionCount);
+	SPTestAssert([cache objectForKeyBytes:&kKey2] == nil, @"Least recently used object wasn't evicted");
+	SPTestAssert([[cache objectForKeyBytes:&kKey1] isEqualToString:@"one"], @"Recently used object was evicted");
+	SPTestAssert([[cache objectForKeyBytes:&kKey3] isEqualToString:@"three"], @"Newest object was evicted");
+	SPTestAssert(cache.hitCount == 3 && cache.missCount == 1, @"Cache counted %lu hits and %lu misses, expected 3 and 1",
+				 (unsigned long)cache.hitCount, (unsigned long)cache.missCount);
+	SPPassTest();
+}
+
+-(void)testEvictedObjectsInUseAreKept {
+	
+	SPObjectCache *cache = [[SPObjectCache alloc] initWithCountLimit:1 totalCostLimit:0];
+	NSMutableString *held = [NSMutableString stringWithString:@"held"];
+	
+	@autoreleasepool {
+		[cache setObject:held forKeyBytes:&kKey1 cost:0];
+		[cache setObject:[NSMutableString stringWithString:@"other"] forKeyBytes:&kKey2 cost:0];
+	}
+	
+	SPTestAssert(cache.evictionCount == 1, @"Object wasn't evicted");
+	SPTestAssert([cache objectForKeyBytes:&kKey1] == held, @"Evicted object still in use wasn't returned");
+	SPTestAssert([cache objectForKeyBytes:&kKey2] == nil, @"Evicted object no longer in use was returned");
+	SPPassTest();
+}
+
+-(void)testCostLimit {
+	
+	SPObjectCache *cache = [[SPObjectCache alloc] initWithCountLimit:0 totalCostLimit:100];
+	
+	@autoreleasepool {
+		[cache setObject:[NSMutableString stringWithString:@"a"] forKeyBytes:&kKey1 cost:40];
+		[cache setObject:[NSMutableString stringWithString:@"b"] forKeyBytes:&kKey2 cost:40];
+		SPTestAssert(cache.evictionCount == 0, @"Cache evicted objects within its cost limit");
+		[cache setCost:80 forKeyBytes:&kKey2];
+	}
+	
+	SPTestAssert(cache.totalCost == 80, @"Cache total cost is %lu, expected 80", (unsigned long)cache.totalCost);
+	SPTestAssert([cache objectForKeyBytes:&kKey1] == nil, @"Cache went over its cost limit");
+	SPTestAssert([cache objectForKeyBytes:&kKey2] != nil, @"Cache evicted the object whose cost changed");
+	SPPassTest();
+}
+
+-(void)testImageIdKeys {
+	
+	SPObjectCache *cache = [[SPObjectCache alloc] initWithKeyLength:20 countLimit:0 totalCostLimit:0];
+	uint8_t firstId[20], secondId[20];
+	memset(firstId, 0xAB, sizeof(firstId));
+	memcpy(secondId, firstId, sizeof(secondId));
+	secondId[19] = 0xCD;
+	
+	NSString *first = @"first";
+	[cache setObject:first forKeyBytes:firstId cost:0];
+	SPTestAssert([cache objectForKeyBytes:firstId] == first, @"Object missing for its image ID");
+	SPTestAssert([cache objectForKeyBytes:secondId] == nil, @"Object returned for an image ID differing in the last byte");
+	
+	[cache removeObjectForKeyBytes:firstId];
+	SPTestAssert([cache objectForKeyBytes:firstId] == nil, @"Object returned after being removed");
+	SPPassTest();
+}
+
+-(void)testLookupBenchmark {
+	
+	// Compare looking objects up by libSpotify struct pointer with the NSValue and NSDictionary lookups the caches used to do.
+	NSMutableArray *objects = [NSMutableArray arrayWithCapacity:kObjectCacheBenchmarkKeyCount];
+	NSMutableDictionary *dictionary = [NSMutableDictionary dictionaryWithCapacity:kObjectCacheBenchmarkKeyCount];
+	SPObjectCache *cache = [[SPObjectCache alloc] initWithCountLimit:0 totalCostLimit:0];
+	const void **keys = malloc(kObjectCacheBenchmarkKeyCount * sizeof(void *));
+	
+	for (NSUInteger index = 0; index < kObjectCacheBenchmarkKeyCount; index++) {
+		NSNumber *object = [NSNumber numberWithUnsignedInteger:index];
+		// Spaced like heap allocations.
+		keys[index] = (const void *)(0x10000000 + (index * 48));
+		[objects addObject:object];
+		[dictionary setObject:object forKey:[NSValue valueWithPointer:keys[index]]];
+		[cache setObject:object forKeyBytes:&keys[index] cost:0];
+	}
+	
+	NSUInteger dictionaryFound = 0, cacheFound = 0;
+	
+	uint64_t start = mach_absolute_time();
+	for (NSUInteger lookup = 0; lookup < kObjectCacheBenchmarkLookupCount; lookup++) {
+		@autoreleasepool {
+			if ([dictionary objectForKey:[NSValue valueWithPointer:keys[(lookup * 7919) % kObjectCacheBenchmarkKeyCount]]] != nil)
+				dictionaryFound++;
+		}
+	}
+	double dictionaryNanoseconds = [self nanosecondsFromMachTime:mach_absolute_time() - start] / kObjectCacheBenchmarkLookupCount;
+	
+	start = mach_absolute_time();
+	for (NSUInteger lookup = 0; lookup < kObjectCacheBenchmarkLookupCount; lookup++) {
+		@autoreleasepool {
+			if ([cache objectForKeyBytes:&keys[(lookup * 7919) % kObjectCacheBenchmarkKeyCount]] != nil)
+				cacheFound++;
+		}
+	}
+	double cacheNanoseconds = [self nanosecondsFromMachTime:mach_absolute_time() - start] / kObjectCacheBenchmarkLookupCount;
+	
+	free(keys);
+	
+	printf(" NSValue and NSDictionary: %.0fns per lookup. SPObjectCache: %.0fns per lookup.", dictionaryNanoseconds, cacheNanoseconds);
+	SPTestAssert(dictionaryFound == kObjectCacheBenchmarkLookupCount, @"Dictionary only found %lu objects", (unsigned long)dictionaryFound);
+	SPTestAssert(cacheFound == kObjectCacheBenchmarkLookupCount, @"Cache only found %lu objects", (unsigned long)cacheFound);
+	SPTestAssert(cache.hitCount == kObjectCacheBenchmarkLookupCount, @"Cache counted %lu hits", (unsigned long)cache.hitCount);
+	SPPassTest();
+}
+
+-(double)nanosecondsFromMachTime:(uint64_t)machTime {
+	mach_timebase_info_data_t timebase;
+	mach_timebase_info(&timebase);
+	return (double)machTime * timebase.numer / timebase.denom;
+}
+
+@end
@@ -32,6 +32,7 @@
 
 #import "SPSessionTeardownTests.h"
 #import "SPSession.h"
+#import "SPObjectCache.h"
 #import "TestConstants.h"
 
 @implementation SPSessionTeardownTests
@@ -51,6 +52,12 @@
 		SPTestAssert(session.inboxPlaylist == nil, @"Logged-out session still has user: %@", session.inboxPlaylist);
 		SPTestAssert(session.connectionState == SP_CONNECTION_STATE_LOGGED_OUT, @"Logged-out session has incorrect connection state: %u", session.connectionState);
 		
+		// The caches filled by SPConcurrencyTests' testSessionCacheStatistics and the rest should now be empty.
+		NSDictionary *cacheStatistics = [session cacheStatistics];
+		for (NSString *key in cacheStatistics)
+			SPTestAssert([[[cacheStatistics valueForKey:key] valueForKey:SPObjectCacheCountKey] unsignedIntegerValue] == 0,
+						 @"Logged-out session still has objects in its cache: %@", [cacheStatistics valueForKey:key]);
+		
 		SPPassTest();
 	}];
 }
@@ -77,11 +77,14 @@
 	NSData *appKey = [NSData dataFromBase64String:base64AppKeyString];
 	SPTestAssert(appKey.length != 0, @"Appket is invalid.");
 
+	// Initialisation returns once libspotify has processed its first events, so this is our cold start time.
 	NSError *error = nil;
+	NSDate *initStart = [NSDate date];
     [SPSession initializeSharedSessionWithApplicationKey:appKey
                                                userAgent:@"com.spotify.CocoaLSUnitTests"
                                            loadingPolicy:SPAsyncLoadingManual
                                                    error:&error];
+	printf(" Session ready in %.0fms.", -[initStart timeIntervalSinceNow] * 1000.0);
 
     SPTestAssert(error == nil, @"Error should be nil: %@.", error);
     SPTestAssert([SPSession sharedSession] != nil, @"Session should not be be nil.");
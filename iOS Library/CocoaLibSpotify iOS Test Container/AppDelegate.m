@@ -41,6 +41,9 @@
 #import "SPSessionTeardownTests.h"
 #import "SPPlaylistTests.h"
 #import "SPConcurrencyTests.h"
+#import "SPCircularBufferTests.h"
+#import "SPObjectCacheTests.h"
+#import "SPAudioOutputTests.h"
 #import "TestConstants.h"
 
 static NSString * const kTestStatusServerUserDefaultsKey = @"StatusColorServer";
@@ -54,6 +57,9 @@ static NSString * const kTestStatusServerUserDefaultsKey = @"StatusColorServer";
 @property (nonatomic, strong) SPTests *teardownTests;
 @property (nonatomic, strong) SPTests *playlistTests;
 @property (nonatomic, strong) SPTests *concurrencyTests;
+@property (nonatomic, strong) SPTests *circularBufferTests;
+@property (nonatomic, strong) SPTests *objectCacheTests;
+@property (nonatomic, strong) SPTests *audioOutputTests;
 @end
 
 @implementation AppDelegate
@@ -68,6 +74,9 @@ static NSString * const kTestStatusServerUserDefaultsKey = @"StatusColorServer";
 @synthesize teardownTests;
 @synthesize playlistTests;
 @synthesize concurrencyTests;
+@synthesize circularBufferTests;
+@synthesize objectCacheTests;
+@synthesize audioOutputTests;
 
 -(void)completeTestsWithPassCount:(NSUInteger)passCount failCount:(NSUInteger)failCount {
 	printf("**** Completed %lu tests with %lu passes and %lu failures ****\n", (unsigned long)(passCount + failCount), (unsigned long)passCount, (unsigned long)failCount);
@@ -182,8 +191,11 @@ static NSString * const kTestStatusServerUserDefaultsKey = @"StatusColorServer";
 	self.inboxTests = [SPPostTracksToInboxTests new];
 	self.metadataTests = [SPMetadataTests new];
 	self.teardownTests = [SPSessionTeardownTests new];
+	self.circularBufferTests = [SPCircularBufferTests new];
+	self.objectCacheTests = [SPObjectCacheTests new];
+	self.audioOutputTests = [SPAudioOutputTests new];
 
-	NSArray *tests = @[self.sessionTests, self.concurrencyTests, self.playlistTests, self.audioTests, self.searchTests,
+	NSArray *tests = @[self.sessionTests, self.concurrencyTests, self.circularBufferTests, self.objectCacheTests, self.audioOutputTests, self.playlistTests, self.audioTests, self.searchTests,
 		self.inboxTests, self.metadataTests, self.teardownTests];
 
 	self.viewController.tests = tests;